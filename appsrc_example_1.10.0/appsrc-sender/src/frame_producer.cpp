@@ -0,0 +1,218 @@
+#include "frame_producer.hpp"
+#include <cerrno>
+#include <ctime>
+
+// Push times kept for the transit measurement, more than any pipeline holds in flight
+static constexpr size_t push_history = 4096;
+
+FrameProducer::FrameProducer(GstAppSrc *appsrc, FrameSource &source, const ProducerConfig &config)
+    : m_appsrc(appsrc), m_source(source), m_config(config), m_push_us(push_history)
+{
+}
+
+FrameProducer::~FrameProducer()
+{
+    stop();
+}
+
+GstPadProbeReturn FrameProducer::sink_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto *producer = static_cast<FrameProducer *>(user_data);
+    GstElement *sink = gst_pad_get_parent_element(pad);
+    producer->on_sink_buffer(GST_PAD_PROBE_INFO_BUFFER(info), sink ? GST_ELEMENT_NAME(sink) : "sink");
+    if (sink)
+    {
+        gst_object_unref(sink);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+int FrameProducer::attach_sink_probes(GstElement *tail)
+{
+    int probes = 0;
+    std::vector<GstElement *> elements;
+    if (!GST_IS_BIN(tail))
+    {
+        elements.push_back(GST_ELEMENT(gst_object_ref(tail)));
+    }
+    else
+    {
+        GstIterator *it = gst_bin_iterate_recurse(GST_BIN(tail));
+        GValue item = G_VALUE_INIT;
+        while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+        {
+            elements.push_back(GST_ELEMENT(g_value_dup_object(&item)));
+            g_value_reset(&item);
+        }
+        g_value_unset(&item);
+        gst_iterator_free(it);
+    }
+    for (GstElement *element : elements)
+    {
+        if (!GST_IS_BIN(element) && GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+        {
+            GstPad *pad = gst_element_get_static_pad(element, "sink");
+            if (pad)
+            {
+                gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, sink_probe_cb, this, nullptr);
+                gst_object_unref(pad);
+                probes++;
+            }
+        }
+        gst_object_unref(element);
+    }
+    return probes;
+}
+
+// Buffer arriving at a sink of the pipeline (streaming thread of that sink)
+void FrameProducer::on_sink_buffer(GstBuffer *buffer, const char *sink_name)
+{
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        return;
+    }
+    int64_t now_us = g_get_monotonic_time();
+    uint64_t n = gst_util_uint64_scale_round(GST_BUFFER_PTS(buffer), static_cast<uint64_t>(m_config.fps_n),
+                                             GST_SECOND * static_cast<uint64_t>(m_config.fps_d));
+    int64_t push_us = m_push_us[n % push_history].load();
+    if (push_us == 0)
+    {
+        return;
+    }
+    m_transit.add(now_us - push_us);
+    if (m_config.log)
+    {
+        // One fprintf per line, stdio locks the stream so lines of several threads never interleave
+        fprintf(m_config.log, "%u,%llu,%llu,%s,%lld\n", m_config.stream, static_cast<unsigned long long>(n),
+                static_cast<unsigned long long>(GST_BUFFER_PTS(buffer)), sink_name,
+                static_cast<long long>(now_us - push_us));
+    }
+}
+
+void FrameProducer::start()
+{
+    GstAppSrcCallbacks callbacks = {};
+    callbacks.need_data = [](GstAppSrc *, guint, gpointer user_data) {
+        static_cast<FrameProducer *>(user_data)->set_need_data(true);
+    };
+    callbacks.enough_data = [](GstAppSrc *, gpointer user_data) {
+        static_cast<FrameProducer *>(user_data)->set_need_data(false);
+    };
+    gst_app_src_set_callbacks(m_appsrc, &callbacks, this, nullptr);
+    m_thread = std::thread(&FrameProducer::run, this);
+}
+
+void FrameProducer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_source.stop();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void FrameProducer::set_need_data(bool need)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_need_data = need;
+    }
+    m_cond.notify_all();
+}
+
+GstClockTime FrameProducer::frame_pts(uint64_t n) const
+{
+    return gst_util_uint64_scale(n, GST_SECOND * static_cast<uint64_t>(m_config.fps_d),
+                                 static_cast<uint64_t>(m_config.fps_n));
+}
+
+// Live pacing: absolute sleep until due_us, so rounding and wake-up jitter never add up
+static void wait_until(int64_t due_us)
+{
+    struct timespec due;
+    due.tv_sec = due_us / 1000000;
+    due.tv_nsec = (due_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR)
+    {
+    }
+}
+
+void FrameProducer::run()
+{
+    uint64_t length = m_source.length();
+    uint64_t total = m_config.frames ? m_config.frames : (length && !m_config.loop ? length : UINT64_MAX);
+    int64_t frame_us = static_cast<int64_t>(frame_pts(1) / GST_USECOND);
+    if (m_config.live)
+    {
+        // The schedule starts with the first need-data, once the pipeline (or a stream added by --ramp)
+        // is running; started earlier, the first frames would count as late or be dropped
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_need_data || m_stop; });
+    }
+    int64_t start_us = g_get_monotonic_time();
+    for (uint64_t n = 0; n < total; n++)
+    {
+        int64_t due_us = 0;
+        if (m_config.live)
+        {
+            due_us = start_us + static_cast<int64_t>(frame_pts(n) / GST_USECOND);
+            wait_until(due_us);
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_config.live && m_config.drop_when_full && !m_need_data && !m_stop)
+            {
+                m_dropped++;
+                continue; // appsrc still full at the due time: skip the frame like a live source
+            }
+            m_cond.wait(lock, [this] { return m_need_data || m_stop; });
+            if (m_stop)
+            {
+                break;
+            }
+        }
+
+        int64_t begin_us = g_get_monotonic_time();
+        GstBuffer *buffer = m_source.produce(n);
+        if (!buffer)
+        {
+            break; // source stopped
+        }
+        m_production_latency.add(g_get_monotonic_time() - begin_us);
+
+        GstClockTime pts = frame_pts(n);
+        GST_BUFFER_PTS(buffer) = pts;
+        GST_BUFFER_DTS(buffer) = pts;
+        GST_BUFFER_DURATION(buffer) = frame_pts(n + 1) - pts;
+        GST_BUFFER_OFFSET(buffer) = n;
+        GST_BUFFER_OFFSET_END(buffer) = n + 1;
+        // Stamped before the push, a fast pipeline may see the buffer at its sink before push returns
+        int64_t push_us = g_get_monotonic_time();
+        m_push_us[n % push_history] = push_us;
+        if (gst_app_src_push_buffer(m_appsrc, buffer) != GST_FLOW_OK)
+        {
+            break; // flushing or shutting down
+        }
+        m_pushed++;
+        if (m_config.live)
+        {
+            m_lateness.add(push_us - due_us);
+            if (push_us - due_us > frame_us)
+            {
+                m_late_frames++;
+            }
+            if (m_config.log)
+            {
+                fprintf(m_config.log, "%u,%llu,%llu,late,%lld\n", m_config.stream,
+                        static_cast<unsigned long long>(n), static_cast<unsigned long long>(pts),
+                        static_cast<long long>(push_us - due_us));
+            }
+        }
+    }
+    gst_app_src_end_of_stream(m_appsrc);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "frame_source.hpp"
+#include "sender_stats.hpp"
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*********************************************************************
+ * Producer thread of one appsrc_sender stream.
+ *
+ * Flow control follows appsrc need-data / enough-data: the thread pushes
+ * while appsrc asks for data and sleeps after enough-data, so at most the
+ * appsrc max-bytes wait in appsrc.
+ * Timestamps are exact: the PTS of frame n is n * fps_d / fps_n seconds,
+ * scaled in integer math from the frame number (no accumulated rounding),
+ * the duration is the distance to the next PTS. Two runs over the same
+ * file therefore push bit-identical buffers with identical timestamps.
+ * Fast pacing pushes as fast as the pipeline takes frames; live pacing
+ * pushes frame n at start + PTS(n) on CLOCK_MONOTONIC (absolute sleeps,
+ * no drift), start being appsrc's first need-data. A live frame that finds appsrc full either waits (pushed
+ * late and counted, the sequence stays complete) or, with drop_when_full,
+ * is skipped and counted as dropped, the way a live source behaves.
+ * Per frame the producer records the production latency (acquire + draw),
+ * the lateness against the live schedule and the transit time from the
+ * push to the arrival at each sink behind the appsrc (matched by PTS,
+ * which encoders keep).
+ *********************************************************************/
+
+struct ProducerConfig
+{
+    unsigned int stream = 0;
+    int fps_n = 30;
+    int fps_d = 1;
+    uint64_t frames = 0; // 0 = one pass through the source (endless with loop or an endless source)
+    bool loop = false;
+    bool live = false;
+    bool drop_when_full = false;
+    FILE *log = nullptr; // per-frame CSV: stream,frame,pts_ns,point,us
+};
+
+class FrameProducer
+{
+  public:
+    FrameProducer(GstAppSrc *appsrc, FrameSource &source, const ProducerConfig &config);
+    ~FrameProducer();
+
+    // Transit probes on every sink inside tail (nested bins included), returns their number
+    int attach_sink_probes(GstElement *tail);
+
+    void start();
+    void stop();
+
+    uint64_t pushed() const { return m_pushed.load(); }
+    uint64_t late_frames() const { return m_late_frames.load(); }
+    uint64_t dropped() const { return m_dropped.load(); }
+    LatencyStats &production_latency() { return m_production_latency; }
+    LatencyStats &lateness() { return m_lateness; }
+    LatencyStats &transit() { return m_transit; }
+
+  private:
+    static GstPadProbeReturn sink_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    void on_sink_buffer(GstBuffer *buffer, const char *sink_name);
+    void set_need_data(bool need);
+    GstClockTime frame_pts(uint64_t n) const;
+    void run();
+
+    GstAppSrc *m_appsrc;
+    FrameSource &m_source;
+    ProducerConfig m_config;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_need_data = false;
+    bool m_stop = false;
+    std::vector<std::atomic<int64_t>> m_push_us;
+    std::atomic<uint64_t> m_pushed{0};
+    std::atomic<uint64_t> m_late_frames{0};
+    std::atomic<uint64_t> m_dropped{0};
+    LatencyStats m_production_latency;
+    LatencyStats m_lateness;
+    LatencyStats m_transit;
+};
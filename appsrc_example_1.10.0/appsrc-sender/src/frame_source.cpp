@@ -0,0 +1,350 @@
+#include "frame_source.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+/* ---------------------------------------------------------------------
+ * SenderBufferPool: GstBufferPool counting allocations and returns, with
+ * buffers cut from a preallocated region when one is given (hugepages)
+ * ------------------------------------------------------------------- */
+
+struct SenderBufferPool
+{
+    GstBufferPool parent;
+
+    uint8_t *region;
+    size_t slice_size;
+    size_t frame_size;
+    GMutex lock;
+    GQueue free_slices;
+
+    std::atomic<uint64_t> *allocations;
+    std::atomic<uint64_t> *returns;
+};
+
+struct SenderBufferPoolClass
+{
+    GstBufferPoolClass parent_class;
+};
+
+G_DEFINE_TYPE(SenderBufferPool, sender_buffer_pool, GST_TYPE_BUFFER_POOL)
+
+static GstFlowReturn sender_buffer_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                                     GstBufferPoolAcquireParams *params)
+{
+    auto *self = reinterpret_cast<SenderBufferPool *>(pool);
+    if (!self->region)
+    {
+        GstFlowReturn ret =
+            GST_BUFFER_POOL_CLASS(sender_buffer_pool_parent_class)->alloc_buffer(pool, buffer, params);
+        if (ret == GST_FLOW_OK)
+        {
+            (*self->allocations)++;
+        }
+        return ret;
+    }
+
+    g_mutex_lock(&self->lock);
+    gpointer slice = g_queue_pop_head(&self->free_slices);
+    g_mutex_unlock(&self->lock);
+    if (!slice)
+    {
+        return GST_FLOW_ERROR; // the region holds exactly max-buffers slices
+    }
+    *buffer = gst_buffer_new_wrapped_full(static_cast<GstMemoryFlags>(0), slice, self->frame_size, 0,
+                                          self->frame_size, nullptr, nullptr);
+    (*self->allocations)++;
+    return GST_FLOW_OK;
+}
+
+static void sender_buffer_pool_free_buffer(GstBufferPool *pool, GstBuffer *buffer)
+{
+    auto *self = reinterpret_cast<SenderBufferPool *>(pool);
+    if (self->region && gst_buffer_n_memory(buffer) == 1)
+    {
+        GstMapInfo map;
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            g_mutex_lock(&self->lock);
+            g_queue_push_tail(&self->free_slices, map.data);
+            g_mutex_unlock(&self->lock);
+            gst_buffer_unmap(buffer, &map);
+        }
+    }
+    GST_BUFFER_POOL_CLASS(sender_buffer_pool_parent_class)->free_buffer(pool, buffer);
+}
+
+static void sender_buffer_pool_release_buffer(GstBufferPool *pool, GstBuffer *buffer)
+{
+    auto *self = reinterpret_cast<SenderBufferPool *>(pool);
+    (*self->returns)++;
+    GST_BUFFER_POOL_CLASS(sender_buffer_pool_parent_class)->release_buffer(pool, buffer);
+}
+
+static void sender_buffer_pool_finalize(GObject *object)
+{
+    auto *self = reinterpret_cast<SenderBufferPool *>(object);
+    g_queue_clear(&self->free_slices);
+    g_mutex_clear(&self->lock);
+    G_OBJECT_CLASS(sender_buffer_pool_parent_class)->finalize(object);
+}
+
+static void sender_buffer_pool_class_init(SenderBufferPoolClass *klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = sender_buffer_pool_finalize;
+    GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS(klass);
+    pool_class->alloc_buffer = sender_buffer_pool_alloc_buffer;
+    pool_class->free_buffer = sender_buffer_pool_free_buffer;
+    pool_class->release_buffer = sender_buffer_pool_release_buffer;
+}
+
+static void sender_buffer_pool_init(SenderBufferPool *self)
+{
+    g_mutex_init(&self->lock);
+    g_queue_init(&self->free_slices);
+}
+
+/* ---------------------------------------------------------------------
+ * MappedFileSource
+ * ------------------------------------------------------------------- */
+
+MappedFileSource::~MappedFileSource()
+{
+    if (m_data)
+    {
+        munmap(m_data, m_size);
+    }
+}
+
+bool MappedFileSource::open(const std::string &path, size_t frame_size, bool populate)
+{
+    m_path = path;
+    m_frame_size = frame_size;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        std::cerr << "Error: Cannot read " << path << ": " << (fd < 0 ? strerror(errno) : "empty file") << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+    close(fd); // the mapping keeps the file
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Error: mmap of " << path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_data = data;
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+    m_frames = m_size / m_frame_size;
+    if (m_frames == 0)
+    {
+        std::cerr << "Error: " << path << " is smaller than one frame (" << m_frame_size << " bytes)" << std::endl;
+        return false;
+    }
+    if (m_size % m_frame_size)
+    {
+        std::cerr << "[SENDER] Warning: ignoring " << m_size % m_frame_size << " trailing bytes of " << path
+                  << std::endl;
+    }
+    return true;
+}
+
+// GDestroyNotify of the wrapped memories
+void MappedFileSource::release(gpointer user_data)
+{
+    static_cast<MappedFileSource *>(user_data)->m_completed++;
+}
+
+GstBuffer *MappedFileSource::produce(uint64_t n)
+{
+    // The buffer points into the mapping; READONLY makes writers downstream copy first
+    uint8_t *frame = static_cast<uint8_t *>(m_data) + (n % m_frames) * m_frame_size;
+    return gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, frame, m_frame_size, 0, m_frame_size, this,
+                                       MappedFileSource::release);
+}
+
+std::string MappedFileSource::describe() const
+{
+    std::ostringstream text;
+    text << m_path << " (" << m_frames << " frames, zero copy from the mapping)";
+    return text.str();
+}
+
+/* ---------------------------------------------------------------------
+ * GeneratedSource
+ * ------------------------------------------------------------------- */
+
+GeneratedSource::~GeneratedSource()
+{
+    if (m_pool)
+    {
+        gst_buffer_pool_set_active(m_pool, FALSE);
+        gst_object_unref(m_pool);
+    }
+    if (m_hugetlb)
+    {
+        munmap(m_region, m_region_size);
+    }
+    else
+    {
+        free(m_region);
+    }
+}
+
+bool GeneratedSource::open(int width, int height, unsigned int pool_size, bool hugepages)
+{
+    m_width = width;
+    m_height = height;
+    m_frame_size = static_cast<size_t>(width) * height * 3 / 2;
+    m_pool_size = pool_size;
+    if (pool_size == 0)
+    {
+        return true;
+    }
+
+    auto *pool = static_cast<SenderBufferPool *>(g_object_new(sender_buffer_pool_get_type(), nullptr));
+    gst_object_ref_sink(pool);
+    m_pool = GST_BUFFER_POOL(pool);
+    pool->frame_size = m_frame_size;
+    pool->allocations = &m_allocations;
+    pool->returns = &m_completed;
+
+    if (hugepages)
+    {
+        // One slice per buffer, each starting on its own huge page
+        pool->slice_size = (m_frame_size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        m_region_size = pool->slice_size * pool_size;
+        void *region = mmap(nullptr, m_region_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            m_region = region;
+            m_hugetlb = true;
+        }
+        else if (posix_memalign(&m_region, huge_page_size, m_region_size) == 0)
+        {
+            std::cerr << "[SENDER] MAP_HUGETLB failed (" << strerror(errno)
+                      << "), using transparent huge pages; reserve pages with /proc/sys/vm/nr_hugepages" << std::endl;
+            m_thp = madvise(m_region, m_region_size, MADV_HUGEPAGE) == 0;
+            memset(m_region, 0, m_region_size); // fault it in now, not while streaming
+        }
+        else
+        {
+            m_region = nullptr;
+            std::cerr << "Error: Cannot allocate " << m_region_size << " bytes for the buffer pool" << std::endl;
+            return false;
+        }
+        pool->region = static_cast<uint8_t *>(m_region);
+        for (unsigned int i = 0; i < pool_size; i++)
+        {
+            g_queue_push_tail(&pool->free_slices, pool->region + i * pool->slice_size);
+        }
+    }
+
+    // Fixed size: every buffer is allocated when the pool starts, acquire waits for a return beyond that
+    GstStructure *config = gst_buffer_pool_get_config(m_pool);
+    gst_buffer_pool_config_set_params(config, nullptr, static_cast<guint>(m_frame_size), pool_size, pool_size);
+    GstAllocationParams params;
+    gst_allocation_params_init(&params);
+    params.align = 4095;
+    gst_buffer_pool_config_set_allocator(config, nullptr, &params);
+    if (!gst_buffer_pool_set_config(m_pool, config) || !gst_buffer_pool_set_active(m_pool, TRUE))
+    {
+        std::cerr << "Error: Cannot start a pool of " << pool_size << " buffers of " << m_frame_size << " bytes"
+                  << std::endl;
+        return false;
+    }
+    // Starting the pool puts every new buffer through release_buffer once, those are no completions
+    m_completed = 0;
+    return true;
+}
+
+void GeneratedSource::fresh_buffer_released(gpointer user_data, GstMiniObject *)
+{
+    static_cast<GeneratedSource *>(user_data)->m_completed++;
+}
+
+GstBuffer *GeneratedSource::produce(uint64_t n)
+{
+    GstBuffer *buffer = nullptr;
+    if (m_pool)
+    {
+        if (gst_buffer_pool_acquire_buffer(m_pool, &buffer, nullptr) != GST_FLOW_OK)
+        {
+            return nullptr; // flushing
+        }
+    }
+    else
+    {
+        buffer = gst_buffer_new_allocate(nullptr, m_frame_size, nullptr);
+        m_allocations++;
+        gst_mini_object_weak_ref(GST_MINI_OBJECT(buffer), GeneratedSource::fresh_buffer_released, this);
+    }
+    draw(buffer, n);
+    return buffer;
+}
+
+// Horizontal luma bands scrolling one band per frame and a box moving across, neutral chroma
+void GeneratedSource::draw(GstBuffer *buffer, uint64_t n)
+{
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        return;
+    }
+    uint8_t *luma = map.data;
+    int box = std::min(m_width, m_height) / 8;
+    int box_x = static_cast<int>((n * 8) % static_cast<uint64_t>(m_width - box + 1));
+    int box_y = (m_height - box) / 2;
+    for (int y = 0; y < m_height; y++)
+    {
+        uint8_t *row = luma + static_cast<size_t>(y) * m_width;
+        memset(row, 16 + static_cast<int>((y / 16 + n) % 14) * 16, m_width);
+        if (y >= box_y && y < box_y + box)
+        {
+            memset(row + box_x, 235, box);
+        }
+    }
+    memset(luma + static_cast<size_t>(m_width) * m_height, 128, static_cast<size_t>(m_width) * m_height / 2);
+    gst_buffer_unmap(buffer, &map);
+}
+
+void GeneratedSource::stop()
+{
+    if (m_pool)
+    {
+        gst_buffer_pool_set_flushing(m_pool, TRUE);
+    }
+}
+
+std::string GeneratedSource::describe() const
+{
+    std::ostringstream text;
+    text << "test pattern, ";
+    if (!m_pool)
+    {
+        text << "a new buffer per frame";
+    }
+    else
+    {
+        text << "pool of " << m_pool_size << " buffers"
+             << (m_hugetlb ? " on hugetlb pages" : m_thp ? " on transparent huge pages" : "");
+    }
+    return text.str();
+}
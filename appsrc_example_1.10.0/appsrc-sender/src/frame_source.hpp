@@ -0,0 +1,100 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*********************************************************************
+ * Frame sources of appsrc_sender. A source hands out one GstBuffer per
+ * frame (timestamps are set by the producer) and counts the buffers the
+ * pipeline released again as completed.
+ *
+ * MappedFileSource wraps frames of a read-only mmap of a raw file, no
+ * copy and no allocation besides the GstBuffer / GstMemory headers.
+ *
+ * GeneratedSource draws a moving test pattern into buffers of a fixed
+ * size-matched GstBufferPool: the pool allocates its buffers once when
+ * it starts and every released buffer goes back to it, so the steady
+ * state has no malloc and no page faults. With hugepages the buffers are
+ * slices of one MAP_HUGETLB region (2 MiB pages, reserved with
+ * /proc/sys/vm/nr_hugepages), falling back to transparent huge pages.
+ * A pool of 0 allocates a fresh buffer per frame, for comparison.
+ * acquire blocks while every pool buffer is downstream, which bounds the
+ * frames in flight to the pool size.
+ *********************************************************************/
+
+class FrameSource
+{
+  public:
+    virtual ~FrameSource() = default;
+
+    // Buffer of frame n, nullptr once stop() was called
+    virtual GstBuffer *produce(uint64_t n) = 0;
+    // Frames of one pass through the source, 0 = endless
+    virtual uint64_t length() const = 0;
+    virtual std::string describe() const = 0;
+    // Unblocks a waiting produce()
+    virtual void stop() {}
+
+    size_t frame_size() const { return m_frame_size; }
+    uint64_t completed() const { return m_completed.load(); }
+    // Memory allocations for frames (0 for a mapped file)
+    uint64_t allocations() const { return m_allocations.load(); }
+    // Bytes copied into frames by the source itself
+    uint64_t copied_bytes() const { return m_copied_bytes.load(); }
+
+  protected:
+    size_t m_frame_size = 0;
+    std::atomic<uint64_t> m_completed{0};
+    std::atomic<uint64_t> m_allocations{0};
+    std::atomic<uint64_t> m_copied_bytes{0};
+};
+
+class MappedFileSource : public FrameSource
+{
+  public:
+    ~MappedFileSource() override;
+
+    bool open(const std::string &path, size_t frame_size, bool populate);
+
+    GstBuffer *produce(uint64_t n) override;
+    uint64_t length() const override { return m_frames; }
+    std::string describe() const override;
+
+  private:
+    static void release(gpointer user_data);
+
+    std::string m_path;
+    void *m_data = nullptr;
+    size_t m_size = 0;
+    uint64_t m_frames = 0;
+};
+
+class GeneratedSource : public FrameSource
+{
+  public:
+    ~GeneratedSource() override;
+
+    // pool_size 0 = a new buffer per frame
+    bool open(int width, int height, unsigned int pool_size, bool hugepages);
+
+    GstBuffer *produce(uint64_t n) override;
+    uint64_t length() const override { return 0; }
+    std::string describe() const override;
+    void stop() override;
+
+  private:
+    static void fresh_buffer_released(gpointer user_data, GstMiniObject *buffer);
+    void draw(GstBuffer *buffer, uint64_t n);
+
+    int m_width = 0;
+    int m_height = 0;
+    unsigned int m_pool_size = 0;
+    GstBufferPool *m_pool = nullptr;
+    void *m_region = nullptr;
+    size_t m_region_size = 0;
+    bool m_hugetlb = false;
+    bool m_thp = false;
+};
@@ -0,0 +1,695 @@
+#include "frame_producer.hpp"
+#include "frame_source.hpp"
+#include "sender_stats.hpp"
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <glib-unix.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+/*********************************************************************
+ * appsrc_sender: feeds raw NV12 frames into a pipeline through appsrc:
+ * hailoencodebin on the device, any software chain on a host. Frames
+ * come from a file (e.g. a capture of rawcapturebypass,
+ * kevin_nv12_detection.raw) or from a generated test pattern
+ * (frame_source.hpp has both, frame_producer.hpp the pacing, timestamps
+ * and latency measurement).
+ *
+ * A file is mapped once (mmap, read only) and every frame is pushed as a
+ * buffer wrapping its part of the mapping, so nothing is copied on the
+ * way into the pipeline. Generated frames are drawn into buffers of a
+ * preallocated GstBufferPool (--pool, optionally on huge pages) that get
+ * recycled when the pipeline releases them.
+ * --pace fast pushes as fast as the pipeline takes frames (throughput),
+ * --pace live pushes each frame at its PTS; replays of a file push
+ * bit-identical buffers and timestamps, which is what encoder regression
+ * runs between firmware versions compare. --log writes one CSV line per
+ * frame and sink (lateness, transit from push to sink).
+ *
+ * --streams N starts N branches appsrc ! <sink>, each with its own
+ * producer thread, pacing and source (--input may be given several times,
+ * the files are handed out round robin; "{id}" in --sink becomes the
+ * stream number, e.g. udpsink port=500{id}). --ramp <s> starts with one
+ * stream and adds the next every <s> seconds into the running pipeline;
+ * each step is measured and the [SCALING] lines name the stream count
+ * where aggregate throughput stops growing (fast: the last stream added
+ * less than half a single stream's rate; live: streams fall below 95% of
+ * the nominal rate or drop frames). --on-full drop makes live streams
+ * skip frames that find their appsrc full, as a camera would.
+ *
+ * Every --interval ms a [SENDER] line shows the pushed and completed fps
+ * (buffers the pipeline released) over all streams, CPU use of the
+ * process, page faults and frame allocations, plus a [STREAM] line per
+ * stream with its fps, drops and latencies (production = acquire + draw,
+ * transit, live lateness); a [SUMMARY] follows at EOS or Ctrl-C.
+ *
+ * Usage: appsrc_sender (--input <file>... | --pattern) [--width <w>] [--height <h>]
+ *                      [--fps <n/d>] [--frames <n>] [--loop] [--queue <frames>]
+ *                      [--populate] [--pool <buffers>] [--hugepages]
+ *                      [--pace fast|live] [--on-full wait|drop] [--log <csv>]
+ *                      [--streams <n>] [--ramp <s>]
+ *                      [--sink <launch>] [--interval <ms>]
+ * e.g. on a host:
+ *   appsrc_sender --input capture.nv12 --width 1920 --height 1080 --frames 3000
+ *   appsrc_sender --input capture.nv12 --sink "videoconvert ! x264enc tune=zerolatency ! fakesink"
+ *   appsrc_sender --pattern --frames 3000 --pool 0     (fresh buffer per frame, for comparison)
+ *   appsrc_sender --pattern --frames 3000 --hugepages
+ * on the device:
+ *   appsrc_sender --input capture.nv12 --sink "hailoencodebin config-file-path=encoder_config.json ! fakesink"
+ *   appsrc_sender --input capture.nv12 --pace live --loop --log run.csv \
+ *                 --sink "hailoencodebin config-file-path=encoder_config.json ! fakesink"
+ *   appsrc_sender --input a.nv12 --input b.nv12 --loop --pace live --on-full drop --streams 8 --ramp 10 \
+ *                 --sink "hailoencodebin config-file-path=encoder_config.json ! fakesink"
+ *********************************************************************/
+
+struct SenderOptions
+{
+    std::vector<std::string> inputs;
+    bool pattern = false;
+    int width = 1920;
+    int height = 1080;
+    int fps_n = 30;
+    int fps_d = 1;
+    uint64_t frames = 0;   // 0 = every frame of the file once (or forever with --loop / --pattern)
+    bool loop = false;
+    unsigned int queue = 4; // frames appsrc may hold before enough-data
+    bool populate = false;  // fault the whole file in before streaming (MAP_POPULATE)
+    int pool = -1;          // generated frames: pool buffers, 0 = fresh buffer per frame, -1 = queue + 4
+    bool hugepages = false;
+    bool live = false;      // pace pushes to the timestamps instead of as fast as possible
+    bool drop_when_full = false;
+    std::string log_path;   // per-frame CSV
+    unsigned int streams = 1;
+    int ramp_s = 0;         // add one stream every ramp_s seconds, 0 = all at once
+    std::string sink = "fakesink sync=false";
+    int interval_ms = 1000;
+};
+
+static void print_usage(const char *program_name)
+{
+    std::cerr << "Usage: " << program_name << " (--input <file>... | --pattern) [options]" << std::endl;
+    std::cerr << "  --input <file>         Raw NV12 frames, back to back (repeat for several streams)" << std::endl;
+    std::cerr << "  --pattern              Generate a moving test pattern instead" << std::endl;
+    std::cerr << "  --width <w>            Frame width (default: 1920)" << std::endl;
+    std::cerr << "  --height <h>           Frame height (default: 1080)" << std::endl;
+    std::cerr << "  --fps <n/d>            Frame rate of the timestamps (default: 30/1)" << std::endl;
+    std::cerr << "  --frames <n>           Frames to push, cycling through the file (default: the file once)" << std::endl;
+    std::cerr << "  --loop                 Without --frames, repeat the file until Ctrl-C" << std::endl;
+    std::cerr << "  --queue <frames>       Frames appsrc holds before enough-data (default: 4)" << std::endl;
+    std::cerr << "  --populate             Fault the file in before streaming (no page faults while timing)" << std::endl;
+    std::cerr << "  --pool <buffers>       Pattern buffer pool size, 0 = new buffer per frame (default: queue + 4)"
+              << std::endl;
+    std::cerr << "  --hugepages            Pattern buffer pool on huge pages" << std::endl;
+    std::cerr << "  --pace fast|live       As fast as possible, or each frame at its PTS (default: fast)" << std::endl;
+    std::cerr << "  --on-full wait|drop    Live frame finding appsrc full: push late or skip it (default: wait)"
+              << std::endl;
+    std::cerr << "  --log <csv>            Per-frame lateness and transit to each sink" << std::endl;
+    std::cerr << "  --streams <n>          Parallel appsrc branches (default: 1)" << std::endl;
+    std::cerr << "  --ramp <s>             Start with one stream, add one every <s> seconds" << std::endl;
+    std::cerr << "  --sink <launch>        Pipeline after each appsrc, {id} = stream (default: \"fakesink sync=false\")"
+              << std::endl;
+    std::cerr << "  --interval <ms>        Live report period, 0 = summary only (default: 1000)" << std::endl;
+}
+
+static bool parse_options(int argc, char *argv[], SenderOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--input" && i + 1 < argc)
+        {
+            options.inputs.push_back(argv[++i]);
+        }
+        else if (arg == "--pattern")
+        {
+            options.pattern = true;
+        }
+        else if (arg == "--width" && i + 1 < argc)
+        {
+            options.width = std::stoi(argv[++i]);
+        }
+        else if (arg == "--height" && i + 1 < argc)
+        {
+            options.height = std::stoi(argv[++i]);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            std::string fps = argv[++i];
+            size_t slash = fps.find('/');
+            options.fps_n = std::stoi(fps.substr(0, slash));
+            options.fps_d = slash == std::string::npos ? 1 : std::stoi(fps.substr(slash + 1));
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = std::stoull(argv[++i]);
+        }
+        else if (arg == "--loop")
+        {
+            options.loop = true;
+        }
+        else if (arg == "--queue" && i + 1 < argc)
+        {
+            options.queue = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--populate")
+        {
+            options.populate = true;
+        }
+        else if (arg == "--pool" && i + 1 < argc)
+        {
+            options.pool = std::max(0, std::stoi(argv[++i]));
+        }
+        else if (arg == "--hugepages")
+        {
+            options.hugepages = true;
+        }
+        else if (arg == "--pace" && i + 1 < argc)
+        {
+            std::string pace = argv[++i];
+            if (pace != "fast" && pace != "live")
+            {
+                std::cerr << "Error: --pace is fast or live" << std::endl;
+                return false;
+            }
+            options.live = pace == "live";
+        }
+        else if (arg == "--on-full" && i + 1 < argc)
+        {
+            std::string on_full = argv[++i];
+            if (on_full != "wait" && on_full != "drop")
+            {
+                std::cerr << "Error: --on-full is wait or drop" << std::endl;
+                return false;
+            }
+            options.drop_when_full = on_full == "drop";
+        }
+        else if (arg == "--log" && i + 1 < argc)
+        {
+            options.log_path = argv[++i];
+        }
+        else if (arg == "--streams" && i + 1 < argc)
+        {
+            options.streams = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--ramp" && i + 1 < argc)
+        {
+            options.ramp_s = std::max(0, std::stoi(argv[++i]));
+        }
+        else if (arg == "--sink" && i + 1 < argc)
+        {
+            options.sink = argv[++i];
+        }
+        else if (arg == "--interval" && i + 1 < argc)
+        {
+            options.interval_ms = std::stoi(argv[++i]);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (options.inputs.empty() == !options.pattern || options.width <= 0 || options.height <= 0 ||
+        (options.width | options.height) & 1 || options.fps_n <= 0 || options.fps_d <= 0)
+    {
+        std::cerr << "Error: one of --input / --pattern is required, width / height must be even and the frame rate "
+                     "positive"
+                  << std::endl;
+        print_usage(argv[0]);
+        return false;
+    }
+    if (options.pool < 0)
+    {
+        options.pool = static_cast<int>(options.queue) + 4;
+    }
+    return true;
+}
+
+// Frame counters of one stream, for the per-interval deltas
+struct StreamCounters
+{
+    uint64_t pushed = 0;
+    uint64_t completed = 0;
+    uint64_t dropped = 0;
+    uint64_t late = 0;
+    uint64_t allocations = 0;
+
+    StreamCounters &operator+=(const StreamCounters &other)
+    {
+        pushed += other.pushed;
+        completed += other.completed;
+        dropped += other.dropped;
+        late += other.late;
+        allocations += other.allocations;
+        return *this;
+    }
+};
+
+struct SenderStream
+{
+    unsigned int id = 0;
+    std::unique_ptr<FrameSource> source;
+    std::unique_ptr<FrameProducer> producer; // declared after the source it reads from, destroyed before it
+    StreamCounters last;
+
+    StreamCounters counters() const
+    {
+        StreamCounters counters;
+        counters.pushed = producer->pushed();
+        counters.completed = source->completed();
+        counters.dropped = producer->dropped();
+        counters.late = producer->late_frames();
+        counters.allocations = source->allocations();
+        return counters;
+    }
+};
+
+// Process CPU time and page faults
+struct UsageSample
+{
+    int64_t wall_us = 0;
+    int64_t cpu_us = 0;
+    long minor_faults = 0;
+    long major_faults = 0;
+
+    static UsageSample take()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        UsageSample sample;
+        sample.wall_us = g_get_monotonic_time();
+        sample.cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+                        usage.ru_stime.tv_usec;
+        sample.minor_faults = usage.ru_minflt;
+        sample.major_faults = usage.ru_majflt;
+        return sample;
+    }
+};
+
+// One --ramp step: the stream count and what it achieved
+struct ScalingStep
+{
+    unsigned int streams = 0;
+    double aggregate_fps = 0;
+    double min_stream_fps = 0;
+    uint64_t dropped = 0;
+    double cpu_percent = 0;
+};
+
+struct SenderContext
+{
+    const SenderOptions *options = nullptr;
+    GMainLoop *loop = nullptr;
+    GstElement *pipeline = nullptr;
+    FILE *log = nullptr;
+    size_t frame_size = 0;
+    bool playing = false;
+    std::vector<std::unique_ptr<SenderStream>> streams;
+    UsageSample last;
+    UsageSample step_start;
+    std::vector<StreamCounters> step_counters; // per stream at the start of the step
+    std::vector<ScalingStep> steps;
+};
+
+static std::string describe_counters(const StreamCounters &from, const StreamCounters &to, double seconds)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << "pushed_fps=" << (to.pushed - from.pushed) / seconds
+         << " completed_fps=" << (to.completed - from.completed) / seconds << " dropped=" << to.dropped - from.dropped
+         << " allocations=" << to.allocations - from.allocations;
+    return text.str();
+}
+
+static std::string describe_usage(const UsageSample &from, const UsageSample &to, uint64_t completed)
+{
+    double seconds = std::max<int64_t>(to.wall_us - from.wall_us, 1) / 1e6;
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << "cpu=" << (to.cpu_us - from.cpu_us) / 1e4 / seconds << "%"
+         << " cpu_us_per_frame=" << (completed ? static_cast<double>(to.cpu_us - from.cpu_us) / completed : 0.0)
+         << " minor_faults=" << to.minor_faults - from.minor_faults
+         << " major_faults=" << to.major_faults - from.major_faults;
+    return text.str();
+}
+
+static std::string take_stream_latencies(SenderStream &stream, bool live)
+{
+    std::string text = stream.producer->production_latency().take_interval("produce") + " " +
+                       stream.producer->transit().take_interval("transit");
+    if (live)
+    {
+        text += " " + stream.producer->lateness().take_interval("late") +
+                " late_frames=" + std::to_string(stream.producer->late_frames());
+    }
+    return text;
+}
+
+static bool start_stream(SenderContext &context, unsigned int id)
+{
+    const SenderOptions &options = *context.options;
+    auto stream = std::make_unique<SenderStream>();
+    stream->id = id;
+    if (options.pattern)
+    {
+        auto generated = std::make_unique<GeneratedSource>();
+        if (!generated->open(options.width, options.height, static_cast<unsigned int>(options.pool),
+                             options.hugepages))
+        {
+            return false;
+        }
+        stream->source = std::move(generated);
+    }
+    else
+    {
+        auto mapped = std::make_unique<MappedFileSource>();
+        if (!mapped->open(options.inputs[id % options.inputs.size()], context.frame_size, options.populate))
+        {
+            return false;
+        }
+        stream->source = std::move(mapped);
+    }
+
+    std::string description = options.sink;
+    for (size_t at = description.find("{id}"); at != std::string::npos; at = description.find("{id}", at))
+    {
+        description.replace(at, 4, std::to_string(id));
+    }
+    GError *error = nullptr;
+    GstElement *tail = gst_parse_bin_from_description(description.c_str(), TRUE, &error);
+    if (!tail)
+    {
+        std::cerr << "Error: Invalid --sink \"" << description << "\": " << (error ? error->message : "")
+                  << std::endl;
+        g_clear_error(&error);
+        return false;
+    }
+    std::string name = "src_" + std::to_string(id);
+    GstElement *appsrc = gst_element_factory_make("appsrc", name.c_str());
+    GstCaps *caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "NV12", "width", G_TYPE_INT,
+                                        options.width, "height", G_TYPE_INT, options.height, "framerate",
+                                        GST_TYPE_FRACTION, options.fps_n, options.fps_d, nullptr);
+    g_object_set(appsrc, "caps", caps, "format", GST_FORMAT_TIME, "max-bytes",
+                 static_cast<guint64>(context.frame_size) * options.queue, "block", FALSE, nullptr);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(context.pipeline), appsrc, tail, nullptr);
+    if (!gst_element_link(appsrc, tail))
+    {
+        std::cerr << "Error: Cannot link appsrc to \"" << description << "\" (NV12 caps)" << std::endl;
+        return false;
+    }
+
+    ProducerConfig config;
+    config.stream = id;
+    config.fps_n = options.fps_n;
+    config.fps_d = options.fps_d;
+    config.frames = options.frames;
+    config.loop = options.loop;
+    config.live = options.live;
+    config.drop_when_full = options.drop_when_full;
+    config.log = context.log;
+    stream->producer = std::make_unique<FrameProducer>(GST_APP_SRC(appsrc), *stream->source, config);
+    int probes = stream->producer->attach_sink_probes(tail);
+    std::cout << "[STREAM " << id << "] " << options.width << "x" << options.height << " NV12 ("
+              << context.frame_size << " bytes) from " << stream->source->describe() << " -> " << description << ", "
+              << (options.live ? "paced to the timestamps" : "as fast as possible") << ", " << probes
+              << " sink(s) timed" << std::endl;
+
+    stream->producer->start();
+    if (context.playing)
+    {
+        gst_element_sync_state_with_parent(tail);
+        gst_element_sync_state_with_parent(appsrc);
+    }
+    context.step_counters.push_back(stream->counters());
+    context.streams.push_back(std::move(stream));
+    return true;
+}
+
+// Closes the current --ramp step (all streams running since step_start)
+static void record_step(SenderContext &context)
+{
+    UsageSample now = UsageSample::take();
+    double seconds = std::max<int64_t>(now.wall_us - context.step_start.wall_us, 1) / 1e6;
+    ScalingStep step;
+    step.streams = static_cast<unsigned int>(context.streams.size());
+    step.min_stream_fps = -1;
+    for (size_t i = 0; i < context.streams.size(); i++)
+    {
+        StreamCounters counters = context.streams[i]->counters();
+        double fps = (counters.completed - context.step_counters[i].completed) / seconds;
+        step.aggregate_fps += fps;
+        step.min_stream_fps = step.min_stream_fps < 0 ? fps : std::min(step.min_stream_fps, fps);
+        step.dropped += counters.dropped - context.step_counters[i].dropped;
+        context.step_counters[i] = counters;
+    }
+    step.cpu_percent = (now.cpu_us - context.step_start.cpu_us) / 1e4 / seconds;
+    context.steps.push_back(step);
+    context.step_start = now;
+}
+
+static void print_scaling(const SenderContext &context)
+{
+    const SenderOptions &options = *context.options;
+    double nominal = static_cast<double>(options.fps_n) / options.fps_d;
+    unsigned int saturated_at = 0;
+    for (size_t i = 0; i < context.steps.size(); i++)
+    {
+        const ScalingStep &step = context.steps[i];
+        std::cout << "[SCALING] streams=" << step.streams << std::fixed << std::setprecision(1)
+                  << " aggregate_fps=" << step.aggregate_fps << " per_stream_min_fps=" << step.min_stream_fps
+                  << " dropped=" << step.dropped << " cpu=" << step.cpu_percent << "%" << std::endl;
+        if (saturated_at)
+        {
+            continue;
+        }
+        bool saturated;
+        if (options.live)
+        {
+            saturated = step.min_stream_fps < 0.95 * nominal || step.dropped > 0;
+        }
+        else
+        {
+            double single = context.steps.front().aggregate_fps;
+            saturated = i > 0 && step.aggregate_fps - context.steps[i - 1].aggregate_fps < 0.5 * single;
+        }
+        if (saturated)
+        {
+            saturated_at = step.streams;
+        }
+    }
+    if (saturated_at > 1)
+    {
+        std::cout << "[SCALING] Throughput stops scaling at " << saturated_at << " streams, " << saturated_at - 1
+                  << " sustained" << std::endl;
+    }
+    else if (saturated_at == 1)
+    {
+        std::cout << "[SCALING] A single stream already falls short" << std::endl;
+    }
+    else if (!context.steps.empty())
+    {
+        std::cout << "[SCALING] Still scaling at " << context.steps.back().streams << " streams" << std::endl;
+    }
+}
+
+static gboolean report_cb(gpointer user_data)
+{
+    auto *context = static_cast<SenderContext *>(user_data);
+    UsageSample now = UsageSample::take();
+    double seconds = std::max<int64_t>(now.wall_us - context->last.wall_us, 1) / 1e6;
+    StreamCounters total_from, total_to;
+    std::ostringstream lines;
+    for (auto &stream : context->streams)
+    {
+        StreamCounters counters = stream->counters();
+        if (context->streams.size() > 1)
+        {
+            lines << "[STREAM " << stream->id << "] " << describe_counters(stream->last, counters, seconds) << " "
+                  << take_stream_latencies(*stream, context->options->live) << std::endl;
+        }
+        total_from += stream->last;
+        total_to += counters;
+        stream->last = counters;
+    }
+    std::cout << "[SENDER] streams=" << context->streams.size() << " frames=" << total_to.completed << " "
+              << describe_counters(total_from, total_to, seconds) << " "
+              << describe_usage(context->last, now, total_to.completed - total_from.completed);
+    if (context->streams.size() == 1)
+    {
+        std::cout << " " << take_stream_latencies(*context->streams.front(), context->options->live);
+    }
+    std::cout << std::endl << lines.str();
+    context->last = now;
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean ramp_cb(gpointer user_data)
+{
+    auto *context = static_cast<SenderContext *>(user_data);
+    record_step(*context);
+    if (!start_stream(*context, static_cast<unsigned int>(context->streams.size())))
+    {
+        g_main_loop_quit(context->loop);
+        return G_SOURCE_REMOVE;
+    }
+    return context->streams.size() < context->options->streams ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static gboolean bus_cb(GstBus *, GstMessage *msg, gpointer user_data)
+{
+    auto *context = static_cast<SenderContext *>(user_data);
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+    case GST_MESSAGE_EOS:
+        g_main_loop_quit(context->loop);
+        break;
+    case GST_MESSAGE_ERROR: {
+        GError *err = nullptr;
+        gchar *debug = nullptr;
+        gst_message_parse_error(msg, &err, &debug);
+        std::cerr << "[SENDER] Error from " << GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)) << ": " << err->message
+                  << std::endl;
+        if (debug)
+        {
+            std::cerr << "[SENDER] " << debug << std::endl;
+        }
+        g_clear_error(&err);
+        g_free(debug);
+        g_main_loop_quit(context->loop);
+        break;
+    }
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+// Ctrl-C: the producers stop and every appsrc sends EOS, so the summary covers every pushed frame
+static gboolean stop_cb(gpointer user_data)
+{
+    auto *context = static_cast<SenderContext *>(user_data);
+    std::cerr << "\n[SENDER] Stopping..." << std::endl;
+    for (auto &stream : context->streams)
+    {
+        stream->producer->stop();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char *argv[])
+{
+    SenderOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+    gst_init(&argc, &argv);
+
+    SenderContext context;
+    context.options = &options;
+    context.frame_size = static_cast<size_t>(options.width) * options.height * 3 / 2;
+    if (!options.log_path.empty())
+    {
+        context.log = fopen(options.log_path.c_str(), "w");
+        if (!context.log)
+        {
+            std::cerr << "Error: Cannot write " << options.log_path << std::endl;
+            return 1;
+        }
+        fprintf(context.log, "stream,frame,pts_ns,point,us\n");
+    }
+    context.loop = g_main_loop_new(nullptr, FALSE);
+    context.pipeline = gst_pipeline_new("appsrc_sender");
+
+    int result = 0;
+    unsigned int initial = options.ramp_s > 0 ? 1 : options.streams;
+    for (unsigned int id = 0; id < initial && result == 0; id++)
+    {
+        if (!start_stream(context, id))
+        {
+            result = 1;
+        }
+    }
+
+    GstBus *bus = gst_element_get_bus(context.pipeline);
+    gst_bus_add_watch(bus, bus_cb, &context);
+    gst_object_unref(bus);
+    g_unix_signal_add(SIGINT, stop_cb, &context);
+    g_unix_signal_add(SIGTERM, stop_cb, &context);
+    if (options.interval_ms > 0)
+    {
+        g_timeout_add(options.interval_ms, report_cb, &context);
+    }
+    if (options.ramp_s > 0 && options.streams > 1)
+    {
+        g_timeout_add_seconds(options.ramp_s, ramp_cb, &context);
+    }
+
+    UsageSample start = UsageSample::take();
+    context.last = start;
+    context.step_start = start;
+    if (result == 0 && gst_element_set_state(context.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        std::cerr << "Error: Failed to set the pipeline to PLAYING" << std::endl;
+        result = 1;
+    }
+    if (result == 0)
+    {
+        context.playing = true;
+        g_main_loop_run(context.loop);
+        record_step(context);
+    }
+
+    UsageSample end = UsageSample::take();
+    for (auto &stream : context.streams)
+    {
+        stream->producer->stop();
+    }
+    gst_element_set_state(context.pipeline, GST_STATE_NULL);
+    gst_object_unref(context.pipeline); // releases the buffers still queued, before the sources go away
+
+    if (result == 0)
+    {
+        double seconds = std::max<int64_t>(end.wall_us - start.wall_us, 1) / 1e6;
+        StreamCounters zero, total;
+        for (auto &stream : context.streams)
+        {
+            StreamCounters counters = stream->counters();
+            total += counters;
+            std::cout << "[SUMMARY " << stream->id << "] pushed=" << counters.pushed
+                      << " completed=" << counters.completed << " dropped=" << counters.dropped
+                      << " total_allocations=" << counters.allocations << " "
+                      << stream->producer->production_latency().describe("produce") << " "
+                      << stream->producer->transit().describe("transit");
+            if (options.live)
+            {
+                std::cout << " " << stream->producer->lateness().describe("late")
+                          << " late_frames=" << counters.late;
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "[SUMMARY] streams=" << context.streams.size() << " pushed=" << total.pushed
+                  << " completed=" << total.completed << " seconds=" << std::fixed << std::setprecision(2)
+                  << seconds << " " << describe_counters(zero, total, seconds) << " "
+                  << describe_usage(start, end, total.completed) << std::endl;
+        if (options.ramp_s > 0 && context.streams.size() > 1)
+        {
+            print_scaling(context);
+        }
+    }
+    context.streams.clear();
+    if (context.log)
+    {
+        fclose(context.log);
+    }
+    g_main_loop_unref(context.loop);
+    return result;
+}
@@ -0,0 +1,72 @@
+#include "sender_stats.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static constexpr size_t latency_buckets = 100000;
+
+LatencyStats::LatencyStats() : m_buckets(latency_buckets, 0)
+{
+}
+
+void LatencyStats::add(int64_t us)
+{
+    us = std::max<int64_t>(us, 0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (static_cast<size_t>(us) < latency_buckets)
+    {
+        m_buckets[us]++;
+    }
+    m_count++;
+    m_max_us = std::max(m_max_us, us);
+    m_interval_count++;
+    m_interval_sum_us += us;
+    m_interval_max_us = std::max(m_interval_max_us, us);
+}
+
+std::string LatencyStats::take_interval(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << name << "_mean_us="
+         << (m_interval_count ? static_cast<double>(m_interval_sum_us) / m_interval_count : 0.0) << " " << name
+         << "_max_us=" << m_interval_max_us;
+    m_interval_count = 0;
+    m_interval_sum_us = 0;
+    m_interval_max_us = 0;
+    return text.str();
+}
+
+int64_t LatencyStats::percentile_locked(double fraction) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(m_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t us = 0; us < latency_buckets; us++)
+    {
+        seen += m_buckets[us];
+        if (seen >= rank)
+        {
+            return static_cast<int64_t>(us);
+        }
+    }
+    return m_max_us; // beyond the histogram
+}
+
+std::string LatencyStats::describe(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream text;
+    text << name << "_p50_us=" << percentile_locked(0.5) << " " << name << "_p99_us=" << percentile_locked(0.99)
+         << " " << name << "_p999_us=" << percentile_locked(0.999) << " " << name << "_max_us=" << m_max_us;
+    return text.str();
+}
+
+uint64_t LatencyStats::count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Latency samples in microseconds, written by a producer thread and read by the
+// reporter: count / mean / max per report interval, percentiles over the whole run.
+// 1 us buckets up to 100 ms, slower samples only count towards max.
+class LatencyStats
+{
+  public:
+    LatencyStats();
+
+    void add(int64_t us);
+
+    // "<name>_mean_us=.. <name>_max_us=.." since the previous call
+    std::string take_interval(const std::string &name);
+    // "<name>_p50_us=.. <name>_p99_us=.. <name>_p999_us=.. <name>_max_us=.." of the whole run
+    std::string describe(const std::string &name) const;
+
+    uint64_t count() const;
+
+  private:
+    int64_t percentile_locked(double fraction) const;
+
+    mutable std::mutex m_mutex;
+    std::vector<uint32_t> m_buckets;
+    uint64_t m_count = 0;
+    int64_t m_max_us = 0;
+    uint64_t m_interval_count = 0;
+    int64_t m_interval_sum_us = 0;
+    int64_t m_interval_max_us = 0;
+};
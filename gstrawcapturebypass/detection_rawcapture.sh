@@ -35,8 +35,36 @@ function init_variables() {
     encoding_hrd="hrd=false"
 
     print_gst_launch_only=false
+    # RTP output pacing through pacedudpsink (none = plain udpsink)
+    udp_pacing="none"
+    udp_gso=false
+    # More receivers of the same RTP packets (host:port,...), fanned out by pacedudpsink
+    udp_extra_destinations=""
+    # Capture timestamp SEI for rtp_analyzer latency reports (timestampsei); 0 = no clock sync responder
+    timestamp_sei=false
+    sei_sync_port=5990
+    # Local consumers over shared memory (memfdsink unix sockets), empty = off
+    shm_socket=""
+    shm_raw_socket=""
+    # Drop policy of the pipeline queues (policyqueue), none = plain queue leaky=no
+    queue_policy="none"
+    encoded_queue_time_ns=200000000
+    # Detection triggered raw captures (rawcapturebypass trigger-classes), empty = off
+    trigger_classes=""
+    trigger_confidence=0.5
+    trigger_cooldown_s=10
+    trigger_burst=1
+    # Motion triggered raw captures (rawcapturebypass motion-threshold), 0 = off
+    motion_threshold=0
+    motion_min_tiles=1
+    # Focus / sharpness score of every n-th frame (sharpnessmeter), 0 = off
+    sharpness_interval=0
     additional_parameters=""
 
+    # Registry snapshot reused across runs while no plugin .so changes (see prepare_registry)
+    readonly REGISTRY_CACHE_DIR="${HOME:-/home/root}/.cache/detection_rawcapture"
+    refresh_registry=false
+
     # Limit the encoding bitrate to 20Mbps to support weak host.
     # if you encounter a large latency in the host side.
     # Set the following values down in the encoder config file, to reach the desired latency (will decrease the video quality).
@@ -54,6 +82,24 @@ function print_usage() {
     echo "  --help                  Show this help"
     echo "  --show-fps              Print fps"
     echo "  --print-gst-launch      Print the ready gst-launch command without running it"
+    echo "  --refresh-registry      Rebuild the GStreamer registry snapshot before running"
+    echo "  --udp-pacing <mode>     Spread each frame's RTP packets over the frame interval:"
+    echo "                          none, txtime (needs: tc qdisc replace dev <if> root fq) or sleep"
+    echo "  --udp-gso               Batch the RTP packets with UDP GSO"
+    echo "  --udp-extra-destinations <host:port,...>  Also send the stream to these receivers (packetized once)"
+    echo "  --timestamp-sei         Insert the capture time as SEI into every frame (rtp_analyzer latency)"
+    echo "  --sei-sync-port <port>  UDP port answering rtp_analyzer --sync requests (default 5990, 0 = off)"
+    echo "  --shm-socket <path>     Also serve the encoded stream to local processes (memfdsink, memfdsrc)"
+    echo "  --shm-raw-socket <path> Also serve the NV12 frames before the encoder to local processes"
+    echo "  --queue-policy <policy> Drop instead of blocking when a queue is full (policyqueue):"
+    echo "                          none (leaky=no queues), drop-oldest, drop-new or drop-to-keyframe"
+    echo "  --trigger-classes <a,b> Capture the frame when one of these classes is detected (rawcapturebypass)"
+    echo "  --trigger-confidence <c> Lowest confidence that triggers (default 0.5)"
+    echo "  --trigger-cooldown <s>  Seconds before the same class triggers again (default 10)"
+    echo "  --trigger-burst <n>     Frames captured per trigger (default 1)"
+    echo "  --motion-threshold <n>  Capture on motion: mean luma difference a 16x9 grid tile must exceed (0 = off)"
+    echo "  --motion-min-tiles <n>  Changed tiles needed for a motion trigger (default 1)"
+    echo "  --sharpness <n>         Print the sharpness scores of every n-th frame (sharpnessmeter, 0 = off)"
     exit 0
 }
 
@@ -64,6 +110,60 @@ function parse_args() {
             exit 0
         elif [ "$1" = "--print-gst-launch" ]; then
             print_gst_launch_only=true
+        elif [ "$1" = "--refresh-registry" ]; then
+            refresh_registry=true
+        elif [ "$1" = "--udp-pacing" ]; then
+            udp_pacing="$2"
+            if [ "$udp_pacing" != "none" ] && [ "$udp_pacing" != "txtime" ] && [ "$udp_pacing" != "sleep" ]; then
+                echo "Invalid --udp-pacing: $udp_pacing (none, txtime or sleep)"
+                exit 1
+            fi
+            shift
+        elif [ "$1" = "--udp-gso" ]; then
+            udp_gso=true
+        elif [ "$1" = "--udp-extra-destinations" ]; then
+            udp_extra_destinations="$2"
+            shift
+        elif [ "$1" = "--timestamp-sei" ]; then
+            timestamp_sei=true
+        elif [ "$1" = "--sei-sync-port" ]; then
+            sei_sync_port="$2"
+            shift
+        elif [ "$1" = "--shm-socket" ]; then
+            shm_socket="$2"
+            shift
+        elif [ "$1" = "--shm-raw-socket" ]; then
+            shm_raw_socket="$2"
+            shift
+        elif [ "$1" = "--queue-policy" ]; then
+            queue_policy="$2"
+            if [ "$queue_policy" != "none" ] && [ "$queue_policy" != "drop-oldest" ] && \
+               [ "$queue_policy" != "drop-new" ] && [ "$queue_policy" != "drop-to-keyframe" ]; then
+                echo "Invalid --queue-policy: $queue_policy (none, drop-oldest, drop-new or drop-to-keyframe)"
+                exit 1
+            fi
+            shift
+        elif [ "$1" = "--trigger-classes" ]; then
+            trigger_classes="$2"
+            shift
+        elif [ "$1" = "--trigger-confidence" ]; then
+            trigger_confidence="$2"
+            shift
+        elif [ "$1" = "--trigger-cooldown" ]; then
+            trigger_cooldown_s="$2"
+            shift
+        elif [ "$1" = "--trigger-burst" ]; then
+            trigger_burst="$2"
+            shift
+        elif [ "$1" = "--motion-threshold" ]; then
+            motion_threshold="$2"
+            shift
+        elif [ "$1" = "--motion-min-tiles" ]; then
+            motion_min_tiles="$2"
+            shift
+        elif [ "$1" = "--sharpness" ]; then
+            sharpness_interval="$2"
+            shift
         elif [ "$1" = "--show-fps" ]; then
             echo "Printing fps"
             additional_parameters="-v | grep hailo_display"
@@ -77,33 +177,134 @@ function parse_args() {
     done
 }
 
+# Plugin files the registry is built from (path, size, mtime) and the GStreamer version
+function plugin_stamp() {
+    local dirs="${GST_PLUGIN_PATH//:/ } /usr/lib/gstreamer-1.0"
+    find $dirs -name '*.so' -type f -exec stat -c '%n %s %Y' {} + 2>/dev/null | sort || true
+    gst-launch-1.0 --version | head -1
+}
+
+# Warm start: reuse the registry snapshot when the plugin stamp did not change,
+# otherwise rebuild it once, check that rawcapturebypass is registered and save the stamp.
+function prepare_registry() {
+    local start_ns=$(date +%s%N)
+    local registry="$REGISTRY_CACHE_DIR/registry.bin"
+    local stamp_file="$REGISTRY_CACHE_DIR/registry.stamp"
+    local stamp
+
+    mkdir -p "$REGISTRY_CACHE_DIR"
+    stamp="$(plugin_stamp)"
+    export GST_REGISTRY="$registry"
+
+    if [ "$refresh_registry" = false ] && [ -f "$registry" ] && [ "$stamp" = "$(cat "$stamp_file" 2>/dev/null)" ]; then
+        registry_mode="warm"
+    else
+        rm -f "$registry" "$stamp_file"
+        export GST_REGISTRY_UPDATE=yes
+        if gst-inspect-1.0 rawcapturebypass > /dev/null 2>&1; then
+            echo "$stamp" > "$stamp_file"
+        else
+            echo "Warning: rawcapturebypass is not registered (GST_PLUGIN_PATH=$GST_PLUGIN_PATH), snapshot not saved"
+        fi
+        registry_mode="cold"
+    fi
+    export GST_REGISTRY_UPDATE=no
+
+    local end_ns=$(date +%s%N)
+    echo "Registry: mode=$registry_mode prepare_ms=$(( (end_ns - start_ns) / 1000000 )) snapshot=$registry"
+}
+
 init_variables $@
 
 parse_args $@
 
 UDP_SINK="udpsink host=$udp_host_ip port=$udp_port"
+if [ "$udp_pacing" != "none" ] || [ "$udp_gso" = true ] || [ -n "$udp_extra_destinations" ]; then
+    # pacedudpsink lives in the rawcapturebypass plugin; packets of a frame are spread over the frame interval
+    frame_duration_ns=$(( 1000000000 * ${framerate#*/} / ${framerate%/*} ))
+    UDP_SINK="pacedudpsink host=$udp_host_ip port=$udp_port pacing=$udp_pacing gso=$udp_gso frame-duration=$frame_duration_ns"
+    if [ -n "$udp_extra_destinations" ]; then
+        UDP_SINK="$UDP_SINK extra-destinations=$udp_extra_destinations"
+    fi
+fi
+
+# policyqueue lives in the rawcapturebypass plugin as well: raw frames are bounded by count (the
+# frontend pool), the encoded stream by time and stays decodable; the drops per reason are in its stats
+RAW_QUEUE="queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0"
+ENCODED_QUEUE="$RAW_QUEUE"
+if [ "$queue_policy" != "none" ]; then
+    RAW_QUEUE="policyqueue policy=$queue_policy max-size-buffers=$max_buffers_size"
+    ENCODED_QUEUE="policyqueue policy=$queue_policy max-size-buffers=0 max-size-time=$encoded_queue_time_ns"
+fi
 
-PIPELINE="gst-launch-1.0 \
+# Detections of hailofilter reach rawcapturebypass as buffer metadata (plugin built with HAVE_HAILO_META)
+RAW_CAPTURE="rawcapturebypass"
+if [ -n "$trigger_classes" ] || [ "$motion_threshold" != 0 ]; then
+    RAW_CAPTURE="rawcapturebypass location=/tmp/detection_%u.nv12 \
+        trigger-cooldown=$(( trigger_cooldown_s * 1000000000 )) trigger-burst=$trigger_burst"
+fi
+if [ -n "$trigger_classes" ]; then
+    RAW_CAPTURE="$RAW_CAPTURE trigger-classes=$trigger_classes trigger-confidence=$trigger_confidence"
+fi
+if [ "$motion_threshold" != 0 ]; then
+    RAW_CAPTURE="$RAW_CAPTURE motion-threshold=$motion_threshold motion-min-tiles=$motion_min_tiles"
+fi
+
+# sharpnessmeter (same plugin) sees the frontend output before hailooverlay draws on it;
+# gst-launch -m prints its "sharpness" messages
+SHARPNESS=""
+LAUNCH_FLAGS=""
+if [ "$sharpness_interval" != 0 ]; then
+    SHARPNESS="sharpnessmeter interval=$sharpness_interval !"
+    LAUNCH_FLAGS="-m"
+fi
+
+TIMESTAMP_SEI=""
+if [ "$timestamp_sei" = true ]; then
+    # timestampsei lives in the rawcapturebypass plugin as well
+    TIMESTAMP_SEI="timestampsei sync-port=$sei_sync_port !"
+fi
+
+# memfdsink lives in the rawcapturebypass plugin too; leaky so a stuck consumer never stalls the stream
+SHM_BRANCH=""
+if [ -n "$shm_socket" ]; then
+    SHM_BRANCH="udp_tee. ! \
+        queue leaky=downstream max-size-buffers=8 max-size-bytes=0 max-size-time=0 ! \
+        memfdsink socket-path=$shm_socket leaky=true sync=false async=false"
+fi
+SHM_RAW_TEE=""
+if [ -n "$shm_raw_socket" ]; then
+    SHM_RAW_TEE="tee name=raw_tee \
+    raw_tee. ! \
+        queue leaky=downstream max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! \
+        memfdsink socket-path=$shm_raw_socket leaky=true sync=false async=false \
+    raw_tee. ! $RAW_QUEUE !"
+fi
+
+PIPELINE="gst-launch-1.0 $LAUNCH_FLAGS \
     hailofrontendbinsrc config-file-path=$frontend_config_file_path name=frontend \
     frontend. ! \
-    queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
+    $RAW_QUEUE ! \
+    $SHARPNESS \
     hailonet hef-path=$hef_path scheduling-algorithm=1 vdevice-group-id=device0 ! \
-    queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
+    $RAW_QUEUE ! \
     hailofilter function-name=$network_name config-path=$json_config_path so-path=$postprocess_so qos=false ! \
-    queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
+    $RAW_QUEUE ! \
     hailooverlay qos=false ! \
-    queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
-    rawcapturebypass ! \
+    $RAW_QUEUE ! \
+    $RAW_CAPTURE ! \
+    $SHM_RAW_TEE \
     hailoencodebin config-file-path=$encoder_config_path ! h264parse config-interval=-1 ! \
     video/x-h264,framerate=$framerate ! \
     tee name=udp_tee \
     udp_tee. ! \
-        queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
-        rtph264pay ! 'application/x-rtp, media=(string)video, encoding-name=(string)H264' ! \
+        $ENCODED_QUEUE ! \
+        $TIMESTAMP_SEI rtph264pay ! 'application/x-rtp, media=(string)video, encoding-name=(string)H264' ! \
         $UDP_SINK name=udp_sink sync=$sync_pipeline \
     udp_tee. ! \
-        queue leaky=no max-size-buffers=$max_buffers_size max-size-bytes=0 max-size-time=0 ! \
+        $ENCODED_QUEUE ! \
         fpsdisplaysink fps-update-interval=2000 video-sink=fakesink name=hailo_display sync=$sync_pipeline text-overlay=false \
+    $SHM_BRANCH \
     ${additional_parameters}"
 
 
@@ -120,4 +321,6 @@ if [ "$print_gst_launch_only" = true ]; then
     exit 0
 fi
 
+prepare_registry
+
 eval ${PIPELINE}
@@ -0,0 +1,26 @@
+#include "gstdetectionmeta.h"
+#include <gst/video/gstvideometa.h>
+
+void
+gst_detection_meta_foreach(GstBuffer *buffer, gint width, gint height, GstDetectionFunc func, gpointer user_data)
+{
+  gpointer state = NULL;
+  GstMeta *meta;
+  gdouble scale_x = width > 0 ? 1.0 / width : 0.0;
+  gdouble scale_y = height > 0 ? 1.0 / height : 0.0;
+
+  while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *) meta;
+    const gchar *label = g_quark_to_string(roi->roi_type);
+    gdouble confidence = 1.0;
+    GstStructure *detection = gst_video_region_of_interest_meta_get_param(roi, "detection");
+    if (detection)
+      gst_structure_get_double(detection, "confidence", &confidence);
+    func(label ? label : "", confidence, roi->x * scale_x, roi->y * scale_y, roi->w * scale_x, roi->h * scale_y,
+        user_data);
+  }
+
+#ifdef HAVE_HAILO_META
+  gst_detection_meta_foreach_hailo(buffer, func, user_data);
+#endif
+}
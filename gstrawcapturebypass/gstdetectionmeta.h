@@ -0,0 +1,34 @@
+#ifndef __GST_DETECTION_META_H__
+#define __GST_DETECTION_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Detections attached to a buffer, read without touching the pixels.
+ *
+ * GstVideoRegionOfInterestMeta: roi_type is the class label, the confidence
+ * is the "confidence" double of the "detection" param structure (missing =
+ * 1.0, an ROI without a score). This is what fakedetections attaches.
+ *
+ * Built with HAVE_HAILO_META (gstdetectionmeta_hailo.cpp, TAPPAS headers and
+ * libgsthailometa) the HailoDetection objects hailofilter adds to the main
+ * ROI of the buffer are reported as well.
+ *
+ * Boxes are normalized to the frame (0..1); width / height are the frame size
+ * used for pixel boxes of the ROI meta.
+ */
+typedef void (*GstDetectionFunc)(const gchar *label, gdouble confidence, gdouble x, gdouble y,
+                                 gdouble width, gdouble height, gpointer user_data);
+
+void gst_detection_meta_foreach(GstBuffer *buffer, gint width, gint height, GstDetectionFunc func,
+                                gpointer user_data);
+
+#ifdef HAVE_HAILO_META
+void gst_detection_meta_foreach_hailo(GstBuffer *buffer, GstDetectionFunc func, gpointer user_data);
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_DETECTION_META_H__ */
@@ -0,0 +1,18 @@
+// HailoDetection objects of hailofilter, for gstdetectionmeta.c (built with HAVE_HAILO_META only)
+#include "gstdetectionmeta.h"
+#include "gst_hailo_meta.hpp"
+#include "hailo_common.hpp"
+
+extern "C" void
+gst_detection_meta_foreach_hailo(GstBuffer *buffer, GstDetectionFunc func, gpointer user_data)
+{
+  // No main ROI = hailofilter did not run on this buffer; never create one here
+  HailoROIPtr roi = get_hailo_main_roi(buffer, false);
+  if (!roi)
+    return;
+  for (HailoDetectionPtr &detection : hailo_common::get_hailo_detections(roi)) {
+    HailoBBox box = detection->get_bbox();
+    func(detection->get_label().c_str(), detection->get_confidence(), box.xmin(), box.ymin(), box.width(),
+         box.height(), user_data);
+  }
+}
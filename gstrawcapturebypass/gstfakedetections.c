@@ -0,0 +1,211 @@
+#define PACKAGE "rawcapturebypass"
+#include "gstfakedetections.h"
+#include <gst/video/video.h>
+#include <string.h>
+
+/*
+ * fakedetections: attaches synthetic detections to raw video, to exercise the
+ * detection trigger of rawcapturebypass without a network:
+ *
+ *   videotestsrc ! video/x-raw,format=NV12 ! fakedetections detections=person:0.9,car:0.3 interval=30 !
+ *     rawcapturebypass trigger-classes=person ! fakesink
+ *
+ * Every interval-th frame gets one GstVideoRegionOfInterestMeta per entry of
+ * detections ("label[:confidence]", confidence 1.0 when omitted), roi_type =
+ * label and a "detection" param with the confidence, the same layout
+ * gstdetectionmeta.c reads. The boxes are a quarter of the frame, centered.
+ */
+
+#define DEFAULT_DETECTIONS "person:0.9"
+#define DEFAULT_INTERVAL 30
+
+enum {
+  PROP_0,
+  PROP_DETECTIONS,
+  PROP_INTERVAL,
+  PROP_FRAMES_TAGGED,
+};
+
+typedef struct {
+  gchar *label;
+  gdouble confidence;
+} FakeDetection;
+
+struct _GstFakeDetections {
+  GstBaseTransform parent;
+
+  // Properties, object lock
+  gchar *detections;
+  GArray *parsed;  // FakeDetection
+  guint interval;
+
+  GstVideoInfo info;
+  guint64 frame;
+  guint64 frames_tagged;
+};
+
+G_DEFINE_TYPE(GstFakeDetections, gst_fake_detections, GST_TYPE_BASE_TRANSFORM)
+
+static void
+fake_detection_clear(gpointer data)
+{
+  g_free(((FakeDetection *) data)->label);
+}
+
+static void
+gst_fake_detections_parse(GstFakeDetections *self)
+{
+  g_array_set_size(self->parsed, 0);
+  gchar **entries = g_strsplit(self->detections ? self->detections : "", ",", -1);
+  for (gchar **entry = entries; *entry; entry++) {
+    gchar *colon = strchr(g_strstrip(*entry), ':');
+    FakeDetection detection = {NULL, 1.0};
+    if (colon) {
+      *colon = '\0';
+      detection.confidence = g_ascii_strtod(colon + 1, NULL);
+    }
+    if (**entry == '\0')
+      continue;
+    detection.label = g_strdup(*entry);
+    g_array_append_val(self->parsed, detection);
+  }
+  g_strfreev(entries);
+}
+
+static gboolean
+gst_fake_detections_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps)
+{
+  GstFakeDetections *self = GST_FAKE_DETECTIONS(trans);
+  return gst_video_info_from_caps(&self->info, incaps);
+}
+
+static GstFlowReturn
+gst_fake_detections_transform_ip(GstBaseTransform *trans, GstBuffer *buf)
+{
+  GstFakeDetections *self = GST_FAKE_DETECTIONS(trans);
+
+  GST_OBJECT_LOCK(self);
+  if (self->interval && self->frame++ % self->interval == 0 && self->parsed->len) {
+    guint w = GST_VIDEO_INFO_WIDTH(&self->info) / 2;
+    guint h = GST_VIDEO_INFO_HEIGHT(&self->info) / 2;
+    for (guint i = 0; i < self->parsed->len; i++) {
+      FakeDetection *detection = &g_array_index(self->parsed, FakeDetection, i);
+      GstVideoRegionOfInterestMeta *roi =
+          gst_buffer_add_video_region_of_interest_meta(buf, detection->label, w / 2, h / 2, w, h);
+      gst_video_region_of_interest_meta_add_param(roi,
+          gst_structure_new("detection", "confidence", G_TYPE_DOUBLE, detection->confidence, NULL));
+    }
+    self->frames_tagged++;
+  }
+  GST_OBJECT_UNLOCK(self);
+  return GST_FLOW_OK;
+}
+
+static void
+gst_fake_detections_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstFakeDetections *self = GST_FAKE_DETECTIONS(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_DETECTIONS:
+      g_free(self->detections);
+      self->detections = g_value_dup_string(value);
+      gst_fake_detections_parse(self);
+      break;
+    case PROP_INTERVAL:
+      self->interval = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_fake_detections_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstFakeDetections *self = GST_FAKE_DETECTIONS(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_DETECTIONS:
+      g_value_set_string(value, self->detections);
+      break;
+    case PROP_INTERVAL:
+      g_value_set_uint(value, self->interval);
+      break;
+    case PROP_FRAMES_TAGGED:
+      g_value_set_uint64(value, self->frames_tagged);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_fake_detections_finalize(GObject *object)
+{
+  GstFakeDetections *self = GST_FAKE_DETECTIONS(object);
+
+  g_free(self->detections);
+  g_array_unref(self->parsed);
+  G_OBJECT_CLASS(gst_fake_detections_parent_class)->finalize(object);
+}
+
+static void
+gst_fake_detections_class_init(GstFakeDetectionsClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+  gobject_class->set_property = gst_fake_detections_set_property;
+  gobject_class->get_property = gst_fake_detections_get_property;
+  gobject_class->finalize = gst_fake_detections_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_DETECTIONS,
+      g_param_spec_string("detections", "Detections",
+          "Comma separated label[:confidence] attached as region of interest metas",
+          DEFAULT_DETECTIONS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_INTERVAL,
+      g_param_spec_uint("interval", "Interval",
+          "Attach the detections to every interval-th frame, 0 = never",
+          0, G_MAXUINT, DEFAULT_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_TAGGED,
+      g_param_spec_uint64("frames-tagged", "Frames tagged", "Frames the detections were attached to",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_new_empty_simple("video/x-raw");
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Synthetic detections",
+    "Filter/Video",
+    "Attaches configurable detection metadata to raw video frames, for testing detection triggered captures",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_transform_class->set_caps = GST_DEBUG_FUNCPTR(gst_fake_detections_set_caps);
+  base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_fake_detections_transform_ip);
+}
+
+static void
+gst_fake_detections_init(GstFakeDetections *self)
+{
+  self->parsed = g_array_new(FALSE, FALSE, sizeof(FakeDetection));
+  g_array_set_clear_func(self->parsed, fake_detection_clear);
+  self->detections = g_strdup(DEFAULT_DETECTIONS);
+  self->interval = DEFAULT_INTERVAL;
+  gst_video_info_init(&self->info);
+  gst_fake_detections_parse(self);
+  gst_base_transform_set_in_place(GST_BASE_TRANSFORM(self), TRUE);
+}
@@ -0,0 +1,14 @@
+#ifndef __GST_FAKE_DETECTIONS_H__
+#define __GST_FAKE_DETECTIONS_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_FAKE_DETECTIONS   (gst_fake_detections_get_type())
+G_DECLARE_FINAL_TYPE(GstFakeDetections, gst_fake_detections, GST, FAKE_DETECTIONS, GstBaseTransform)
+
+G_END_DECLS
+
+#endif /* __GST_FAKE_DETECTIONS_H__ */
@@ -0,0 +1,698 @@
+#define _GNU_SOURCE // memfd_create
+#define PACKAGE "rawcapturebypass"
+#include "gstmemfdsink.h"
+#include <gst/allocators/allocators.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * memfdsink: hands buffers to local consumer processes through shared memory.
+ *
+ * Consumers connect to socket-path (see gstmemfdsink.h for the protocol) and
+ * get every buffer as an fd + offset + size instead of a copy over UDP
+ * loopback:
+ *   - a buffer of one fd backed memory (dmabuf from the ISP / encoder, or
+ *     memfd from the allocator this sink proposes upstream) is passed as is,
+ *     no copy on either side
+ *   - any other buffer is copied once into a memfd of the sink (frames-copied)
+ * A frame is held (buffer ref) until every consumer it was sent to released
+ * it. A consumer may hold max-in-flight frames; then the sink waits for it
+ * (backpressure up the pipeline) or, with leaky=true, skips the consumer for
+ * that frame (frames-dropped). A consumer that does not read its socket is
+ * skipped the same way, sends never block the streaming thread.
+ *
+ * Frames held by consumers are not returned to the upstream buffer pool, so
+ * with leaky=false max-in-flight must stay below the pool size upstream.
+ * Without a connected consumer buffers are discarded.
+ */
+
+#define DEFAULT_SOCKET_PATH "/tmp/memfdsink.sock"
+#define DEFAULT_MAX_IN_FLIGHT 4
+#define DEFAULT_LEAKY FALSE
+
+#define MAX_CLIENTS 32
+#define COPY_ROUNDING (64 * 1024)
+
+enum {
+  PROP_0,
+  PROP_SOCKET_PATH,
+  PROP_MAX_IN_FLIGHT,
+  PROP_LEAKY,
+  PROP_CLIENTS,
+  PROP_FRAMES_SENT,
+  PROP_FRAMES_COPIED,
+  PROP_FRAMES_DROPPED,
+};
+
+typedef struct {
+  int fd;
+  guint in_flight;
+  gboolean caps_sent;
+} MemfdClient;
+
+// A frame some consumers still hold: the buffer (zero copy) or the copy memory
+typedef struct {
+  GstBuffer *buffer;
+  GstMemory *copy;
+  guint32 clients;  // bit per client slot
+} MemfdFrame;
+
+struct _GstMemfdSink {
+  GstBaseSink parent;
+
+  gchar *socket_path;
+  guint max_in_flight;
+  gboolean leaky;
+
+  GstAllocator *allocator;  // memfd allocator, proposed upstream and used for copies
+  int listen_fd;
+  int wake_fd[2];           // wakes the socket thread on stop
+  GThread *thread;
+
+  GMutex lock;              // everything below
+  GCond cond;               // a consumer released a frame or left
+  MemfdClient *clients[MAX_CLIENTS];
+  guint n_clients;
+  GHashTable *frames;       // id -> MemfdFrame
+  guint32 next_id;
+  gchar *caps;
+  GList *spares;            // idle copy memories
+  gboolean flushing;
+
+  guint64 frames_sent;
+  guint64 frames_copied;
+  guint64 frames_dropped;
+};
+
+G_DEFINE_TYPE(GstMemfdSink, gst_memfd_sink, GST_TYPE_BASE_SINK)
+
+/*
+ * Allocator of fd memories backed by one memfd each. Proposed upstream, so
+ * producers that use the downstream allocator (video encoders, videoconvert)
+ * write straight into memory the consumers can map.
+ */
+typedef struct {
+  GstFdAllocator parent;
+} GstMemfdAllocator;
+
+typedef struct {
+  GstFdAllocatorClass parent_class;
+} GstMemfdAllocatorClass;
+
+GType gst_memfd_allocator_get_type(void);
+G_DEFINE_TYPE(GstMemfdAllocator, gst_memfd_allocator, GST_TYPE_FD_ALLOCATOR)
+
+static GstMemory *
+gst_memfd_allocator_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params)
+{
+  gsize prefix = params ? params->prefix : 0;
+  gsize maxsize = MAX(prefix + size + (params ? params->padding : 0), 1);
+
+  int fd = memfd_create("memfdsink", MFD_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  if (ftruncate(fd, maxsize) < 0) {
+    close(fd);
+    return NULL;
+  }
+  GstMemory *memory = gst_fd_allocator_alloc(allocator, fd, maxsize, GST_FD_MEMORY_FLAG_KEEP_MAPPED);
+  if (memory)
+    gst_memory_resize(memory, prefix, size);
+  return memory;
+}
+
+static void
+gst_memfd_allocator_class_init(GstMemfdAllocatorClass *klass)
+{
+  GST_ALLOCATOR_CLASS(klass)->alloc = gst_memfd_allocator_alloc;
+}
+
+static void
+gst_memfd_allocator_init(GstMemfdAllocator *self)
+{
+}
+
+static void
+memfd_frame_free(gpointer data)
+{
+  MemfdFrame *frame = data;
+  if (frame->buffer)
+    gst_buffer_unref(frame->buffer);
+  if (frame->copy)
+    gst_memory_unref(frame->copy);
+  g_free(frame);
+}
+
+// Drops client slot's hold on frame id, lock held
+static void
+gst_memfd_sink_release(GstMemfdSink *self, guint slot, guint32 id)
+{
+  MemfdFrame *frame = g_hash_table_lookup(self->frames, GUINT_TO_POINTER(id));
+  if (!frame || !(frame->clients & (1u << slot)))
+    return;
+  frame->clients &= ~(1u << slot);
+  if (self->clients[slot] && self->clients[slot]->in_flight)
+    self->clients[slot]->in_flight--;
+  if (!frame->clients) {
+    // Copy memories go back to the spares instead of a new memfd per frame
+    if (frame->copy && g_list_length(self->spares) < self->max_in_flight + 2) {
+      self->spares = g_list_prepend(self->spares, frame->copy);
+      frame->copy = NULL;
+    }
+    g_hash_table_remove(self->frames, GUINT_TO_POINTER(id));
+  }
+  g_cond_broadcast(&self->cond);
+}
+
+static void
+gst_memfd_sink_remove_client(GstMemfdSink *self, guint slot)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GList *held = NULL;
+
+  g_hash_table_iter_init(&iter, self->frames);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (((MemfdFrame *) value)->clients & (1u << slot))
+      held = g_list_prepend(held, key);
+  }
+  for (GList *l = held; l; l = l->next)
+    gst_memfd_sink_release(self, slot, GPOINTER_TO_UINT(l->data));
+  g_list_free(held);
+
+  close(self->clients[slot]->fd);
+  g_free(self->clients[slot]);
+  self->clients[slot] = NULL;
+  self->n_clients--;
+  g_cond_broadcast(&self->cond);
+  GST_INFO_OBJECT(self, "consumer %u left, %u connected", slot, self->n_clients);
+}
+
+// Accepts consumers and reads their releases
+static gpointer
+gst_memfd_sink_socket_thread(gpointer data)
+{
+  GstMemfdSink *self = data;
+
+  for (;;) {
+    struct pollfd fds[MAX_CLIENTS + 2];
+    guint slots[MAX_CLIENTS + 2];
+    guint n = 0;
+    fds[n++] = (struct pollfd) {.fd = self->wake_fd[0], .events = POLLIN};
+    fds[n++] = (struct pollfd) {.fd = self->listen_fd, .events = POLLIN};
+    g_mutex_lock(&self->lock);
+    for (guint i = 0; i < MAX_CLIENTS; i++) {
+      if (self->clients[i]) {
+        slots[n] = i;
+        fds[n++] = (struct pollfd) {.fd = self->clients[i]->fd, .events = POLLIN};
+      }
+    }
+    g_mutex_unlock(&self->lock);
+
+    if (poll(fds, n, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents)
+      break;
+
+    if (fds[1].revents & POLLIN) {
+      int fd = accept4(self->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      g_mutex_lock(&self->lock);
+      guint slot = 0;
+      while (slot < MAX_CLIENTS && self->clients[slot])
+        slot++;
+      if (fd >= 0 && slot < MAX_CLIENTS) {
+        self->clients[slot] = g_new0(MemfdClient, 1);
+        self->clients[slot]->fd = fd;
+        self->n_clients++;
+        GST_INFO_OBJECT(self, "consumer %u connected, %u connected", slot, self->n_clients);
+      } else if (fd >= 0) {
+        g_warning("memfdsink: more than %d consumers, refusing one", MAX_CLIENTS);
+        close(fd);
+      }
+      g_mutex_unlock(&self->lock);
+    }
+
+    for (guint i = 2; i < n; i++) {
+      if (!fds[i].revents)
+        continue;
+      MemfdShmMessage message;
+      ssize_t length;
+      g_mutex_lock(&self->lock);
+      while ((length = recv(fds[i].fd, &message, sizeof(message), MSG_DONTWAIT)) > 0) {
+        if (length == sizeof(message) && message.magic == MEMFD_SHM_MAGIC && message.type == MEMFD_SHM_RELEASE)
+          gst_memfd_sink_release(self, slots[i], message.id);
+      }
+      if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR))
+        gst_memfd_sink_remove_client(self, slots[i]);
+      g_mutex_unlock(&self->lock);
+    }
+  }
+  return NULL;
+}
+
+static gboolean
+gst_memfd_sink_start(GstBaseSink *sink)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  GST_OBJECT_LOCK(self);
+  gboolean fits = strlen(self->socket_path) < sizeof(addr.sun_path);
+  g_strlcpy(addr.sun_path, self->socket_path, sizeof(addr.sun_path));
+  GST_OBJECT_UNLOCK(self);
+  if (!fits) {
+    GST_ELEMENT_ERROR(self, RESOURCE, SETTINGS, ("socket-path too long"), (NULL));
+    return FALSE;
+  }
+
+  unlink(addr.sun_path);
+  self->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (self->listen_fd < 0 || bind(self->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(self->listen_fd, 8) < 0) {
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Could not listen on %s", addr.sun_path),
+        ("%s", g_strerror(errno)));
+    if (self->listen_fd >= 0)
+      close(self->listen_fd);
+    self->listen_fd = -1;
+    return FALSE;
+  }
+  if (pipe2(self->wake_fd, O_CLOEXEC) < 0) {
+    GST_ELEMENT_ERROR(self, RESOURCE, FAILED, ("Could not create a pipe"), ("%s", g_strerror(errno)));
+    close(self->listen_fd);
+    self->listen_fd = -1;
+    return FALSE;
+  }
+
+  self->next_id = 1;
+  self->flushing = FALSE;
+  self->frames_sent = self->frames_copied = self->frames_dropped = 0;
+  self->thread = g_thread_new("memfdsink", gst_memfd_sink_socket_thread, self);
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_sink_stop(GstBaseSink *sink)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+
+  if (self->thread) {
+    if (write(self->wake_fd[1], "x", 1) < 0)
+      GST_WARNING_OBJECT(self, "could not wake the socket thread: %s", g_strerror(errno));
+    g_thread_join(self->thread);
+    self->thread = NULL;
+    close(self->wake_fd[0]);
+    close(self->wake_fd[1]);
+  }
+
+  // Consumers still holding frames keep their fds / mappings, the data stays valid for them
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < MAX_CLIENTS; i++) {
+    if (self->clients[i])
+      gst_memfd_sink_remove_client(self, i);
+  }
+  g_hash_table_remove_all(self->frames);
+  g_list_free_full(self->spares, (GDestroyNotify) gst_memory_unref);
+  self->spares = NULL;
+  g_clear_pointer(&self->caps, g_free);
+  g_mutex_unlock(&self->lock);
+
+  if (self->listen_fd >= 0) {
+    close(self->listen_fd);
+    self->listen_fd = -1;
+    GST_OBJECT_LOCK(self);
+    unlink(self->socket_path);
+    GST_OBJECT_UNLOCK(self);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_sink_unlock(GstBaseSink *sink)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+  g_mutex_lock(&self->lock);
+  self->flushing = TRUE;
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_sink_unlock_stop(GstBaseSink *sink)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+  g_mutex_lock(&self->lock);
+  self->flushing = FALSE;
+  g_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_sink_set_caps(GstBaseSink *sink, GstCaps *caps)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+  gchar *string = gst_caps_to_string(caps);
+  if (strlen(string) >= MEMFD_SHM_MAX_CAPS) {
+    GST_ELEMENT_ERROR(self, STREAM, FORMAT, ("Caps too long for memfdsink"), ("%s", string));
+    g_free(string);
+    return FALSE;
+  }
+
+  g_mutex_lock(&self->lock);
+  g_free(self->caps);
+  self->caps = string;
+  for (guint i = 0; i < MAX_CLIENTS; i++) {
+    if (self->clients[i])
+      self->clients[i]->caps_sent = FALSE;
+  }
+  g_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_sink_propose_allocation(GstBaseSink *sink, GstQuery *query)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+  gst_query_add_allocation_param(query, self->allocator, NULL);
+  return TRUE;
+}
+
+// Sends without blocking; FALSE if the consumer's socket is full or gone
+static gboolean
+gst_memfd_sink_send(int socket_fd, const MemfdShmMessage *message, const gchar *payload, int fd)
+{
+  struct iovec iov[2] = {
+    {.iov_base = (void *) message, .iov_len = sizeof(*message)},
+    {.iov_base = (void *) payload, .iov_len = payload ? message->size : 0},
+  };
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr hdr = {.msg_iov = iov, .msg_iovlen = payload ? 2 : 1};
+
+  if (fd >= 0) {
+    hdr.msg_control = control.buf;
+    hdr.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+  return sendmsg(socket_fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0;
+}
+
+// Memory the frame is sent from: the buffer's own fd memory or a copy into a spare memfd
+static GstMemory *
+gst_memfd_sink_frame_memory(GstMemfdSink *self, GstBuffer *buffer, GstMemory **copy)
+{
+  *copy = NULL;
+  if (gst_buffer_n_memory(buffer) == 1) {
+    GstMemory *memory = gst_buffer_peek_memory(buffer, 0);
+    if (gst_is_fd_memory(memory))
+      return memory;
+  }
+
+  gsize size = gst_buffer_get_size(buffer);
+  g_mutex_lock(&self->lock);
+  for (GList *l = self->spares; l; l = l->next) {
+    GstMemory *spare = l->data;
+    if (spare->maxsize >= size) {
+      *copy = spare;
+      self->spares = g_list_delete_link(self->spares, l);
+      break;
+    }
+  }
+  g_mutex_unlock(&self->lock);
+  if (!*copy)
+    *copy = gst_allocator_alloc(self->allocator, (size + COPY_ROUNDING - 1) / COPY_ROUNDING * COPY_ROUNDING, NULL);
+  if (!*copy)
+    return NULL;
+  gst_memory_resize(*copy, -(gssize) (*copy)->offset, size);
+
+  GstMapInfo map;
+  if (!gst_memory_map(*copy, &map, GST_MAP_WRITE)) {
+    gst_memory_unref(*copy);
+    *copy = NULL;
+    return NULL;
+  }
+  gst_buffer_extract(buffer, 0, map.data, size);
+  gst_memory_unmap(*copy, &map);
+  return *copy;
+}
+
+static GstFlowReturn
+gst_memfd_sink_render(GstBaseSink *sink, GstBuffer *buffer)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(sink);
+
+  g_mutex_lock(&self->lock);
+  gboolean connected = self->n_clients > 0;
+  g_mutex_unlock(&self->lock);
+  if (!connected)
+    return GST_FLOW_OK;
+
+  GstMemory *copy;
+  GstMemory *memory = gst_memfd_sink_frame_memory(self, buffer, &copy);
+  if (!memory) {
+    GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Could not allocate a memfd"), ("%s", g_strerror(errno)));
+    return GST_FLOW_ERROR;
+  }
+
+  MemfdShmMessage message;
+  memset(&message, 0, sizeof(message));
+  message.magic = MEMFD_SHM_MAGIC;
+  message.type = MEMFD_SHM_FRAME;
+  message.fd_flags = !copy && gst_is_dmabuf_memory(memory) ? MEMFD_SHM_FD_DMABUF : 0;
+  message.offset = memory->offset;
+  message.size = memory->size;
+  message.pts = GST_BUFFER_PTS(buffer);
+  message.dts = GST_BUFFER_DTS(buffer);
+  message.duration = GST_BUFFER_DURATION(buffer);
+  message.buffer_flags = GST_BUFFER_FLAGS(buffer);
+  int fd = gst_fd_memory_get_fd(memory);
+
+  MemfdFrame *frame = g_new0(MemfdFrame, 1);
+  frame->buffer = copy ? NULL : gst_buffer_ref(buffer);
+  frame->copy = copy;
+
+  GstFlowReturn ret = GST_FLOW_OK;
+  g_mutex_lock(&self->lock);
+  message.id = self->next_id++;
+  for (guint i = 0; i < MAX_CLIENTS; i++) {
+    // Backpressure: wait for the consumer to release a frame (it may leave while we wait)
+    while (!self->leaky && !self->flushing && self->clients[i] && self->clients[i]->in_flight >= self->max_in_flight)
+      g_cond_wait(&self->cond, &self->lock);
+    if (self->flushing) {
+      ret = GST_FLOW_FLUSHING;
+      break;
+    }
+    MemfdClient *client = self->clients[i];
+    if (!client)
+      continue;
+
+    if (client->in_flight >= self->max_in_flight) {
+      self->frames_dropped++;
+      continue;
+    }
+    if (!client->caps_sent && self->caps) {
+      MemfdShmMessage caps_message;
+      memset(&caps_message, 0, sizeof(caps_message));
+      caps_message.magic = MEMFD_SHM_MAGIC;
+      caps_message.type = MEMFD_SHM_CAPS;
+      caps_message.size = strlen(self->caps) + 1;
+      client->caps_sent = gst_memfd_sink_send(client->fd, &caps_message, self->caps, -1);
+      if (!client->caps_sent) {
+        self->frames_dropped++;
+        continue;
+      }
+    }
+    if (!gst_memfd_sink_send(client->fd, &message, NULL, fd)) {
+      self->frames_dropped++;
+      continue;
+    }
+    client->in_flight++;
+    frame->clients |= 1u << i;
+    self->frames_sent++;
+  }
+
+  if (copy && frame->clients)
+    self->frames_copied++;
+  if (frame->clients) {
+    g_hash_table_insert(self->frames, GUINT_TO_POINTER(message.id), frame);
+  } else {
+    if (copy && ret == GST_FLOW_OK) {
+      self->spares = g_list_prepend(self->spares, copy);
+      frame->copy = NULL;
+    }
+    memfd_frame_free(frame);
+  }
+  g_mutex_unlock(&self->lock);
+  return ret;
+}
+
+static void
+gst_memfd_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      GST_OBJECT_LOCK(self);
+      g_free(self->socket_path);
+      self->socket_path = g_value_dup_string(value);
+      if (!self->socket_path)
+        self->socket_path = g_strdup(DEFAULT_SOCKET_PATH);
+      GST_OBJECT_UNLOCK(self);
+      break;
+    case PROP_MAX_IN_FLIGHT:
+      g_mutex_lock(&self->lock);
+      self->max_in_flight = g_value_get_uint(value);
+      g_cond_broadcast(&self->cond);
+      g_mutex_unlock(&self->lock);
+      break;
+    case PROP_LEAKY:
+      g_mutex_lock(&self->lock);
+      self->leaky = g_value_get_boolean(value);
+      g_cond_broadcast(&self->cond);
+      g_mutex_unlock(&self->lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_memfd_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(object);
+
+  if (prop_id == PROP_SOCKET_PATH) {
+    GST_OBJECT_LOCK(self);
+    g_value_set_string(value, self->socket_path);
+    GST_OBJECT_UNLOCK(self);
+    return;
+  }
+
+  g_mutex_lock(&self->lock);
+  switch (prop_id) {
+    case PROP_MAX_IN_FLIGHT:
+      g_value_set_uint(value, self->max_in_flight);
+      break;
+    case PROP_LEAKY:
+      g_value_set_boolean(value, self->leaky);
+      break;
+    case PROP_CLIENTS:
+      g_value_set_uint(value, self->n_clients);
+      break;
+    case PROP_FRAMES_SENT:
+      g_value_set_uint64(value, self->frames_sent);
+      break;
+    case PROP_FRAMES_COPIED:
+      g_value_set_uint64(value, self->frames_copied);
+      break;
+    case PROP_FRAMES_DROPPED:
+      g_value_set_uint64(value, self->frames_dropped);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+gst_memfd_sink_finalize(GObject *object)
+{
+  GstMemfdSink *self = GST_MEMFD_SINK(object);
+
+  g_hash_table_unref(self->frames);
+  gst_object_unref(self->allocator);
+  g_free(self->socket_path);
+  g_mutex_clear(&self->lock);
+  g_cond_clear(&self->cond);
+  G_OBJECT_CLASS(gst_memfd_sink_parent_class)->finalize(object);
+}
+
+static void
+gst_memfd_sink_class_init(GstMemfdSinkClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS(klass);
+
+  gobject_class->set_property = gst_memfd_sink_set_property;
+  gobject_class->get_property = gst_memfd_sink_get_property;
+  gobject_class->finalize = gst_memfd_sink_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_SOCKET_PATH,
+      g_param_spec_string("socket-path", "Socket path", "Unix socket the consumers connect to",
+          DEFAULT_SOCKET_PATH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAX_IN_FLIGHT,
+      g_param_spec_uint("max-in-flight", "Max in flight", "Frames one consumer may hold before it is waited for / skipped",
+          1, 64, DEFAULT_MAX_IN_FLIGHT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_LEAKY,
+      g_param_spec_boolean("leaky", "Leaky", "Skip a consumer that holds max-in-flight frames instead of waiting for it",
+          DEFAULT_LEAKY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_CLIENTS,
+      g_param_spec_uint("clients", "Clients", "Connected consumers",
+          0, MAX_CLIENTS, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_SENT,
+      g_param_spec_uint64("frames-sent", "Frames sent", "Frames handed to consumers (one per consumer)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_COPIED,
+      g_param_spec_uint64("frames-copied", "Frames copied", "Frames that were not fd backed and were copied into a memfd",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_DROPPED,
+      g_param_spec_uint64("frames-dropped", "Frames dropped", "Frames a consumer was skipped for (busy or socket full)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_new_any();
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "memfd shared memory sink",
+    "Sink",
+    "Passes buffers to local consumers as memfd / dmabuf fds, zero copy for fd backed buffers",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_sink_class->start = GST_DEBUG_FUNCPTR(gst_memfd_sink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR(gst_memfd_sink_stop);
+  base_sink_class->unlock = GST_DEBUG_FUNCPTR(gst_memfd_sink_unlock);
+  base_sink_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_memfd_sink_unlock_stop);
+  base_sink_class->set_caps = GST_DEBUG_FUNCPTR(gst_memfd_sink_set_caps);
+  base_sink_class->propose_allocation = GST_DEBUG_FUNCPTR(gst_memfd_sink_propose_allocation);
+  base_sink_class->render = GST_DEBUG_FUNCPTR(gst_memfd_sink_render);
+}
+
+static void
+gst_memfd_sink_init(GstMemfdSink *self)
+{
+  self->socket_path = g_strdup(DEFAULT_SOCKET_PATH);
+  self->max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+  self->leaky = DEFAULT_LEAKY;
+  self->allocator = g_object_new(gst_memfd_allocator_get_type(), NULL);
+  gst_object_ref_sink(self->allocator);
+  self->listen_fd = -1;
+  self->frames = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, memfd_frame_free);
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->cond);
+  gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
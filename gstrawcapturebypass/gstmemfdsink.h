@@ -0,0 +1,50 @@
+#ifndef __GST_MEMFD_SINK_H__
+#define __GST_MEMFD_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MEMFD_SINK   (gst_memfd_sink_get_type())
+G_DECLARE_FINAL_TYPE(GstMemfdSink, gst_memfd_sink, GST, MEMFD_SINK, GstBaseSink)
+
+/*
+ * Protocol between memfdsink and its consumers (memfdsrc, shm_bench) on a
+ * SOCK_SEQPACKET unix socket, one MemfdShmMessage per packet, host byte order
+ * (both ends are on the same device):
+ *   sink -> consumer  MEMFD_SHM_CAPS     caps string of `size` bytes follows the header
+ *   sink -> consumer  MEMFD_SHM_FRAME    one fd in SCM_RIGHTS; data is [offset, offset + size) of it
+ *   consumer -> sink  MEMFD_SHM_RELEASE  the consumer is done with frame `id`
+ * The fd is a memfd (MEMFD_SHM_FD_DMABUF unset), which consumers mmap once per
+ * file and reuse, or a dmabuf of the producer, which they import as is. Until
+ * the release the sink keeps the frame and does not reuse its memory.
+ */
+#define MEMFD_SHM_MAGIC 0x3144464du /* "MFD1" */
+#define MEMFD_SHM_MAX_CAPS 4096
+
+typedef enum {
+  MEMFD_SHM_CAPS = 1,
+  MEMFD_SHM_FRAME = 2,
+  MEMFD_SHM_RELEASE = 3,
+} MemfdShmMessageType;
+
+#define MEMFD_SHM_FD_DMABUF (1u << 0)
+
+typedef struct {
+  guint32 magic;
+  guint32 type;          // MemfdShmMessageType
+  guint32 id;            // frame id, echoed by MEMFD_SHM_RELEASE
+  guint32 fd_flags;      // MEMFD_SHM_FD_*
+  guint64 offset;
+  guint64 size;
+  guint64 pts;           // GstClockTime, GST_CLOCK_TIME_NONE if unset
+  guint64 dts;
+  guint64 duration;
+  guint32 buffer_flags;  // GstBufferFlags
+  guint32 reserved;
+} MemfdShmMessage;
+
+G_END_DECLS
+
+#endif /* __GST_MEMFD_SINK_H__ */
@@ -0,0 +1,464 @@
+#define _GNU_SOURCE
+#define PACKAGE "rawcapturebypass"
+#include "gstmemfdsrc.h"
+#include "gstmemfdsink.h"
+#include <gst/allocators/allocators.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * memfdsrc: consumer side of memfdsink, for on-device analytics / recording
+ * pipelines in another process.
+ *
+ * Every frame arrives as an fd (gstmemfdsink.h). A memfd is mapped read-only
+ * once per file and the buffers wrap that mapping; a dmabuf is imported with
+ * the dmabuf allocator so hardware elements downstream can use it directly.
+ * Either way no data is copied. When the last reference to a buffer's memory
+ * is gone the frame is released back to the sink; holding buffers for long
+ * (a deep queue downstream) therefore holds the producer's memory as well.
+ *
+ * Timestamps are the producer's running time; set do-timestamp=true when the
+ * consumer pipeline syncs to its own clock.
+ */
+
+#define DEFAULT_SOCKET_PATH "/tmp/memfdsink.sock"
+#define MAX_IDLE_MAPPINGS 16
+
+enum {
+  PROP_0,
+  PROP_SOCKET_PATH,
+  PROP_FRAMES_RECEIVED,
+  PROP_MAPPINGS,
+};
+
+// One mapped memfd, shared by all frames that come from it
+typedef struct {
+  guint64 inode;
+  guint8 *data;
+  gsize size;
+  guint outstanding;  // frames still wrapping the mapping
+} MemfdMapping;
+
+// The connection outlives the element's start / stop while buffers are still out there
+typedef struct {
+  gint refcount;
+  GMutex lock;
+  int fd;
+  GHashTable *mappings;  // inode -> MemfdMapping
+} MemfdConnection;
+
+typedef struct {
+  MemfdConnection *connection;
+  MemfdMapping *mapping;  // NULL for dmabuf frames
+  guint32 id;
+} MemfdRelease;
+
+struct _GstMemfdSrc {
+  GstPushSrc parent;
+
+  gchar *socket_path;
+
+  MemfdConnection *connection;
+  int wake_fd[2];  // unlock
+  GstAllocator *dmabuf_allocator;
+  guint64 frames_received;
+};
+
+G_DEFINE_TYPE(GstMemfdSrc, gst_memfd_src, GST_TYPE_PUSH_SRC)
+
+static void
+memfd_mapping_free(gpointer data)
+{
+  MemfdMapping *mapping = data;
+  munmap(mapping->data, mapping->size);
+  g_free(mapping);
+}
+
+static void
+memfd_connection_unref(MemfdConnection *connection)
+{
+  if (!g_atomic_int_dec_and_test(&connection->refcount))
+    return;
+  if (connection->fd >= 0)
+    close(connection->fd);
+  g_hash_table_unref(connection->mappings);
+  g_mutex_clear(&connection->lock);
+  g_free(connection);
+}
+
+// Unmaps files no frame uses any more once there are too many of them (the producer's pool changed)
+static void
+memfd_connection_trim(MemfdConnection *connection)
+{
+  if (g_hash_table_size(connection->mappings) <= MAX_IDLE_MAPPINGS)
+    return;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, connection->mappings);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    if (!((MemfdMapping *) value)->outstanding)
+      g_hash_table_iter_remove(&iter);
+  }
+}
+
+static void
+memfd_release(gpointer data)
+{
+  MemfdRelease *release = data;
+  MemfdConnection *connection = release->connection;
+  MemfdShmMessage message;
+
+  memset(&message, 0, sizeof(message));
+  message.magic = MEMFD_SHM_MAGIC;
+  message.type = MEMFD_SHM_RELEASE;
+  message.id = release->id;
+
+  g_mutex_lock(&connection->lock);
+  if (release->mapping)
+    release->mapping->outstanding--;
+  if (connection->fd >= 0 && send(connection->fd, &message, sizeof(message), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    GST_DEBUG("memfdsrc: release of frame %u failed: %s", release->id, g_strerror(errno));
+  g_mutex_unlock(&connection->lock);
+
+  memfd_connection_unref(connection);
+  g_free(release);
+}
+
+static void
+memfd_release_weak_notify(gpointer data, GstMiniObject *object)
+{
+  memfd_release(data);
+}
+
+static gboolean
+gst_memfd_src_start(GstBaseSrc *src)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(src);
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  GST_OBJECT_LOCK(self);
+  g_strlcpy(addr.sun_path, self->socket_path, sizeof(addr.sun_path));
+  GST_OBJECT_UNLOCK(self);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("Could not connect to memfdsink at %s", addr.sun_path),
+        ("%s", g_strerror(errno)));
+    if (fd >= 0)
+      close(fd);
+    return FALSE;
+  }
+  if (pipe2(self->wake_fd, O_CLOEXEC | O_NONBLOCK) < 0) {
+    GST_ELEMENT_ERROR(self, RESOURCE, FAILED, ("Could not create a pipe"), ("%s", g_strerror(errno)));
+    close(fd);
+    return FALSE;
+  }
+
+  MemfdConnection *connection = g_new0(MemfdConnection, 1);
+  connection->refcount = 1;
+  connection->fd = fd;
+  g_mutex_init(&connection->lock);
+  connection->mappings = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, memfd_mapping_free);
+  self->connection = connection;
+  self->frames_received = 0;
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_src_stop(GstBaseSrc *src)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(src);
+
+  if (self->connection) {
+    // Buffers still downstream keep their mappings; their releases have nowhere to go
+    g_mutex_lock(&self->connection->lock);
+    close(self->connection->fd);
+    self->connection->fd = -1;
+    g_mutex_unlock(&self->connection->lock);
+    memfd_connection_unref(self->connection);
+    self->connection = NULL;
+    close(self->wake_fd[0]);
+    close(self->wake_fd[1]);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_src_unlock(GstBaseSrc *src)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(src);
+  if (write(self->wake_fd[1], "x", 1) < 0)
+    GST_WARNING_OBJECT(self, "could not wake create: %s", g_strerror(errno));
+  return TRUE;
+}
+
+static gboolean
+gst_memfd_src_unlock_stop(GstBaseSrc *src)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(src);
+  char drain[16];
+  while (read(self->wake_fd[0], drain, sizeof(drain)) > 0) {
+  }
+  return TRUE;
+}
+
+// Wraps [offset, offset + size) of a memfd, mapping the file on its first frame
+static GstMemory *
+gst_memfd_src_wrap_memfd(GstMemfdSrc *self, int fd, const MemfdShmMessage *message, MemfdRelease *release)
+{
+  MemfdConnection *connection = self->connection;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || message->offset + message->size > (guint64) st.st_size)
+    return NULL;
+
+  guint64 inode = st.st_ino;
+  g_mutex_lock(&connection->lock);
+  MemfdMapping *mapping = g_hash_table_lookup(connection->mappings, &inode);
+  if (!mapping) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      g_mutex_unlock(&connection->lock);
+      return NULL;
+    }
+    mapping = g_new0(MemfdMapping, 1);
+    mapping->inode = inode;
+    mapping->data = data;
+    mapping->size = st.st_size;
+    memfd_connection_trim(connection);
+    g_hash_table_insert(connection->mappings, &mapping->inode, mapping);
+  }
+  mapping->outstanding++;
+  g_mutex_unlock(&connection->lock);
+
+  release->mapping = mapping;
+  return gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, mapping->data, mapping->size, message->offset,
+      message->size, release, memfd_release);
+}
+
+static GstFlowReturn
+gst_memfd_src_create(GstPushSrc *src, GstBuffer **buffer)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(src);
+  int socket_fd = self->connection->fd;
+
+  for (;;) {
+    struct pollfd fds[2] = {
+      {.fd = socket_fd, .events = POLLIN},
+      {.fd = self->wake_fd[0], .events = POLLIN},
+    };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      GST_ELEMENT_ERROR(self, RESOURCE, READ, ("poll failed"), ("%s", g_strerror(errno)));
+      return GST_FLOW_ERROR;
+    }
+    if (fds[1].revents)
+      return GST_FLOW_FLUSHING;
+
+    guint8 payload[sizeof(MemfdShmMessage) + MEMFD_SHM_MAX_CAPS];
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = {.iov_base = payload, .iov_len = sizeof(payload)};
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+    ssize_t length = recvmsg(socket_fd, &hdr, MSG_CMSG_CLOEXEC);
+    if (length == 0) {
+      GST_INFO_OBJECT(self, "memfdsink closed the connection");
+      return GST_FLOW_EOS;
+    }
+    if (length < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Could not read from memfdsink"), ("%s", g_strerror(errno)));
+      return GST_FLOW_ERROR;
+    }
+
+    int fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    MemfdShmMessage message;
+    if ((gsize) length < sizeof(message)) {
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+    memcpy(&message, payload, sizeof(message));
+    if (message.magic != MEMFD_SHM_MAGIC) {
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+
+    if (message.type == MEMFD_SHM_CAPS) {
+      payload[length - 1] = '\0';
+      GstCaps *caps = gst_caps_from_string((const gchar *) payload + sizeof(message));
+      if (caps) {
+        gst_base_src_set_caps(GST_BASE_SRC(self), caps);
+        gst_caps_unref(caps);
+      }
+      continue;
+    }
+    if (message.type != MEMFD_SHM_FRAME || fd < 0) {
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+
+    MemfdRelease *release = g_new0(MemfdRelease, 1);
+    g_atomic_int_inc(&self->connection->refcount);
+    release->connection = self->connection;
+    release->id = message.id;
+
+    GstMemory *memory;
+    if (message.fd_flags & MEMFD_SHM_FD_DMABUF) {
+      // The memory owns the fd; the release is tied to the memory, whichever buffer ends up holding it
+      memory = gst_dmabuf_allocator_alloc(self->dmabuf_allocator, fd, message.offset + message.size);
+      if (memory) {
+        gst_memory_resize(memory, message.offset, message.size);
+        gst_mini_object_weak_ref(GST_MINI_OBJECT(memory), memfd_release_weak_notify, release);
+      }
+    } else {
+      memory = gst_memfd_src_wrap_memfd(self, fd, &message, release);
+      close(fd);
+    }
+    if (!memory) {
+      memfd_release(release);
+      GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Could not map frame %u", message.id), (NULL));
+      return GST_FLOW_ERROR;
+    }
+
+    *buffer = gst_buffer_new();
+    gst_buffer_append_memory(*buffer, memory);
+    GST_BUFFER_PTS(*buffer) = message.pts;
+    GST_BUFFER_DTS(*buffer) = message.dts;
+    GST_BUFFER_DURATION(*buffer) = message.duration;
+    GST_BUFFER_FLAGS(*buffer) = message.buffer_flags & ~(GST_BUFFER_FLAG_TAG_MEMORY);
+    GST_OBJECT_LOCK(self);
+    self->frames_received++;
+    GST_OBJECT_UNLOCK(self);
+    return GST_FLOW_OK;
+  }
+}
+
+static void
+gst_memfd_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_free(self->socket_path);
+      self->socket_path = g_value_dup_string(value);
+      if (!self->socket_path)
+        self->socket_path = g_strdup(DEFAULT_SOCKET_PATH);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_memfd_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_value_set_string(value, self->socket_path);
+      break;
+    case PROP_FRAMES_RECEIVED:
+      g_value_set_uint64(value, self->frames_received);
+      break;
+    case PROP_MAPPINGS:
+      if (self->connection) {
+        g_mutex_lock(&self->connection->lock);
+        g_value_set_uint(value, g_hash_table_size(self->connection->mappings));
+        g_mutex_unlock(&self->connection->lock);
+      } else {
+        g_value_set_uint(value, 0);
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_memfd_src_finalize(GObject *object)
+{
+  GstMemfdSrc *self = GST_MEMFD_SRC(object);
+
+  gst_object_unref(self->dmabuf_allocator);
+  g_free(self->socket_path);
+  G_OBJECT_CLASS(gst_memfd_src_parent_class)->finalize(object);
+}
+
+static void
+gst_memfd_src_class_init(GstMemfdSrcClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseSrcClass *base_src_class = GST_BASE_SRC_CLASS(klass);
+  GstPushSrcClass *push_src_class = GST_PUSH_SRC_CLASS(klass);
+
+  gobject_class->set_property = gst_memfd_src_set_property;
+  gobject_class->get_property = gst_memfd_src_get_property;
+  gobject_class->finalize = gst_memfd_src_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_SOCKET_PATH,
+      g_param_spec_string("socket-path", "Socket path", "Unix socket of the memfdsink",
+          DEFAULT_SOCKET_PATH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_RECEIVED,
+      g_param_spec_uint64("frames-received", "Frames received", "Frames received from the sink",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAPPINGS,
+      g_param_spec_uint("mappings", "Mappings", "memfd files currently mapped",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_new_any();
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "memfd shared memory source",
+    "Source",
+    "Receives the buffers of a memfdsink in another process without copying them",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_src_class->start = GST_DEBUG_FUNCPTR(gst_memfd_src_start);
+  base_src_class->stop = GST_DEBUG_FUNCPTR(gst_memfd_src_stop);
+  base_src_class->unlock = GST_DEBUG_FUNCPTR(gst_memfd_src_unlock);
+  base_src_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_memfd_src_unlock_stop);
+  push_src_class->create = GST_DEBUG_FUNCPTR(gst_memfd_src_create);
+}
+
+static void
+gst_memfd_src_init(GstMemfdSrc *self)
+{
+  self->socket_path = g_strdup(DEFAULT_SOCKET_PATH);
+  self->dmabuf_allocator = gst_dmabuf_allocator_new();
+  gst_base_src_set_live(GST_BASE_SRC(self), TRUE);
+  gst_base_src_set_format(GST_BASE_SRC(self), GST_FORMAT_TIME);
+}
@@ -0,0 +1,14 @@
+#ifndef __GST_MEMFD_SRC_H__
+#define __GST_MEMFD_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MEMFD_SRC   (gst_memfd_src_get_type())
+G_DECLARE_FINAL_TYPE(GstMemfdSrc, gst_memfd_src, GST, MEMFD_SRC, GstPushSrc)
+
+G_END_DECLS
+
+#endif /* __GST_MEMFD_SRC_H__ */
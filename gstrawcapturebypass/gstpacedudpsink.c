@@ -0,0 +1,1008 @@
+#define _GNU_SOURCE // sendmmsg
+#define PACKAGE "rawcapturebypass"
+#include "gstpacedudpsink.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/net_tstamp.h> // struct sock_txtime
+
+// Older libc headers do not have these yet
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+/*
+ * pacedudpsink: udpsink replacement for the RTP output of the encoder branches.
+ *
+ * rtph264pay pushes the packets of one encoded frame as a buffer list. udpsink
+ * sends such a list back to back, so an I-frame leaves the host as a burst of
+ * hundreds of packets that overflows receiver socket buffers and switch queues.
+ * This sink spreads the packets of a frame over pacing-fraction of the frame
+ * interval instead:
+ *   pacing=txtime  every send carries an SCM_TXTIME launch time (SO_TXTIME);
+ *                  the fq qdisc on the egress interface holds the packet until
+ *                  then (tc qdisc replace dev eth0 root fq). Without fq the
+ *                  launch times are ignored and packets leave immediately.
+ *   pacing=sleep   the streaming thread sleeps until each launch time itself,
+ *                  works without fq at the cost of one syscall per send.
+ * gso=true batches consecutive same-size packets into one UDP_SEGMENT send
+ * (at most gso-segments packets), the kernel / NIC splits them again. With
+ * pacing the GSO batch is the pacing unit.
+ * Both features are probed on start and fall back (with a warning) when the
+ * kernel does not support them.
+ *
+ * extra-destinations="host:port,host:port" sends the same packets to more
+ * receivers without another tee branch / rtph264pay per receiver: the packet
+ * list is packetized and mapped once and shared by all destinations. Then
+ * every destination (host:port included) gets its own socket, sender thread
+ * and queue of up to queue-frames frames, so a destination whose sends block
+ * (full socket buffer, fq holding its packets) falls behind alone: once its
+ * queue is full new frames are dropped for it and counted in frames-dropped.
+ * Pacing and GSO batching are done per destination. destination-stats has the
+ * counters of each destination.
+ * Setting host / port while running retargets only destination 0 (host:port);
+ * the extra destinations keep their receivers until the next start.
+ */
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT 5000
+#define DEFAULT_PACING GST_PACED_UDP_PACING_NONE
+#define DEFAULT_GSO FALSE
+#define DEFAULT_GSO_SEGMENTS 16
+#define DEFAULT_FRAME_DURATION 0
+#define DEFAULT_PACING_FRACTION 0.8
+#define DEFAULT_BUFFER_SIZE (4 * 1024 * 1024)
+#define DEFAULT_QUEUE_FRAMES 8
+
+#define FALLBACK_FRAME_DURATION (GST_SECOND / 30)
+#define MAX_GSO_SEGMENTS 64
+#define MAX_GSO_BYTES 65000
+#define CONTROL_SPACE (CMSG_SPACE(sizeof(guint16)) + CMSG_SPACE(sizeof(guint64)))
+
+enum {
+  PROP_0,
+  PROP_HOST,
+  PROP_PORT,
+  PROP_PACING,
+  PROP_GSO,
+  PROP_GSO_SEGMENTS,
+  PROP_FRAME_DURATION,
+  PROP_PACING_FRACTION,
+  PROP_BUFFER_SIZE,
+  PROP_PACKETS_SENT,
+  PROP_BYTES_SENT,
+  PROP_SEND_CALLS,
+  PROP_SEND_ERRORS,
+  PROP_EXTRA_DESTINATIONS,
+  PROP_QUEUE_FRAMES,
+  PROP_FRAMES_DROPPED,
+  PROP_DESTINATION_STATS,
+};
+
+struct _GstPacedUdpSink {
+  GstBaseSink parent;
+
+  gchar *host;
+  gint port;
+  GstPacedUdpPacing pacing;
+  gboolean gso;
+  guint gso_segments;
+  guint64 frame_duration;   // ns, 0 = buffer duration
+  gdouble pacing_fraction;  // part of the frame interval the packets are spread over
+  gint buffer_size;
+  gchar *extra_destinations;
+  guint queue_frames;
+
+  GPtrArray *destinations;  // PacedDestination, [0] is host:port; rebuilt on start
+  gboolean fan_out;         // sender thread per destination (extra-destinations set)
+  gboolean flushing;
+};
+
+// One receiver: socket, pacing state and counters. With fan-out also its sender thread and frame queue.
+typedef struct {
+  gchar *host;
+  gint port;
+  int fd;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  GstPacedUdpPacing active_pacing;  // pacing after probing the socket
+  gboolean active_gso;
+  guint64 next_tx_ns;               // end of the previous frame's pacing span
+
+  // Under the object lock
+  guint64 packets_sent;
+  guint64 bytes_sent;
+  guint64 send_calls;
+  guint64 send_errors;
+  guint64 frames_dropped;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  GQueue frames;                    // PacedFrame, under lock
+  gboolean stopping;
+} PacedDestination;
+
+// Packets of one render call: the memories of all buffers as one iovec array
+typedef struct {
+  struct iovec *iov;
+  guint *first_iov;  // packet i uses iov[first_iov[i]] .. iov[first_iov[i + 1] - 1]
+  gsize *size;
+} PacedPackets;
+
+// The mapped packets of one render call, shared by all destinations
+typedef struct {
+  gint refcount;
+  guint n;
+  GstBuffer **buffers;
+  GstMapInfo *maps;
+  guint n_maps;
+  PacedPackets packets;
+  GstClockTime duration;
+} PacedFrame;
+
+G_DEFINE_TYPE(GstPacedUdpSink, gst_paced_udp_sink, GST_TYPE_BASE_SINK)
+
+GType
+gst_paced_udp_pacing_get_type(void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_PACED_UDP_PACING_NONE, "No pacing", "none"},
+    {GST_PACED_UDP_PACING_TXTIME, "SO_TXTIME launch times (fq qdisc)", "txtime"},
+    {GST_PACED_UDP_PACING_SLEEP, "Sleep between sends", "sleep"},
+    {0, NULL, NULL},
+  };
+  if (g_once_init_enter(&type)) {
+    GType new_type = g_enum_register_static("GstPacedUdpPacing", values);
+    g_once_init_leave(&type, new_type);
+  }
+  return type;
+}
+
+static guint64
+gst_paced_udp_sink_now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (guint64) now.tv_sec * GST_SECOND + now.tv_nsec;
+}
+
+static gboolean
+gst_paced_udp_sink_resolve(const gchar *host, gint port, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+  struct addrinfo hints;
+  struct addrinfo *result = NULL;
+  gchar service[16];
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICSERV;
+  g_snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &result) != 0 || !result)
+    return FALSE;
+  memcpy(addr, result->ai_addr, result->ai_addrlen);
+  *addr_len = result->ai_addrlen;
+  freeaddrinfo(result);
+  return TRUE;
+}
+
+static PacedDestination *
+paced_destination_new(const gchar *host, gint port)
+{
+  PacedDestination *dest = g_new0(PacedDestination, 1);
+  dest->host = g_strdup(host);
+  dest->port = port;
+  dest->fd = -1;
+  g_mutex_init(&dest->lock);
+  g_cond_init(&dest->cond);
+  g_queue_init(&dest->frames);
+  return dest;
+}
+
+static PacedFrame *
+paced_frame_ref(PacedFrame *frame)
+{
+  g_atomic_int_inc(&frame->refcount);
+  return frame;
+}
+
+static void
+paced_frame_unref(PacedFrame *frame)
+{
+  if (!g_atomic_int_dec_and_test(&frame->refcount))
+    return;
+  for (guint i = 0; i < frame->n_maps; i++)
+    gst_memory_unmap(frame->maps[i].memory, &frame->maps[i]);
+  for (guint i = 0; i < frame->n; i++)
+    gst_buffer_unref(frame->buffers[i]);
+  g_free(frame->maps);
+  g_free(frame->buffers);
+  g_free(frame->packets.size);
+  g_free(frame->packets.first_iov);
+  g_free(frame->packets.iov);
+  g_free(frame);
+}
+
+static void
+paced_destination_free(gpointer data)
+{
+  PacedDestination *dest = data;
+  g_queue_clear_full(&dest->frames, (GDestroyNotify) paced_frame_unref);
+  g_cond_clear(&dest->cond);
+  g_mutex_clear(&dest->lock);
+  g_free(dest->host);
+  g_free(dest);
+}
+
+// Maps the memories of all buffers once; header and payload of a packet go out as two iovecs without a copy
+static PacedFrame *
+paced_frame_new(GstBuffer **buffers, guint n)
+{
+  PacedFrame *frame = g_new0(PacedFrame, 1);
+  frame->refcount = 1;
+  frame->n = n;
+  frame->buffers = g_new(GstBuffer *, n);
+  frame->duration = GST_BUFFER_DURATION(buffers[0]);
+
+  guint n_iov = 0;
+  for (guint i = 0; i < n; i++) {
+    frame->buffers[i] = gst_buffer_ref(buffers[i]);
+    n_iov += gst_buffer_n_memory(buffers[i]);
+  }
+  frame->packets.iov = g_new(struct iovec, n_iov);
+  frame->packets.first_iov = g_new(guint, n + 1);
+  frame->packets.size = g_new0(gsize, n);
+  frame->maps = g_new(GstMapInfo, n_iov);
+
+  guint k = 0;
+  for (guint i = 0; i < n; i++) {
+    frame->packets.first_iov[i] = k;
+    for (guint m = 0; m < gst_buffer_n_memory(buffers[i]); m++) {
+      GstMemory *memory = gst_buffer_peek_memory(buffers[i], m);
+      if (!gst_memory_map(memory, &frame->maps[k], GST_MAP_READ))
+        continue;
+      frame->packets.iov[k].iov_base = frame->maps[k].data;
+      frame->packets.iov[k].iov_len = frame->maps[k].size;
+      frame->packets.size[i] += frame->maps[k].size;
+      k++;
+    }
+  }
+  frame->packets.first_iov[n] = k;
+  frame->n_maps = k;
+  return frame;
+}
+
+static gboolean
+gst_paced_udp_sink_open_destination(GstPacedUdpSink *self, PacedDestination *dest)
+{
+  if (!gst_paced_udp_sink_resolve(dest->host, dest->port, &dest->addr, &dest->addr_len)) {
+    GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("Could not resolve host %s", dest->host), (NULL));
+    return FALSE;
+  }
+
+  dest->fd = socket(dest->addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (dest->fd < 0) {
+    GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Could not create socket"), ("%s", g_strerror(errno)));
+    return FALSE;
+  }
+  if (self->buffer_size > 0)
+    setsockopt(dest->fd, SOL_SOCKET, SO_SNDBUF, &self->buffer_size, sizeof(self->buffer_size));
+
+  dest->active_pacing = self->pacing;
+  if (dest->active_pacing == GST_PACED_UDP_PACING_TXTIME) {
+    struct sock_txtime txtime = {.clockid = CLOCK_MONOTONIC, .flags = 0};
+    if (setsockopt(dest->fd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0) {
+      g_warning("pacedudpsink: SO_TXTIME not supported (%s), pacing with sleeps", g_strerror(errno));
+      dest->active_pacing = GST_PACED_UDP_PACING_SLEEP;
+    }
+  }
+
+  // Segment size 0 only enables per-call UDP_SEGMENT cmsgs, it tells whether the kernel has GSO
+  dest->active_gso = self->gso;
+  if (dest->active_gso) {
+    int segment = 0;
+    if (setsockopt(dest->fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) < 0) {
+      g_warning("pacedudpsink: UDP GSO not supported (%s), sending single packets", g_strerror(errno));
+      dest->active_gso = FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// "host:port,host:port" (IPv6 as [addr]:port) -> destinations appended to array
+static gboolean
+gst_paced_udp_sink_parse_destinations(const gchar *list, GPtrArray *array)
+{
+  if (!list || !*list)
+    return TRUE;
+
+  gchar **entries = g_strsplit(list, ",", -1);
+  gboolean ok = TRUE;
+  for (gchar **entry = entries; *entry && ok; entry++) {
+    gchar *item = g_strstrip(*entry);
+    gchar *colon = strrchr(item, ':');
+    gchar *end = NULL;
+    gint64 port = colon ? g_ascii_strtoll(colon + 1, &end, 10) : 0;
+    if (!colon || colon == item || !end || *end || port <= 0 || port > 65535) {
+      ok = FALSE;
+      break;
+    }
+    *colon = '\0';
+    gsize length = strlen(item);
+    if (item[0] == '[' && length > 2 && item[length - 1] == ']') {
+      item[length - 1] = '\0';
+      item++;
+    }
+    g_ptr_array_add(array, paced_destination_new(item, (gint) port));
+  }
+  g_strfreev(entries);
+  return ok;
+}
+
+static gpointer gst_paced_udp_sink_sender_thread(gpointer data);
+
+typedef struct {
+  GstPacedUdpSink *sink;
+  PacedDestination *dest;
+} PacedSender;
+
+static gboolean
+gst_paced_udp_sink_start(GstBaseSink *sink)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(sink);
+  GPtrArray *destinations = g_ptr_array_new_with_free_func(paced_destination_free);
+
+  GST_OBJECT_LOCK(self);
+  g_ptr_array_add(destinations, paced_destination_new(self->host, self->port));
+  gboolean parsed = gst_paced_udp_sink_parse_destinations(self->extra_destinations, destinations);
+  gchar *extra = g_strdup(self->extra_destinations);
+  GST_OBJECT_UNLOCK(self);
+  if (!parsed) {
+    GST_ELEMENT_ERROR(self, RESOURCE, SETTINGS, ("Invalid extra-destinations \"%s\"", extra),
+        ("expected host:port[,host:port...]"));
+    g_free(extra);
+    g_ptr_array_unref(destinations);
+    return FALSE;
+  }
+  g_free(extra);
+
+  for (guint i = 0; i < destinations->len; i++) {
+    if (!gst_paced_udp_sink_open_destination(self, g_ptr_array_index(destinations, i))) {
+      for (guint j = 0; j <= i; j++) {
+        PacedDestination *dest = g_ptr_array_index(destinations, j);
+        if (dest->fd >= 0)
+          close(dest->fd);
+      }
+      g_ptr_array_unref(destinations);
+      return FALSE;
+    }
+  }
+
+  GST_OBJECT_LOCK(self);
+  if (self->destinations)
+    g_ptr_array_unref(self->destinations);
+  self->destinations = destinations;
+  self->fan_out = destinations->len > 1;
+  GST_OBJECT_UNLOCK(self);
+  self->flushing = FALSE;
+
+  if (self->fan_out) {
+    for (guint i = 0; i < destinations->len; i++) {
+      PacedDestination *dest = g_ptr_array_index(destinations, i);
+      PacedSender *sender = g_new(PacedSender, 1);
+      sender->sink = self;
+      sender->dest = dest;
+      gchar *name = g_strdup_printf("pacedudp-%u", i);
+      dest->thread = g_thread_new(name, gst_paced_udp_sink_sender_thread, sender);
+      g_free(name);
+    }
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_paced_udp_sink_stop(GstBaseSink *sink)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(sink);
+
+  // The destinations stay until the next start so their counters can still be read
+  for (guint i = 0; self->destinations && i < self->destinations->len; i++) {
+    PacedDestination *dest = g_ptr_array_index(self->destinations, i);
+    if (dest->thread) {
+      g_mutex_lock(&dest->lock);
+      g_atomic_int_set(&dest->stopping, TRUE);
+      g_cond_signal(&dest->cond);
+      g_mutex_unlock(&dest->lock);
+      g_thread_join(dest->thread);
+      dest->thread = NULL;
+    }
+    g_queue_clear_full(&dest->frames, (GDestroyNotify) paced_frame_unref);
+    if (dest->fd >= 0) {
+      close(dest->fd);
+      dest->fd = -1;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_paced_udp_sink_unlock(GstBaseSink *sink)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(sink);
+  g_atomic_int_set(&self->flushing, TRUE);
+
+  // Frames still queued for a destination are stale after a flush
+  for (guint i = 0; self->fan_out && self->destinations && i < self->destinations->len; i++) {
+    PacedDestination *dest = g_ptr_array_index(self->destinations, i);
+    g_mutex_lock(&dest->lock);
+    g_queue_clear_full(&dest->frames, (GDestroyNotify) paced_frame_unref);
+    g_mutex_unlock(&dest->lock);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_paced_udp_sink_unlock_stop(GstBaseSink *sink)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(sink);
+  g_atomic_int_set(&self->flushing, FALSE);
+  return TRUE;
+}
+
+// Fills the control data of one send: UDP_SEGMENT when it carries several packets, SCM_TXTIME when paced
+static void
+gst_paced_udp_sink_set_control(struct msghdr *hdr, guint8 *control, guint16 segment_size, guint64 txtime)
+{
+  hdr->msg_control = control;
+  hdr->msg_controllen = CONTROL_SPACE;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+  gsize used = 0;
+
+  if (segment_size) {
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(guint16));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    used += CMSG_SPACE(sizeof(guint16));
+    cmsg = CMSG_NXTHDR(hdr, cmsg);
+  }
+  if (txtime) {
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(guint64));
+    memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+    used += CMSG_SPACE(sizeof(guint64));
+  }
+
+  hdr->msg_controllen = used;
+  if (!used)
+    hdr->msg_control = NULL;
+}
+
+/*
+ * Sends packets [first, last) of one frame to one destination. Consecutive
+ * packets of the same size form one GSO send (only the last segment may be
+ * shorter); each send gets a launch time evenly spaced over span_ns starting
+ * at start_ns.
+ */
+static void
+gst_paced_udp_sink_send(GstPacedUdpSink *self, PacedDestination *dest, const PacedPackets *packets, guint first,
+    guint last, guint64 start_ns, guint64 span_ns)
+{
+  guint n = last - first;
+  guint *chunk_first = g_new(guint, n + 1);
+  guint chunks = 0;
+  gboolean gso = dest->active_gso;
+
+  for (guint i = first; i < last;) {
+    guint j = i + 1;
+    if (gso) {
+      gsize segment = packets->size[i];
+      gsize total = segment;
+      while (j < last && j - i < self->gso_segments && packets->size[j] <= segment &&
+             total + packets->size[j] <= MAX_GSO_BYTES) {
+        total += packets->size[j];
+        if (packets->size[j++] < segment)
+          break;
+      }
+    }
+    chunk_first[chunks++] = i;
+    i = j;
+  }
+  chunk_first[chunks] = last;
+
+  GST_OBJECT_LOCK(self);
+  struct sockaddr_storage addr = dest->addr;
+  socklen_t addr_len = dest->addr_len;
+  GST_OBJECT_UNLOCK(self);
+
+  struct mmsghdr *messages = g_new0(struct mmsghdr, chunks);
+  guint8 *control = g_malloc0(chunks * CONTROL_SPACE);
+  guint64 *launch = g_new(guint64, chunks);
+  for (guint c = 0; c < chunks; c++) {
+    guint packet = chunk_first[c];
+    guint packet_end = chunk_first[c + 1];
+    struct msghdr *hdr = &messages[c].msg_hdr;
+    hdr->msg_name = &addr;
+    hdr->msg_namelen = addr_len;
+    hdr->msg_iov = &packets->iov[packets->first_iov[packet]];
+    hdr->msg_iovlen = packets->first_iov[packet_end] - packets->first_iov[packet];
+    launch[c] = span_ns ? start_ns + span_ns * c / chunks : 0;
+    guint16 segment_size = packet_end - packet > 1 ? (guint16) packets->size[packet] : 0;
+    guint64 txtime = dest->active_pacing == GST_PACED_UDP_PACING_TXTIME ? launch[c] : 0;
+    gst_paced_udp_sink_set_control(hdr, control + c * CONTROL_SPACE, segment_size, txtime);
+  }
+
+  guint sent = 0;
+  guint64 calls = 0, errors = 0, bytes = 0;
+  while (sent < chunks && !g_atomic_int_get(&self->flushing) && !g_atomic_int_get(&dest->stopping)) {
+    int result;
+    if (dest->active_pacing == GST_PACED_UDP_PACING_SLEEP) {
+      if (launch[sent]) {
+        struct timespec at = {.tv_sec = launch[sent] / GST_SECOND, .tv_nsec = launch[sent] % GST_SECOND};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR) {
+        }
+      }
+      ssize_t length = sendmsg(dest->fd, &messages[sent].msg_hdr, 0);
+      messages[sent].msg_len = length < 0 ? 0 : (unsigned int) length;
+      result = length < 0 ? -1 : 1;
+    } else {
+      result = sendmmsg(dest->fd, &messages[sent], chunks - sent, 0);
+    }
+    calls++;
+
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      // GSO needs checksum offload on the egress device, resend the rest without it
+      if ((errno == EIO || errno == EINVAL) && gso && chunk_first[sent + 1] - chunk_first[sent] > 1) {
+        g_warning("pacedudpsink: GSO send to %s:%d failed (%s), disabling GSO", dest->host, dest->port,
+            g_strerror(errno));
+        dest->active_gso = FALSE;
+        guint64 resend_start = launch[sent] ? launch[sent] : start_ns;
+        guint64 resend_span = span_ns ? start_ns + span_ns - resend_start : 0;
+        gst_paced_udp_sink_send(self, dest, packets, chunk_first[sent], last, resend_start, resend_span);
+        break;
+      }
+      GST_DEBUG_OBJECT(self, "send to %s:%d failed: %s", dest->host, dest->port, g_strerror(errno));
+      errors += chunk_first[sent + 1] - chunk_first[sent];
+      sent++;
+      continue;
+    }
+    for (int k = 0; k < result; k++)
+      bytes += messages[sent + k].msg_len;
+    sent += result;
+  }
+
+  GST_OBJECT_LOCK(self);
+  dest->packets_sent += chunk_first[sent] - first - errors;
+  dest->bytes_sent += bytes;
+  dest->send_calls += calls;
+  dest->send_errors += errors;
+  GST_OBJECT_UNLOCK(self);
+
+  g_free(launch);
+  g_free(control);
+  g_free(messages);
+  g_free(chunk_first);
+}
+
+// Paces one frame for one destination, from the streaming thread or the destination's sender thread
+static void
+gst_paced_udp_sink_send_frame(GstPacedUdpSink *self, PacedDestination *dest, const PacedFrame *frame)
+{
+  guint64 start_ns = 0;
+  guint64 span_ns = 0;
+  if (dest->active_pacing != GST_PACED_UDP_PACING_NONE) {
+    GST_OBJECT_LOCK(self);
+    guint64 frame_duration = self->frame_duration;
+    gdouble fraction = self->pacing_fraction;
+    GST_OBJECT_UNLOCK(self);
+    if (!frame_duration)
+      frame_duration = GST_CLOCK_TIME_IS_VALID(frame->duration) ? frame->duration : FALLBACK_FRAME_DURATION;
+
+    // Frames start where the previous span ended so packets never overtake; a sender more than a
+    // frame behind (stall upstream) starts over from now instead of queueing the backlog
+    guint64 now = gst_paced_udp_sink_now_ns();
+    start_ns = dest->next_tx_ns > now && dest->next_tx_ns - now < frame_duration ? dest->next_tx_ns : now;
+    span_ns = frame->n > 1 ? (guint64) (frame_duration * fraction) : 0;
+    dest->next_tx_ns = start_ns + span_ns;
+    if (!span_ns)
+      span_ns = 1; // single packet: launch time start_ns
+  }
+
+  gst_paced_udp_sink_send(self, dest, &frame->packets, 0, frame->n, start_ns, span_ns);
+}
+
+static gpointer
+gst_paced_udp_sink_sender_thread(gpointer data)
+{
+  PacedSender *sender = data;
+  GstPacedUdpSink *self = sender->sink;
+  PacedDestination *dest = sender->dest;
+  g_free(sender);
+
+  g_mutex_lock(&dest->lock);
+  while (!g_atomic_int_get(&dest->stopping)) {
+    PacedFrame *frame = g_queue_pop_head(&dest->frames);
+    if (!frame) {
+      g_cond_wait(&dest->cond, &dest->lock);
+      continue;
+    }
+    g_mutex_unlock(&dest->lock);
+    gst_paced_udp_sink_send_frame(self, dest, frame);
+    paced_frame_unref(frame);
+    g_mutex_lock(&dest->lock);
+  }
+  g_mutex_unlock(&dest->lock);
+  return NULL;
+}
+
+static GstFlowReturn
+gst_paced_udp_sink_render_buffers(GstPacedUdpSink *self, GstBuffer **buffers, guint n)
+{
+  PacedFrame *frame = paced_frame_new(buffers, n);
+
+  if (!self->fan_out) {
+    gst_paced_udp_sink_send_frame(self, g_ptr_array_index(self->destinations, 0), frame);
+    paced_frame_unref(frame);
+    return GST_FLOW_OK;
+  }
+
+  // Never waits for a destination: a full queue drops the frame for that destination only
+  guint queue_frames = self->queue_frames;
+  for (guint i = 0; i < self->destinations->len; i++) {
+    PacedDestination *dest = g_ptr_array_index(self->destinations, i);
+    gboolean dropped = FALSE;
+    g_mutex_lock(&dest->lock);
+    if (g_queue_get_length(&dest->frames) < queue_frames) {
+      g_queue_push_tail(&dest->frames, paced_frame_ref(frame));
+      g_cond_signal(&dest->cond);
+    } else {
+      dropped = TRUE;
+    }
+    g_mutex_unlock(&dest->lock);
+
+    if (dropped) {
+      GST_OBJECT_LOCK(self);
+      dest->frames_dropped++;
+      GST_OBJECT_UNLOCK(self);
+      GST_DEBUG_OBJECT(self, "%s:%d is %u frames behind, dropping a frame", dest->host, dest->port, queue_frames);
+    }
+  }
+  paced_frame_unref(frame);
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_paced_udp_sink_render(GstBaseSink *sink, GstBuffer *buffer)
+{
+  return gst_paced_udp_sink_render_buffers(GST_PACED_UDP_SINK(sink), &buffer, 1);
+}
+
+static GstFlowReturn
+gst_paced_udp_sink_render_list(GstBaseSink *sink, GstBufferList *list)
+{
+  guint n = gst_buffer_list_length(list);
+  if (!n)
+    return GST_FLOW_OK;
+
+  GstBuffer **buffers = g_new(GstBuffer *, n);
+  for (guint i = 0; i < n; i++)
+    buffers[i] = gst_buffer_list_get(list, i);
+  GstFlowReturn ret = gst_paced_udp_sink_render_buffers(GST_PACED_UDP_SINK(sink), buffers, n);
+  g_free(buffers);
+  return ret;
+}
+
+// Sum of one counter over all destinations, object lock held
+static guint64
+gst_paced_udp_sink_total(GstPacedUdpSink *self, gsize offset)
+{
+  guint64 total = 0;
+  for (guint i = 0; self->destinations && i < self->destinations->len; i++)
+    total += G_STRUCT_MEMBER(guint64, g_ptr_array_index(self->destinations, i), offset);
+  return total;
+}
+
+// destination-stats: one "destination" structure per destination, object lock held
+static GstStructure *
+gst_paced_udp_sink_destination_stats(GstPacedUdpSink *self)
+{
+  GstStructure *stats = gst_structure_new("application/x-paced-udp-stats",
+      "destinations", G_TYPE_UINT, self->destinations ? self->destinations->len : 0, NULL);
+  for (guint i = 0; self->destinations && i < self->destinations->len; i++) {
+    PacedDestination *dest = g_ptr_array_index(self->destinations, i);
+    g_mutex_lock(&dest->lock);
+    guint queued = g_queue_get_length(&dest->frames);
+    g_mutex_unlock(&dest->lock);
+    GstStructure *entry = gst_structure_new("destination",
+        "host", G_TYPE_STRING, dest->host,
+        "port", G_TYPE_INT, dest->port,
+        "packets-sent", G_TYPE_UINT64, dest->packets_sent,
+        "bytes-sent", G_TYPE_UINT64, dest->bytes_sent,
+        "send-calls", G_TYPE_UINT64, dest->send_calls,
+        "send-errors", G_TYPE_UINT64, dest->send_errors,
+        "frames-dropped", G_TYPE_UINT64, dest->frames_dropped,
+        "frames-queued", G_TYPE_UINT, queued, NULL);
+    gchar *name = g_strdup_printf("destination-%u", i);
+    gst_structure_set(stats, name, GST_TYPE_STRUCTURE, entry, NULL);
+    gst_structure_free(entry);
+    g_free(name);
+  }
+  return stats;
+}
+
+static void
+gst_paced_udp_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_HOST:
+      g_free(self->host);
+      self->host = g_value_dup_string(value);
+      if (!self->host)
+        self->host = g_strdup(DEFAULT_HOST);
+      break;
+    case PROP_PORT:
+      self->port = g_value_get_int(value);
+      break;
+    case PROP_PACING:
+      self->pacing = g_value_get_enum(value);
+      break;
+    case PROP_GSO:
+      self->gso = g_value_get_boolean(value);
+      break;
+    case PROP_GSO_SEGMENTS:
+      self->gso_segments = g_value_get_uint(value);
+      break;
+    case PROP_FRAME_DURATION:
+      self->frame_duration = g_value_get_uint64(value);
+      break;
+    case PROP_PACING_FRACTION:
+      self->pacing_fraction = g_value_get_double(value);
+      break;
+    case PROP_BUFFER_SIZE:
+      self->buffer_size = g_value_get_int(value);
+      break;
+    case PROP_EXTRA_DESTINATIONS:
+      g_free(self->extra_destinations);
+      self->extra_destinations = g_value_dup_string(value);
+      break;
+    case PROP_QUEUE_FRAMES:
+      self->queue_frames = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+
+  // Destination changes while running (set_udp_target) move only the primary destination and take
+  // effect with the next frame; extra destinations are fixed until the next start
+  PacedDestination *primary = self->destinations ? g_ptr_array_index(self->destinations, 0) : NULL;
+  GPtrArray *running = NULL;
+  gchar *host = NULL;
+  gint port = 0;
+  if ((prop_id == PROP_HOST || prop_id == PROP_PORT) && primary && primary->fd >= 0) {
+    running = g_ptr_array_ref(self->destinations);
+    host = g_strdup(self->host);
+    port = self->port;
+  }
+  GST_OBJECT_UNLOCK(self);
+  if (!running)
+    return;
+
+  // getaddrinfo can block on DNS, render takes the object lock for every frame
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  gboolean resolved = gst_paced_udp_sink_resolve(host, port, &addr, &addr_len);
+
+  GST_OBJECT_LOCK(self);
+  primary = g_ptr_array_index(running, 0);
+  gboolean current = self->destinations == running && primary->fd >= 0 && self->port == port &&
+      g_strcmp0(self->host, host) == 0; // otherwise restarted or retargeted again meanwhile
+  gboolean switched = current && resolved && addr.ss_family == primary->addr.ss_family;
+  if (switched) {
+    primary->addr = addr;
+    primary->addr_len = addr_len;
+    g_free(primary->host);
+    primary->host = g_strdup(host);
+    primary->port = port;
+  }
+  GST_OBJECT_UNLOCK(self);
+  if (current && !switched)
+    g_warning("pacedudpsink: cannot switch destination to %s:%d while running", host, port);
+  g_free(host);
+  g_ptr_array_unref(running);
+}
+
+static void
+gst_paced_udp_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_HOST:
+      g_value_set_string(value, self->host);
+      break;
+    case PROP_PORT:
+      g_value_set_int(value, self->port);
+      break;
+    case PROP_PACING:
+      g_value_set_enum(value, self->pacing);
+      break;
+    case PROP_GSO:
+      g_value_set_boolean(value, self->gso);
+      break;
+    case PROP_GSO_SEGMENTS:
+      g_value_set_uint(value, self->gso_segments);
+      break;
+    case PROP_FRAME_DURATION:
+      g_value_set_uint64(value, self->frame_duration);
+      break;
+    case PROP_PACING_FRACTION:
+      g_value_set_double(value, self->pacing_fraction);
+      break;
+    case PROP_BUFFER_SIZE:
+      g_value_set_int(value, self->buffer_size);
+      break;
+    case PROP_EXTRA_DESTINATIONS:
+      g_value_set_string(value, self->extra_destinations);
+      break;
+    case PROP_QUEUE_FRAMES:
+      g_value_set_uint(value, self->queue_frames);
+      break;
+    case PROP_PACKETS_SENT:
+      g_value_set_uint64(value, gst_paced_udp_sink_total(self, G_STRUCT_OFFSET(PacedDestination, packets_sent)));
+      break;
+    case PROP_BYTES_SENT:
+      g_value_set_uint64(value, gst_paced_udp_sink_total(self, G_STRUCT_OFFSET(PacedDestination, bytes_sent)));
+      break;
+    case PROP_SEND_CALLS:
+      g_value_set_uint64(value, gst_paced_udp_sink_total(self, G_STRUCT_OFFSET(PacedDestination, send_calls)));
+      break;
+    case PROP_SEND_ERRORS:
+      g_value_set_uint64(value, gst_paced_udp_sink_total(self, G_STRUCT_OFFSET(PacedDestination, send_errors)));
+      break;
+    case PROP_FRAMES_DROPPED:
+      g_value_set_uint64(value, gst_paced_udp_sink_total(self, G_STRUCT_OFFSET(PacedDestination, frames_dropped)));
+      break;
+    case PROP_DESTINATION_STATS:
+      g_value_take_boxed(value, gst_paced_udp_sink_destination_stats(self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_paced_udp_sink_finalize(GObject *object)
+{
+  GstPacedUdpSink *self = GST_PACED_UDP_SINK(object);
+
+  g_free(self->host);
+  g_free(self->extra_destinations);
+  if (self->destinations)
+    g_ptr_array_unref(self->destinations);
+  G_OBJECT_CLASS(gst_paced_udp_sink_parent_class)->finalize(object);
+}
+
+static void
+gst_paced_udp_sink_class_init(GstPacedUdpSinkClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS(klass);
+
+  gobject_class->set_property = gst_paced_udp_sink_set_property;
+  gobject_class->get_property = gst_paced_udp_sink_get_property;
+  gobject_class->finalize = gst_paced_udp_sink_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_HOST,
+      g_param_spec_string("host", "Host", "Destination host or address",
+          DEFAULT_HOST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PORT,
+      g_param_spec_int("port", "Port", "Destination UDP port",
+          0, 65535, DEFAULT_PORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PACING,
+      g_param_spec_enum("pacing", "Pacing", "How the packets of a frame are spread over the frame interval",
+          GST_TYPE_PACED_UDP_PACING, DEFAULT_PACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_GSO,
+      g_param_spec_boolean("gso", "GSO", "Batch same-size packets into UDP_SEGMENT sends",
+          DEFAULT_GSO, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_GSO_SEGMENTS,
+      g_param_spec_uint("gso-segments", "GSO segments", "Maximum packets per GSO send",
+          1, MAX_GSO_SEGMENTS, DEFAULT_GSO_SEGMENTS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAME_DURATION,
+      g_param_spec_uint64("frame-duration", "Frame duration",
+          "Frame interval in ns the packets are paced over (0 = buffer duration, 1/30 s if unset)",
+          0, G_MAXUINT64, DEFAULT_FRAME_DURATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PACING_FRACTION,
+      g_param_spec_double("pacing-fraction", "Pacing fraction",
+          "Part of the frame interval a frame's packets are spread over",
+          0.0, 1.0, DEFAULT_PACING_FRACTION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_BUFFER_SIZE,
+      g_param_spec_int("buffer-size", "Buffer size", "Socket send buffer size (0 = system default)",
+          0, G_MAXINT, DEFAULT_BUFFER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PACKETS_SENT,
+      g_param_spec_uint64("packets-sent", "Packets sent", "Packets handed to the kernel",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_BYTES_SENT,
+      g_param_spec_uint64("bytes-sent", "Bytes sent", "Payload bytes handed to the kernel",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_SEND_CALLS,
+      g_param_spec_uint64("send-calls", "Send calls", "sendmsg / sendmmsg system calls",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_SEND_ERRORS,
+      g_param_spec_uint64("send-errors", "Send errors", "Packets the kernel refused",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_EXTRA_DESTINATIONS,
+      g_param_spec_string("extra-destinations", "Extra destinations",
+          "More receivers of the same packets, host:port[,host:port...] (applied on start)",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_QUEUE_FRAMES,
+      g_param_spec_uint("queue-frames", "Queue frames",
+          "Frames a destination may fall behind before frames are dropped for it (extra-destinations only)",
+          1, 1000, DEFAULT_QUEUE_FRAMES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_DROPPED,
+      g_param_spec_uint64("frames-dropped", "Frames dropped",
+          "Frames not sent to a destination because its queue was full, all destinations",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_DESTINATION_STATS,
+      g_param_spec_boxed("destination-stats", "Destination stats",
+          "Counters of every destination (destination-<i> structures, 0 is host:port)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_new_any();
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Paced UDP sink",
+    "Sink/Network",
+    "Sends RTP packets over UDP to one or more receivers, spreading each frame over the frame interval (SO_TXTIME / fq) with optional UDP GSO",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_sink_class->start = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_stop);
+  base_sink_class->unlock = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_unlock);
+  base_sink_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_unlock_stop);
+  base_sink_class->render = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_render);
+  base_sink_class->render_list = GST_DEBUG_FUNCPTR(gst_paced_udp_sink_render_list);
+}
+
+static void
+gst_paced_udp_sink_init(GstPacedUdpSink *self)
+{
+  self->host = g_strdup(DEFAULT_HOST);
+  self->port = DEFAULT_PORT;
+  self->pacing = DEFAULT_PACING;
+  self->gso = DEFAULT_GSO;
+  self->gso_segments = DEFAULT_GSO_SEGMENTS;
+  self->frame_duration = DEFAULT_FRAME_DURATION;
+  self->pacing_fraction = DEFAULT_PACING_FRACTION;
+  self->buffer_size = DEFAULT_BUFFER_SIZE;
+  self->queue_frames = DEFAULT_QUEUE_FRAMES;
+  gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
@@ -0,0 +1,23 @@
+#ifndef __GST_PACED_UDP_SINK_H__
+#define __GST_PACED_UDP_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PACED_UDP_SINK   (gst_paced_udp_sink_get_type())
+G_DECLARE_FINAL_TYPE(GstPacedUdpSink, gst_paced_udp_sink, GST, PACED_UDP_SINK, GstBaseSink)
+
+#define GST_TYPE_PACED_UDP_PACING (gst_paced_udp_pacing_get_type())
+GType gst_paced_udp_pacing_get_type(void);
+
+typedef enum {
+  GST_PACED_UDP_PACING_NONE,    // send as fast as possible (udpsink behaviour)
+  GST_PACED_UDP_PACING_TXTIME,  // SO_TXTIME launch times, enforced by the fq qdisc
+  GST_PACED_UDP_PACING_SLEEP,   // sender thread sleeps between sends (no fq needed)
+} GstPacedUdpPacing;
+
+G_END_DECLS
+
+#endif /* __GST_PACED_UDP_SINK_H__ */
@@ -0,0 +1,830 @@
+#define PACKAGE "rawcapturebypass"
+#include "gstpolicyqueue.h"
+
+/*
+ * policyqueue: a queue (own streaming thread on the src pad) that decides
+ * what to lose when it is full, so a slow encoder or network costs counted
+ * frames instead of backing pressure into the frontend's fixed buffer pools.
+ *
+ * The queue is full when the next buffer would exceed max-size-buffers,
+ * max-size-bytes or max-size-time (running time between the oldest and the
+ * newest queued buffer); 0 disables a limit. Events are queued in order but
+ * never count and are never dropped. What happens then is the policy:
+ *   block             wait for room, like queue leaky=no (blocked, blocked-us)
+ *   drop-oldest       drop the oldest buffer; dropped raw frames go back to
+ *                     their pool right away
+ *   drop-new          drop the incoming buffer
+ *   drop-to-keyframe  drop everything queued before the newest keyframe; with
+ *                     no newer keyframe queued, drop the incoming buffers up
+ *                     to the next keyframe, which then replaces the backlog.
+ *                     Catches up a late encoded stream in one step.
+ *
+ * Encoded streams (caps other than video/x-raw, audio/x-raw) are dropped so
+ * that what leaves the queue still decodes: once a buffer is dropped, the
+ * delta units after it (DELTA_UNIT flag) go too, queued or still to come, up
+ * to the next keyframe (dropped-dependent). With protect-keyframes the
+ * drop-oldest / drop-new policies never drop an encoded keyframe: they drop
+ * the oldest delta unit instead and only wait when nothing but keyframes is
+ * queued. drop-to-keyframe only drops a keyframe that a newer one replaces.
+ * Raw frames have no dependencies, every one is droppable.
+ *
+ * stats counts the buffers dropped per reason (dropped-oldest, dropped-new,
+ * dropped-to-keyframe, dropped-dependent), how often each limit was hit
+ * (over-buffers, over-bytes, over-time), the level and the time buffers spent
+ * in the queue (residence-avg-us / residence-max-us), which is the latency
+ * the queue adds and stays bounded by the limits with any drop policy.
+ * current-level-buffers / -bytes / -time are read-only like on queue.
+ */
+
+#define DEFAULT_MAX_SIZE_BUFFERS 5
+#define DEFAULT_MAX_SIZE_BYTES 0
+#define DEFAULT_MAX_SIZE_TIME 0
+#define DEFAULT_POLICY GST_POLICY_QUEUE_DROP_OLDEST
+#define DEFAULT_PROTECT_KEYFRAMES TRUE
+
+enum {
+  PROP_0,
+  PROP_MAX_SIZE_BUFFERS,
+  PROP_MAX_SIZE_BYTES,
+  PROP_MAX_SIZE_TIME,
+  PROP_POLICY,
+  PROP_PROTECT_KEYFRAMES,
+  PROP_CURRENT_LEVEL_BUFFERS,
+  PROP_CURRENT_LEVEL_BYTES,
+  PROP_CURRENT_LEVEL_TIME,
+  PROP_STATS,
+};
+
+// Limits a buffer would exceed
+#define OVER_BUFFERS (1 << 0)
+#define OVER_BYTES   (1 << 1)
+#define OVER_TIME    (1 << 2)
+
+typedef enum {
+  DROP_OLDEST,
+  DROP_NEW,
+  DROP_TO_KEYFRAME,
+  DROP_DEPENDENT,
+} DropReason;
+
+typedef enum {
+  ROOM_MADE,         // something queued was dropped, check again
+  INCOMING_DROPPED,
+  MUST_WAIT,
+} RoomResult;
+
+typedef struct {
+  GstMiniObject *object;  // GstBuffer or serialized GstEvent
+  gboolean keyframe;      // buffer a decoder can start at (any raw buffer)
+  gsize size;
+  GstClockTime running_time;
+  gint64 enqueue_us;
+} PolicyQueueItem;
+
+struct _GstPolicyQueue {
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  // Everything below, properties included, is protected by lock
+  GMutex lock;
+  GCond item_added;
+  GCond item_removed;
+
+  guint max_buffers;
+  guint64 max_bytes;
+  GstClockTime max_time;
+  GstPolicyQueuePolicy policy;
+  gboolean protect_keyframes;
+
+  GQueue items;            // PolicyQueueItem, oldest first
+  guint level_buffers;
+  guint64 level_bytes;
+  GstFlowReturn srcresult; // FLUSHING while flushing / inactive
+  gboolean eos;
+  gboolean encoded;
+  gboolean dropping;       // a reference was dropped, drop delta units up to the next keyframe
+  GstSegment sink_segment;
+
+  // Stats
+  guint64 buffers_in;
+  guint64 buffers_out;
+  guint64 dropped[DROP_DEPENDENT + 1];
+  guint64 bytes_dropped;
+  guint64 over_buffers;
+  guint64 over_bytes;
+  guint64 over_time;
+  guint64 blocked;
+  guint64 blocked_us;
+  guint level_buffers_max;
+  guint64 residence_total_us;
+  guint64 residence_max_us;
+};
+
+G_DEFINE_TYPE(GstPolicyQueue, gst_policy_queue, GST_TYPE_ELEMENT)
+
+static GstStaticPadTemplate sink_template =
+    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+static GstStaticPadTemplate src_template =
+    GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+GType
+gst_policy_queue_policy_get_type(void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_POLICY_QUEUE_BLOCK, "Wait for room", "block"},
+    {GST_POLICY_QUEUE_DROP_OLDEST, "Drop the oldest buffer", "drop-oldest"},
+    {GST_POLICY_QUEUE_DROP_NEW, "Drop the incoming buffer", "drop-new"},
+    {GST_POLICY_QUEUE_DROP_TO_KEYFRAME, "Drop the backlog up to the newest keyframe", "drop-to-keyframe"},
+    {0, NULL, NULL},
+  };
+  if (g_once_init_enter(&type)) {
+    GType new_type = g_enum_register_static("GstPolicyQueuePolicy", values);
+    g_once_init_leave(&type, new_type);
+  }
+  return type;
+}
+
+static void
+policy_queue_item_free(PolicyQueueItem *item)
+{
+  if (item->object)
+    gst_mini_object_unref(item->object);
+  g_free(item);
+}
+
+static gboolean
+policy_queue_item_is_buffer(const PolicyQueueItem *item)
+{
+  return GST_IS_BUFFER(item->object);
+}
+
+// Running time between the oldest and the newest queued buffer
+static GstClockTime
+gst_policy_queue_level_time(GstPolicyQueue *self)
+{
+  GstClockTime first = GST_CLOCK_TIME_NONE, last = GST_CLOCK_TIME_NONE;
+  for (GList *l = self->items.head; l && !GST_CLOCK_TIME_IS_VALID(first); l = l->next) {
+    PolicyQueueItem *item = l->data;
+    if (policy_queue_item_is_buffer(item))
+      first = item->running_time;
+  }
+  for (GList *l = self->items.tail; l && !GST_CLOCK_TIME_IS_VALID(last); l = l->prev) {
+    PolicyQueueItem *item = l->data;
+    if (policy_queue_item_is_buffer(item))
+      last = item->running_time;
+  }
+  if (!GST_CLOCK_TIME_IS_VALID(first) || !GST_CLOCK_TIME_IS_VALID(last) || last < first)
+    return 0;
+  return last - first;
+}
+
+static guint
+gst_policy_queue_overrun(GstPolicyQueue *self, const PolicyQueueItem *item)
+{
+  guint over = 0;
+  if (self->level_buffers == 0)
+    return 0;  // a single buffer always fits
+  if (self->max_buffers && self->level_buffers + 1 > self->max_buffers)
+    over |= OVER_BUFFERS;
+  if (self->max_bytes && self->level_bytes + item->size > self->max_bytes)
+    over |= OVER_BYTES;
+  if (self->max_time && GST_CLOCK_TIME_IS_VALID(item->running_time)) {
+    for (GList *l = self->items.head; l; l = l->next) {
+      PolicyQueueItem *oldest = l->data;
+      if (!policy_queue_item_is_buffer(oldest))
+        continue;
+      if (GST_CLOCK_TIME_IS_VALID(oldest->running_time) && item->running_time > oldest->running_time &&
+          item->running_time - oldest->running_time > self->max_time)
+        over |= OVER_TIME;
+      break;
+    }
+  }
+  return over;
+}
+
+static gboolean
+gst_policy_queue_protected(GstPolicyQueue *self, const PolicyQueueItem *item)
+{
+  return self->encoded && self->protect_keyframes && item->keyframe;
+}
+
+static void
+gst_policy_queue_count_drop(GstPolicyQueue *self, const PolicyQueueItem *item, DropReason reason)
+{
+  self->dropped[reason]++;
+  self->bytes_dropped += item->size;
+}
+
+static void
+gst_policy_queue_unlink(GstPolicyQueue *self, GList *link)
+{
+  PolicyQueueItem *item = link->data;
+  if (policy_queue_item_is_buffer(item)) {
+    self->level_buffers--;
+    self->level_bytes -= item->size;
+  }
+  g_queue_delete_link(&self->items, link);
+}
+
+// Drops the queued buffer at link; on an encoded stream also the delta units
+// depending on it, up to the next keyframe (queued or still to come)
+static void
+gst_policy_queue_drop_link(GstPolicyQueue *self, GList *link, DropReason reason)
+{
+  PolicyQueueItem *item = link->data;
+  GList *next = link->next;
+  gst_policy_queue_count_drop(self, item, reason);
+  gst_policy_queue_unlink(self, link);
+  policy_queue_item_free(item);
+  if (!self->encoded)
+    return;
+
+  while (next) {
+    PolicyQueueItem *dependent = next->data;
+    GList *after = next->next;
+    if (policy_queue_item_is_buffer(dependent)) {
+      if (dependent->keyframe)
+        return;
+      gst_policy_queue_count_drop(self, dependent, DROP_DEPENDENT);
+      gst_policy_queue_unlink(self, next);
+      policy_queue_item_free(dependent);
+    }
+    next = after;
+  }
+  self->dropping = TRUE;
+}
+
+// Oldest queued buffer the policy may drop, NULL if all are protected keyframes
+static GList *
+gst_policy_queue_oldest_droppable(GstPolicyQueue *self)
+{
+  for (GList *l = self->items.head; l; l = l->next) {
+    PolicyQueueItem *item = l->data;
+    if (policy_queue_item_is_buffer(item) && !gst_policy_queue_protected(self, item))
+      return l;
+  }
+  return NULL;
+}
+
+static RoomResult
+gst_policy_queue_make_room(GstPolicyQueue *self, PolicyQueueItem *incoming)
+{
+  GList *link;
+
+  switch (self->policy) {
+    case GST_POLICY_QUEUE_BLOCK:
+      return MUST_WAIT;
+
+    case GST_POLICY_QUEUE_DROP_OLDEST:
+      if ((link = gst_policy_queue_oldest_droppable(self))) {
+        gst_policy_queue_drop_link(self, link, DROP_OLDEST);
+        return ROOM_MADE;
+      }
+      if (gst_policy_queue_protected(self, incoming))
+        return MUST_WAIT;
+      // Only protected keyframes queued: the incoming delta unit goes instead
+      gst_policy_queue_count_drop(self, incoming, DROP_NEW);
+      self->dropping = self->encoded;
+      return INCOMING_DROPPED;
+
+    case GST_POLICY_QUEUE_DROP_NEW:
+      if (!gst_policy_queue_protected(self, incoming)) {
+        gst_policy_queue_count_drop(self, incoming, DROP_NEW);
+        self->dropping = self->encoded;
+        return INCOMING_DROPPED;
+      }
+      if ((link = gst_policy_queue_oldest_droppable(self))) {
+        gst_policy_queue_drop_link(self, link, DROP_OLDEST);
+        return ROOM_MADE;
+      }
+      return MUST_WAIT;
+
+    case GST_POLICY_QUEUE_DROP_TO_KEYFRAME: {
+      // Newest queued keyframe with buffers before it
+      GList *keyframe = NULL;
+      gboolean older = FALSE;
+      for (link = self->items.tail; link; link = link->prev) {
+        PolicyQueueItem *item = link->data;
+        if (!policy_queue_item_is_buffer(item))
+          continue;
+        if (keyframe) {
+          older = TRUE;
+          break;
+        }
+        if (item->keyframe)
+          keyframe = link;
+      }
+      if (!older && !incoming->keyframe) {
+        gst_policy_queue_count_drop(self, incoming, DROP_TO_KEYFRAME);
+        self->dropping = self->encoded;
+        return INCOMING_DROPPED;
+      }
+      // Everything before the newest keyframe, or the whole backlog for an incoming keyframe
+      GList *stop = older ? keyframe : NULL;
+      for (link = self->items.head; link != stop;) {
+        GList *next = link->next;
+        PolicyQueueItem *item = link->data;
+        if (policy_queue_item_is_buffer(item)) {
+          gst_policy_queue_count_drop(self, item, DROP_TO_KEYFRAME);
+          gst_policy_queue_unlink(self, link);
+          policy_queue_item_free(item);
+        }
+        link = next;
+      }
+      return ROOM_MADE;
+    }
+  }
+  return MUST_WAIT;
+}
+
+static GstFlowReturn
+gst_policy_queue_chain(GstPad *pad, GstObject *parent, GstBuffer *buf)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+  GstFlowReturn ret = GST_FLOW_OK;
+  gint64 wait_start_us = 0;
+
+  PolicyQueueItem *item = g_new0(PolicyQueueItem, 1);
+  item->object = GST_MINI_OBJECT_CAST(buf);
+  item->size = gst_buffer_get_size(buf);
+
+  g_mutex_lock(&self->lock);
+  if (self->srcresult != GST_FLOW_OK || self->eos) {
+    ret = self->eos ? GST_FLOW_EOS : self->srcresult;
+    goto out_drop;
+  }
+  item->keyframe = !self->encoded || !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  if (self->sink_segment.format == GST_FORMAT_TIME)
+    item->running_time = gst_segment_to_running_time(&self->sink_segment, GST_FORMAT_TIME,
+        GST_BUFFER_DTS_OR_PTS(buf));
+  else
+    item->running_time = GST_CLOCK_TIME_NONE;
+  self->buffers_in++;
+
+  guint over = gst_policy_queue_overrun(self, item);
+  self->over_buffers += (over & OVER_BUFFERS) != 0;
+  self->over_bytes += (over & OVER_BYTES) != 0;
+  self->over_time += (over & OVER_TIME) != 0;
+
+  while (TRUE) {
+    if (self->dropping) {
+      if (!item->keyframe) {
+        gst_policy_queue_count_drop(self, item, DROP_DEPENDENT);
+        goto out_drop;
+      }
+      self->dropping = FALSE;
+    }
+    if (!gst_policy_queue_overrun(self, item))
+      break;
+
+    RoomResult room = gst_policy_queue_make_room(self, item);
+    if (room == INCOMING_DROPPED)
+      goto out_drop;
+    if (room == MUST_WAIT) {
+      if (!wait_start_us) {
+        wait_start_us = g_get_monotonic_time();
+        self->blocked++;
+      }
+      g_cond_wait(&self->item_removed, &self->lock);
+      if (self->srcresult != GST_FLOW_OK) {
+        ret = self->srcresult;
+        goto out_drop;
+      }
+    }
+  }
+  if (wait_start_us)
+    self->blocked_us += g_get_monotonic_time() - wait_start_us;
+
+  item->enqueue_us = g_get_monotonic_time();
+  g_queue_push_tail(&self->items, item);
+  self->level_buffers++;
+  self->level_bytes += item->size;
+  self->level_buffers_max = MAX(self->level_buffers_max, self->level_buffers);
+  g_cond_signal(&self->item_added);
+  g_mutex_unlock(&self->lock);
+  return GST_FLOW_OK;
+
+out_drop:
+  if (wait_start_us)
+    self->blocked_us += g_get_monotonic_time() - wait_start_us;
+  g_mutex_unlock(&self->lock);
+  policy_queue_item_free(item);
+  return ret;
+}
+
+static void
+gst_policy_queue_clear(GstPolicyQueue *self)
+{
+  PolicyQueueItem *item;
+  while ((item = g_queue_pop_head(&self->items)))
+    policy_queue_item_free(item);
+  self->level_buffers = 0;
+  self->level_bytes = 0;
+  g_cond_signal(&self->item_removed);
+}
+
+static void
+gst_policy_queue_loop(gpointer user_data)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(user_data);
+
+  g_mutex_lock(&self->lock);
+  while (g_queue_is_empty(&self->items) && self->srcresult == GST_FLOW_OK)
+    g_cond_wait(&self->item_added, &self->lock);
+  if (self->srcresult != GST_FLOW_OK) {
+    g_mutex_unlock(&self->lock);
+    gst_pad_pause_task(self->srcpad);
+    return;
+  }
+
+  PolicyQueueItem *item = g_queue_pop_head(&self->items);
+  GstMiniObject *object = item->object;
+  item->object = NULL;
+  gboolean is_buffer = GST_IS_BUFFER(object);
+  if (is_buffer) {
+    guint64 residence_us = MAX(g_get_monotonic_time() - item->enqueue_us, 0);
+    self->level_buffers--;
+    self->level_bytes -= item->size;
+    self->buffers_out++;
+    self->residence_total_us += residence_us;
+    self->residence_max_us = MAX(self->residence_max_us, residence_us);
+  }
+  policy_queue_item_free(item);
+  g_cond_signal(&self->item_removed);
+  g_mutex_unlock(&self->lock);
+
+  GstFlowReturn ret = GST_FLOW_OK;
+  if (is_buffer) {
+    ret = gst_pad_push(self->srcpad, GST_BUFFER_CAST(object));
+  } else {
+    GstEvent *event = GST_EVENT_CAST(object);
+    gboolean is_eos = GST_EVENT_TYPE(event) == GST_EVENT_EOS;
+    gst_pad_push_event(self->srcpad, event);
+    if (is_eos)
+      ret = GST_FLOW_EOS;
+  }
+  if (ret == GST_FLOW_OK)
+    return;
+
+  g_mutex_lock(&self->lock);
+  if (self->srcresult == GST_FLOW_OK)
+    self->srcresult = ret;
+  g_cond_signal(&self->item_removed);
+  g_mutex_unlock(&self->lock);
+  gst_pad_pause_task(self->srcpad);
+
+  if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+    GST_ELEMENT_FLOW_ERROR(self, ret);
+    gst_pad_push_event(self->srcpad, gst_event_new_eos());
+  }
+}
+
+static gboolean
+gst_policy_queue_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_FLUSH_START:
+      gst_pad_push_event(self->srcpad, event);
+      g_mutex_lock(&self->lock);
+      self->srcresult = GST_FLOW_FLUSHING;
+      g_cond_signal(&self->item_added);
+      g_cond_signal(&self->item_removed);
+      g_mutex_unlock(&self->lock);
+      gst_pad_pause_task(self->srcpad);
+      return TRUE;
+    case GST_EVENT_FLUSH_STOP:
+      gst_pad_push_event(self->srcpad, event);
+      g_mutex_lock(&self->lock);
+      gst_policy_queue_clear(self);
+      self->srcresult = GST_FLOW_OK;
+      self->eos = FALSE;
+      self->dropping = FALSE;
+      g_mutex_unlock(&self->lock);
+      return gst_pad_start_task(self->srcpad, gst_policy_queue_loop, self, NULL);
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED(event))
+    return gst_pad_push_event(self->srcpad, event);
+
+  g_mutex_lock(&self->lock);
+  if (self->srcresult == GST_FLOW_FLUSHING) {
+    g_mutex_unlock(&self->lock);
+    gst_event_unref(event);
+    return FALSE;
+  }
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+    gst_event_parse_caps(event, &caps);
+    const GstStructure *s = gst_caps_get_size(caps) ? gst_caps_get_structure(caps, 0) : NULL;
+    self->encoded = s && !gst_structure_has_name(s, "video/x-raw") && !gst_structure_has_name(s, "audio/x-raw");
+  } else if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+    gst_event_copy_segment(event, &self->sink_segment);
+  } else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+    self->eos = TRUE;
+  }
+  PolicyQueueItem *item = g_new0(PolicyQueueItem, 1);
+  item->object = GST_MINI_OBJECT_CAST(event);
+  item->running_time = GST_CLOCK_TIME_NONE;
+  g_queue_push_tail(&self->items, item);
+  g_cond_signal(&self->item_added);
+  g_mutex_unlock(&self->lock);
+  return TRUE;
+}
+
+static gboolean
+gst_policy_queue_sink_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+
+  if (!GST_QUERY_IS_SERIALIZED(query))
+    return gst_pad_query_default(pad, parent, query);
+
+  // Serialized queries (allocation, drain) must see downstream after the queued data
+  g_mutex_lock(&self->lock);
+  while (!g_queue_is_empty(&self->items) && self->srcresult == GST_FLOW_OK)
+    g_cond_wait(&self->item_removed, &self->lock);
+  gboolean flushing = self->srcresult != GST_FLOW_OK;
+  g_mutex_unlock(&self->lock);
+  if (flushing)
+    return FALSE;
+  return gst_pad_peer_query(self->srcpad, query);
+}
+
+static gboolean
+gst_policy_queue_src_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+
+  if (!gst_pad_query_default(pad, parent, query))
+    return FALSE;
+  if (GST_QUERY_TYPE(query) == GST_QUERY_LATENCY) {
+    // A full queue holds up to max-size-time more, unknown without a time limit
+    gboolean live;
+    GstClockTime min, max;
+    gst_query_parse_latency(query, &live, &min, &max);
+    g_mutex_lock(&self->lock);
+    if (!self->max_time)
+      max = GST_CLOCK_TIME_NONE;
+    else if (GST_CLOCK_TIME_IS_VALID(max))
+      max += self->max_time;
+    g_mutex_unlock(&self->lock);
+    gst_query_set_latency(query, live, min, max);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_policy_queue_sink_activate_mode(GstPad *pad, GstObject *parent, GstPadMode mode, gboolean active)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+  g_mutex_lock(&self->lock);
+  if (active) {
+    self->srcresult = GST_FLOW_OK;
+    self->eos = FALSE;
+    self->dropping = FALSE;
+    gst_segment_init(&self->sink_segment, GST_FORMAT_UNDEFINED);
+  } else {
+    self->srcresult = GST_FLOW_FLUSHING;
+    g_cond_signal(&self->item_removed);
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (!active) {
+    // Wait for a chain call to leave before dropping what is queued
+    GST_PAD_STREAM_LOCK(pad);
+    g_mutex_lock(&self->lock);
+    gst_policy_queue_clear(self);
+    g_mutex_unlock(&self->lock);
+    GST_PAD_STREAM_UNLOCK(pad);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_policy_queue_src_activate_mode(GstPad *pad, GstObject *parent, GstPadMode mode, gboolean active)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+  g_mutex_lock(&self->lock);
+  self->srcresult = active ? GST_FLOW_OK : GST_FLOW_FLUSHING;
+  g_cond_signal(&self->item_added);
+  g_cond_signal(&self->item_removed);
+  g_mutex_unlock(&self->lock);
+
+  if (active)
+    return gst_pad_start_task(pad, gst_policy_queue_loop, self, NULL);
+  return gst_pad_stop_task(pad);
+}
+
+static GstStructure *
+gst_policy_queue_stats(GstPolicyQueue *self)
+{
+  g_mutex_lock(&self->lock);
+  GstStructure *stats = gst_structure_new("application/x-policy-queue-stats",
+      "buffers-in", G_TYPE_UINT64, self->buffers_in,
+      "buffers-out", G_TYPE_UINT64, self->buffers_out,
+      "dropped-oldest", G_TYPE_UINT64, self->dropped[DROP_OLDEST],
+      "dropped-new", G_TYPE_UINT64, self->dropped[DROP_NEW],
+      "dropped-to-keyframe", G_TYPE_UINT64, self->dropped[DROP_TO_KEYFRAME],
+      "dropped-dependent", G_TYPE_UINT64, self->dropped[DROP_DEPENDENT],
+      "bytes-dropped", G_TYPE_UINT64, self->bytes_dropped,
+      "over-buffers", G_TYPE_UINT64, self->over_buffers,
+      "over-bytes", G_TYPE_UINT64, self->over_bytes,
+      "over-time", G_TYPE_UINT64, self->over_time,
+      "blocked", G_TYPE_UINT64, self->blocked,
+      "blocked-us", G_TYPE_UINT64, self->blocked_us,
+      "level-buffers", G_TYPE_UINT, self->level_buffers,
+      "level-buffers-max", G_TYPE_UINT, self->level_buffers_max,
+      "level-bytes", G_TYPE_UINT64, self->level_bytes,
+      "level-time", G_TYPE_UINT64, gst_policy_queue_level_time(self),
+      "residence-avg-us", G_TYPE_UINT64, self->buffers_out ? self->residence_total_us / self->buffers_out : 0,
+      "residence-max-us", G_TYPE_UINT64, self->residence_max_us, NULL);
+  g_mutex_unlock(&self->lock);
+  return stats;
+}
+
+static void
+gst_policy_queue_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(object);
+
+  g_mutex_lock(&self->lock);
+  switch (prop_id) {
+    case PROP_MAX_SIZE_BUFFERS:
+      self->max_buffers = g_value_get_uint(value);
+      break;
+    case PROP_MAX_SIZE_BYTES:
+      self->max_bytes = g_value_get_uint64(value);
+      break;
+    case PROP_MAX_SIZE_TIME:
+      self->max_time = g_value_get_uint64(value);
+      break;
+    case PROP_POLICY:
+      self->policy = g_value_get_enum(value);
+      break;
+    case PROP_PROTECT_KEYFRAMES:
+      self->protect_keyframes = g_value_get_boolean(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  // A waiting chain call re-checks against the new limits
+  g_cond_signal(&self->item_removed);
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+gst_policy_queue_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(object);
+
+  if (prop_id == PROP_STATS) {
+    g_value_take_boxed(value, gst_policy_queue_stats(self));
+    return;
+  }
+
+  g_mutex_lock(&self->lock);
+  switch (prop_id) {
+    case PROP_MAX_SIZE_BUFFERS:
+      g_value_set_uint(value, self->max_buffers);
+      break;
+    case PROP_MAX_SIZE_BYTES:
+      g_value_set_uint64(value, self->max_bytes);
+      break;
+    case PROP_MAX_SIZE_TIME:
+      g_value_set_uint64(value, self->max_time);
+      break;
+    case PROP_POLICY:
+      g_value_set_enum(value, self->policy);
+      break;
+    case PROP_PROTECT_KEYFRAMES:
+      g_value_set_boolean(value, self->protect_keyframes);
+      break;
+    case PROP_CURRENT_LEVEL_BUFFERS:
+      g_value_set_uint(value, self->level_buffers);
+      break;
+    case PROP_CURRENT_LEVEL_BYTES:
+      g_value_set_uint64(value, self->level_bytes);
+      break;
+    case PROP_CURRENT_LEVEL_TIME:
+      g_value_set_uint64(value, gst_policy_queue_level_time(self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+gst_policy_queue_finalize(GObject *object)
+{
+  GstPolicyQueue *self = GST_POLICY_QUEUE(object);
+
+  gst_policy_queue_clear(self);
+  g_cond_clear(&self->item_added);
+  g_cond_clear(&self->item_removed);
+  g_mutex_clear(&self->lock);
+  G_OBJECT_CLASS(gst_policy_queue_parent_class)->finalize(object);
+}
+
+static void
+gst_policy_queue_class_init(GstPolicyQueueClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+  gobject_class->set_property = gst_policy_queue_set_property;
+  gobject_class->get_property = gst_policy_queue_get_property;
+  gobject_class->finalize = gst_policy_queue_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_MAX_SIZE_BUFFERS,
+      g_param_spec_uint("max-size-buffers", "Max size buffers",
+          "Buffers in the queue before the policy applies, 0 = unlimited",
+          0, G_MAXUINT, DEFAULT_MAX_SIZE_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAX_SIZE_BYTES,
+      g_param_spec_uint64("max-size-bytes", "Max size bytes",
+          "Bytes in the queue before the policy applies, 0 = unlimited",
+          0, G_MAXUINT64, DEFAULT_MAX_SIZE_BYTES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAX_SIZE_TIME,
+      g_param_spec_uint64("max-size-time", "Max size time",
+          "Running time between the oldest and the newest buffer before the policy applies (ns), 0 = unlimited",
+          0, G_MAXUINT64, DEFAULT_MAX_SIZE_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_POLICY,
+      g_param_spec_enum("policy", "Policy", "What is dropped when the queue is full",
+          GST_TYPE_POLICY_QUEUE_POLICY, DEFAULT_POLICY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PROTECT_KEYFRAMES,
+      g_param_spec_boolean("protect-keyframes", "Protect keyframes",
+          "Never drop keyframes of an encoded stream with drop-oldest / drop-new",
+          DEFAULT_PROTECT_KEYFRAMES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_CURRENT_LEVEL_BUFFERS,
+      g_param_spec_uint("current-level-buffers", "Current level buffers", "Buffers in the queue",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  // Same names and types as GstQueue, so code reading the level of a queue works with either
+  g_object_class_install_property(gobject_class, PROP_CURRENT_LEVEL_BYTES,
+      g_param_spec_uint64("current-level-bytes", "Current level bytes", "Bytes in the queue",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_CURRENT_LEVEL_TIME,
+      g_param_spec_uint64("current-level-time", "Current level time",
+          "Running time between the oldest and the newest queued buffer (in ns)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Stats",
+          "Drops per reason, limit hits, level and residence time since the element was created",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Drop policy queue",
+    "Generic",
+    "Queue with a drop policy (oldest, new, to keyframe) that keeps encoded streams decodable and counts drops per reason",
+    "Kevin P <your.email@example.com>"
+  );
+}
+
+static void
+gst_policy_queue_init(GstPolicyQueue *self)
+{
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_policy_queue_chain));
+  gst_pad_set_event_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_policy_queue_sink_event));
+  gst_pad_set_query_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_policy_queue_sink_query));
+  gst_pad_set_activatemode_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_policy_queue_sink_activate_mode));
+  GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION(self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  gst_pad_set_query_function(self->srcpad, GST_DEBUG_FUNCPTR(gst_policy_queue_src_query));
+  gst_pad_set_activatemode_function(self->srcpad, GST_DEBUG_FUNCPTR(gst_policy_queue_src_activate_mode));
+  GST_PAD_SET_PROXY_CAPS(self->srcpad);
+  gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+  self->max_buffers = DEFAULT_MAX_SIZE_BUFFERS;
+  self->max_bytes = DEFAULT_MAX_SIZE_BYTES;
+  self->max_time = DEFAULT_MAX_SIZE_TIME;
+  self->policy = DEFAULT_POLICY;
+  self->protect_keyframes = DEFAULT_PROTECT_KEYFRAMES;
+  self->srcresult = GST_FLOW_FLUSHING;
+  g_queue_init(&self->items);
+  gst_segment_init(&self->sink_segment, GST_FORMAT_UNDEFINED);
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->item_added);
+  g_cond_init(&self->item_removed);
+}
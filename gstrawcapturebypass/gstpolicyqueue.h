@@ -0,0 +1,23 @@
+#ifndef __GST_POLICY_QUEUE_H__
+#define __GST_POLICY_QUEUE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_POLICY_QUEUE   (gst_policy_queue_get_type())
+G_DECLARE_FINAL_TYPE(GstPolicyQueue, gst_policy_queue, GST, POLICY_QUEUE, GstElement)
+
+#define GST_TYPE_POLICY_QUEUE_POLICY (gst_policy_queue_policy_get_type())
+GType gst_policy_queue_policy_get_type(void);
+
+typedef enum {
+  GST_POLICY_QUEUE_BLOCK,            // wait for room (queue leaky=no)
+  GST_POLICY_QUEUE_DROP_OLDEST,      // drop the oldest queued buffer (queue leaky=downstream)
+  GST_POLICY_QUEUE_DROP_NEW,         // drop the incoming buffer (queue leaky=upstream)
+  GST_POLICY_QUEUE_DROP_TO_KEYFRAME, // skip the backlog up to the newest keyframe
+} GstPolicyQueuePolicy;
+
+G_END_DECLS
+
+#endif /* __GST_POLICY_QUEUE_H__ */
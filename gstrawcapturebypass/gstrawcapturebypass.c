@@ -1,48 +1,672 @@
 #define PACKAGE "rawcapturebypass"
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+#include <string.h>
+#include "gstpacedudpsink.h"
+#include "gsttimestampsei.h"
+#include "gstmemfdsink.h"
+#include "gstmemfdsrc.h"
+#include "gstsegmentsink.h"
+#include "gstpolicyqueue.h"
+#include "gstdetectionmeta.h"
+#include "gstfakedetections.h"
+#include "gstsharpnessmeter.h"
+#include "motiondetect.h"
 #include <stdio.h>
 #include <unistd.h> // for access() and unlink()
 
 #define GST_TYPE_RAWCAPTUREBYPASS   (gst_rawcapture_bypass_get_type())
 G_DECLARE_FINAL_TYPE(GstRawCaptureBypass, gst_rawcapture_bypass, GST, RAWCAPTUREBYPASS, GstBaseTransform)
 
+/*
+ * Besides captures requested by the application (capture-frames, or the
+ * /tmp/capture_flag file) a frame can capture itself when it carries a
+ * detection of one of trigger-classes with at least trigger-confidence
+ * (gstdetectionmeta.h: region of interest metas, and hailofilter's detections
+ * in a HAVE_HAILO_META build). Only the buffer metadata is scanned, the pixels
+ * are read when a capture fires. A class fires at most once per
+ * trigger-cooldown (running time of the frames); a trigger captures
+ * trigger-burst frames starting with the detection frame and posts a
+ * "rawcapture-trigger" element message with the class, confidence and box.
+ *
+ * Without detection, motion-threshold > 0 captures on motion: every
+ * motion-interval-th frame the luma plane is subsampled (motion-step) and
+ * compared with the previous subsampled plane per tile of a
+ * motion-grid-columns x motion-grid-rows grid (motiondetect.h). When at least
+ * motion-min-tiles tiles have a mean absolute difference above
+ * motion-threshold, a burst is captured like for a detection (class "motion",
+ * same cooldown and burst). The "rawcapture-trigger" message and the
+ * "rawcapture-done" messages of the burst carry the tile map of the trigger:
+ * "tile-map" (one string of 0/1 per grid row, rows separated by '/') and
+ * "tile-levels" (mean absolute difference per tile, row major). The
+ * differencing runs outside the object lock, its cost is in the stats.
+ */
+
+#define DEFAULT_LOCATION "kevin_nv12.raw"
+#define DEFAULT_TRIGGER_CONFIDENCE 0.5
+#define DEFAULT_TRIGGER_COOLDOWN (10 * GST_SECOND)
+#define DEFAULT_TRIGGER_BURST 1
+#define DEFAULT_MOTION_THRESHOLD 0
+#define DEFAULT_MOTION_MIN_TILES 1
+#define DEFAULT_MOTION_GRID_COLUMNS 16
+#define DEFAULT_MOTION_GRID_ROWS 9
+#define DEFAULT_MOTION_STEP 16
+#define DEFAULT_MOTION_INTERVAL 2
+
+enum {
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CAPTURE_FRAMES,
+  PROP_TRIGGER_CLASSES,
+  PROP_TRIGGER_CONFIDENCE,
+  PROP_TRIGGER_COOLDOWN,
+  PROP_TRIGGER_BURST,
+  PROP_MOTION_THRESHOLD,
+  PROP_MOTION_MIN_TILES,
+  PROP_MOTION_GRID_COLUMNS,
+  PROP_MOTION_GRID_ROWS,
+  PROP_MOTION_STEP,
+  PROP_MOTION_INTERVAL,
+  PROP_STATS,
+};
+
+typedef struct {
+  const gchar *label;         // interned
+  GstClockTime last_trigger;  // running time, NONE = never fired
+  // Best detection of the class in the current frame, confidence < 0 = none
+  gdouble confidence;
+  gdouble x, y, width, height;
+} TriggerClass;
+
 struct _GstRawCaptureBypass {
   GstBaseTransform parent;
+
+  // Object lock
+  gchar *location;       // output file, "%u" is replaced by the capture index
+  guint capture_frames;  // frames still to capture, set by the application
+  guint capture_index;
+
+  gchar *trigger_classes;
+  GArray *triggers;      // TriggerClass per class of trigger_classes
+  gdouble trigger_confidence;
+  GstClockTime trigger_cooldown;
+  guint trigger_burst;
+  guint trigger_frames;  // frames of the current burst still to capture
+  const gchar *burst_reason;
+
+  guint motion_threshold;
+  guint motion_min_tiles;
+  guint motion_columns, motion_rows;
+  guint motion_step;
+  guint motion_interval;
+  gboolean motion_reconfigure;  // caps or grid changed, motion must be initialized again
+  guint64 motion_frame;
+  GstClockTime motion_last_trigger;
+  GstStructure *motion_tiles;   // tile map of the last motion trigger, for the captures of its burst
+
+  GstVideoInfo info;
+
+  guint64 frames_scanned;
+  guint64 detections_matched;
+  guint64 triggers_fired;
+  guint64 triggers_suppressed;
+  guint64 frames_captured;
+  guint64 motion_frames;
+  guint64 motion_triggers;
+  guint64 motion_suppressed;
+  guint64 motion_time_us;
+  guint64 motion_max_us;
+
+  // Streaming thread only
+  MotionDetect motion;
+  gboolean motion_ready;
+  guint8 *motion_levels;  // columns * rows
 };
 
 G_DEFINE_TYPE(GstRawCaptureBypass, gst_rawcapture_bypass, GST_TYPE_BASE_TRANSFORM)
 
+static gchar *
+gst_rawcapture_bypass_file_name(const gchar *location, guint index)
+{
+  // Only "%u" is expanded, the location is never used as a printf format
+  gchar **parts = g_strsplit(location, "%u", -1);
+  gchar *number = g_strdup_printf("%u", index);
+  gchar *name = g_strjoinv(number, parts);
+  g_free(number);
+  g_strfreev(parts);
+  return name;
+}
+
+static void
+gst_rawcapture_bypass_parse_classes(GstRawCaptureBypass *self)
+{
+  g_array_set_size(self->triggers, 0);
+  gchar **labels = g_strsplit(self->trigger_classes ? self->trigger_classes : "", ",", -1);
+  for (gchar **label = labels; *label; label++) {
+    g_strstrip(*label);
+    if (**label == '\0')
+      continue;
+    TriggerClass trigger = {g_intern_string(*label), GST_CLOCK_TIME_NONE, -1.0, 0, 0, 0, 0};
+    g_array_append_val(self->triggers, trigger);
+  }
+  g_strfreev(labels);
+}
+
+// GstDetectionFunc, object lock held
+static void
+gst_rawcapture_bypass_match(const gchar *label, gdouble confidence, gdouble x, gdouble y, gdouble width,
+    gdouble height, gpointer user_data)
+{
+  GstRawCaptureBypass *self = user_data;
+
+  if (confidence < self->trigger_confidence)
+    return;
+  for (guint i = 0; i < self->triggers->len; i++) {
+    TriggerClass *trigger = &g_array_index(self->triggers, TriggerClass, i);
+    if (strcmp(trigger->label, label) != 0)
+      continue;
+    self->detections_matched++;
+    if (confidence > trigger->confidence) {
+      trigger->confidence = confidence;
+      trigger->x = x;
+      trigger->y = y;
+      trigger->width = width;
+      trigger->height = height;
+    }
+    return;
+  }
+}
+
+// Running time of buf, monotonic time when there is no time segment
+static GstClockTime
+gst_rawcapture_bypass_running_time(GstRawCaptureBypass *self, GstBuffer *buf)
+{
+  GstSegment *segment = &GST_BASE_TRANSFORM(self)->segment;
+  GstClockTime now = GST_CLOCK_TIME_NONE;
+  if (segment->format == GST_FORMAT_TIME)
+    now = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  if (!GST_CLOCK_TIME_IS_VALID(now))
+    now = g_get_monotonic_time() * GST_USECOND;
+  return now;
+}
+
+static gboolean
+gst_rawcapture_bypass_cooling_down(GstRawCaptureBypass *self, GstClockTime last_trigger, GstClockTime now)
+{
+  return GST_CLOCK_TIME_IS_VALID(last_trigger) && now >= last_trigger && now - last_trigger < self->trigger_cooldown;
+}
+
+// Scans the detections of buf, object lock held. Returns the "rawcapture-trigger"
+// structures of the classes that fired (NULL if none) and arms the burst.
+static GPtrArray *
+gst_rawcapture_bypass_check_triggers(GstRawCaptureBypass *self, GstBuffer *buf)
+{
+  GPtrArray *fired = NULL;
+
+  for (guint i = 0; i < self->triggers->len; i++)
+    g_array_index(self->triggers, TriggerClass, i).confidence = -1.0;
+  self->frames_scanned++;
+  gst_detection_meta_foreach(buf, GST_VIDEO_INFO_WIDTH(&self->info), GST_VIDEO_INFO_HEIGHT(&self->info),
+      gst_rawcapture_bypass_match, self);
+
+  GstClockTime now = gst_rawcapture_bypass_running_time(self, buf);
+  for (guint i = 0; i < self->triggers->len; i++) {
+    TriggerClass *trigger = &g_array_index(self->triggers, TriggerClass, i);
+    if (trigger->confidence < 0)
+      continue;
+    if (gst_rawcapture_bypass_cooling_down(self, trigger->last_trigger, now)) {
+      self->triggers_suppressed++;
+      continue;
+    }
+    trigger->last_trigger = now;
+    self->triggers_fired++;
+    self->trigger_frames = MAX(self->trigger_frames, self->trigger_burst);
+    self->burst_reason = "detection";
+    if (!fired)
+      fired = g_ptr_array_new_with_free_func((GDestroyNotify) gst_structure_free);
+    g_ptr_array_add(fired, gst_structure_new("rawcapture-trigger",
+        "class", G_TYPE_STRING, trigger->label,
+        "confidence", G_TYPE_DOUBLE, trigger->confidence,
+        "x", G_TYPE_DOUBLE, trigger->x,
+        "y", G_TYPE_DOUBLE, trigger->y,
+        "width", G_TYPE_DOUBLE, trigger->width,
+        "height", G_TYPE_DOUBLE, trigger->height,
+        "pts", G_TYPE_UINT64, GST_BUFFER_PTS(buf),
+        "burst", G_TYPE_UINT, self->trigger_burst,
+        NULL));
+  }
+  return fired;
+}
+
+// Sets "columns", "rows", "tile-map" and "tile-levels" of a motion trigger
+static void
+gst_rawcapture_bypass_set_tiles(GstStructure *s, const guint8 *levels, guint columns, guint rows, guint threshold)
+{
+  GString *map = g_string_sized_new((columns + 1) * rows);
+  GValue array = G_VALUE_INIT;
+  GValue level = G_VALUE_INIT;
+
+  g_value_init(&array, GST_TYPE_ARRAY);
+  g_value_init(&level, G_TYPE_UINT);
+  for (guint r = 0; r < rows; r++) {
+    if (r)
+      g_string_append_c(map, '/');
+    for (guint c = 0; c < columns; c++) {
+      guint8 value = levels[r * columns + c];
+      g_string_append_c(map, value > threshold ? '1' : '0');
+      g_value_set_uint(&level, value);
+      gst_value_array_append_value(&array, &level);
+    }
+  }
+  gst_structure_set(s,
+      "columns", G_TYPE_UINT, columns,
+      "rows", G_TYPE_UINT, rows,
+      "tile-map", G_TYPE_STRING, map->str,
+      NULL);
+  gst_structure_take_value(s, "tile-levels", &array);
+  g_value_unset(&level);
+  g_string_free(map, TRUE);
+}
+
+// Motion trigger of every motion-interval-th frame, called without the object
+// lock. Returns the "rawcapture-trigger" structure when enough tiles changed
+// (NULL otherwise) and arms the burst.
+static GstStructure *
+gst_rawcapture_bypass_check_motion(GstRawCaptureBypass *self, GstBuffer *buf)
+{
+  GST_OBJECT_LOCK(self);
+  guint threshold = self->motion_threshold;
+  gboolean due = threshold > 0 && self->motion_interval > 0 && self->motion_frame++ % self->motion_interval == 0;
+  gboolean reconfigure = due && self->motion_reconfigure;
+  if (reconfigure)
+    self->motion_reconfigure = FALSE;
+  guint step = self->motion_step;
+  guint columns = self->motion_columns;
+  guint rows = self->motion_rows;
+  guint min_tiles = self->motion_min_tiles;
+  GstVideoInfo info = self->info;
+  GST_OBJECT_UNLOCK(self);
+
+  if (!due)
+    return NULL;
+  if (reconfigure) {
+    motion_detect_clear(&self->motion);
+    g_free(self->motion_levels);
+    self->motion_levels = NULL;
+    self->motion_ready = motion_detect_init(&self->motion, GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info),
+        step, columns, rows);
+    if (self->motion_ready)
+      self->motion_levels = g_malloc0(columns * rows);
+    else
+      GST_WARNING_OBJECT(self, "%dx%d is too small for a %ux%u motion grid with step %u, motion trigger off",
+          GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info), columns, rows, step);
+  }
+  if (!self->motion_ready)
+    return NULL;
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, &info, buf, GST_MAP_READ))
+    return NULL;
+  gint64 start = g_get_monotonic_time();
+  guint changed = motion_detect_frame(&self->motion, GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0), threshold, self->motion_levels);
+  guint64 elapsed = g_get_monotonic_time() - start;
+  gst_video_frame_unmap(&frame);
+
+  GstStructure *fired = NULL;
+  GST_OBJECT_LOCK(self);
+  self->motion_frames++;
+  self->motion_time_us += elapsed;
+  self->motion_max_us = MAX(self->motion_max_us, elapsed);
+  if (changed > 0 && changed >= min_tiles) {
+    GstClockTime now = gst_rawcapture_bypass_running_time(self, buf);
+    if (gst_rawcapture_bypass_cooling_down(self, self->motion_last_trigger, now)) {
+      self->motion_suppressed++;
+    } else {
+      self->motion_last_trigger = now;
+      self->motion_triggers++;
+      self->trigger_frames = MAX(self->trigger_frames, self->trigger_burst);
+      self->burst_reason = "motion";
+      fired = gst_structure_new("rawcapture-trigger",
+          "class", G_TYPE_STRING, "motion",
+          "tiles-changed", G_TYPE_UINT, changed,
+          "pts", G_TYPE_UINT64, GST_BUFFER_PTS(buf),
+          "burst", G_TYPE_UINT, self->trigger_burst,
+          NULL);
+      gst_rawcapture_bypass_set_tiles(fired, self->motion_levels, columns, rows, threshold);
+      if (self->motion_tiles)
+        gst_structure_free(self->motion_tiles);
+      self->motion_tiles = gst_structure_copy(fired);
+    }
+  }
+  GST_OBJECT_UNLOCK(self);
+  return fired;
+}
+
+// tiles: motion trigger of the capture, its tile map is added to "rawcapture-done"
+static void
+gst_rawcapture_bypass_save(GstRawCaptureBypass *self, GstBuffer *buf, const gchar *location, const gchar *reason,
+    const GstStructure *tiles)
+{
+  FILE *outfile = fopen(location, "wb");
+  if (outfile) {
+    GstMapInfo info;
+    if (gst_buffer_map(buf, &info, GST_MAP_READ)) {
+      fwrite(info.data, 1, info.size, outfile);
+      gst_buffer_unmap(buf, &info);
+      g_print("Captured NV12 frame to %s (%s)\n", location, reason);
+      GST_OBJECT_LOCK(self);
+      self->frames_captured++;
+      GST_OBJECT_UNLOCK(self);
+      GstStructure *done = gst_structure_new("rawcapture-done",
+          "location", G_TYPE_STRING, location,
+          "pts", G_TYPE_UINT64, GST_BUFFER_PTS(buf),
+          "reason", G_TYPE_STRING, reason,
+          NULL);
+      if (tiles) {
+        static const gchar *fields[] = {"tiles-changed", "columns", "rows", "tile-map", "tile-levels"};
+        for (guint i = 0; i < G_N_ELEMENTS(fields); i++)
+          gst_structure_set_value(done, fields[i], gst_structure_get_value(tiles, fields[i]));
+        gst_structure_set(done, "trigger-pts", G_TYPE_UINT64,
+            g_value_get_uint64(gst_structure_get_value(tiles, "pts")), NULL);
+      }
+      gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), done));
+    }
+    fclose(outfile);
+  } else {
+    g_warning("Could not open %s for writing", location);
+  }
+}
+
 static GstFlowReturn
 gst_rawcapture_bypass_transform_ip(GstBaseTransform *trans, GstBuffer *buf)
 {
+  GstRawCaptureBypass *self = GST_RAWCAPTUREBYPASS(trans);
+  gchar *location = NULL;
+  const gchar *reason = NULL;
+  GPtrArray *fired = NULL;
+  GstStructure *tiles = NULL;
+
+  // Motion trigger, reads the luma plane
+  GstStructure *motion = gst_rawcapture_bypass_check_motion(self, buf);
+
+  GST_OBJECT_LOCK(self);
+  // Detection trigger, metadata only
+  if (self->triggers->len)
+    fired = gst_rawcapture_bypass_check_triggers(self, buf);
+
+  // Captures requested through the capture-frames property, then the detection / motion burst
+  if (self->capture_frames > 0) {
+    self->capture_frames--;
+    reason = "request";
+  } else if (self->trigger_frames > 0) {
+    self->trigger_frames--;
+    reason = self->burst_reason;
+    if (self->motion_tiles && strcmp(reason, "motion") == 0)
+      tiles = gst_structure_copy(self->motion_tiles);
+  }
+  if (reason)
+    location = gst_rawcapture_bypass_file_name(self->location, self->capture_index++);
+  GST_OBJECT_UNLOCK(self);
+
   // Check for the capture flag file
-  if (access("/tmp/capture_flag", F_OK) == 0) {
-    FILE *outfile = fopen("kevin_nv12.raw", "wb");
-    if (outfile) {
-      GstMapInfo info;
-      if (gst_buffer_map(buf, &info, GST_MAP_READ)) {
-        fwrite(info.data, 1, info.size, outfile);
-        gst_buffer_unmap(buf, &info);
-        g_print("Captured NV12 frame to kevin_nv12.raw\n");
-      }
-      fclose(outfile);
-    } else {
-      g_warning("Could not open kevin_nv12.raw for writing");
-    }
+  if (!location && access("/tmp/capture_flag", F_OK) == 0) {
+    GST_OBJECT_LOCK(self);
+    location = gst_rawcapture_bypass_file_name(self->location, self->capture_index++);
+    GST_OBJECT_UNLOCK(self);
+    reason = "flag";
     // Remove the flag file after capturing
     unlink("/tmp/capture_flag");
   }
 
+  if (fired) {
+    for (guint i = 0; i < fired->len; i++) {
+      gst_element_post_message(GST_ELEMENT(self),
+          gst_message_new_element(GST_OBJECT(self), gst_structure_copy(g_ptr_array_index(fired, i))));
+    }
+    g_ptr_array_unref(fired);
+  }
+  if (motion)
+    gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), motion));
+
+  if (location) {
+    gst_rawcapture_bypass_save(self, buf, location, reason, tiles);
+    g_free(location);
+  }
+  if (tiles)
+    gst_structure_free(tiles);
+
   // Pass buffer through (in-place transform)
   return GST_FLOW_OK;
 }
 
+static gboolean
+gst_rawcapture_bypass_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps)
+{
+  GstRawCaptureBypass *self = GST_RAWCAPTUREBYPASS(trans);
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps(&info, incaps))
+    return FALSE;
+  GST_OBJECT_LOCK(self);
+  self->info = info;
+  self->motion_reconfigure = TRUE;
+  GST_OBJECT_UNLOCK(self);
+  return TRUE;
+}
+
+static GstStructure *
+gst_rawcapture_bypass_stats(GstRawCaptureBypass *self)
+{
+  GST_OBJECT_LOCK(self);
+  GstStructure *stats = gst_structure_new("application/x-rawcapture-stats",
+      "frames-captured", G_TYPE_UINT64, self->frames_captured,
+      "frames-scanned", G_TYPE_UINT64, self->frames_scanned,
+      "detections-matched", G_TYPE_UINT64, self->detections_matched,
+      "triggers", G_TYPE_UINT64, self->triggers_fired,
+      "triggers-suppressed", G_TYPE_UINT64, self->triggers_suppressed,
+      "motion-frames", G_TYPE_UINT64, self->motion_frames,
+      "motion-triggers", G_TYPE_UINT64, self->motion_triggers,
+      "motion-suppressed", G_TYPE_UINT64, self->motion_suppressed,
+      "motion-avg-us", G_TYPE_UINT64, self->motion_frames ? self->motion_time_us / self->motion_frames : 0,
+      "motion-max-us", G_TYPE_UINT64, self->motion_max_us, NULL);
+  GST_OBJECT_UNLOCK(self);
+  return stats;
+}
+
+static void
+gst_rawcapture_bypass_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstRawCaptureBypass *self = GST_RAWCAPTUREBYPASS(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free(self->location);
+      self->location = g_value_dup_string(value);
+      if (!self->location)
+        self->location = g_strdup(DEFAULT_LOCATION);
+      break;
+    case PROP_CAPTURE_FRAMES:
+      self->capture_frames = g_value_get_uint(value);
+      break;
+    case PROP_TRIGGER_CLASSES:
+      g_free(self->trigger_classes);
+      self->trigger_classes = g_value_dup_string(value);
+      gst_rawcapture_bypass_parse_classes(self);
+      break;
+    case PROP_TRIGGER_CONFIDENCE:
+      self->trigger_confidence = g_value_get_double(value);
+      break;
+    case PROP_TRIGGER_COOLDOWN:
+      self->trigger_cooldown = g_value_get_uint64(value);
+      break;
+    case PROP_TRIGGER_BURST:
+      self->trigger_burst = g_value_get_uint(value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint(value);
+      self->motion_reconfigure = TRUE;
+      break;
+    case PROP_MOTION_MIN_TILES:
+      self->motion_min_tiles = g_value_get_uint(value);
+      break;
+    case PROP_MOTION_GRID_COLUMNS:
+      self->motion_columns = g_value_get_uint(value);
+      self->motion_reconfigure = TRUE;
+      break;
+    case PROP_MOTION_GRID_ROWS:
+      self->motion_rows = g_value_get_uint(value);
+      self->motion_reconfigure = TRUE;
+      break;
+    case PROP_MOTION_STEP:
+      self->motion_step = g_value_get_uint(value);
+      self->motion_reconfigure = TRUE;
+      break;
+    case PROP_MOTION_INTERVAL:
+      self->motion_interval = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_rawcapture_bypass_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstRawCaptureBypass *self = GST_RAWCAPTUREBYPASS(object);
+
+  if (prop_id == PROP_STATS) {
+    g_value_take_boxed(value, gst_rawcapture_bypass_stats(self));
+    return;
+  }
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string(value, self->location);
+      break;
+    case PROP_CAPTURE_FRAMES:
+      g_value_set_uint(value, self->capture_frames);
+      break;
+    case PROP_TRIGGER_CLASSES:
+      g_value_set_string(value, self->trigger_classes);
+      break;
+    case PROP_TRIGGER_CONFIDENCE:
+      g_value_set_double(value, self->trigger_confidence);
+      break;
+    case PROP_TRIGGER_COOLDOWN:
+      g_value_set_uint64(value, self->trigger_cooldown);
+      break;
+    case PROP_TRIGGER_BURST:
+      g_value_set_uint(value, self->trigger_burst);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint(value, self->motion_threshold);
+      break;
+    case PROP_MOTION_MIN_TILES:
+      g_value_set_uint(value, self->motion_min_tiles);
+      break;
+    case PROP_MOTION_GRID_COLUMNS:
+      g_value_set_uint(value, self->motion_columns);
+      break;
+    case PROP_MOTION_GRID_ROWS:
+      g_value_set_uint(value, self->motion_rows);
+      break;
+    case PROP_MOTION_STEP:
+      g_value_set_uint(value, self->motion_step);
+      break;
+    case PROP_MOTION_INTERVAL:
+      g_value_set_uint(value, self->motion_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_rawcapture_bypass_finalize(GObject *object)
+{
+  GstRawCaptureBypass *self = GST_RAWCAPTUREBYPASS(object);
+
+  g_free(self->location);
+  g_free(self->trigger_classes);
+  g_array_unref(self->triggers);
+  if (self->motion_tiles)
+    gst_structure_free(self->motion_tiles);
+  motion_detect_clear(&self->motion);
+  g_free(self->motion_levels);
+  G_OBJECT_CLASS(gst_rawcapture_bypass_parent_class)->finalize(object);
+}
+
 static void
 gst_rawcapture_bypass_class_init(GstRawCaptureBypassClass *klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
 
+  gobject_class->set_property = gst_rawcapture_bypass_set_property;
+  gobject_class->get_property = gst_rawcapture_bypass_get_property;
+  gobject_class->finalize = gst_rawcapture_bypass_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_LOCATION,
+      g_param_spec_string("location", "Location",
+          "File the captured NV12 frame is written to (%u = capture index)",
+          DEFAULT_LOCATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_CAPTURE_FRAMES,
+      g_param_spec_uint("capture-frames", "Capture frames",
+          "Number of upcoming frames to capture (alternative to /tmp/capture_flag)",
+          0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_TRIGGER_CLASSES,
+      g_param_spec_string("trigger-classes", "Trigger classes",
+          "Comma separated detection labels that capture the frame they are found in, empty = off",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_TRIGGER_CONFIDENCE,
+      g_param_spec_double("trigger-confidence", "Trigger confidence",
+          "Lowest detection confidence that triggers a capture",
+          0.0, 1.0, DEFAULT_TRIGGER_CONFIDENCE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_TRIGGER_COOLDOWN,
+      g_param_spec_uint64("trigger-cooldown", "Trigger cooldown",
+          "Running time before the same class can trigger again (ns)",
+          0, G_MAXUINT64, DEFAULT_TRIGGER_COOLDOWN, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_TRIGGER_BURST,
+      g_param_spec_uint("trigger-burst", "Trigger burst",
+          "Frames captured per trigger, starting with the detection frame",
+          1, 1000, DEFAULT_TRIGGER_BURST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint("motion-threshold", "Motion threshold",
+          "Mean absolute luma difference above which a tile has changed, 0 = motion trigger off",
+          0, 254, DEFAULT_MOTION_THRESHOLD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_MIN_TILES,
+      g_param_spec_uint("motion-min-tiles", "Motion min tiles",
+          "Changed tiles needed for a motion trigger",
+          1, G_MAXUINT, DEFAULT_MOTION_MIN_TILES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_GRID_COLUMNS,
+      g_param_spec_uint("motion-grid-columns", "Motion grid columns",
+          "Tile columns of the motion grid",
+          1, 64, DEFAULT_MOTION_GRID_COLUMNS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_GRID_ROWS,
+      g_param_spec_uint("motion-grid-rows", "Motion grid rows",
+          "Tile rows of the motion grid",
+          1, 64, DEFAULT_MOTION_GRID_ROWS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_STEP,
+      g_param_spec_uint("motion-step", "Motion step",
+          "Subsampling of the luma plane for motion (8, 16 or 32 pixels per sample in both directions)",
+          8, 32, DEFAULT_MOTION_STEP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MOTION_INTERVAL,
+      g_param_spec_uint("motion-interval", "Motion interval",
+          "Compare every motion-interval-th frame with the previous compared one",
+          1, 1000, DEFAULT_MOTION_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Stats",
+          "Captures, detection and motion trigger counters since the element was created",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   // Only accept video/x-raw with NV12 format on src and sink
   GstCaps *caps = gst_caps_new_simple(
       "video/x-raw",
@@ -73,28 +697,55 @@ gst_rawcapture_bypass_class_init(GstRawCaptureBypassClass *klass)
     element_class,
     "NV12 Raw Capture Bypass Filter",
     "Filter/Effect/Bypass",
-    "Bypasses NV12 buffers and saves a raw file when /tmp/capture_flag is created",
+    "Bypasses NV12 buffers and saves a raw file when /tmp/capture_flag is created, capture-frames is set "
+    "or a detection of trigger-classes or motion is found",
     "Kevin P <your.email@example.com>"
   );
 
   GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+  base_transform_class->set_caps = GST_DEBUG_FUNCPTR(gst_rawcapture_bypass_set_caps);
   base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_rawcapture_bypass_transform_ip);
 }
 
 static void
-gst_rawcapture_bypass_init(GstRawCaptureBypass *self) {}
+gst_rawcapture_bypass_init(GstRawCaptureBypass *self)
+{
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->triggers = g_array_new(FALSE, FALSE, sizeof(TriggerClass));
+  self->trigger_confidence = DEFAULT_TRIGGER_CONFIDENCE;
+  self->trigger_cooldown = DEFAULT_TRIGGER_COOLDOWN;
+  self->trigger_burst = DEFAULT_TRIGGER_BURST;
+  self->burst_reason = "detection";
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->motion_min_tiles = DEFAULT_MOTION_MIN_TILES;
+  self->motion_columns = DEFAULT_MOTION_GRID_COLUMNS;
+  self->motion_rows = DEFAULT_MOTION_GRID_ROWS;
+  self->motion_step = DEFAULT_MOTION_STEP;
+  self->motion_interval = DEFAULT_MOTION_INTERVAL;
+  self->motion_reconfigure = TRUE;
+  self->motion_last_trigger = GST_CLOCK_TIME_NONE;
+  gst_video_info_init(&self->info);
+}
 
 static gboolean
 plugin_init(GstPlugin *plugin)
 {
-  return gst_element_register(plugin, "rawcapturebypass", GST_RANK_NONE, GST_TYPE_RAWCAPTUREBYPASS);
+  return gst_element_register(plugin, "rawcapturebypass", GST_RANK_NONE, GST_TYPE_RAWCAPTUREBYPASS) &&
+         gst_element_register(plugin, "pacedudpsink", GST_RANK_NONE, GST_TYPE_PACED_UDP_SINK) &&
+         gst_element_register(plugin, "timestampsei", GST_RANK_NONE, GST_TYPE_TIMESTAMP_SEI) &&
+         gst_element_register(plugin, "memfdsink", GST_RANK_NONE, GST_TYPE_MEMFD_SINK) &&
+         gst_element_register(plugin, "memfdsrc", GST_RANK_NONE, GST_TYPE_MEMFD_SRC) &&
+         gst_element_register(plugin, "segmentsink", GST_RANK_NONE, GST_TYPE_SEGMENT_SINK) &&
+         gst_element_register(plugin, "policyqueue", GST_RANK_NONE, GST_TYPE_POLICY_QUEUE) &&
+         gst_element_register(plugin, "fakedetections", GST_RANK_NONE, GST_TYPE_FAKE_DETECTIONS) &&
+         gst_element_register(plugin, "sharpnessmeter", GST_RANK_NONE, GST_TYPE_SHARPNESS_METER);
 }
 
 GST_PLUGIN_DEFINE(
   GST_VERSION_MAJOR,
   GST_VERSION_MINOR,
   rawcapturebypass,
-  "Bypass NV12 filter that saves frame when /tmp/capture_flag exists",
+  "Bypass NV12 filter that saves frames on /tmp/capture_flag, detections or motion, paced UDP sink, capture timestamp SEI, memfd shared memory sink/src, segment recorder sink, drop policy queue, synthetic detections, sharpness meter",
   plugin_init,
   "1.0",
   "LGPL",
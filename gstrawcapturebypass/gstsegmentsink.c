@@ -0,0 +1,1062 @@
+#define _GNU_SOURCE // O_DIRECT, fallocate, sync_file_range
+#define PACKAGE "rawcapturebypass"
+#include "gstsegmentsink.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * segmentsink: records an encoded stream on the device as a ring of
+ * fixed-duration segment files within a storage budget.
+ *
+ * The sink must never hold up the tee it hangs off, so the streaming thread
+ * does no file I/O at all:
+ *   - render copies the buffer into a write-size chunk (one of `buffers`
+ *     preallocated, 4 KiB aligned chunks) and hands full chunks to a writer
+ *     thread. When no chunk is free the disk is behind: the buffer is dropped
+ *     and so is everything up to the next keyframe (buffers-dropped), instead
+ *     of waiting.
+ *   - the writer thread opens the segment, preallocates it with fallocate
+ *     (preallocate, default: size of the previous segment + 1/8), writes
+ *     whole chunks at aligned offsets (O_DIRECT with direct-io=true, else
+ *     buffered with flush-behind: sync_file_range + POSIX_FADV_DONTNEED keep
+ *     the dirty page cache at about two chunks, so no writeback storm stalls
+ *     other processes), trims the file to its data on close and deletes the
+ *     oldest segments while the files exceed max-storage. max-write-rate caps
+ *     its disk bandwidth; what does not fit ends up as drops.
+ *
+ * Cutting:
+ *   segment-duration > 0  the sink cuts itself: a new file starts at the first
+ *                         keyframe (buffer without DELTA_UNIT) once the
+ *                         current one holds segment-duration, so every
+ *                         segment decodes on its own. For streams that can be
+ *                         cut anywhere (mpegtsmux, h264parse byte-stream).
+ *                         location contains "%u", the segment index (5
+ *                         digits); after a restart it continues after the
+ *                         highest index on disk.
+ *   segment-duration = 0  one file per start, at location; for use as the
+ *                         sink of splitmuxsink (mp4mux), which cuts at
+ *                         keyframes and sets location per fragment. The byte
+ *                         segment mp4mux sends to rewrite its header turns the
+ *                         file to plain writes at that offset. storage-pattern
+ *                         then names the files counted against max-storage.
+ *                         A muxer's byte stream cannot lose a range without
+ *                         corrupting the file, so this mode never drops:
+ *                         render waits for a free chunk and the dropping has
+ *                         to happen in front of the muxer (policyqueue).
+ *
+ * Every finished segment posts a "segmentsink-segment" element message with
+ * its size, duration, drops and worst write latency; stats has the totals,
+ * the write latency (average, p99, max) and render-max-us, the longest render
+ * call, which stays in the microseconds while the disk is slow when the sink
+ * cuts itself (with segment-duration = 0 it shows the waits for the writer).
+ */
+
+#define DEFAULT_LOCATION "/tmp/segment_%u.ts"
+#define DEFAULT_SEGMENT_DURATION (60 * GST_SECOND)
+#define DEFAULT_MAX_STORAGE 0
+#define DEFAULT_PREALLOCATE 0
+#define DEFAULT_WRITE_SIZE (1024 * 1024)
+#define DEFAULT_BUFFERS 8
+#define DEFAULT_DIRECT_IO FALSE
+#define DEFAULT_MAX_WRITE_RATE 0
+
+#define IO_ALIGN 4096
+#define LATENCY_BUCKETS 33  // log2 buckets of microseconds
+
+enum {
+  PROP_0,
+  PROP_LOCATION,
+  PROP_SEGMENT_DURATION,
+  PROP_MAX_STORAGE,
+  PROP_STORAGE_PATTERN,
+  PROP_PREALLOCATE,
+  PROP_WRITE_SIZE,
+  PROP_BUFFERS,
+  PROP_DIRECT_IO,
+  PROP_MAX_WRITE_RATE,
+  PROP_STATS,
+};
+
+typedef enum {
+  SEGMENT_JOB_OPEN,   // path, NULL = next index of location
+  SEGMENT_JOB_DATA,   // chunk
+  SEGMENT_JOB_SEEK,   // offset the next data goes to
+  SEGMENT_JOB_CLOSE,  // duration / dropped of the segment, for the report
+  SEGMENT_JOB_SYNC,   // offset = sync number, signals synced once the jobs before it are done
+  SEGMENT_JOB_QUIT,
+} SegmentJobType;
+
+typedef struct {
+  guint8 *data;  // chunk_size bytes, IO_ALIGN aligned
+  gsize size;    // bytes filled
+} SegmentChunk;
+
+typedef struct {
+  SegmentJobType type;
+  SegmentChunk *chunk;
+  gchar *path;
+  guint64 offset;
+  GstClockTime duration;
+  guint64 dropped;
+} SegmentJob;
+
+typedef struct {
+  gchar *path;
+  guint64 size;
+  guint index;
+} SegmentFile;
+
+struct _GstSegmentSink {
+  GstBaseSink parent;
+
+  // Properties, object lock
+  gchar *location;
+  gchar *storage_pattern;
+  GstClockTime segment_duration;
+  guint64 max_storage;
+  guint64 preallocate;
+  guint write_size;
+  guint buffers;
+  gboolean direct_io;
+  guint64 max_write_rate;
+
+  // Created on the first start, kept until finalize: splitmuxsink cycles the
+  // sink's state per fragment and the previous file may still be written
+  GThread *writer;
+  GAsyncQueue *jobs;         // SegmentJob, streaming thread -> writer
+  GAsyncQueue *free_chunks;  // SegmentChunk, writer -> streaming thread
+  gsize chunk_size;
+
+  // Streaming thread only
+  SegmentChunk *chunk;       // being filled
+  gboolean open;             // an OPEN was queued and no CLOSE yet
+  gboolean dropping;         // out of chunks, dropping up to the next keyframe
+  gboolean unlocked;         // between unlock and unlock_stop, object lock
+  guint64 position;          // byte offset in the current segment
+  GstClockTime segment_start;
+  GstClockTime segment_last;
+  guint64 segment_dropped;
+
+  // Writer thread only
+  int fd;
+  gchar *path;
+  gboolean file_direct;
+  guint64 file_offset;
+  guint64 file_end;
+  guint64 flushed;           // written back and dropped from the page cache
+  guint64 last_segment_size;
+  guint64 segment_latency_max_us;
+  gint64 next_write_us;      // max-write-rate pacing
+  gboolean scanned;
+  guint next_index;
+  GQueue segments;           // SegmentFile on disk, oldest first
+
+  guint64 sync_requested;    // streaming thread only
+
+  GMutex lock;               // everything below
+  GCond synced;
+  guint64 sync_done;         // last SYNC the writer got to
+  GQueue reports;            // finished segment structures, posted from the streaming thread
+  guint64 segments_written;
+  guint64 segments_deleted;
+  guint64 storage_used;
+  guint64 bytes_written;
+  guint64 buffers_dropped;
+  guint64 bytes_dropped;
+  guint64 write_errors;
+  guint64 writes;
+  guint64 write_time_us;
+  guint64 write_max_us;
+  guint64 latency_hist[LATENCY_BUCKETS];
+  guint64 render_max_us;
+  guint queue_max;
+};
+
+G_DEFINE_TYPE(GstSegmentSink, gst_segment_sink, GST_TYPE_BASE_SINK)
+
+// Only "%u" is expanded (zero padded, so names sort by index), the location is never a printf format
+static gchar *
+gst_segment_sink_file_name(const gchar *location, guint index)
+{
+  gchar **parts = g_strsplit(location, "%u", -1);
+  gchar *number = g_strdup_printf("%05u", index);
+  gchar *name = g_strjoinv(number, parts);
+  g_free(number);
+  g_strfreev(parts);
+  return name;
+}
+
+static gint
+segment_file_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  guint index_a = ((const SegmentFile *) a)->index;
+  guint index_b = ((const SegmentFile *) b)->index;
+  return index_a < index_b ? -1 : index_a > index_b;
+}
+
+static void
+segment_file_free(gpointer data)
+{
+  SegmentFile *file = data;
+  g_free(file->path);
+  g_free(file);
+}
+
+// Segments an earlier run left on disk count against the budget too; lists the
+// files of the pattern ("<prefix>%u<suffix>" in one directory) oldest first
+static void
+gst_segment_sink_scan(GstSegmentSink *self, const gchar *pattern)
+{
+  gchar *dir_name = g_path_get_dirname(pattern);
+  gchar *base = g_path_get_basename(pattern);
+  gchar *marker = strstr(base, "%u");
+  GDir *dir = marker ? g_dir_open(dir_name, 0, NULL) : NULL;
+
+  if (dir) {
+    *marker = '\0';
+    const gchar *prefix = base;
+    const gchar *suffix = marker + 2;
+    GQueue found = G_QUEUE_INIT;
+    const gchar *name;
+    while ((name = g_dir_read_name(dir))) {
+      gsize length = strlen(name);
+      if (!g_str_has_prefix(name, prefix) || !g_str_has_suffix(name, suffix) ||
+          length <= strlen(prefix) + strlen(suffix))
+        continue;
+      const gchar *digits = name + strlen(prefix);
+      gsize n_digits = length - strlen(prefix) - strlen(suffix);
+      gboolean numeric = n_digits <= 9;
+      for (gsize i = 0; numeric && i < n_digits; i++)
+        numeric = g_ascii_isdigit(digits[i]);
+      if (!numeric)
+        continue;
+
+      SegmentFile *file = g_new0(SegmentFile, 1);
+      file->path = g_build_filename(dir_name, name, NULL);
+      GStatBuf st;
+      if (g_stat(file->path, &st) < 0) {
+        segment_file_free(file);
+        continue;
+      }
+      file->size = st.st_size;
+      file->index = (guint) g_ascii_strtoull(digits, NULL, 10);
+      g_queue_insert_sorted(&found, file, segment_file_compare, NULL);
+      self->next_index = MAX(self->next_index, file->index + 1);
+    }
+    g_dir_close(dir);
+
+    g_mutex_lock(&self->lock);
+    for (GList *l = found.head; l; l = l->next) {
+      SegmentFile *file = l->data;
+      self->storage_used += file->size;
+      g_queue_push_tail(&self->segments, file);
+    }
+    g_mutex_unlock(&self->lock);
+    g_queue_clear(&found);
+    GST_INFO_OBJECT(self, "%u segments of %s on disk, next index %u", g_queue_get_length(&self->segments),
+        pattern, self->next_index);
+  }
+  g_free(base);
+  g_free(dir_name);
+}
+
+// Deletes the oldest segments until the files plus reserve fit max-storage (writer thread)
+static void
+gst_segment_sink_enforce_budget(GstSegmentSink *self, guint64 reserve)
+{
+  GST_OBJECT_LOCK(self);
+  guint64 budget = self->max_storage;
+  GST_OBJECT_UNLOCK(self);
+  if (!budget)
+    return;
+
+  g_mutex_lock(&self->lock);
+  while (self->storage_used + reserve > budget && !g_queue_is_empty(&self->segments)) {
+    SegmentFile *oldest = g_queue_pop_head(&self->segments);
+    self->storage_used -= oldest->size;
+    self->segments_deleted++;
+    g_mutex_unlock(&self->lock);
+    if (unlink(oldest->path) < 0 && errno != ENOENT)
+      g_warning("segmentsink: could not delete %s: %s", oldest->path, g_strerror(errno));
+    segment_file_free(oldest);
+    g_mutex_lock(&self->lock);
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+gst_segment_sink_record_latency(GstSegmentSink *self, gint64 start_us)
+{
+  guint64 us = MAX(g_get_monotonic_time() - start_us, 0);
+  self->segment_latency_max_us = MAX(self->segment_latency_max_us, us);
+  g_mutex_lock(&self->lock);
+  self->writes++;
+  self->write_time_us += us;
+  self->write_max_us = MAX(self->write_max_us, us);
+  self->latency_hist[MIN(g_bit_storage(us), LATENCY_BUCKETS - 1)]++;
+  g_mutex_unlock(&self->lock);
+}
+
+// Upper bound of the bucket holding the 99th percentile, lock held
+static guint64
+gst_segment_sink_latency_p99(GstSegmentSink *self)
+{
+  guint64 target = self->writes - self->writes / 100;
+  guint64 seen = 0;
+  for (guint i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += self->latency_hist[i];
+    if (self->writes && seen >= target)
+      return i ? MIN((guint64) 1 << i, self->write_max_us) : 0;
+  }
+  return self->write_max_us;
+}
+
+static void
+gst_segment_sink_write_failed(GstSegmentSink *self, const gchar *what)
+{
+  g_warning("segmentsink: %s %s failed: %s", what, self->path, g_strerror(errno));
+  g_mutex_lock(&self->lock);
+  self->write_errors++;
+  g_mutex_unlock(&self->lock);
+  // The rest of the segment is discarded, the next one tries again
+  close(self->fd);
+  self->fd = -1;
+}
+
+static void
+gst_segment_sink_writer_close(GstSegmentSink *self, GstClockTime duration, guint64 dropped, gboolean report)
+{
+  if (!self->path)
+    return;
+
+  if (self->fd >= 0) {
+    gint64 start_us = g_get_monotonic_time();
+    // Gives back the preallocation past the data and the O_DIRECT padding of the last chunk
+    if (ftruncate(self->fd, self->file_end) < 0)
+      g_warning("segmentsink: could not trim %s: %s", self->path, g_strerror(errno));
+    close(self->fd);
+    self->fd = -1;
+    gst_segment_sink_record_latency(self, start_us);
+  }
+
+  SegmentFile *file = g_new0(SegmentFile, 1);
+  file->path = self->path;
+  file->size = self->file_end;
+  self->path = NULL;
+  self->last_segment_size = file->size;
+  g_mutex_lock(&self->lock);
+  g_queue_push_tail(&self->segments, file);
+  self->storage_used += file->size;
+  self->segments_written++;
+  g_mutex_unlock(&self->lock);
+  gst_segment_sink_enforce_budget(self, 0);
+
+  if (report) {
+    g_mutex_lock(&self->lock);
+    GstStructure *s = gst_structure_new("segmentsink-segment",
+        "location", G_TYPE_STRING, file->path,
+        "bytes", G_TYPE_UINT64, file->size,
+        "duration", G_TYPE_UINT64, duration,
+        "buffers-dropped", G_TYPE_UINT64, dropped,
+        "write-latency-max-us", G_TYPE_UINT64, self->segment_latency_max_us,
+        "storage-used", G_TYPE_UINT64, self->storage_used,
+        "segments-deleted", G_TYPE_UINT64, self->segments_deleted, NULL);
+    g_queue_push_tail(&self->reports, s);
+    g_mutex_unlock(&self->lock);
+  }
+}
+
+static void
+gst_segment_sink_writer_open(GstSegmentSink *self, gchar *path)
+{
+  gst_segment_sink_writer_close(self, GST_CLOCK_TIME_NONE, 0, TRUE);
+
+  GST_OBJECT_LOCK(self);
+  gchar *location = g_strdup(self->location);
+  gchar *pattern = g_strdup(self->storage_pattern ? self->storage_pattern : self->location);
+  gboolean direct = self->direct_io;
+  guint64 preallocate = self->preallocate;
+  GST_OBJECT_UNLOCK(self);
+
+  if (!self->scanned) {
+    gst_segment_sink_scan(self, pattern);
+    self->scanned = TRUE;
+  }
+  if (!path)
+    path = gst_segment_sink_file_name(location, self->next_index++);
+  if (!preallocate)
+    preallocate = self->last_segment_size ? self->last_segment_size + self->last_segment_size / 8
+                                          : 4 * self->chunk_size;
+  g_free(location);
+  g_free(pattern);
+
+  // Room for the new segment first, so the budget holds while it grows
+  gst_segment_sink_enforce_budget(self, preallocate);
+
+  gint64 start_us = g_get_monotonic_time();
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  self->fd = open(path, flags | (direct ? O_DIRECT : 0), 0644);
+  if (self->fd < 0 && direct && errno == EINVAL) {
+    // tmpfs and some FUSE file systems refuse O_DIRECT
+    g_warning("segmentsink: %s does not support O_DIRECT, writing buffered", path);
+    direct = FALSE;
+    self->fd = open(path, flags, 0644);
+  }
+  self->path = path;
+  self->file_direct = direct;
+  self->file_offset = self->file_end = self->flushed = 0;
+  self->segment_latency_max_us = 0;
+  if (self->fd < 0) {
+    g_warning("segmentsink: could not open %s: %s", path, g_strerror(errno));
+    g_mutex_lock(&self->lock);
+    self->write_errors++;
+    g_mutex_unlock(&self->lock);
+    g_clear_pointer(&self->path, g_free);
+    return;
+  }
+  // KEEP_SIZE: the file shows only its data while the blocks are reserved
+  if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, 0, preallocate) < 0 && errno != EOPNOTSUPP)
+    GST_INFO_OBJECT(self, "fallocate of %s failed: %s", path, g_strerror(errno));
+  gst_segment_sink_record_latency(self, start_us);
+}
+
+static void
+gst_segment_sink_writer_write(GstSegmentSink *self, SegmentChunk *chunk)
+{
+  if (self->fd < 0) {
+    g_mutex_lock(&self->lock);
+    self->bytes_dropped += chunk->size;
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+
+  // O_DIRECT needs whole blocks; only the last chunk of a segment is partial, close trims the padding
+  gsize length = chunk->size;
+  gsize io_length = length;
+  if (self->file_direct && length % IO_ALIGN) {
+    io_length = (length + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    memset(chunk->data + length, 0, io_length - length);
+  }
+
+  GST_OBJECT_LOCK(self);
+  guint64 rate = self->max_write_rate;
+  GST_OBJECT_UNLOCK(self);
+  if (rate) {
+    gint64 now_us = g_get_monotonic_time();
+    if (self->next_write_us > now_us)
+      g_usleep(self->next_write_us - now_us);
+    self->next_write_us = MAX(now_us, self->next_write_us) + (gint64) (length * G_USEC_PER_SEC / rate);
+  }
+
+  gint64 start_us = g_get_monotonic_time();
+  gsize done = 0;
+  while (done < io_length) {
+    ssize_t n = pwrite(self->fd, chunk->data + done, io_length - done, self->file_offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      gst_segment_sink_write_failed(self, "write to");
+      return;
+    }
+    done += n;
+  }
+  guint64 chunk_offset = self->file_offset;
+  self->file_offset += length;
+  self->file_end = MAX(self->file_end, self->file_offset);
+
+  if (!self->file_direct) {
+    // Flush-behind: start writeback of this chunk, wait for the ones before and drop them from the cache
+    sync_file_range(self->fd, chunk_offset, length, SYNC_FILE_RANGE_WRITE);
+    if (chunk_offset > self->flushed) {
+      sync_file_range(self->fd, self->flushed, chunk_offset - self->flushed,
+          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+      posix_fadvise(self->fd, self->flushed, chunk_offset - self->flushed, POSIX_FADV_DONTNEED);
+      self->flushed = chunk_offset;
+    }
+  }
+  gst_segment_sink_record_latency(self, start_us);
+
+  g_mutex_lock(&self->lock);
+  self->bytes_written += length;
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+gst_segment_sink_writer_seek(GstSegmentSink *self, guint64 offset)
+{
+  if (self->fd < 0)
+    return;
+  // Header rewrites are small and unaligned, the rest of the file is written buffered
+  if (self->file_direct) {
+    int flags = fcntl(self->fd, F_GETFL);
+    if (flags >= 0)
+      fcntl(self->fd, F_SETFL, flags & ~O_DIRECT);
+    self->file_direct = FALSE;
+  }
+  self->file_offset = offset;
+}
+
+static gpointer
+gst_segment_sink_writer_thread(gpointer data)
+{
+  GstSegmentSink *self = data;
+
+  for (;;) {
+    SegmentJob *job = g_async_queue_pop(self->jobs);
+    SegmentJobType type = job->type;
+    switch (type) {
+      case SEGMENT_JOB_OPEN:
+        gst_segment_sink_writer_open(self, job->path);
+        job->path = NULL;
+        break;
+      case SEGMENT_JOB_DATA:
+        gst_segment_sink_writer_write(self, job->chunk);
+        job->chunk->size = 0;
+        g_async_queue_push(self->free_chunks, job->chunk);
+        break;
+      case SEGMENT_JOB_SEEK:
+        gst_segment_sink_writer_seek(self, job->offset);
+        break;
+      case SEGMENT_JOB_CLOSE:
+        gst_segment_sink_writer_close(self, job->duration, job->dropped, TRUE);
+        break;
+      case SEGMENT_JOB_SYNC:
+        g_mutex_lock(&self->lock);
+        self->sync_done = job->offset;
+        g_cond_broadcast(&self->synced);
+        g_mutex_unlock(&self->lock);
+        break;
+      case SEGMENT_JOB_QUIT:
+        gst_segment_sink_writer_close(self, GST_CLOCK_TIME_NONE, 0, FALSE);
+        break;
+    }
+    g_free(job->path);
+    g_free(job);
+    if (type == SEGMENT_JOB_QUIT)
+      break;
+  }
+  return NULL;
+}
+
+static void
+gst_segment_sink_push_job(GstSegmentSink *self, SegmentJob *job)
+{
+  g_async_queue_push(self->jobs, job);
+  gint depth = g_async_queue_length(self->jobs);
+  g_mutex_lock(&self->lock);
+  self->queue_max = MAX(self->queue_max, (guint) MAX(depth, 0));
+  g_mutex_unlock(&self->lock);
+}
+
+static SegmentJob *
+segment_job_new(SegmentJobType type)
+{
+  SegmentJob *job = g_new0(SegmentJob, 1);
+  job->type = type;
+  job->duration = GST_CLOCK_TIME_NONE;
+  return job;
+}
+
+// Hands the filled part of the current chunk to the writer; only before a CLOSE or SEEK
+// when partial, so O_DIRECT writes stay aligned
+static void
+gst_segment_sink_flush_chunk(GstSegmentSink *self)
+{
+  if (!self->chunk || !self->chunk->size)
+    return;
+  SegmentJob *job = segment_job_new(SEGMENT_JOB_DATA);
+  job->chunk = self->chunk;
+  self->chunk = NULL;
+  gst_segment_sink_push_job(self, job);
+}
+
+static void
+gst_segment_sink_open_segment(GstSegmentSink *self, gchar *path)
+{
+  SegmentJob *job = segment_job_new(SEGMENT_JOB_OPEN);
+  job->path = path;
+  gst_segment_sink_push_job(self, job);
+  self->open = TRUE;
+  self->dropping = FALSE;
+  self->position = 0;
+  self->segment_start = self->segment_last = GST_CLOCK_TIME_NONE;
+  self->segment_dropped = 0;
+}
+
+static void
+gst_segment_sink_close_segment(GstSegmentSink *self)
+{
+  if (!self->open)
+    return;
+  gst_segment_sink_flush_chunk(self);
+  SegmentJob *job = segment_job_new(SEGMENT_JOB_CLOSE);
+  if (GST_CLOCK_TIME_IS_VALID(self->segment_start) && GST_CLOCK_TIME_IS_VALID(self->segment_last))
+    job->duration = self->segment_last - self->segment_start;
+  job->dropped = self->segment_dropped;
+  gst_segment_sink_push_job(self, job);
+  self->open = FALSE;
+}
+
+// Waits until the writer has done every job queued so far
+static void
+gst_segment_sink_sync_writer(GstSegmentSink *self)
+{
+  if (!self->writer)
+    return;
+  SegmentJob *job = segment_job_new(SEGMENT_JOB_SYNC);
+  job->offset = ++self->sync_requested;
+  gst_segment_sink_push_job(self, job);
+  g_mutex_lock(&self->lock);
+  while (self->sync_done < self->sync_requested)
+    g_cond_wait(&self->synced, &self->lock);
+  g_mutex_unlock(&self->lock);
+}
+
+// The writer thread must not post (it outlives the element's last reference
+// until finalize), so finished segments are announced from here
+static void
+gst_segment_sink_post_reports(GstSegmentSink *self)
+{
+  for (;;) {
+    g_mutex_lock(&self->lock);
+    GstStructure *s = g_queue_pop_head(&self->reports);
+    g_mutex_unlock(&self->lock);
+    if (!s)
+      break;
+    gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), s));
+  }
+}
+
+static gboolean
+gst_segment_sink_start(GstBaseSink *sink)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+
+  GST_OBJECT_LOCK(self);
+  guint write_size = self->write_size;
+  guint buffers = self->buffers;
+  gboolean self_cut = self->segment_duration > 0;
+  gchar *location = g_strdup(self->location);
+  GST_OBJECT_UNLOCK(self);
+
+  if (!self->writer) {
+    // write-size and buffers are fixed from here on
+    self->chunk_size = (write_size + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    for (guint i = 0; i < buffers; i++) {
+      SegmentChunk *chunk = g_new0(SegmentChunk, 1);
+      if (posix_memalign((void **) &chunk->data, IO_ALIGN, self->chunk_size) != 0) {
+        g_free(chunk);
+        g_free(location);
+        GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Could not allocate the write buffers"), (NULL));
+        return FALSE;
+      }
+      g_async_queue_push(self->free_chunks, chunk);
+    }
+    self->writer = g_thread_new("segmentsink", gst_segment_sink_writer_thread, self);
+  }
+
+  if (self_cut && !strstr(location, "%u")) {
+    GST_ELEMENT_ERROR(self, RESOURCE, SETTINGS, ("location needs %%u with segment-duration > 0"),
+        ("location: %s", location));
+    g_free(location);
+    return FALSE;
+  }
+
+  self->open = FALSE;
+  self->dropping = FALSE;
+  // Cut outside (splitmuxsink): this start is one segment
+  if (!self_cut)
+    gst_segment_sink_open_segment(self, location);
+  else
+    g_free(location);
+  return TRUE;
+}
+
+static gboolean
+gst_segment_sink_stop(GstBaseSink *sink)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+
+  // Waits for the writer to close the file (at most `buffers` chunks behind), otherwise the
+  // report of the last segment would only be queued after nothing posts them anymore
+  gst_segment_sink_close_segment(self);
+  gst_segment_sink_sync_writer(self);
+  gst_segment_sink_post_reports(self);
+  return TRUE;
+}
+
+static gboolean
+gst_segment_sink_event(GstBaseSink *sink, GstEvent *event)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT: {
+      const GstSegment *segment;
+      gst_event_parse_segment(event, &segment);
+      // Muxers that rewrite a header when they finish (mp4mux) seek back with a byte segment
+      if (segment->format == GST_FORMAT_BYTES && self->open && segment->start != self->position) {
+        gst_segment_sink_flush_chunk(self);
+        SegmentJob *job = segment_job_new(SEGMENT_JOB_SEEK);
+        job->offset = segment->start;
+        gst_segment_sink_push_job(self, job);
+        self->position = segment->start;
+      }
+      break;
+    }
+    case GST_EVENT_EOS:
+      gst_segment_sink_close_segment(self);
+      break;
+    default:
+      break;
+  }
+  return GST_BASE_SINK_CLASS(gst_segment_sink_parent_class)->event(sink, event);
+}
+
+// Next free chunk, waits for the writer to give one back; NULL once the sink is unlocked (flush / shutdown)
+static SegmentChunk *
+gst_segment_sink_wait_chunk(GstSegmentSink *self)
+{
+  for (;;) {
+    SegmentChunk *chunk = g_async_queue_timeout_pop(self->free_chunks, 50 * G_TIME_SPAN_MILLISECOND);
+    if (chunk)
+      return chunk;
+    GST_OBJECT_LOCK(self);
+    gboolean unlocked = self->unlocked;
+    GST_OBJECT_UNLOCK(self);
+    if (unlocked)
+      return NULL;
+  }
+}
+
+static gboolean
+gst_segment_sink_unlock(GstBaseSink *sink)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+  GST_OBJECT_LOCK(self);
+  self->unlocked = TRUE;
+  GST_OBJECT_UNLOCK(self);
+  return TRUE;
+}
+
+static gboolean
+gst_segment_sink_unlock_stop(GstBaseSink *sink)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+  GST_OBJECT_LOCK(self);
+  self->unlocked = FALSE;
+  GST_OBJECT_UNLOCK(self);
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_segment_sink_render(GstBaseSink *sink, GstBuffer *buffer)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(sink);
+  gint64 start_us = g_get_monotonic_time();
+  gboolean keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  GstClockTime ts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) : GST_BUFFER_DTS(buffer);
+
+  GST_OBJECT_LOCK(self);
+  GstClockTime segment_duration = self->segment_duration;
+  GST_OBJECT_UNLOCK(self);
+
+  if (segment_duration > 0 && keyframe) {
+    if (self->open && GST_CLOCK_TIME_IS_VALID(ts) && GST_CLOCK_TIME_IS_VALID(self->segment_start) &&
+        ts >= self->segment_start + segment_duration)
+      gst_segment_sink_close_segment(self);
+    if (!self->open)
+      gst_segment_sink_open_segment(self, NULL);
+  }
+  gst_segment_sink_post_reports(self);
+  // Self cutting waits for the first keyframe
+  if (!self->open)
+    return GST_FLOW_OK;
+
+  if (GST_CLOCK_TIME_IS_VALID(ts)) {
+    if (!GST_CLOCK_TIME_IS_VALID(self->segment_start))
+      self->segment_start = ts;
+    if (!GST_CLOCK_TIME_IS_VALID(self->segment_last) || ts > self->segment_last)
+      self->segment_last = ts;
+  }
+
+  gsize size = gst_buffer_get_size(buffer);
+  gsize room = (self->chunk ? self->chunk_size - self->chunk->size : 0) +
+               (gsize) MAX(g_async_queue_length(self->free_chunks), 0) * self->chunk_size;
+  // A muxer's byte stream (segment-duration 0) is never dropped from, it waits for the writer below
+  gboolean byte_stream = segment_duration == 0;
+  // A self cut stream resumes at a keyframe, so the segment stays decodable after the gap
+  if (self->dropping && keyframe && size <= room)
+    self->dropping = FALSE;
+  if (!byte_stream && (self->dropping || size > room)) {
+    self->dropping = TRUE;
+    self->segment_dropped++;
+    g_mutex_lock(&self->lock);
+    self->buffers_dropped++;
+    self->bytes_dropped += size;
+    g_mutex_unlock(&self->lock);
+  } else {
+    // Only this thread takes chunks, so room cannot shrink while copying; only a byte stream waits here
+    gsize done = 0;
+    while (done < size) {
+      if (!self->chunk && !(self->chunk = gst_segment_sink_wait_chunk(self)))
+        return GST_FLOW_FLUSHING;
+      gsize n = MIN(size - done, self->chunk_size - self->chunk->size);
+      gst_buffer_extract(buffer, done, self->chunk->data + self->chunk->size, n);
+      self->chunk->size += n;
+      done += n;
+      if (self->chunk->size == self->chunk_size) {
+        SegmentJob *job = segment_job_new(SEGMENT_JOB_DATA);
+        job->chunk = self->chunk;
+        self->chunk = NULL;
+        gst_segment_sink_push_job(self, job);
+      }
+    }
+    self->position += size;
+  }
+
+  guint64 elapsed_us = MAX(g_get_monotonic_time() - start_us, 0);
+  g_mutex_lock(&self->lock);
+  self->render_max_us = MAX(self->render_max_us, elapsed_us);
+  g_mutex_unlock(&self->lock);
+  return GST_FLOW_OK;
+}
+
+static GstStructure *
+gst_segment_sink_stats(GstSegmentSink *self)
+{
+  g_mutex_lock(&self->lock);
+  GstStructure *stats = gst_structure_new("application/x-segment-sink-stats",
+      "segments-written", G_TYPE_UINT64, self->segments_written,
+      "segments-deleted", G_TYPE_UINT64, self->segments_deleted,
+      "storage-used", G_TYPE_UINT64, self->storage_used,
+      "bytes-written", G_TYPE_UINT64, self->bytes_written,
+      "buffers-dropped", G_TYPE_UINT64, self->buffers_dropped,
+      "bytes-dropped", G_TYPE_UINT64, self->bytes_dropped,
+      "write-errors", G_TYPE_UINT64, self->write_errors,
+      "writes", G_TYPE_UINT64, self->writes,
+      "write-latency-avg-us", G_TYPE_UINT64, self->writes ? self->write_time_us / self->writes : 0,
+      "write-latency-p99-us", G_TYPE_UINT64, gst_segment_sink_latency_p99(self),
+      "write-latency-max-us", G_TYPE_UINT64, self->write_max_us,
+      "render-max-us", G_TYPE_UINT64, self->render_max_us,
+      "queue-max", G_TYPE_UINT, self->queue_max, NULL);
+  g_mutex_unlock(&self->lock);
+  return stats;
+}
+
+static void
+gst_segment_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free(self->location);
+      self->location = g_value_dup_string(value);
+      if (!self->location)
+        self->location = g_strdup(DEFAULT_LOCATION);
+      break;
+    case PROP_SEGMENT_DURATION:
+      self->segment_duration = g_value_get_uint64(value);
+      break;
+    case PROP_MAX_STORAGE:
+      self->max_storage = g_value_get_uint64(value);
+      break;
+    case PROP_STORAGE_PATTERN:
+      g_free(self->storage_pattern);
+      self->storage_pattern = g_value_dup_string(value);
+      break;
+    case PROP_PREALLOCATE:
+      self->preallocate = g_value_get_uint64(value);
+      break;
+    case PROP_WRITE_SIZE:
+      self->write_size = g_value_get_uint(value);
+      break;
+    case PROP_BUFFERS:
+      self->buffers = g_value_get_uint(value);
+      break;
+    case PROP_DIRECT_IO:
+      self->direct_io = g_value_get_boolean(value);
+      break;
+    case PROP_MAX_WRITE_RATE:
+      self->max_write_rate = g_value_get_uint64(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_segment_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(object);
+
+  if (prop_id == PROP_STATS) {
+    g_value_take_boxed(value, gst_segment_sink_stats(self));
+    return;
+  }
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string(value, self->location);
+      break;
+    case PROP_SEGMENT_DURATION:
+      g_value_set_uint64(value, self->segment_duration);
+      break;
+    case PROP_MAX_STORAGE:
+      g_value_set_uint64(value, self->max_storage);
+      break;
+    case PROP_STORAGE_PATTERN:
+      g_value_set_string(value, self->storage_pattern);
+      break;
+    case PROP_PREALLOCATE:
+      g_value_set_uint64(value, self->preallocate);
+      break;
+    case PROP_WRITE_SIZE:
+      g_value_set_uint(value, self->write_size);
+      break;
+    case PROP_BUFFERS:
+      g_value_set_uint(value, self->buffers);
+      break;
+    case PROP_DIRECT_IO:
+      g_value_set_boolean(value, self->direct_io);
+      break;
+    case PROP_MAX_WRITE_RATE:
+      g_value_set_uint64(value, self->max_write_rate);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_segment_sink_finalize(GObject *object)
+{
+  GstSegmentSink *self = GST_SEGMENT_SINK(object);
+
+  if (self->writer) {
+    // Waits for the queued chunks to reach the disk
+    g_async_queue_push(self->jobs, segment_job_new(SEGMENT_JOB_QUIT));
+    g_thread_join(self->writer);
+  }
+  SegmentChunk *chunk = self->chunk;
+  do {
+    if (chunk) {
+      free(chunk->data);
+      g_free(chunk);
+    }
+  } while ((chunk = g_async_queue_try_pop(self->free_chunks)));
+  g_async_queue_unref(self->free_chunks);
+  g_async_queue_unref(self->jobs);
+  g_queue_clear_full(&self->segments, segment_file_free);
+  g_queue_clear_full(&self->reports, (GDestroyNotify) gst_structure_free);
+  g_free(self->location);
+  g_free(self->storage_pattern);
+  g_cond_clear(&self->synced);
+  g_mutex_clear(&self->lock);
+  G_OBJECT_CLASS(gst_segment_sink_parent_class)->finalize(object);
+}
+
+static void
+gst_segment_sink_class_init(GstSegmentSinkClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS(klass);
+
+  gobject_class->set_property = gst_segment_sink_set_property;
+  gobject_class->get_property = gst_segment_sink_get_property;
+  gobject_class->finalize = gst_segment_sink_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_LOCATION,
+      g_param_spec_string("location", "Location",
+          "Segment file, \"%u\" is the segment index (needed with segment-duration > 0)",
+          DEFAULT_LOCATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_SEGMENT_DURATION,
+      g_param_spec_uint64("segment-duration", "Segment duration",
+          "Start a new segment at the first keyframe after this long (ns), 0 = one file per start (splitmuxsink)",
+          0, G_MAXUINT64, DEFAULT_SEGMENT_DURATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAX_STORAGE,
+      g_param_spec_uint64("max-storage", "Max storage",
+          "Delete the oldest segments while the segment files exceed this many bytes, 0 = unlimited",
+          0, G_MAXUINT64, DEFAULT_MAX_STORAGE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_STORAGE_PATTERN,
+      g_param_spec_string("storage-pattern", "Storage pattern",
+          "Files (\"%u\" = index) counted against max-storage, default: location",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_PREALLOCATE,
+      g_param_spec_uint64("preallocate", "Preallocate",
+          "Bytes reserved with fallocate for each segment, 0 = previous segment size + 1/8",
+          0, G_MAXUINT64, DEFAULT_PREALLOCATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_WRITE_SIZE,
+      g_param_spec_uint("write-size", "Write size",
+          "Bytes per write, rounded up to 4 KiB (fixed after the first start)",
+          IO_ALIGN, 64 * 1024 * 1024, DEFAULT_WRITE_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_BUFFERS,
+      g_param_spec_uint("buffers", "Buffers",
+          "Write buffers of write-size between the stream and the disk; when all are in use data is dropped",
+          2, 256, DEFAULT_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_DIRECT_IO,
+      g_param_spec_boolean("direct-io", "Direct I/O",
+          "Write with O_DIRECT instead of buffered with flush-behind",
+          DEFAULT_DIRECT_IO, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_MAX_WRITE_RATE,
+      g_param_spec_uint64("max-write-rate", "Max write rate",
+          "Disk bandwidth limit of the writer in bytes per second, 0 = unlimited",
+          0, G_MAXUINT64, DEFAULT_MAX_WRITE_RATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Stats",
+          "Segment, drop and write latency counters since the element was created",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_new_any();
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Segment recorder sink",
+    "Sink/File",
+    "Writes a stream as keyframe aligned segment files within a storage budget",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_sink_class->start = GST_DEBUG_FUNCPTR(gst_segment_sink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR(gst_segment_sink_stop);
+  base_sink_class->event = GST_DEBUG_FUNCPTR(gst_segment_sink_event);
+  base_sink_class->render = GST_DEBUG_FUNCPTR(gst_segment_sink_render);
+  base_sink_class->unlock = GST_DEBUG_FUNCPTR(gst_segment_sink_unlock);
+  base_sink_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_segment_sink_unlock_stop);
+}
+
+static void
+gst_segment_sink_init(GstSegmentSink *self)
+{
+  self->location = g_strdup(DEFAULT_LOCATION);
+  self->segment_duration = DEFAULT_SEGMENT_DURATION;
+  self->max_storage = DEFAULT_MAX_STORAGE;
+  self->preallocate = DEFAULT_PREALLOCATE;
+  self->write_size = DEFAULT_WRITE_SIZE;
+  self->buffers = DEFAULT_BUFFERS;
+  self->direct_io = DEFAULT_DIRECT_IO;
+  self->max_write_rate = DEFAULT_MAX_WRITE_RATE;
+  self->jobs = g_async_queue_new();
+  self->free_chunks = g_async_queue_new();
+  self->fd = -1;
+  g_queue_init(&self->segments);
+  g_queue_init(&self->reports);
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->synced);
+  gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
@@ -0,0 +1,14 @@
+#ifndef __GST_SEGMENT_SINK_H__
+#define __GST_SEGMENT_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SEGMENT_SINK   (gst_segment_sink_get_type())
+G_DECLARE_FINAL_TYPE(GstSegmentSink, gst_segment_sink, GST, SEGMENT_SINK, GstBaseSink)
+
+G_END_DECLS
+
+#endif /* __GST_SEGMENT_SINK_H__ */
@@ -0,0 +1,322 @@
+#define PACKAGE "rawcapturebypass"
+#include "gstsharpnessmeter.h"
+#include "sharpness.h"
+#include <gst/video/video.h>
+
+/*
+ * sharpnessmeter: passthrough focus / sharpness score of raw video, for aging
+ * runs where a unit slowly drifts out of focus or the ISP output softens
+ * while the frame rate stays fine:
+ *
+ *   ... ! video/x-raw,format=NV12 ! sharpnessmeter interval=300 ! hailoencodebin ! ...
+ *
+ * Every interval-th frame the Laplacian variance (sharpness.h) of the luma
+ * plane is computed for a centered ROI of center-size of the frame width and
+ * height and for each tile of a grid-columns x grid-rows grid, on every
+ * row-step-th row. The scores are posted as a "sharpness" element message:
+ *
+ *   frame, pts        frame index since start, buffer PTS
+ *   center            score of the center ROI
+ *   columns, rows     grid
+ *   tiles             score per tile, row major (GstValueArray of gdouble)
+ *   tile-min / -mean / -max
+ *   measure-us        time the measurement took
+ *
+ * The absolute value depends on the scene and the noise level; what matters
+ * is its trend on a fixed scene over the aging cycles, and the tiles show
+ * whether a softening is global (focus, ISP) or local (dirt, condensation).
+ * The buffers are never written, the element runs in passthrough.
+ */
+
+#define DEFAULT_INTERVAL 30
+#define DEFAULT_GRID_COLUMNS 4
+#define DEFAULT_GRID_ROWS 3
+#define DEFAULT_CENTER_SIZE 0.25
+#define DEFAULT_ROW_STEP 2
+
+enum {
+  PROP_0,
+  PROP_INTERVAL,
+  PROP_GRID_COLUMNS,
+  PROP_GRID_ROWS,
+  PROP_CENTER_SIZE,
+  PROP_ROW_STEP,
+  PROP_STATS,
+};
+
+struct _GstSharpnessMeter {
+  GstBaseTransform parent;
+
+  // Properties, object lock
+  guint interval;
+  guint columns, rows;
+  gdouble center_size;
+  guint row_step;
+
+  GstVideoInfo info;
+  guint64 frame;
+
+  guint64 frames_measured;
+  guint64 measure_time_us;
+  guint64 measure_max_us;
+  gdouble last_center;
+};
+
+G_DEFINE_TYPE(GstSharpnessMeter, gst_sharpness_meter, GST_TYPE_BASE_TRANSFORM)
+
+static gboolean
+gst_sharpness_meter_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps)
+{
+  GstSharpnessMeter *self = GST_SHARPNESS_METER(trans);
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps(&info, incaps))
+    return FALSE;
+  GST_OBJECT_LOCK(self);
+  self->info = info;
+  GST_OBJECT_UNLOCK(self);
+  return TRUE;
+}
+
+static gdouble
+gst_sharpness_meter_window(GstVideoFrame *frame, guint x, guint y, guint width, guint height, guint row_step)
+{
+  SharpnessSums sums = {0, 0, 0};
+  sharpness_laplacian(GST_VIDEO_FRAME_PLANE_DATA(frame, 0), GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0),
+      GST_VIDEO_FRAME_WIDTH(frame), GST_VIDEO_FRAME_HEIGHT(frame), x, y, width, height, row_step, &sums);
+  return sharpness_variance(&sums);
+}
+
+// Scores of one frame, without the object lock
+static GstStructure *
+gst_sharpness_meter_measure(GstVideoFrame *frame, guint columns, guint rows, gdouble center_size, guint row_step)
+{
+  guint width = GST_VIDEO_FRAME_WIDTH(frame);
+  guint height = GST_VIDEO_FRAME_HEIGHT(frame);
+  guint center_width = MAX((guint) (width * center_size), 1);
+  guint center_height = MAX((guint) (height * center_size), 1);
+  gdouble center = gst_sharpness_meter_window(frame, (width - center_width) / 2, (height - center_height) / 2,
+      center_width, center_height, row_step);
+
+  GValue tiles = G_VALUE_INIT;
+  GValue score = G_VALUE_INIT;
+  gdouble tile_min = G_MAXDOUBLE, tile_max = 0.0, tile_total = 0.0;
+  g_value_init(&tiles, GST_TYPE_ARRAY);
+  g_value_init(&score, G_TYPE_DOUBLE);
+  for (guint r = 0; r < rows; r++) {
+    guint y = r * height / rows;
+    for (guint c = 0; c < columns; c++) {
+      guint x = c * width / columns;
+      gdouble value = gst_sharpness_meter_window(frame, x, y, (c + 1) * width / columns - x,
+          (r + 1) * height / rows - y, row_step);
+      tile_min = MIN(tile_min, value);
+      tile_max = MAX(tile_max, value);
+      tile_total += value;
+      g_value_set_double(&score, value);
+      gst_value_array_append_value(&tiles, &score);
+    }
+  }
+  g_value_unset(&score);
+
+  GstStructure *s = gst_structure_new("sharpness",
+      "center", G_TYPE_DOUBLE, center,
+      "columns", G_TYPE_UINT, columns,
+      "rows", G_TYPE_UINT, rows,
+      "tile-min", G_TYPE_DOUBLE, tile_min,
+      "tile-mean", G_TYPE_DOUBLE, tile_total / (columns * rows),
+      "tile-max", G_TYPE_DOUBLE, tile_max,
+      NULL);
+  gst_structure_take_value(s, "tiles", &tiles);
+  return s;
+}
+
+static GstFlowReturn
+gst_sharpness_meter_transform_ip(GstBaseTransform *trans, GstBuffer *buf)
+{
+  GstSharpnessMeter *self = GST_SHARPNESS_METER(trans);
+
+  GST_OBJECT_LOCK(self);
+  guint64 frame_index = self->frame++;
+  gboolean due = self->interval > 0 && frame_index % self->interval == 0;
+  guint columns = self->columns;
+  guint rows = self->rows;
+  gdouble center_size = self->center_size;
+  guint row_step = self->row_step;
+  GstVideoInfo info = self->info;
+  GST_OBJECT_UNLOCK(self);
+
+  if (!due)
+    return GST_FLOW_OK;
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, &info, buf, GST_MAP_READ)) {
+    GST_WARNING_OBJECT(self, "could not map frame %" G_GUINT64_FORMAT, frame_index);
+    return GST_FLOW_OK;
+  }
+  gint64 start = g_get_monotonic_time();
+  GstStructure *scores = gst_sharpness_meter_measure(&frame, columns, rows, center_size, row_step);
+  guint64 elapsed = g_get_monotonic_time() - start;
+  gst_video_frame_unmap(&frame);
+
+  gdouble center = 0.0;
+  gst_structure_get_double(scores, "center", &center);
+  gst_structure_set(scores,
+      "frame", G_TYPE_UINT64, frame_index,
+      "pts", G_TYPE_UINT64, GST_BUFFER_PTS(buf),
+      "measure-us", G_TYPE_UINT64, elapsed,
+      NULL);
+
+  GST_OBJECT_LOCK(self);
+  self->frames_measured++;
+  self->measure_time_us += elapsed;
+  self->measure_max_us = MAX(self->measure_max_us, elapsed);
+  self->last_center = center;
+  GST_OBJECT_UNLOCK(self);
+
+  gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), scores));
+  return GST_FLOW_OK;
+}
+
+static GstStructure *
+gst_sharpness_meter_stats(GstSharpnessMeter *self)
+{
+  GST_OBJECT_LOCK(self);
+  GstStructure *stats = gst_structure_new("application/x-sharpnessmeter-stats",
+      "frames", G_TYPE_UINT64, self->frame,
+      "frames-measured", G_TYPE_UINT64, self->frames_measured,
+      "measure-avg-us", G_TYPE_UINT64, self->frames_measured ? self->measure_time_us / self->frames_measured : 0,
+      "measure-max-us", G_TYPE_UINT64, self->measure_max_us,
+      "center", G_TYPE_DOUBLE, self->last_center, NULL);
+  GST_OBJECT_UNLOCK(self);
+  return stats;
+}
+
+static void
+gst_sharpness_meter_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstSharpnessMeter *self = GST_SHARPNESS_METER(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_INTERVAL:
+      self->interval = g_value_get_uint(value);
+      break;
+    case PROP_GRID_COLUMNS:
+      self->columns = g_value_get_uint(value);
+      break;
+    case PROP_GRID_ROWS:
+      self->rows = g_value_get_uint(value);
+      break;
+    case PROP_CENTER_SIZE:
+      self->center_size = g_value_get_double(value);
+      break;
+    case PROP_ROW_STEP:
+      self->row_step = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_sharpness_meter_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstSharpnessMeter *self = GST_SHARPNESS_METER(object);
+
+  if (prop_id == PROP_STATS) {
+    g_value_take_boxed(value, gst_sharpness_meter_stats(self));
+    return;
+  }
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_INTERVAL:
+      g_value_set_uint(value, self->interval);
+      break;
+    case PROP_GRID_COLUMNS:
+      g_value_set_uint(value, self->columns);
+      break;
+    case PROP_GRID_ROWS:
+      g_value_set_uint(value, self->rows);
+      break;
+    case PROP_CENTER_SIZE:
+      g_value_set_double(value, self->center_size);
+      break;
+    case PROP_ROW_STEP:
+      g_value_set_uint(value, self->row_step);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_sharpness_meter_class_init(GstSharpnessMeterClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+  gobject_class->set_property = gst_sharpness_meter_set_property;
+  gobject_class->get_property = gst_sharpness_meter_get_property;
+
+  g_object_class_install_property(gobject_class, PROP_INTERVAL,
+      g_param_spec_uint("interval", "Interval",
+          "Measure every interval-th frame, starting with the first, 0 = never",
+          0, G_MAXUINT, DEFAULT_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_GRID_COLUMNS,
+      g_param_spec_uint("grid-columns", "Grid columns",
+          "Tile columns of the score grid",
+          1, 32, DEFAULT_GRID_COLUMNS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_GRID_ROWS,
+      g_param_spec_uint("grid-rows", "Grid rows",
+          "Tile rows of the score grid",
+          1, 32, DEFAULT_GRID_ROWS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_CENTER_SIZE,
+      g_param_spec_double("center-size", "Center size",
+          "Width and height of the centered ROI as a fraction of the frame",
+          0.01, 1.0, DEFAULT_CENTER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_ROW_STEP,
+      g_param_spec_uint("row-step", "Row step",
+          "Use every row-step-th row of the luma plane",
+          1, 16, DEFAULT_ROW_STEP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "Stats",
+          "Measured frames, measurement cost and the last center score",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  // Formats whose first plane is 8 bit luma
+  GstCaps *caps = gst_caps_from_string("video/x-raw, format=(string){ NV12, NV21, I420, YV12, GRAY8 }");
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Sharpness meter",
+    "Filter/Analyzer/Video",
+    "Posts the Laplacian variance of a center ROI and a tile grid of every Nth frame, for focus drift tracking",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_transform_class->set_caps = GST_DEBUG_FUNCPTR(gst_sharpness_meter_set_caps);
+  base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_sharpness_meter_transform_ip);
+}
+
+static void
+gst_sharpness_meter_init(GstSharpnessMeter *self)
+{
+  self->interval = DEFAULT_INTERVAL;
+  self->columns = DEFAULT_GRID_COLUMNS;
+  self->rows = DEFAULT_GRID_ROWS;
+  self->center_size = DEFAULT_CENTER_SIZE;
+  self->row_step = DEFAULT_ROW_STEP;
+  gst_video_info_init(&self->info);
+  gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(self), TRUE);
+}
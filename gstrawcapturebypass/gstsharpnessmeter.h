@@ -0,0 +1,14 @@
+#ifndef __GST_SHARPNESS_METER_H__
+#define __GST_SHARPNESS_METER_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SHARPNESS_METER   (gst_sharpness_meter_get_type())
+G_DECLARE_FINAL_TYPE(GstSharpnessMeter, gst_sharpness_meter, GST, SHARPNESS_METER, GstBaseTransform)
+
+G_END_DECLS
+
+#endif /* __GST_SHARPNESS_METER_H__ */
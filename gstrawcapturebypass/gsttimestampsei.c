@@ -0,0 +1,379 @@
+#define PACKAGE "rawcapturebypass"
+#include "gsttimestampsei.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * timestampsei: stamps every H.264 access unit with its capture time.
+ *
+ * Sits between the encoder and rtph264pay (byte-stream, au alignment) and
+ * inserts one user_data_unregistered SEI NAL per access unit (after the AUD
+ * when there is one). The SEI carries the capture time of the frame on the
+ * device CLOCK_REALTIME in us and a frame index; rtp_analyzer finds it in the
+ * RTP payload without decoding and reports glass-to-wire-to-host latency.
+ *
+ * The capture time is derived from the buffer PTS: v4l2src timestamps a frame
+ * with the pipeline clock when it is captured, so the time since capture is
+ * clock_now - (base_time + running_time(PTS)); that age is subtracted from
+ * CLOCK_REALTIME. Without a clock or PTS the time of encoder output is used.
+ *
+ * sync-port > 0 answers clock sync requests on that UDP port (NTP style
+ * t1/t2/t3 exchange, see gsttimestampsei.h) so the host can estimate the
+ * offset between its clock and the device clock without NTP or PTP.
+ */
+
+#define DEFAULT_SYNC_PORT 0
+#define DEFAULT_ENABLED TRUE
+
+#define SEI_NAL_TYPE 6
+#define AUD_NAL_TYPE 9
+#define SEI_USER_DATA_UNREGISTERED 5
+#define SYNC_POLL_MS 100
+
+enum {
+  PROP_0,
+  PROP_ENABLED,
+  PROP_SYNC_PORT,
+  PROP_FRAMES_STAMPED,
+  PROP_SYNC_REQUESTS,
+};
+
+struct _GstTimestampSei {
+  GstBaseTransform parent;
+
+  gboolean enabled;
+  gint sync_port;
+
+  guint32 frame_index;
+  guint64 frames_stamped;
+
+  int sync_fd;
+  GThread *sync_thread;
+  gint sync_stop;
+  guint64 sync_requests;
+};
+
+G_DEFINE_TYPE(GstTimestampSei, gst_timestamp_sei, GST_TYPE_BASE_TRANSFORM)
+
+static gint64
+gst_timestamp_sei_realtime_us(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (gint64) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void
+gst_timestamp_sei_write_be(guint8 *out, guint64 value, guint bytes)
+{
+  for (guint i = 0; i < bytes; i++)
+    out[i] = (guint8) (value >> (8 * (bytes - 1 - i)));
+}
+
+// Capture time of the buffer on CLOCK_REALTIME (us), see the element description
+static gint64
+gst_timestamp_sei_capture_us(GstTimestampSei *self, GstBuffer *buf)
+{
+  gint64 now_us = gst_timestamp_sei_realtime_us();
+  if (!GST_BUFFER_PTS_IS_VALID(buf))
+    return now_us;
+
+  GstClock *clock = gst_element_get_clock(GST_ELEMENT(self));
+  if (!clock)
+    return now_us;
+  GstClockTime clock_now = gst_clock_get_time(clock);
+  gst_object_unref(clock);
+
+  GstClockTime running_time =
+      gst_segment_to_running_time(&GST_BASE_TRANSFORM(self)->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  if (!GST_CLOCK_TIME_IS_VALID(running_time))
+    return now_us;
+  GstClockTime captured = gst_element_get_base_time(GST_ELEMENT(self)) + running_time;
+  if (captured > clock_now)
+    return now_us;
+  return now_us - (gint64) ((clock_now - captured) / GST_USECOND);
+}
+
+/*
+ * Complete SEI NAL with 4 byte start code: header, payload type / size,
+ * payload with emulation prevention bytes, rbsp trailing bits.
+ * Returns the size written to out (at most 64 bytes).
+ */
+static gsize
+gst_timestamp_sei_build(guint8 *out, gint64 capture_us, guint32 frame_index)
+{
+  guint8 payload[TIMESTAMP_SEI_PAYLOAD_SIZE];
+  memcpy(payload, TIMESTAMP_SEI_UUID, 16);
+  gst_timestamp_sei_write_be(payload + 16, (guint64) capture_us, 8);
+  gst_timestamp_sei_write_be(payload + 24, frame_index, 4);
+
+  gsize n = 0;
+  out[n++] = 0;
+  out[n++] = 0;
+  out[n++] = 0;
+  out[n++] = 1;
+  out[n++] = SEI_NAL_TYPE;
+
+  guint8 rbsp[2 + TIMESTAMP_SEI_PAYLOAD_SIZE + 1];
+  gsize rbsp_size = 0;
+  rbsp[rbsp_size++] = SEI_USER_DATA_UNREGISTERED;
+  rbsp[rbsp_size++] = TIMESTAMP_SEI_PAYLOAD_SIZE;
+  memcpy(rbsp + rbsp_size, payload, sizeof(payload));
+  rbsp_size += sizeof(payload);
+  rbsp[rbsp_size++] = 0x80;
+
+  guint zeros = 0;
+  for (gsize i = 0; i < rbsp_size; i++) {
+    if (zeros >= 2 && rbsp[i] <= 3) {
+      out[n++] = 3;
+      zeros = 0;
+    }
+    out[n++] = rbsp[i];
+    zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+  }
+  return n;
+}
+
+// Size of a leading AUD NAL including its start code, 0 when the access unit does not start with one
+static gsize
+gst_timestamp_sei_aud_size(GstMemory *memory)
+{
+  GstMapInfo map;
+  gsize size = 0;
+  if (!gst_memory_map(memory, &map, GST_MAP_READ))
+    return 0;
+  gsize start = 0;
+  if (map.size >= 4 && map.data[0] == 0 && map.data[1] == 0 && map.data[2] == 0 && map.data[3] == 1)
+    start = 4;
+  else if (map.size >= 3 && map.data[0] == 0 && map.data[1] == 0 && map.data[2] == 1)
+    start = 3;
+  // AUD: header + primary_pic_type byte
+  if (start && map.size >= start + 2 && (map.data[start] & 0x1f) == AUD_NAL_TYPE)
+    size = start + 2;
+  gst_memory_unmap(memory, &map);
+  return size;
+}
+
+static GstFlowReturn
+gst_timestamp_sei_transform_ip(GstBaseTransform *trans, GstBuffer *buf)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(trans);
+
+  GST_OBJECT_LOCK(self);
+  gboolean enabled = self->enabled;
+  GST_OBJECT_UNLOCK(self);
+  if (!enabled || gst_buffer_n_memory(buf) == 0)
+    return GST_FLOW_OK;
+
+  guint8 sei[64];
+  gsize sei_size = gst_timestamp_sei_build(sei, gst_timestamp_sei_capture_us(self, buf), self->frame_index++);
+  guint8 *sei_data = g_malloc(sei_size);
+  memcpy(sei_data, sei, sei_size);
+  GstMemory *sei_memory = gst_memory_new_wrapped(0, sei_data, sei_size, 0, sei_size, sei_data, g_free);
+
+  // The encoder memory is shared, not copied: [AUD][SEI][rest of the access unit]
+  GstMemory *first = gst_buffer_peek_memory(buf, 0);
+  gsize aud_size = gst_timestamp_sei_aud_size(first);
+  if (aud_size && aud_size < first->size) {
+    GstMemory *aud = gst_memory_share(first, 0, aud_size);
+    GstMemory *rest = gst_memory_share(first, aud_size, -1);
+    gst_buffer_replace_memory(buf, 0, aud);
+    gst_buffer_insert_memory(buf, 1, sei_memory);
+    gst_buffer_insert_memory(buf, 2, rest);
+  } else if (aud_size) {
+    gst_buffer_insert_memory(buf, 1, sei_memory);
+  } else {
+    gst_buffer_prepend_memory(buf, sei_memory);
+  }
+
+  GST_OBJECT_LOCK(self);
+  self->frames_stamped++;
+  GST_OBJECT_UNLOCK(self);
+  return GST_FLOW_OK;
+}
+
+// Answers clock sync requests until sync_stop is set
+static gpointer
+gst_timestamp_sei_sync_loop(gpointer data)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(data);
+  struct pollfd pfd = {.fd = self->sync_fd, .events = POLLIN};
+
+  while (!g_atomic_int_get(&self->sync_stop)) {
+    if (poll(&pfd, 1, SYNC_POLL_MS) <= 0)
+      continue;
+
+    guint8 request[64];
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    ssize_t length = recvfrom(self->sync_fd, request, sizeof(request), 0, (struct sockaddr *) &from, &from_len);
+    gint64 t2 = gst_timestamp_sei_realtime_us();
+    if (length != TIMESTAMP_SYNC_REQUEST_SIZE || memcmp(request, "TSYQ", 4) != 0)
+      continue;
+
+    // Echo seq and t1, add receive and send times on the device clock
+    guint8 reply[TIMESTAMP_SYNC_REPLY_SIZE];
+    memcpy(reply, "TSYR", 4);
+    memcpy(reply + 4, request + 4, 12);
+    gst_timestamp_sei_write_be(reply + 16, (guint64) t2, 8);
+    gst_timestamp_sei_write_be(reply + 24, (guint64) gst_timestamp_sei_realtime_us(), 8);
+    sendto(self->sync_fd, reply, sizeof(reply), 0, (struct sockaddr *) &from, from_len);
+
+    GST_OBJECT_LOCK(self);
+    self->sync_requests++;
+    GST_OBJECT_UNLOCK(self);
+  }
+  return NULL;
+}
+
+static gboolean
+gst_timestamp_sei_start(GstBaseTransform *trans)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(trans);
+
+  self->frame_index = 0;
+  self->frames_stamped = 0;
+  self->sync_requests = 0;
+  if (self->sync_port <= 0)
+    return TRUE;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(self->sync_port);
+  self->sync_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+  // Sync is a monitoring aid, the stream runs without it
+  if (self->sync_fd < 0 || bind(self->sync_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    g_warning("timestampsei: cannot listen for clock sync on port %d (%s)", self->sync_port, g_strerror(errno));
+    if (self->sync_fd >= 0)
+      close(self->sync_fd);
+    self->sync_fd = -1;
+    return TRUE;
+  }
+
+  g_atomic_int_set(&self->sync_stop, FALSE);
+  self->sync_thread = g_thread_new("timestampsei-sync", gst_timestamp_sei_sync_loop, self);
+  return TRUE;
+}
+
+static gboolean
+gst_timestamp_sei_stop(GstBaseTransform *trans)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(trans);
+
+  if (self->sync_thread) {
+    g_atomic_int_set(&self->sync_stop, TRUE);
+    g_thread_join(self->sync_thread);
+    self->sync_thread = NULL;
+  }
+  if (self->sync_fd >= 0) {
+    close(self->sync_fd);
+    self->sync_fd = -1;
+  }
+  return TRUE;
+}
+
+static void
+gst_timestamp_sei_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_ENABLED:
+      self->enabled = g_value_get_boolean(value);
+      break;
+    case PROP_SYNC_PORT:
+      self->sync_port = g_value_get_int(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_timestamp_sei_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstTimestampSei *self = GST_TIMESTAMP_SEI(object);
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id) {
+    case PROP_ENABLED:
+      g_value_set_boolean(value, self->enabled);
+      break;
+    case PROP_SYNC_PORT:
+      g_value_set_int(value, self->sync_port);
+      break;
+    case PROP_FRAMES_STAMPED:
+      g_value_set_uint64(value, self->frames_stamped);
+      break;
+    case PROP_SYNC_REQUESTS:
+      g_value_set_uint64(value, self->sync_requests);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_timestamp_sei_class_init(GstTimestampSeiClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+  gobject_class->set_property = gst_timestamp_sei_set_property;
+  gobject_class->get_property = gst_timestamp_sei_get_property;
+
+  g_object_class_install_property(gobject_class, PROP_ENABLED,
+      g_param_spec_boolean("enabled", "Enabled", "Insert the capture timestamp SEI",
+          DEFAULT_ENABLED, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property(gobject_class, PROP_SYNC_PORT,
+      g_param_spec_int("sync-port", "Sync port", "UDP port answering clock sync requests (0 = off)",
+          0, 65535, DEFAULT_SYNC_PORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_FRAMES_STAMPED,
+      g_param_spec_uint64("frames-stamped", "Frames stamped", "Access units a timestamp SEI was inserted into",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(gobject_class, PROP_SYNC_REQUESTS,
+      g_param_spec_uint64("sync-requests", "Sync requests", "Clock sync requests answered",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  GstCaps *caps = gst_caps_from_string("video/x-h264, stream-format=(string)byte-stream, alignment=(string)au");
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+  gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+  gst_caps_unref(caps);
+
+  gst_element_class_set_metadata(
+    element_class,
+    "Capture timestamp SEI",
+    "Filter/Video",
+    "Inserts the capture time of every H.264 access unit as user data SEI, answers clock sync requests",
+    "Kevin P <your.email@example.com>"
+  );
+
+  base_transform_class->start = GST_DEBUG_FUNCPTR(gst_timestamp_sei_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR(gst_timestamp_sei_stop);
+  base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_timestamp_sei_transform_ip);
+}
+
+static void
+gst_timestamp_sei_init(GstTimestampSei *self)
+{
+  self->enabled = DEFAULT_ENABLED;
+  self->sync_port = DEFAULT_SYNC_PORT;
+  self->sync_fd = -1;
+  gst_base_transform_set_in_place(GST_BASE_TRANSFORM(self), TRUE);
+}
@@ -0,0 +1,31 @@
+#ifndef __GST_TIMESTAMP_SEI_H__
+#define __GST_TIMESTAMP_SEI_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TIMESTAMP_SEI   (gst_timestamp_sei_get_type())
+G_DECLARE_FINAL_TYPE(GstTimestampSei, gst_timestamp_sei, GST, TIMESTAMP_SEI, GstBaseTransform)
+
+/*
+ * Wire formats shared with rtp_analyzer (rtp_analyzer_1.10.0, latency.hpp).
+ *
+ * SEI: user_data_unregistered (payload type 5) with
+ *   uuid[16] = TIMESTAMP_SEI_UUID
+ *   capture time, int64 big endian, device CLOCK_REALTIME in us
+ *   frame index, uint32 big endian
+ *
+ * Clock sync over UDP (sync-port), all fields big endian:
+ *   request "TSYQ" seq:u32 t1:i64                    (16 bytes, host clock)
+ *   reply   "TSYR" seq:u32 t1:i64 t2:i64 t3:i64      (32 bytes, t2/t3 device clock)
+ */
+#define TIMESTAMP_SEI_UUID "hailo-capture-ts"
+#define TIMESTAMP_SEI_PAYLOAD_SIZE (16 + 8 + 4)
+#define TIMESTAMP_SYNC_REQUEST_SIZE 16
+#define TIMESTAMP_SYNC_REPLY_SIZE 32
+
+G_END_DECLS
+
+#endif /* __GST_TIMESTAMP_SEI_H__ */
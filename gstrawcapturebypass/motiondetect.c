@@ -0,0 +1,183 @@
+#include "motiondetect.h"
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MOTION_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MOTION_SSE2 1
+#endif
+
+// column_diff holds at most this many rows of differences (255 * 256 < 65536)
+#define COLUMN_DIFF_MAX_ROWS 256
+
+// Sums of the groups consecutive 8 byte groups of src
+static void
+motion_sum_groups(const guint8 *src, guint groups, guint32 *sums)
+{
+  guint g = 0;
+#if MOTION_NEON
+  for (; g + 2 <= groups; g += 2) {
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vld1q_u8(src + g * 8))));
+    sums[g] = (guint32) vgetq_lane_u64(s, 0);
+    sums[g + 1] = (guint32) vgetq_lane_u64(s, 1);
+  }
+#elif MOTION_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; g + 2 <= groups; g += 2) {
+    __m128i s = _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (src + g * 8)), zero);
+    sums[g] = (guint32) _mm_cvtsi128_si32(s);
+    sums[g + 1] = (guint32) _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+  }
+#endif
+  for (; g < groups; g++) {
+    guint32 sum = 0;
+    for (guint i = 0; i < 8; i++)
+      sum += src[g * 8 + i];
+    sums[g] = sum;
+  }
+}
+
+// diff[i] += |a[i] - b[i]|
+static void
+motion_accumulate_absdiff(const guint8 *a, const guint8 *b, guint16 *diff, guint n)
+{
+  guint i = 0;
+#if MOTION_NEON
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+    vst1q_u16(diff + i, vaddw_u8(vld1q_u16(diff + i), vget_low_u8(d)));
+    vst1q_u16(diff + i + 8, vaddw_u8(vld1q_u16(diff + i + 8), vget_high_u8(d)));
+  }
+#elif MOTION_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+    __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+    __m128i lo = _mm_loadu_si128((const __m128i *) (diff + i));
+    __m128i hi = _mm_loadu_si128((const __m128i *) (diff + i + 8));
+    _mm_storeu_si128((__m128i *) (diff + i), _mm_add_epi16(lo, _mm_unpacklo_epi8(d, zero)));
+    _mm_storeu_si128((__m128i *) (diff + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(d, zero)));
+  }
+#endif
+  for (; i < n; i++)
+    diff[i] += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+}
+
+// Adds the column differences to the tiles of tile row r and clears them
+static void
+motion_flush_columns(MotionDetect *md, guint r)
+{
+  for (guint c = 0; c < md->columns; c++) {
+    guint64 sad = 0;
+    for (guint x = md->tile_x[c]; x < md->tile_x[c + 1]; x++)
+      sad += md->column_diff[x];
+    md->tile_sad[r * md->columns + c] += sad;
+  }
+  memset(md->column_diff, 0, md->width * sizeof(guint16));
+}
+
+gboolean
+motion_detect_init(MotionDetect *md, guint frame_width, guint frame_height, guint step, guint columns, guint rows)
+{
+  memset(md, 0, sizeof(*md));
+  md->shift = step >= 32 ? 5 : step >= 16 ? 4 : 3;
+  md->step = 1u << md->shift;
+  md->frame_width = frame_width;
+  md->frame_height = frame_height;
+  md->width = frame_width / md->step;
+  md->height = frame_height / md->step;
+  md->columns = columns;
+  md->rows = rows;
+  if (!columns || !rows || md->width < columns || md->height < rows)
+    return FALSE;
+
+  md->reference = g_malloc0(md->width * md->height);
+  md->current = g_malloc0(md->width * md->height);
+  md->tile_x = g_new(guint, columns + 1);
+  md->tile_y = g_new(guint, rows + 1);
+  for (guint c = 0; c <= columns; c++)
+    md->tile_x[c] = c * md->width / columns;
+  for (guint r = 0; r <= rows; r++)
+    md->tile_y[r] = r * md->height / rows;
+  md->tile_sad = g_new0(guint64, columns * rows);
+  md->group_sums = g_new(guint32, md->width * (md->step / 8));
+  md->column_diff = g_new0(guint16, md->width);
+  return TRUE;
+}
+
+void
+motion_detect_clear(MotionDetect *md)
+{
+  g_free(md->reference);
+  g_free(md->current);
+  g_free(md->tile_x);
+  g_free(md->tile_y);
+  g_free(md->tile_sad);
+  g_free(md->group_sums);
+  g_free(md->column_diff);
+  memset(md, 0, sizeof(*md));
+}
+
+void
+motion_detect_reset(MotionDetect *md)
+{
+  md->have_reference = FALSE;
+}
+
+guint
+motion_detect_frame(MotionDetect *md, const guint8 *luma, gsize stride, guint threshold, guint8 *levels)
+{
+  guint groups_per_sample = md->step / 8;
+  guint groups = md->width * groups_per_sample;
+
+  // Subsample: the middle row of every step rows, averaged over step pixels
+  for (guint y = 0; y < md->height; y++) {
+    const guint8 *row = luma + (gsize) (y * md->step + md->step / 2) * stride;
+    guint8 *out = md->current + y * md->width;
+    motion_sum_groups(row, groups, md->group_sums);
+    for (guint x = 0; x < md->width; x++) {
+      guint32 sum = 0;
+      for (guint g = 0; g < groups_per_sample; g++)
+        sum += md->group_sums[x * groups_per_sample + g];
+      out[x] = (guint8) (sum >> md->shift);
+    }
+  }
+
+  guint changed = 0;
+  if (md->have_reference) {
+    memset(md->tile_sad, 0, md->columns * md->rows * sizeof(guint64));
+    for (guint r = 0; r < md->rows; r++) {
+      guint pending = 0;
+      for (guint y = md->tile_y[r]; y < md->tile_y[r + 1]; y++) {
+        motion_accumulate_absdiff(md->current + y * md->width, md->reference + y * md->width, md->column_diff,
+            md->width);
+        if (++pending == COLUMN_DIFF_MAX_ROWS) {
+          motion_flush_columns(md, r);
+          pending = 0;
+        }
+      }
+      motion_flush_columns(md, r);
+    }
+    for (guint r = 0; r < md->rows; r++) {
+      for (guint c = 0; c < md->columns; c++) {
+        guint64 samples = (guint64) (md->tile_x[c + 1] - md->tile_x[c]) * (md->tile_y[r + 1] - md->tile_y[r]);
+        guint64 level = md->tile_sad[r * md->columns + c] / samples;
+        levels[r * md->columns + c] = (guint8) MIN(level, 255);
+        if (level > threshold)
+          changed++;
+      }
+    }
+  } else {
+    memset(levels, 0, md->columns * md->rows);
+  }
+
+  // The plane just computed is the reference of the next call
+  guint8 *previous = md->reference;
+  md->reference = md->current;
+  md->current = previous;
+  md->have_reference = TRUE;
+  return changed;
+}
@@ -0,0 +1,51 @@
+#ifndef __MOTION_DETECT_H__
+#define __MOTION_DETECT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Tile based frame differencing on a subsampled luma plane, for the motion
+ * trigger of rawcapturebypass.
+ *
+ * Every step-th row of the luma plane is read and averaged over step pixels
+ * horizontally (step 8, 16 or 32), so a 3840x2160 frame becomes a 240x135
+ * plane with step 16 and only 1/16 of the rows are touched. The sum of
+ * absolute differences against the previous processed plane is taken per
+ * tile of a columns x rows grid; a tile's level is its mean absolute
+ * difference (0..255). Row sums and SAD use NEON (aarch64 / armv7 with NEON)
+ * or SSE2 when available, plain C otherwise.
+ */
+typedef struct {
+  guint step;
+  guint shift;                // log2(step)
+  guint columns, rows;        // tile grid
+  guint width, height;        // subsampled plane
+  guint frame_width, frame_height;
+  guint8 *reference;          // previous plane, width * height
+  guint8 *current;
+  gboolean have_reference;
+  guint *tile_x;              // columns + 1 tile borders in the plane
+  guint *tile_y;              // rows + 1
+  guint64 *tile_sad;          // columns * rows
+  guint32 *group_sums;        // sums of 8 pixels of one sampled row
+  guint16 *column_diff;       // absolute differences of a tile row, per plane column
+} MotionDetect;
+
+// FALSE if the frame is smaller than one sample per tile
+gboolean motion_detect_init(MotionDetect *md, guint frame_width, guint frame_height, guint step, guint columns,
+                            guint rows);
+void motion_detect_clear(MotionDetect *md);
+// Forgets the reference, the next frame only becomes the new reference
+void motion_detect_reset(MotionDetect *md);
+
+// Subsamples the luma plane, compares it with the reference and makes it the
+// new reference. levels gets the mean absolute difference of every tile (row
+// major, columns * rows). Returns the number of tiles above threshold, 0 for
+// the first frame after init / reset.
+guint motion_detect_frame(MotionDetect *md, const guint8 *luma, gsize stride, guint threshold, guint8 *levels);
+
+G_END_DECLS
+
+#endif /* __MOTION_DETECT_H__ */
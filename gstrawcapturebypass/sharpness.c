@@ -0,0 +1,128 @@
+#include "sharpness.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SHARPNESS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SHARPNESS_SSE2 1
+#endif
+
+// 16 pixel blocks added to the 32 bit lane accumulators before they are folded
+// into the 64 bit sums: a lane takes 4 squares of at most 1020^2 per block
+#define LANE_FLUSH_BLOCKS 256
+
+// Laplacian at center, up / down point at the pixels above / below it
+static inline gint
+laplacian(const guint8 *up, const guint8 *center, const guint8 *down)
+{
+  return 4 * center[0] - center[-1] - center[1] - up[0] - down[0];
+}
+
+#if SHARPNESS_NEON || SHARPNESS_SSE2
+static void
+fold_lanes(const gint32 *lane_sums, const gint32 *lane_squares, gint64 *sum, guint64 *sum_squares)
+{
+  for (guint k = 0; k < 4; k++) {
+    *sum += lane_sums[k];
+    *sum_squares += (guint32) lane_squares[k];
+  }
+}
+#endif
+
+// Laplacian of row[0..n); row[-1] and row[n] must be readable
+static void
+laplacian_row(const guint8 *up, const guint8 *row, const guint8 *down, guint n, gint64 *sum, guint64 *sum_squares)
+{
+  guint i = 0;
+#if SHARPNESS_NEON
+  gint32 lane_sums[4], lane_squares[4];
+  while (i + 16 <= n) {
+    int32x4_t acc_sum = vdupq_n_s32(0);
+    int32x4_t acc_squares = vdupq_n_s32(0);
+    for (guint blocks = 0; blocks < LANE_FLUSH_BLOCKS && i + 16 <= n; blocks++, i += 16) {
+      uint8x16_t c = vld1q_u8(row + i);
+      uint8x16_t l = vld1q_u8(row + i - 1);
+      uint8x16_t r = vld1q_u8(row + i + 1);
+      uint8x16_t u = vld1q_u8(up + i);
+      uint8x16_t d = vld1q_u8(down + i);
+      // Wrapping u16 arithmetic, the result fits in s16 (-1020..1020)
+      int16x8_t lo = vreinterpretq_s16_u16(vsubq_u16(vshlq_n_u16(vmovl_u8(vget_low_u8(c)), 2),
+          vaddq_u16(vaddl_u8(vget_low_u8(l), vget_low_u8(r)), vaddl_u8(vget_low_u8(u), vget_low_u8(d)))));
+      int16x8_t hi = vreinterpretq_s16_u16(vsubq_u16(vshlq_n_u16(vmovl_u8(vget_high_u8(c)), 2),
+          vaddq_u16(vaddl_u8(vget_high_u8(l), vget_high_u8(r)), vaddl_u8(vget_high_u8(u), vget_high_u8(d)))));
+      acc_sum = vpadalq_s16(acc_sum, lo);
+      acc_sum = vpadalq_s16(acc_sum, hi);
+      acc_squares = vmlal_s16(acc_squares, vget_low_s16(lo), vget_low_s16(lo));
+      acc_squares = vmlal_s16(acc_squares, vget_high_s16(lo), vget_high_s16(lo));
+      acc_squares = vmlal_s16(acc_squares, vget_low_s16(hi), vget_low_s16(hi));
+      acc_squares = vmlal_s16(acc_squares, vget_high_s16(hi), vget_high_s16(hi));
+    }
+    vst1q_s32(lane_sums, acc_sum);
+    vst1q_s32(lane_squares, acc_squares);
+    fold_lanes(lane_sums, lane_squares, sum, sum_squares);
+  }
+#elif SHARPNESS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  gint32 lane_sums[4], lane_squares[4];
+  while (i + 16 <= n) {
+    __m128i acc_sum = zero;
+    __m128i acc_squares = zero;
+    for (guint blocks = 0; blocks < LANE_FLUSH_BLOCKS && i + 16 <= n; blocks++, i += 16) {
+      __m128i c = _mm_loadu_si128((const __m128i *) (row + i));
+      __m128i l = _mm_loadu_si128((const __m128i *) (row + i - 1));
+      __m128i r = _mm_loadu_si128((const __m128i *) (row + i + 1));
+      __m128i u = _mm_loadu_si128((const __m128i *) (up + i));
+      __m128i d = _mm_loadu_si128((const __m128i *) (down + i));
+      __m128i lo = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(c, zero), 2),
+          _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(r, zero)),
+              _mm_add_epi16(_mm_unpacklo_epi8(u, zero), _mm_unpacklo_epi8(d, zero))));
+      __m128i hi = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(c, zero), 2),
+          _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(r, zero)),
+              _mm_add_epi16(_mm_unpackhi_epi8(u, zero), _mm_unpackhi_epi8(d, zero))));
+      acc_sum = _mm_add_epi32(acc_sum, _mm_add_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones)));
+      acc_squares = _mm_add_epi32(acc_squares, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    _mm_storeu_si128((__m128i *) lane_sums, acc_sum);
+    _mm_storeu_si128((__m128i *) lane_squares, acc_squares);
+    fold_lanes(lane_sums, lane_squares, sum, sum_squares);
+  }
+#endif
+  for (; i < n; i++) {
+    gint value = laplacian(up + i, row + i, down + i);
+    *sum += value;
+    *sum_squares += (guint64) (value * value);
+  }
+}
+
+void
+sharpness_laplacian(const guint8 *luma, gsize stride, guint plane_width, guint plane_height, guint x, guint y,
+    guint width, guint height, guint row_step, SharpnessSums *sums)
+{
+  // The Laplacian needs all four neighbours, so the plane border is left out
+  guint x0 = MAX(x, 1);
+  guint x1 = MIN(x + width, plane_width - 1);
+  guint y0 = MAX(y, 1);
+  guint y1 = MIN(y + height, plane_height - 1);
+  if (plane_width < 3 || plane_height < 3 || x0 >= x1 || y0 >= y1)
+    return;
+  if (row_step == 0)
+    row_step = 1;
+
+  for (guint row = y0; row < y1; row += row_step) {
+    const guint8 *center = luma + (gsize) row * stride + x0;
+    laplacian_row(center - stride, center, center + stride, x1 - x0, &sums->sum, &sums->sum_squares);
+    sums->count += x1 - x0;
+  }
+}
+
+gdouble
+sharpness_variance(const SharpnessSums *sums)
+{
+  if (!sums->count)
+    return 0.0;
+  gdouble mean = (gdouble) sums->sum / sums->count;
+  gdouble variance = (gdouble) sums->sum_squares / sums->count - mean * mean;
+  return MAX(variance, 0.0);
+}
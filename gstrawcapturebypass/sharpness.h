@@ -0,0 +1,32 @@
+#ifndef __SHARPNESS_H__
+#define __SHARPNESS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Laplacian variance of a window of a luma plane, for sharpnessmeter.
+ *
+ * The 4-neighbour Laplacian (4 * c - left - right - up - down) is taken for
+ * every pixel of every row_step-th row of the window; pixels on the plane
+ * border are skipped. The variance of the responses is the focus score: it
+ * drops when edges soften (defocus, ISP smoothing) and rises with noise, so
+ * only its trend per scene is meaningful. Uses NEON (aarch64 / armv7 with
+ * NEON) or SSE2 when available, plain C otherwise.
+ */
+typedef struct {
+  guint64 count;
+  gint64 sum;
+  guint64 sum_squares;
+} SharpnessSums;
+
+// Adds the Laplacian responses of the window (x, y, width, height) to sums
+void sharpness_laplacian(const guint8 *luma, gsize stride, guint plane_width, guint plane_height, guint x, guint y,
+                         guint width, guint height, guint row_step, SharpnessSums *sums);
+// Variance of the responses in sums, 0 if there are none
+gdouble sharpness_variance(const SharpnessSums *sums);
+
+G_END_DECLS
+
+#endif /* __SHARPNESS_H__ */
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <iostream>
 #include <string>
+#include "pipeline_graph.hpp"
 
 /* =======================
  * Globals
@@ -136,26 +137,6 @@ static gboolean state_machine_cb(gpointer) {
 }
 
 
-/* =======================
- * Tee → queue helper
- * ======================= */
-static bool link_tee_to_queue(GstElement *tee, GstElement *queue) {
-    GstPad *tee_src = gst_element_request_pad_simple(tee, "src_%u");
-    GstPad *queue_sink = gst_element_get_static_pad(queue, "sink");
-
-    if (!tee_src || !queue_sink) {
-        if (tee_src) gst_object_unref(tee_src);
-        if (queue_sink) gst_object_unref(queue_sink);
-        return false;
-    }
-
-    GstPadLinkReturn ret = gst_pad_link(tee_src, queue_sink);
-    gst_object_unref(tee_src);
-    gst_object_unref(queue_sink);
-
-    return ret == GST_PAD_LINK_OK;
-}
-
 /* =======================
  * Pipeline creation
  * ======================= */
@@ -163,47 +144,51 @@ static bool link_tee_to_queue(GstElement *tee, GstElement *queue) {
  * Pipeline creation
  * ======================= */
 static GstElement* create_pipeline(const std::string &host, int port) {
-    GError *error = nullptr;
-
     // Matches your gst-launch pipeline, plus an extra tee branch for FPS measurement.
     // Branch A: RTP/UDP streaming
     // Branch B: identity handoff -> fakesink (FPS counting)
-    std::string pipeline_desc =
-        "hailofrontendbinsrc config-file-path=./frontend_config_aging.json name=preproc "
-        "preproc.src_0 ! queue leaky=no max-size-buffers=600 max-size-bytes=0 max-size-time=0 ! "
-        "hailoencodebin config-file-path=./encoder_config_aging.json ! "
-        "video/x-h264 ! "
-        "tee name=fourk_enc_tee "
-
-        // --- Stream branch (like your gst-launch) ---
-        "fourk_enc_tee. ! queue ! rtph264pay ! "
-        "application/x-rtp, media=(string)video, encoding-name=(string)H264 ! "
-        "udpsink name=udp_out host=" + host + " port=" + std::to_string(port) + " sync=false "
-
-        // --- FPS measurement branch ---
-        "fourk_enc_tee. ! queue ! identity name=fps_id signal-handoffs=true ! fakesink";
-
-    GstElement *pipe = gst_parse_launch(pipeline_desc.c_str(), &error);
-    if (!pipe) {
-        if (error) {
-            std::cerr << "[GST_PARSE_ERROR] " << error->message << std::endl;
-            g_error_free(error);
-        }
+    PipelineGraph graph;
+
+    GstElement *preproc = graph.add("hailofrontendbinsrc", "preproc");
+    graph.set(preproc, "config-file-path", "./frontend_config_aging.json");
+    GstElement *in_queue = graph.add("queue");
+    graph.set(in_queue, "leaky", "no");
+    graph.set(in_queue, "max-size-buffers", 600);
+    graph.set(in_queue, "max-size-bytes", 0);
+    graph.set(in_queue, "max-size-time", 0);
+    GstElement *encoder = graph.add("hailoencodebin");
+    graph.set(encoder, "config-file-path", "./encoder_config_aging.json");
+    GstElement *h264_caps = graph.add_caps_filter("video/x-h264");
+    GstElement *tee = graph.add("tee", "fourk_enc_tee");
+
+    // --- Stream branch (like your gst-launch) ---
+    GstElement *stream_queue = graph.add("queue");
+    GstElement *pay = graph.add("rtph264pay");
+    GstElement *rtp_caps = graph.add_caps_filter("application/x-rtp, media=(string)video, encoding-name=(string)H264");
+    GstElement *udp = graph.add("udpsink", "udp_out");
+    graph.set(udp, "host", host);
+    graph.set(udp, "port", port);
+    graph.set(udp, "sync", false);
+
+    // --- FPS measurement branch ---
+    GstElement *fps_queue = graph.add("queue");
+    GstElement *id = graph.add("identity", "fps_id");
+    graph.set(id, "signal-handoffs", true);
+    GstElement *sink = graph.add("fakesink");
+
+    graph.link_pads(preproc, "src_0", in_queue, "sink");
+    graph.link_chain({in_queue, encoder, h264_caps, tee});
+    graph.link_chain({tee, stream_queue, pay, rtp_caps, udp});
+    graph.link_chain({tee, fps_queue, id, sink});
+    if (!graph.ok()) {
+        std::cerr << "[GST_GRAPH_ERROR] " << graph.error() << std::endl;
         return nullptr;
     }
-    if (error) g_error_free(error);
 
     // Connect identity handoff for FPS counting
-    GstElement *id = gst_bin_get_by_name(GST_BIN(pipe), "fps_id");
-    if (!id) {
-        std::cerr << "[ERROR] Could not find identity element 'fps_id' in pipeline\n";
-        gst_object_unref(pipe);
-        return nullptr;
-    }
     g_signal_connect(id, "handoff", G_CALLBACK(on_handoff), nullptr);
-    gst_object_unref(id);
 
-    return pipe;
+    return graph.release();
 }
 
 static void print_help(const char *prog) {
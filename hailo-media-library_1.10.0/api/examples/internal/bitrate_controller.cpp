@@ -0,0 +1,340 @@
+#include "bitrate_controller.hpp"
+#include "runner_session.hpp"
+#include <glib-unix.h>
+#include <gst/gst.h>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr uint8_t RTCP_SR = 200;
+static constexpr uint8_t RTCP_RR = 201;
+static constexpr uint8_t RTCP_APP = 204;
+
+static constexpr guint TICK_MS = 200;
+static constexpr int64_t STALE_US = 2000000;
+static constexpr int64_t DECREASE_HOLD_US = 500000;
+static constexpr int64_t INCREASE_AFTER_US = 1000000;
+static constexpr double LOSS_HIGH = 0.02;
+static constexpr double RX_QUEUE_HIGH_MS = 40.0;
+static constexpr double TX_QUEUE_HIGH_MS = 100.0;
+static constexpr double INCREASE_STEP = 0.05; // of the upper bound
+
+static uint32_t read_be32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+           static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+static FeedbackReport &report_for(std::vector<FeedbackReport> &reports, uint32_t ssrc)
+{
+    auto it = std::find_if(reports.begin(), reports.end(), [ssrc](const FeedbackReport &r) { return r.ssrc == ssrc; });
+    if (it != reports.end())
+    {
+        return *it;
+    }
+    reports.push_back(FeedbackReport());
+    reports.back().ssrc = ssrc;
+    return reports.back();
+}
+
+bool parse_rtcp_feedback(const uint8_t *data, size_t size, std::vector<FeedbackReport> &reports)
+{
+    bool any = false;
+    for (size_t offset = 0; offset + 8 <= size;)
+    {
+        const uint8_t *packet = data + offset;
+        if ((packet[0] >> 6) != 2)
+        {
+            break;
+        }
+        uint8_t count = packet[0] & 0x1f;
+        uint8_t type = packet[1];
+        size_t length = (static_cast<size_t>(packet[2] << 8 | packet[3]) + 1) * 4;
+        if (offset + length > size)
+        {
+            break;
+        }
+
+        if (type == RTCP_SR || type == RTCP_RR)
+        {
+            size_t blocks = type == RTCP_SR ? 28 : 8; // after header + sender SSRC (+ sender info)
+            for (uint8_t i = 0; i < count && blocks + 24 <= length; i++, blocks += 24)
+            {
+                const uint8_t *block = packet + blocks;
+                FeedbackReport &report = report_for(reports, read_be32(block));
+                report.fraction_lost = block[4] / 256.0;
+                report.jitter = read_be32(block + 12);
+            }
+            any = true;
+        }
+        else if (type == RTCP_APP && length >= 12 && memcmp(packet + 8, "QDLY", 4) == 0)
+        {
+            for (size_t entry = 12; entry + 8 <= length; entry += 8)
+            {
+                FeedbackReport &report = report_for(reports, read_be32(packet + entry));
+                report.has_queue_delay = true;
+                report.queue_delay_us = read_be32(packet + entry + 4);
+            }
+            any = true;
+        }
+        offset += length;
+    }
+    return any;
+}
+
+AbrDecision abr_step(const AbrLimits &limits, AbrState &state, const AbrInput &input, int64_t now_us)
+{
+    AbrDecision decision;
+    decision.bitrate = state.bitrate;
+    // The sender queue is sampled locally, so it is acted on even when the receiver went quiet
+    state.stale = !input.fresh;
+    double loss = state.stale ? 0 : input.loss;
+
+    const char *congestion = nullptr;
+    if (loss >= LOSS_HIGH)
+    {
+        congestion = "loss";
+    }
+    else if (!state.stale && input.rx_queue_ms >= RX_QUEUE_HIGH_MS)
+    {
+        congestion = "receiver queue";
+    }
+    else if (input.tx_queue_ms >= TX_QUEUE_HIGH_MS)
+    {
+        congestion = "sender queue";
+    }
+
+    if (!congestion && state.stale)
+    {
+        decision.action = "stale";
+        decision.reason = "no receiver report";
+        return decision;
+    }
+    if (congestion)
+    {
+        decision.reason = congestion;
+        if (now_us - state.last_decrease_us < DECREASE_HOLD_US || state.bitrate <= limits.min_bitrate)
+        {
+            return decision; // the previous cut has not shown up in the reports yet, or at the floor
+        }
+        double factor = std::max(0.5, 0.85 - loss);
+        decision.bitrate = std::max(limits.min_bitrate, static_cast<unsigned int>(state.bitrate * factor + 0.5));
+        decision.action = "decrease";
+        state.last_decrease_us = state.last_change_us = now_us;
+    }
+    else if (now_us - state.last_change_us >= INCREASE_AFTER_US && state.bitrate < limits.max_bitrate)
+    {
+        unsigned int step = static_cast<unsigned int>(limits.max_bitrate * INCREASE_STEP);
+        decision.bitrate = std::min(limits.max_bitrate, state.bitrate + std::max(step, 1u));
+        decision.action = "increase";
+        decision.reason = "clean";
+        state.last_change_us = now_us;
+    }
+    state.bitrate = decision.bitrate;
+    return decision;
+}
+
+BitrateController::BitrateController(RunnerSession &session, int port, unsigned int min_bitrate,
+                                     unsigned int max_bitrate)
+    : m_session(session), m_port(port), m_min_bitrate(min_bitrate), m_max_bitrate(max_bitrate)
+{
+}
+
+BitrateController::~BitrateController()
+{
+    stop();
+}
+
+bool BitrateController::start()
+{
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(m_port));
+    if (m_fd < 0 || bind(m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        perror("[ABR] bind");
+        stop();
+        return false;
+    }
+    m_fd_source = g_unix_fd_add(m_fd, G_IO_IN, on_feedback, this);
+    m_tick_source = g_timeout_add(TICK_MS, on_tick, this);
+    std::cout << "[ABR] Receiver reports on UDP port " << m_port << std::endl;
+    return true;
+}
+
+void BitrateController::stop()
+{
+    if (m_tick_source)
+    {
+        g_source_remove(m_tick_source);
+        m_tick_source = 0;
+    }
+    if (m_fd_source)
+    {
+        g_source_remove(m_fd_source);
+        m_fd_source = 0;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        if (m_unknown_ssrc_reports)
+        {
+            std::cout << "[ABR] Ignored " << m_unknown_ssrc_reports << " report blocks for unknown SSRCs" << std::endl;
+        }
+    }
+}
+
+gboolean BitrateController::on_feedback(gint fd, GIOCondition, gpointer user_data)
+{
+    auto *self = static_cast<BitrateController *>(user_data);
+    uint8_t packet[1500];
+    ssize_t length;
+    while ((length = recv(fd, packet, sizeof(packet), 0)) > 0)
+    {
+        self->handle_packet(packet, static_cast<size_t>(length), g_get_monotonic_time());
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean BitrateController::on_tick(gpointer user_data)
+{
+    static_cast<BitrateController *>(user_data)->tick(g_get_monotonic_time());
+    return G_SOURCE_CONTINUE;
+}
+
+// Follows the running pipeline: new / removed streams, rebuilt payloaders (new SSRC) and
+// target_bitrate changes that did not come from the controller (profile switch)
+void BitrateController::sync_streams()
+{
+    std::map<std::string, Stream> streams;
+    for (const auto &branch : m_session.branches())
+    {
+        auto found = m_streams.find(branch.stream_id);
+        Stream stream = found != m_streams.end() ? found->second : Stream();
+        unsigned int configured = m_session.target_bitrate(branch.stream_id);
+        if (configured && configured != stream.configured)
+        {
+            if (stream.configured)
+            {
+                std::cout << "[ABR] stream=" << branch.stream_id << " target_bitrate changed to " << configured
+                          << ", restarting from it" << std::endl;
+            }
+            stream.configured = configured;
+            stream.limits.max_bitrate = m_max_bitrate ? m_max_bitrate : configured;
+            stream.limits.min_bitrate = m_min_bitrate ? m_min_bitrate : stream.limits.max_bitrate / 4;
+            stream.limits.min_bitrate = std::min(stream.limits.min_bitrate, stream.limits.max_bitrate);
+            stream.state = AbrState();
+            stream.state.bitrate = std::clamp(configured, stream.limits.min_bitrate, stream.limits.max_bitrate);
+            stream.state.last_change_us = g_get_monotonic_time();
+        }
+
+        if (branch.pay)
+        {
+            GstStructure *stats = nullptr;
+            g_object_get(branch.pay, "stats", &stats, nullptr);
+            guint ssrc = 0;
+            if (stats && gst_structure_get_uint(stats, "ssrc", &ssrc))
+            {
+                stream.ssrc = ssrc;
+                stream.have_ssrc = true;
+            }
+            if (stats)
+            {
+                gst_structure_free(stats);
+            }
+        }
+        stream.pay = branch.pay;
+        streams[branch.stream_id] = stream;
+    }
+    m_streams = std::move(streams);
+}
+
+void BitrateController::handle_packet(const uint8_t *data, size_t size, int64_t now_us)
+{
+    std::vector<FeedbackReport> reports;
+    if (!parse_rtcp_feedback(data, size, reports))
+    {
+        return;
+    }
+    for (const auto &report : reports)
+    {
+        auto stream = std::find_if(m_streams.begin(), m_streams.end(), [&](const auto &entry) {
+            return entry.second.have_ssrc && entry.second.ssrc == report.ssrc;
+        });
+        if (stream == m_streams.end())
+        {
+            m_unknown_ssrc_reports++; // old SSRC after a rebuild, or another sender's stream
+            continue;
+        }
+        AbrInput &pending = stream->second.pending;
+        pending.loss = std::max(pending.loss, report.fraction_lost);
+        if (report.has_queue_delay)
+        {
+            pending.rx_queue_ms = std::max(pending.rx_queue_ms, report.queue_delay_us / 1000.0);
+        }
+        stream->second.last_report_us = now_us;
+    }
+}
+
+void BitrateController::tick(int64_t now_us)
+{
+    sync_streams();
+    for (const auto &branch : m_session.branches())
+    {
+        auto found = m_streams.find(branch.stream_id);
+        if (found == m_streams.end() || !found->second.configured)
+        {
+            continue;
+        }
+        Stream &stream = found->second;
+        AbrInput input = stream.pending;
+        stream.pending = AbrInput();
+        input.fresh = stream.last_report_us && now_us - stream.last_report_us < STALE_US;
+        if (branch.udp_queue)
+        {
+            guint64 level_ns = 0;
+            g_object_get(branch.udp_queue, "current-level-time", &level_ns, nullptr);
+            input.tx_queue_ms = level_ns / 1e6;
+        }
+
+        bool was_stale = stream.state.stale;
+        unsigned int previous = stream.state.bitrate;
+        AbrDecision decision = abr_step(stream.limits, stream.state, input, now_us);
+
+        bool changed = decision.bitrate != previous;
+        if (changed)
+        {
+            try
+            {
+                m_session.set_bitrate(branch.stream_id, decision.bitrate);
+                stream.configured = decision.bitrate;
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[ABR] stream=" << branch.stream_id << " set_bitrate failed: " << e.what() << std::endl;
+                stream.state.bitrate = previous;
+                continue;
+            }
+        }
+        // Holds are not logged every tick, only going stale and back
+        if (changed || stream.state.stale != was_stale)
+        {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << "[ABR] stream=" << branch.stream_id
+                 << " action=" << decision.action << " bitrate=" << previous << "->" << decision.bitrate
+                 << " reason=\"" << decision.reason << "\" loss_pct=" << input.loss * 100.0
+                 << " rx_queue_ms=" << input.rx_queue_ms << " tx_queue_ms=" << input.tx_queue_ms
+                 << " bounds=" << stream.limits.min_bitrate << ".." << stream.limits.max_bitrate;
+            std::cout << line.str() << std::endl;
+        }
+    }
+}
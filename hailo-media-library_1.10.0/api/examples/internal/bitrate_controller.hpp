@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glib.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class RunnerSession;
+
+/*********************************************************************
+ * Adaptive bitrate for medialib_gst_runner (--abr).
+ *
+ * Receives RTCP on --abr-port: receiver reports (RFC 3550 RR/SR report
+ * blocks) from any RTCP receiver, and the "QDLY" APP packet of
+ * rtp_analyzer --feedback with the queueing delay the receiver sees
+ * (rtp_analyzer_1.10.0, rtcp_feedback.hpp). Report blocks are matched to
+ * the streams by the SSRC of their rtph264pay. The sender side queue in
+ * front of the payloader is sampled as well, it grows when the socket
+ * cannot keep up.
+ *
+ * Every 200 ms each stream runs one AIMD step (abr_step):
+ *  - congestion (loss >= 2 %, receiver queueing delay >= 40 ms or sender
+ *    queue >= 100 ms): multiplicative decrease to 0.85 - loss of the
+ *    current bitrate (at least 0.5), at most every 500 ms so the effect
+ *    of the previous cut is seen first; the first report showing loss is
+ *    acted on at the next tick, well within a second
+ *  - clean reports for 1 s since the last change: additive increase of
+ *    5 % of the upper bound
+ *  - no report for 2 s: hold, unless the sender queue is congested, which
+ *    is sampled locally and still decreases
+ * within [--abr-min, --abr-max] (default: configured target_bitrate / 4
+ * and the configured target_bitrate). Changes go through
+ * RunnerSession::set_bitrate; every decision is logged as an [ABR] line.
+ * A profile switch that changes a stream's target_bitrate restarts its
+ * controller from the new value.
+ *
+ * Loopback test with simulated loss:
+ *   medialib_gst_runner medialib_config.json --stub-config --sw-elements --udp-host 127.0.0.1 --abr
+ *   rtp_analyzer --port 5000 --feedback 127.0.0.1:5100 --simulate-loss 5
+ *********************************************************************/
+
+// One report block of a received RTCP compound packet, merged with the QDLY delay of the same SSRC
+struct FeedbackReport
+{
+    uint32_t ssrc = 0;
+    double fraction_lost = 0;  // 0..1 since the receiver's previous report
+    uint32_t jitter = 0;       // RTP timestamp units
+    bool has_queue_delay = false;
+    uint32_t queue_delay_us = 0;
+};
+
+// Parses an RTCP compound packet (SR, RR and APP "QDLY"); false if it is not RTCP.
+bool parse_rtcp_feedback(const uint8_t *data, size_t size, std::vector<FeedbackReport> &reports);
+
+struct AbrLimits
+{
+    unsigned int min_bitrate = 0;
+    unsigned int max_bitrate = 0;
+};
+
+// Feedback of one stream collected over a controller tick
+struct AbrInput
+{
+    bool fresh = false;        // a report arrived within the stale timeout
+    double loss = 0;           // worst fraction lost reported since the previous tick
+    double rx_queue_ms = 0;    // receiver queueing delay (QDLY)
+    double tx_queue_ms = 0;    // sender queue level in front of the payloader
+};
+
+struct AbrState
+{
+    unsigned int bitrate = 0;
+    int64_t last_change_us = 0;
+    int64_t last_decrease_us = 0;
+    bool stale = false;
+};
+
+struct AbrDecision
+{
+    const char *action = "hold"; // decrease / increase / hold / stale
+    const char *reason = "";
+    unsigned int bitrate = 0;    // new bitrate, the current one on hold
+};
+
+// One AIMD step, updates state; see the class description for the rules.
+AbrDecision abr_step(const AbrLimits &limits, AbrState &state, const AbrInput &input, int64_t now_us);
+
+class BitrateController
+{
+  public:
+    BitrateController(RunnerSession &session, int port, unsigned int min_bitrate, unsigned int max_bitrate);
+    ~BitrateController();
+    BitrateController(const BitrateController &) = delete;
+    BitrateController &operator=(const BitrateController &) = delete;
+
+    bool start();
+    void stop();
+
+  private:
+    struct Stream
+    {
+        const void *pay = nullptr; // rtph264pay the SSRC was read from, changes on a rebuild
+        uint32_t ssrc = 0;
+        bool have_ssrc = false;
+        unsigned int configured = 0; // target_bitrate the controller last saw or set
+        AbrLimits limits;
+        AbrState state;
+        AbrInput pending;            // collected from the reports since the last tick
+        int64_t last_report_us = 0;
+    };
+
+    static gboolean on_feedback(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_tick(gpointer user_data);
+    void sync_streams();
+    void handle_packet(const uint8_t *data, size_t size, int64_t now_us);
+    void tick(int64_t now_us);
+
+    RunnerSession &m_session;
+    int m_port;
+    unsigned int m_min_bitrate;
+    unsigned int m_max_bitrate;
+    int m_fd = -1;
+    guint m_fd_source = 0;
+    guint m_tick_source = 0;
+    std::map<std::string, Stream> m_streams; // by stream id
+    uint64_t m_unknown_ssrc_reports = 0;
+};
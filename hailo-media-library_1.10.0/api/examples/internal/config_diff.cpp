@@ -0,0 +1,122 @@
+#include "config_diff.hpp"
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+// Kinds the encoder bin applies at runtime through config-string; the GOP structure (gop_size, b-frames)
+// is only taken when the encoder starts
+static const std::set<std::string> live_kinds = {"bitrate", "rate_control", "osd", "privacy_mask"};
+
+static bool is_under(const std::string &path, const std::string &key)
+{
+    size_t at = path.find("/" + key);
+    size_t end = at + key.size() + 1;
+    return at != std::string::npos && (end == path.size() || path[end] == '/');
+}
+
+// Maps a JSON patch path (e.g. /encoding/hailo_encoder/rate_control/bitrate/target_bitrate) to a change kind.
+static std::string classify_path(const std::string &path)
+{
+    if (path.rfind("/osd", 0) == 0)
+    {
+        return "osd";
+    }
+    if (path.rfind("/privacy_mask", 0) == 0)
+    {
+        return "privacy_mask";
+    }
+    if (path.find("/rate_control/bitrate") != std::string::npos)
+    {
+        return "bitrate";
+    }
+    if (path.find("/rate_control") != std::string::npos)
+    {
+        return "rate_control";
+    }
+    if (is_under(path, "gop_config"))
+    {
+        return "gop";
+    }
+    return "encoder";
+}
+
+ConfigSnapshot snapshot_spec(const RunnerPipelineSpec &spec)
+{
+    ConfigSnapshot snapshot;
+    snapshot.frontend_config = read_file_to_string(spec.frontend_config_path);
+    for (const auto &[stream_id, encoder_path] : spec.encoder_configs)
+    {
+        snapshot.encoder_configs[stream_id] = nlohmann::json::parse(read_file_to_string(encoder_path));
+    }
+    return snapshot;
+}
+
+ConfigDiff diff_config_snapshots(const ConfigSnapshot &old_snapshot, const ConfigSnapshot &new_snapshot)
+{
+    ConfigDiff diff;
+    // Compared as parsed JSON, so formatting / key order changes are not changes
+    diff.frontend_changed = nlohmann::json::parse(old_snapshot.frontend_config, nullptr, false) !=
+                            nlohmann::json::parse(new_snapshot.frontend_config, nullptr, false);
+
+    if (old_snapshot.encoder_configs.size() != new_snapshot.encoder_configs.size())
+    {
+        diff.streams_changed = true;
+        return diff;
+    }
+
+    for (const auto &[stream_id, new_config] : new_snapshot.encoder_configs)
+    {
+        auto old_config = old_snapshot.encoder_configs.find(stream_id);
+        if (old_config == old_snapshot.encoder_configs.end())
+        {
+            diff.streams_changed = true;
+            return diff;
+        }
+
+        nlohmann::json patch = nlohmann::json::diff(old_config->second, new_config);
+        if (patch.empty())
+        {
+            continue;
+        }
+
+        std::set<std::string> kinds;
+        for (const auto &operation : patch)
+        {
+            kinds.insert(classify_path(operation["path"].get<std::string>()));
+        }
+
+        EncoderChange change;
+        change.stream_id = stream_id;
+        change.kinds.assign(kinds.begin(), kinds.end());
+        change.live = std::all_of(kinds.begin(), kinds.end(),
+                                  [](const std::string &kind) { return live_kinds.count(kind) > 0; });
+        diff.encoders.push_back(change);
+    }
+    return diff;
+}
+
+std::string describe_config_diff(const ConfigDiff &diff)
+{
+    std::stringstream out;
+    if (diff.needs_full_rebuild())
+    {
+        out << "full rebuild (" << (diff.streams_changed ? "streams" : "frontend") << ")";
+        return out.str();
+    }
+    if (diff.empty())
+    {
+        return "no change";
+    }
+
+    for (size_t i = 0; i < diff.encoders.size(); i++)
+    {
+        const auto &change = diff.encoders[i];
+        out << (i ? "; " : "") << change.stream_id << ": ";
+        for (size_t k = 0; k < change.kinds.size(); k++)
+        {
+            out << (k ? "," : "") << change.kinds[k];
+        }
+        out << (change.live ? " (live)" : " (branch rebuild)");
+    }
+    return out.str();
+}
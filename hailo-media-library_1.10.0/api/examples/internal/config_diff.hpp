@@ -0,0 +1,53 @@
+#pragma once
+
+#include "medialib_gst_runner.hpp"
+#include <nlohmann/json.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Old vs new runner config comparison.
+ *
+ * A ConfigSnapshot keeps the contents of the extracted frontend and
+ * encoder configs of a running pipeline. config_pipeline overwrites the
+ * files in place, so the contents are kept here rather than the paths.
+ * diff_config_snapshots() tells whether a new config can be applied by
+ * touching only the encoder branches. It also classifies each encoder
+ * change:
+ *   bitrate, rate_control, osd, privacy_mask - the encoder bin can
+ *     take them through config-string while it keeps running ("live"),
+ *   gop (gop_config: gop_size, b-frames) and encoder (any other key, e.g.
+ *     input / coding settings) - the branch encoder has to be recreated.
+ * A changed frontend config or a different set of streams needs a full
+ * rebuild.
+ *********************************************************************/
+
+struct ConfigSnapshot
+{
+    std::string frontend_config;
+    std::map<std::string, nlohmann::json> encoder_configs; // stream id -> encoder config
+};
+
+struct EncoderChange
+{
+    std::string stream_id;
+    std::vector<std::string> kinds; // sorted, unique
+    bool live = true;               // every kind can be applied without recreating the encoder
+};
+
+struct ConfigDiff
+{
+    bool frontend_changed = false;
+    bool streams_changed = false;
+    std::vector<EncoderChange> encoders;
+
+    bool needs_full_rebuild() const { return frontend_changed || streams_changed; }
+    bool empty() const { return !needs_full_rebuild() && encoders.empty(); }
+};
+
+ConfigSnapshot snapshot_spec(const RunnerPipelineSpec &spec);
+ConfigDiff diff_config_snapshots(const ConfigSnapshot &old_snapshot, const ConfigSnapshot &new_snapshot);
+
+// Short description for logs, e.g. "full rebuild (frontend)" or "sink0: bitrate,gop (live)".
+std::string describe_config_diff(const ConfigDiff &diff);
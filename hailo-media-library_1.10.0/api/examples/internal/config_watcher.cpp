@@ -0,0 +1,333 @@
+#include "config_watcher.hpp"
+#include "phase_timing.hpp"
+#include "runner_session.hpp"
+#include <glib-unix.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Editors either rewrite in place (close after write) or write a temp file and rename it over
+static constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+static std::pair<std::string, std::string> split_path(const std::string &path)
+{
+    fs::path absolute = fs::absolute(path);
+    return {absolute.parent_path().string(), absolute.filename().string()};
+}
+
+// Returns true if the inotify events in buffer touch one of files (by directory).
+static bool events_match(const char *buffer, ssize_t length, const std::map<int, std::string> &dirs,
+                         const std::map<std::string, std::vector<std::string>> &files)
+{
+    bool matched = false;
+    for (const char *ptr = buffer; ptr < buffer + length;)
+    {
+        const auto *event = reinterpret_cast<const struct inotify_event *>(ptr);
+        ptr += sizeof(struct inotify_event) + event->len;
+        if (event->len == 0)
+        {
+            continue;
+        }
+        auto dir = dirs.find(event->wd);
+        if (dir == dirs.end())
+        {
+            continue;
+        }
+        const auto &names = files.at(dir->second);
+        if (std::find(names.begin(), names.end(), event->name) != names.end())
+        {
+            matched = true;
+        }
+    }
+    return matched;
+}
+
+// Runs on the worker thread: re-reads the args file and extracts the configs into staging_dir.
+// staging_dir is removed again unless the returned config is ok.
+static StagedConfig stage_config(const std::string &args_file_path, const std::string &medialib_config_path,
+                                 const PipelineConfig &current, const std::string &staging_dir)
+{
+    auto start = std::chrono::steady_clock::now();
+    StagedConfig staged;
+    staged.args_file_path = args_file_path;
+    staged.medialib_config_path = medialib_config_path;
+    PipelineConfig config = current;
+    auto reject = [&](const std::string &error) {
+        std::error_code ec;
+        fs::remove_all(staging_dir, ec);
+        staged.ok = false;
+        staged.error = error;
+        return staged;
+    };
+
+    if (!args_file_path.empty())
+    {
+        std::string program = "medialib_gst_runner";
+        std::string option = "--args_file";
+        std::string path = args_file_path;
+        char *argv[] = {program.data(), option.data(), path.data(), nullptr};
+        std::string ignored_args_file;
+        if (!parse_arguments(3, argv, staged.medialib_config_path, ignored_args_file, config, false))
+        {
+            return reject("Invalid args file: " + args_file_path);
+        }
+        // Process level options keep their startup values
+        config.control_socket = current.control_socket;
+        config.watch = current.watch;
+        config.watch_debounce_ms = current.watch_debounce_ms;
+    }
+
+    if (!fs::exists(staged.medialib_config_path))
+    {
+        return reject("Media library config file does not exist: " + staged.medialib_config_path);
+    }
+
+    config.output_dir = staging_dir;
+    {
+        ScopedPhase phase("watch_validate");
+        try
+        {
+            staged.ok = config_pipeline(config, staged.medialib_config_path, staged.spec);
+        }
+        catch (const std::exception &e)
+        {
+            return reject(e.what());
+        }
+    }
+    if (!staged.ok)
+    {
+        return reject("Failed to configure the pipeline from " + staged.medialib_config_path);
+    }
+    staged.validate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return staged;
+}
+
+ConfigWatcher::ConfigWatcher(RunnerSession &session, unsigned int debounce_ms)
+    : m_session(session), m_debounce_ms(debounce_ms)
+{
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    stop();
+}
+
+bool ConfigWatcher::start()
+{
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotify_fd < 0 || m_event_fd < 0)
+    {
+        perror("[WATCH] inotify/eventfd");
+        stop();
+        return false;
+    }
+    if (!update_watches())
+    {
+        stop();
+        return false;
+    }
+
+    m_inotify_source = g_unix_fd_add(m_inotify_fd, G_IO_IN, on_inotify, this);
+    m_event_source = g_unix_fd_add(m_event_fd, G_IO_IN, on_validated, this);
+    return true;
+}
+
+void ConfigWatcher::stop()
+{
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+    for (guint *source : {&m_inotify_source, &m_event_source, &m_debounce_source})
+    {
+        if (*source)
+        {
+            g_source_remove(*source);
+            *source = 0;
+        }
+    }
+    for (int *fd : {&m_inotify_fd, &m_event_fd})
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    m_dirs.clear();
+    m_files.clear();
+}
+
+bool ConfigWatcher::update_watches()
+{
+    for (const auto &[wd, dir] : m_dirs)
+    {
+        inotify_rm_watch(m_inotify_fd, wd);
+    }
+    m_dirs.clear();
+    m_files.clear();
+
+    std::vector<std::string> paths = {m_session.medialib_config_path()};
+    if (!m_session.args_file_path().empty())
+    {
+        paths.push_back(m_session.args_file_path());
+    }
+
+    for (const auto &path : paths)
+    {
+        auto [dir, name] = split_path(path);
+        if (m_files.find(dir) == m_files.end())
+        {
+            int wd = inotify_add_watch(m_inotify_fd, dir.c_str(), WATCH_MASK);
+            if (wd < 0)
+            {
+                std::cerr << "[WATCH] Cannot watch " << dir << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+            m_dirs[wd] = dir;
+        }
+        m_files[dir].push_back(name);
+        std::cout << "[WATCH] Watching " << dir << "/" << name << std::endl;
+    }
+    return true;
+}
+
+gboolean ConfigWatcher::on_inotify(gint fd, GIOCondition, gpointer user_data)
+{
+    auto *self = static_cast<ConfigWatcher *>(user_data);
+    alignas(struct inotify_event) char buffer[4096];
+    bool matched = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        matched |= events_match(buffer, length, self->m_dirs, self->m_files);
+    }
+
+    if (matched)
+    {
+        self->schedule_validation();
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void ConfigWatcher::schedule_validation()
+{
+    if (m_debounce_source)
+    {
+        // Still inside a burst of writes, restart the quiet period
+        g_source_remove(m_debounce_source);
+    }
+    else
+    {
+        m_first_event = std::chrono::steady_clock::now();
+    }
+    m_debounce_source = g_timeout_add(m_debounce_ms, on_debounce, this);
+}
+
+gboolean ConfigWatcher::on_debounce(gpointer user_data)
+{
+    auto *self = static_cast<ConfigWatcher *>(user_data);
+    self->m_debounce_source = 0;
+    if (self->m_validating)
+    {
+        self->m_pending = true;
+    }
+    else
+    {
+        self->launch_validation();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void ConfigWatcher::launch_validation()
+{
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+
+    phase_timeline().begin_run("watch", m_session.config().profile_name);
+    phase_timeline().record("watch_debounce", m_first_event, PhaseTimeline::clock::now());
+
+    // Everything the worker needs is copied here, it never touches the session
+    std::string args_file_path = m_session.args_file_path();
+    std::string medialib_config_path = m_session.medialib_config_path();
+    PipelineConfig config = m_session.config();
+    std::string staging_dir = m_session.next_staging_dir();
+
+    m_validating = true;
+    m_worker = std::thread([this, args_file_path, medialib_config_path, config, staging_dir]() {
+        StagedConfig staged = stage_config(args_file_path, medialib_config_path, config, staging_dir);
+        {
+            std::lock_guard<std::mutex> lock(m_result_mutex);
+            m_result = std::move(staged);
+        }
+        uint64_t one = 1;
+        if (write(m_event_fd, &one, sizeof(one)) < 0)
+        {
+            perror("[WATCH] eventfd write");
+        }
+    });
+}
+
+gboolean ConfigWatcher::on_validated(gint fd, GIOCondition, gpointer user_data)
+{
+    auto *self = static_cast<ConfigWatcher *>(user_data);
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+    if (self->m_worker.joinable())
+    {
+        self->m_worker.join();
+    }
+    self->m_validating = false;
+
+    StagedConfig staged;
+    {
+        std::lock_guard<std::mutex> lock(self->m_result_mutex);
+        staged = std::move(self->m_result);
+    }
+
+    if (!staged.ok)
+    {
+        std::cerr << "[WATCH] Change rejected, keeping the running pipeline: " << staged.error << std::endl;
+        phase_timeline().annotate("watch_error", staged.error);
+        phase_timeline().finish_run();
+    }
+    else
+    {
+        if (self->m_session.apply_spec(staged.spec, staged.medialib_config_path))
+        {
+            double latency_ms =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - self->m_first_event).count();
+            std::cout << "[WATCH] Applied profile '" << staged.spec.config.profile_name
+                      << "' validate_ms=" << staged.validate_ms << " reaction_ms=" << latency_ms << std::endl;
+            phase_timeline().annotate("watch_reaction_ms", latency_ms);
+            // The args file may now point at another medialib config
+            self->update_watches();
+        }
+        else
+        {
+            std::cerr << "[WATCH] Failed to start the pipeline of profile '" << staged.spec.config.profile_name << "'"
+                      << std::endl;
+        }
+    }
+
+    if (self->m_pending)
+    {
+        self->m_pending = false;
+        self->launch_validation();
+    }
+    return G_SOURCE_CONTINUE;
+}
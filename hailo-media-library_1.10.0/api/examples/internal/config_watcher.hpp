@@ -0,0 +1,78 @@
+#pragma once
+
+#include "medialib_gst_runner.hpp"
+#include <glib.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RunnerSession;
+
+/*********************************************************************
+ * Event driven config reload for medialib_gst_runner (--watch).
+ *
+ * Watches the args file and the medialib config it references with
+ * inotify. The parent directories are watched, so editors that save
+ * through rename-over are seen as well. Bursts of events are
+ * debounced (--watch-debounce, default 200 ms). The new config is then
+ * validated and extracted into a fresh staging directory on a worker
+ * thread, while the current pipeline keeps running. Only a valid result is
+ * handed back to the main loop (eventfd source) and applied to the
+ * session. A broken edit is reported and the running pipeline is left
+ * alone.
+ *
+ * Nothing polls: the main loop sleeps in poll() until inotify or the
+ * worker eventfd becomes readable.
+ *********************************************************************/
+
+struct StagedConfig
+{
+    bool ok = false;
+    std::string error;
+    std::string args_file_path;
+    std::string medialib_config_path;
+    RunnerPipelineSpec spec;
+    double validate_ms = 0;
+};
+
+class ConfigWatcher
+{
+  public:
+    ConfigWatcher(RunnerSession &session, unsigned int debounce_ms);
+    ~ConfigWatcher();
+    ConfigWatcher(const ConfigWatcher &) = delete;
+    ConfigWatcher &operator=(const ConfigWatcher &) = delete;
+
+    bool start();
+    void stop();
+
+  private:
+    bool update_watches();
+    void schedule_validation();
+    void launch_validation();
+
+    static gboolean on_inotify(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_debounce(gpointer user_data);
+    static gboolean on_validated(gint fd, GIOCondition condition, gpointer user_data);
+
+    RunnerSession &m_session;
+    unsigned int m_debounce_ms;
+    int m_inotify_fd = -1;
+    int m_event_fd = -1;
+    guint m_inotify_source = 0;
+    guint m_event_source = 0;
+    guint m_debounce_source = 0;
+    std::map<int, std::string> m_dirs;                   // watch descriptor -> directory
+    std::map<std::string, std::vector<std::string>> m_files; // directory -> watched file names
+    std::chrono::steady_clock::time_point m_first_event; // first event of the current burst, for the reaction latency
+
+    std::thread m_worker;
+    bool m_validating = false;
+    bool m_pending = false; // a change arrived while validating
+    std::mutex m_result_mutex;
+    StagedConfig m_result;
+};
+
@@ -0,0 +1,187 @@
+#include "control_socket.hpp"
+#include <glib-unix.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A client sending more than this without a newline is dropped
+static constexpr size_t MAX_REQUEST_SIZE = 64 * 1024;
+
+ControlSocket::ControlSocket(std::string path, Handler handler) : m_path(std::move(path)), m_handler(std::move(handler))
+{
+}
+
+ControlSocket::~ControlSocket()
+{
+    stop();
+}
+
+bool ControlSocket::start()
+{
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "[CONTROL] Socket path too long: " << m_path << std::endl;
+        return false;
+    }
+    std::strncpy(addr.sun_path, m_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0)
+    {
+        perror("[CONTROL] socket");
+        return false;
+    }
+
+    unlink(m_path.c_str()); // stale socket of a previous run
+    if (bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(m_listen_fd, 4) < 0)
+    {
+        perror("[CONTROL] bind/listen");
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    m_listen_source = g_unix_fd_add(m_listen_fd, G_IO_IN, on_accept, this);
+    std::cout << "[CONTROL] Listening on " << m_path << std::endl;
+    return true;
+}
+
+void ControlSocket::stop()
+{
+    while (!m_clients.empty())
+    {
+        close_client(m_clients.begin()->first);
+    }
+    if (m_listen_source)
+    {
+        g_source_remove(m_listen_source);
+        m_listen_source = 0;
+    }
+    if (m_listen_fd >= 0)
+    {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        unlink(m_path.c_str());
+    }
+}
+
+gboolean ControlSocket::on_accept(gint fd, GIOCondition, gpointer user_data)
+{
+    auto *self = static_cast<ControlSocket *>(user_data);
+    int client_fd = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    Client client;
+    client.fd = client_fd;
+    client.source_id = g_unix_fd_add(client_fd, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR), on_client, self);
+    self->m_clients[client_fd] = client;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean ControlSocket::on_client(gint fd, GIOCondition, gpointer user_data)
+{
+    auto *self = static_cast<ControlSocket *>(user_data);
+    auto it = self->m_clients.find(fd);
+    if (it == self->m_clients.end())
+    {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (!self->handle_client_input(it->second))
+    {
+        // The source is removed by returning G_SOURCE_REMOVE, only close the fd
+        it->second.source_id = 0;
+        self->close_client(fd);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+bool ControlSocket::handle_client_input(Client &client)
+{
+    char buffer[4096];
+    ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        return false;
+    }
+    if (received < 0)
+    {
+        return true;
+    }
+
+    client.pending.append(buffer, static_cast<size_t>(received));
+    size_t newline;
+    while ((newline = client.pending.find('\n')) != std::string::npos)
+    {
+        std::string line = client.pending.substr(0, newline);
+        client.pending.erase(0, newline + 1);
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string response = dispatch(line) + "\n";
+        // Responses are small; the socket buffer takes them without blocking
+        if (send(client.fd, response.data(), response.size(), MSG_NOSIGNAL) < 0)
+        {
+            return false;
+        }
+    }
+    return client.pending.size() <= MAX_REQUEST_SIZE;
+}
+
+std::string ControlSocket::dispatch(const std::string &line)
+{
+    auto start = std::chrono::steady_clock::now();
+    nlohmann::json response;
+    try
+    {
+        nlohmann::json request = nlohmann::json::parse(line);
+        response["cmd"] = request.value("cmd", "");
+        nlohmann::json result = m_handler(request);
+        if (result.is_object())
+        {
+            response.update(result);
+        }
+        response["ok"] = true;
+    }
+    catch (const std::exception &e)
+    {
+        response["ok"] = false;
+        response["error"] = e.what();
+    }
+    response["elapsed_ms"] =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "[CONTROL] " << line << " -> ok=" << response["ok"] << " elapsed_ms=" << response["elapsed_ms"]
+              << std::endl;
+    return response.dump();
+}
+
+void ControlSocket::close_client(int fd)
+{
+    auto it = m_clients.find(fd);
+    if (it == m_clients.end())
+    {
+        return;
+    }
+    if (it->second.source_id)
+    {
+        g_source_remove(it->second.source_id);
+    }
+    close(fd);
+    m_clients.erase(it);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glib.h>
+#include <nlohmann/json.hpp>
+#include <functional>
+#include <map>
+#include <string>
+
+/*********************************************************************
+ * Local control API of medialib_gst_runner.
+ *
+ * A Unix domain stream socket accepting one JSON object per line, e.g.
+ *   {"cmd": "switch_profile", "profile": "Daylight"}
+ *   {"cmd": "set_udp_target", "host": "10.0.0.3", "port": 5000}   (--udp-extra-hosts are not moved)
+ *   {"cmd": "set_bitrate", "stream": "sink0", "bitrate": 4000000}
+ *   {"cmd": "capture", "frames": 1}
+ *   {"cmd": "stats"}
+ * and answering each with one JSON line containing "ok", "cmd",
+ * "elapsed_ms" (time spent applying the command) and the command's result
+ * or "error". The sockets are GLib sources of the default main context, so
+ * every command is applied from the main loop, never from a signal handler
+ * or a second thread.
+ *
+ * Try it with: echo '{"cmd":"stats"}' | socat - UNIX-CONNECT:/tmp/medialib_gst_runner.sock
+ *********************************************************************/
+
+class ControlSocket
+{
+  public:
+    // Returns the result fields of a command; throw std::runtime_error to report an error.
+    using Handler = std::function<nlohmann::json(const nlohmann::json &request)>;
+
+    ControlSocket(std::string path, Handler handler);
+    ~ControlSocket();
+    ControlSocket(const ControlSocket &) = delete;
+    ControlSocket &operator=(const ControlSocket &) = delete;
+
+    bool start();
+    void stop();
+
+  private:
+    struct Client
+    {
+        int fd = -1;
+        guint source_id = 0;
+        std::string pending;
+    };
+
+    static gboolean on_accept(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_client(gint fd, GIOCondition condition, gpointer user_data);
+    bool handle_client_input(Client &client);
+    std::string dispatch(const std::string &line);
+    void close_client(int fd);
+
+    std::string m_path;
+    Handler m_handler;
+    int m_listen_fd = -1;
+    guint m_listen_source = 0;
+    std::map<int, Client> m_clients;
+};
@@ -0,0 +1,183 @@
+#include "media_library/media_library.hpp"
+#include "media_library/config_manager.hpp"
+#include "media_library/config_parser.hpp"
+#include "medialib_gst_runner.hpp"
+#include "parallel_jobs.hpp"
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/*********************************************************************
+ * extract_configs_bench measures the per-stream part of extract_configs
+ * (read encoder file, serialize the OSD + privacy mask structs with
+ * ConfigParser::config_struct_to_string, parse, merge, dump, write)
+ * serially and on the worker pool, for 1..16 synthetic encoded streams.
+ * The structs are parsed once from synthetic JSON up front, like the
+ * runner gets them from the ConfigManager.
+ * No sensor or ConfigManagerInteractor is needed, so it runs on a host.
+ *
+ * Usage: extract_configs_bench [--max-streams <n>] [--repeat <n>] [--workers <n>]
+ *********************************************************************/
+
+namespace fs = std::filesystem;
+
+static nlohmann::json synthetic_encoder_config(size_t index)
+{
+    nlohmann::json area = {{"bottom", 0}, {"enable", false}, {"left", 0}, {"right", 0}, {"top", 0}};
+    nlohmann::json encoder;
+    encoder["version"] = "1.1.0";
+    encoder["encoding"]["input_stream"] = {
+        {"format", "NV12"}, {"framerate", 30}, {"width", index % 2 ? 1920 : 3840}, {"height", index % 2 ? 1080 : 2160}};
+    auto &hailo = encoder["encoding"]["hailo_encoder"];
+    hailo["config"]["output_stream"]["codec"] = "CODEC_TYPE_H264";
+    hailo["gop_config"] = {{"b_frame_qp_delta", 0}, {"gop_size", 30}};
+    hailo["coding_control"]["intra_area"] = area;
+    hailo["coding_control"]["ipcm_area1"] = area;
+    hailo["coding_control"]["ipcm_area2"] = area;
+    hailo["coding_control"]["sei_messages"] = {{"encoder_timing_sei", true}, {"user_metadata_sei", true}};
+    hailo["rate_control"] = {{"rc_mode", "CBR"},
+                             {"intra_pic_rate", 60},
+                             {"picture_rc", true},
+                             {"bitrate", {{"target_bitrate", 2000000 + index}}},
+                             {"qp_smooth_settings",
+                              {{"alpha", 0}, {"q_step_divisor", 2}, {"qp_delta", 128}, {"qp_delta_limit", 1536}}}};
+    return encoder;
+}
+
+static std::string synthetic_osd_config(size_t index)
+{
+    nlohmann::json osd;
+    for (int i = 0; i < 8; i++)
+    {
+        osd["osd"]["text"].push_back({{"id", "text" + std::to_string(i)},
+                                      {"label", "stream " + std::to_string(index)},
+                                      {"font_size", 40},
+                                      {"x", 0.1 * i},
+                                      {"y", 0.05},
+                                      {"z-index", i},
+                                      {"rgb", {255, 255, 255}}});
+    }
+    osd["osd"]["dateTime"].push_back({{"id", "datetime"}, {"font_size", 30}, {"x", 0.7}, {"y", 0.9}});
+    return osd.dump();
+}
+
+static std::string synthetic_masking_config()
+{
+    nlohmann::json mask = {{"mask_type", "COLOR"}, {"color_value", {0, 0, 0}}, {"pixelization_size", 60}};
+    for (int i = 0; i < 4; i++)
+    {
+        mask["static_privacy_masks"].push_back(
+            {{"id", "mask" + std::to_string(i)}, {"polygon", {{{"x", 0}, {"y", 0}}, {{"x", 100}, {"y", 0}}, {{"x", 100}, {"y", 100}}}}});
+    }
+    return mask.dump();
+}
+
+// Same per-stream work as extract_configs, including one ConfigParser pair per worker
+static double run_once(const std::vector<std::string> &source_paths, const std::vector<config_stream_osd_t> &osd_configs,
+                       const privacy_mask_config_t &masking_config, const std::string &output_dir, size_t workers)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<ConfigParser>> osd_parsers(workers);
+    std::vector<std::unique_ptr<ConfigParser>> masking_parsers(workers);
+    run_ordered_jobs(source_paths.size(), workers, [&](size_t index, size_t worker) {
+        if (!osd_parsers[worker])
+        {
+            osd_parsers[worker] = std::make_unique<ConfigParser>(ConfigSchema::CONFIG_SCHEMA_OSD);
+            masking_parsers[worker] = std::make_unique<ConfigParser>(ConfigSchema::CONFIG_SCHEMA_PRIVACY_MASK);
+        }
+        std::string merged = merge_encoder_config(
+            read_file_to_string(source_paths[index]),
+            osd_parsers[worker]->config_struct_to_string<config_stream_osd_t>(osd_configs[index]),
+            masking_parsers[worker]->config_struct_to_string<privacy_mask_config_t>(masking_config));
+        write_string_to_file(merged, output_dir + "/encoder_stream_" + std::to_string(index) + "_config.json");
+    });
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_streams = 16;
+    int repeat = 20;
+    size_t workers = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--max-streams" && i + 1 < argc)
+        {
+            max_streams = std::stoul(argv[++i]);
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::stoi(argv[++i]);
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            workers = std::stoul(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--max-streams <n>] [--repeat <n>] [--workers <n>]" << std::endl;
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::string work_dir = "/tmp/extract_configs_bench_" + std::to_string(getpid());
+    fs::create_directories(work_dir + "/src");
+    fs::create_directories(work_dir + "/out");
+
+    std::vector<std::string> source_paths;
+    std::vector<config_stream_osd_t> osd_configs(max_streams);
+    privacy_mask_config_t masking_config;
+    ConfigParser osd_parser(ConfigSchema::CONFIG_SCHEMA_OSD);
+    ConfigParser masking_parser(ConfigSchema::CONFIG_SCHEMA_PRIVACY_MASK);
+    if (masking_parser.config_string_to_struct<privacy_mask_config_t>(synthetic_masking_config(), masking_config) !=
+        MEDIA_LIBRARY_SUCCESS)
+    {
+        std::cerr << "Error: synthetic privacy mask config rejected by the schema" << std::endl;
+        fs::remove_all(work_dir);
+        return 1;
+    }
+    for (size_t i = 0; i < max_streams; i++)
+    {
+        source_paths.push_back(work_dir + "/src/encoder_" + std::to_string(i) + ".json");
+        write_string_to_file(synthetic_encoder_config(i).dump(4), source_paths.back());
+        if (osd_parser.config_string_to_struct<config_stream_osd_t>(synthetic_osd_config(i), osd_configs[i]) !=
+            MEDIA_LIBRARY_SUCCESS)
+        {
+            std::cerr << "Error: synthetic OSD config rejected by the schema" << std::endl;
+            fs::remove_all(work_dir);
+            return 1;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t streams = 1; streams <= max_streams; streams++)
+    {
+        std::vector<std::string> paths(source_paths.begin(), source_paths.begin() + streams);
+        size_t parallel_workers = workers > 0 ? workers : default_job_workers(streams);
+
+        double serial_ms = 0;
+        double parallel_ms = 0;
+        for (int r = 0; r < repeat; r++)
+        {
+            serial_ms += run_once(paths, osd_configs, masking_config, work_dir + "/out", 1);
+            parallel_ms += run_once(paths, osd_configs, masking_config, work_dir + "/out", parallel_workers);
+        }
+        serial_ms /= repeat;
+        parallel_ms /= repeat;
+
+        std::cout << "[BENCH] streams=" << streams << " workers=" << parallel_workers << " serial_ms=" << serial_ms
+                  << " parallel_ms=" << parallel_ms << " speedup=" << (parallel_ms > 0 ? serial_ms / parallel_ms : 0)
+                  << std::endl;
+    }
+
+    fs::remove_all(work_dir);
+    return 0;
+}
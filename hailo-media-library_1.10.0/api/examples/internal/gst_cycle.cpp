@@ -1,9 +1,15 @@
 #include <gst/gst.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <csignal>
 #include <atomic>
 #include <iostream>
 #include <string>
+#include "medialib_gst_runner.hpp"
+#include "phase_timing.hpp"
+#include "pipeline_graph.hpp"
+#include "registry_cache.hpp"
+#include <vector>
 
 /* =======================
  * Globals
@@ -17,6 +23,7 @@ static uint64_t last_frame_count = 0;
 static const char *current_stage = "NULL";
 static int state_tick = 0;
 static guint state_timer_id = 0;
+static PhaseTimeline::clock::time_point playing_requested;
 
 
 static std::string base =
@@ -32,14 +39,16 @@ static std::string base =
         "h264parse name=parser config-interval=-1 ! "
         "video/x-h264,framerate=30/1";
 
-static std::string pipeline_base = "";
+static RunnerPipelineSpec runner_spec;
+static std::vector<GstElement *> record_sinks; // segmentsinks of the current pipeline (--record-dir)
+static std::vector<GstElement *> policy_queues; // policyqueues of the current pipeline (--queue-policy)
+static std::vector<GstElement *> sharpness_meters; // sharpnessmeters of the current pipeline (--sharpness)
 
 /* =======================
  * Forward declarations
  * ======================= */
-static GstElement* create_pipeline(const std::string &host, int port, std::string pipe_base);
+static GstElement* create_pipeline(const RunnerPipelineSpec &spec);
 static gboolean state_machine_cb(gpointer);
-extern std::string main_media_runner(int argc, char *argv[]);
 
 /* =======================
  * Signal handling
@@ -50,6 +59,13 @@ static void handle_sigint(int) {
         g_main_loop_quit(loop);
 }
 
+// main_media_runner only records SIGTERM in gSignalStatus, so kill <pid> stops the loop from here
+static gboolean handle_sigterm(gpointer) {
+    std::cerr << "\n[SIGNAL] SIGTERM received, stopping...\n";
+    g_main_loop_quit(loop);
+    return G_SOURCE_CONTINUE;
+}
+
 /* =======================
  * FPS handoff callback
  * ======================= */
@@ -72,15 +88,115 @@ static gboolean fps_log_cb(gpointer) {
     return TRUE;
 }
 
+/* =======================
+ * Phase timing hooks
+ * ======================= */
+static GstPadProbeReturn first_buffer_probe(GstPad *, GstPadProbeInfo *, gpointer user_data) {
+    phase_timeline().record_first_buffer(static_cast<const char *>(user_data));
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static gboolean timing_bus_cb(GstBus *, GstMessage *msg, gpointer) {
+    std::string record = describe_record_message(msg);
+    if (!record.empty()) {
+        std::cerr << record << std::endl;
+    }
+    std::string sharpness = describe_sharpness_message(msg);
+    if (!sharpness.empty()) {
+        std::cerr << sharpness << std::endl;
+    }
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STATE_CHANGED &&
+        GST_MESSAGE_SRC(msg) == GST_OBJECT(pipeline)) {
+        GstState old_state, new_state;
+        gst_message_parse_state_changed(msg, &old_state, &new_state, nullptr);
+        if (new_state == GST_STATE_PLAYING && old_state != GST_STATE_PLAYING) {
+            phase_timeline().record("state_playing", playing_requested, PhaseTimeline::clock::now());
+        }
+    }
+    return TRUE;
+}
+
+// Encoders are named enc_<stream_id> by the runner; the first buffer on each
+// encoder src pad ends the startup breakdown of that stream.
+static void attach_timing(GstElement *pipe) {
+    GstBus *bus = gst_element_get_bus(pipe);
+    gst_bus_add_watch(bus, timing_bus_cb, nullptr);
+    gst_object_unref(bus);
+
+    size_t encoders = 0;
+    GstIterator *it = gst_bin_iterate_elements(GST_BIN(pipe));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+        gchar *name = gst_element_get_name(element);
+        if (g_str_has_prefix(name, "enc_")) {
+            GstPad *src = gst_element_get_static_pad(element, "src");
+            if (src) {
+                gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, first_buffer_probe,
+                                  g_strdup(name + 4), g_free);
+                gst_object_unref(src);
+                encoders++;
+            }
+        }
+        g_free(name);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    phase_timeline().expect_first_buffers(encoders);
+}
+
+static void detach_timing(GstElement *pipe) {
+    GstBus *bus = gst_element_get_bus(pipe);
+    gst_bus_remove_watch(bus);
+    gst_object_unref(bus);
+}
+
 /* =======================
  * State helper
  * ======================= */
 static void set_pipeline_state(GstState state, const char *name) {
     current_stage = name;
     std::cerr << "[STATE] -> " << name << std::endl;
+    if (state == GST_STATE_PLAYING) {
+        playing_requested = PhaseTimeline::clock::now();
+        phase_timeline().mark_playing_requested();
+    }
     gst_element_set_state(pipeline, state);
 }
 
+/* -----------------------
+ * Recreate the pipeline for the next cycle
+ * ----------------------- */
+static void print_record_stats() {
+    for (GstElement *sink : record_sinks) {
+        std::cerr << describe_record_stats(sink) << std::endl;
+    }
+    for (GstElement *queue : policy_queues) {
+        std::cerr << describe_queue_stats(queue) << std::endl;
+    }
+    // Last score of the cycle, the focus drift over an aging run is the trend of these lines
+    for (GstElement *meter : sharpness_meters) {
+        std::cerr << describe_sharpness_stats(meter) << std::endl;
+    }
+}
+
+static void recreate_pipeline() {
+    print_record_stats();
+    record_sinks.clear();
+    policy_queues.clear();
+    sharpness_meters.clear();
+    detach_timing(pipeline);
+    gst_object_unref(pipeline);
+    phase_timeline().begin_run("cycle");
+    {
+        ScopedPhase construct("pipeline_construct");
+        pipeline = create_pipeline(runner_spec);
+    }
+    if (pipeline) attach_timing(pipeline);
+}
+
 /* =======================
  * State machine
  * ======================= */
@@ -133,8 +249,7 @@ static gboolean state_machine_cb(gpointer) {
                 arm_next_state_timer(1);
             } else {
                 set_pipeline_state(GST_STATE_NULL, "NULL");
-                gst_object_unref(pipeline);
-                pipeline = create_pipeline("10.0.0.2", 5000, pipeline_base);
+                recreate_pipeline();
                 phase = Phase::NULL_STATE;
                 arm_next_state_timer(1);
             }
@@ -142,8 +257,7 @@ static gboolean state_machine_cb(gpointer) {
 
         case Phase::READY:
             set_pipeline_state(GST_STATE_NULL, "NULL");
-            gst_object_unref(pipeline);
-            pipeline = create_pipeline("10.0.0.2", 5000, pipeline_base);
+            recreate_pipeline();
             phase = Phase::NULL_STATE;
             arm_next_state_timer(1);
             break;
@@ -153,77 +267,33 @@ static gboolean state_machine_cb(gpointer) {
 }
 
 
-/* =======================
- * Tee → queue helper
- * ======================= */
-static bool link_tee_to_queue(GstElement *tee, GstElement *queue) {
-    GstPad *tee_src = gst_element_request_pad_simple(tee, "src_%u");
-    GstPad *queue_sink = gst_element_get_static_pad(queue, "sink");
-
-    if (!tee_src || !queue_sink) {
-        if (tee_src) gst_object_unref(tee_src);
-        if (queue_sink) gst_object_unref(queue_sink);
-        return false;
-    }
-
-    GstPadLinkReturn ret = gst_pad_link(tee_src, queue_sink);
-    gst_object_unref(tee_src);
-    gst_object_unref(queue_sink);
-
-    return ret == GST_PAD_LINK_OK;
-}
-
 /* =======================
  * Pipeline creation
  * ======================= */
-static GstElement* create_pipeline(const std::string &host, int port, std::string pipe_base ) {
-    GError *error = nullptr;
+static GstElement* create_pipeline(const RunnerPipelineSpec &spec) {
+    PipelineGraph graph;
+    std::vector<RunnerStreamBranch> branches;
 
-    
-    
+    // First encoded stream: tee -> (RTP/UDP) + (identity handoff -> fakesink for FPS)
+    if (!build_gst_pipeline_graph(graph, spec, branches) ||
+        !attach_stream_outputs(graph, spec, branches)) {
+        return nullptr;
+    }
 
-    GstElement *pipe = gst_parse_launch(pipe_base.c_str(), &error);
-    if (!pipe) {
-        if (error) {
-            std::cerr << "<<Parse launch>>" << error->message << std::endl;
-            g_error_free(error);
+    g_signal_connect(branches.front().fps_identity, "handoff", G_CALLBACK(on_handoff), nullptr);
+    for (const auto &branch : branches) {
+        if (branch.record_sink) {
+            record_sinks.push_back(branch.record_sink);
+        }
+        if (spec.config.queue_policy != "none") {
+            policy_queues.push_back(branch.queue);
+            policy_queues.push_back(branch.udp_queue);
+        }
+        if (branch.sharpness) {
+            sharpness_meters.push_back(branch.sharpness);
         }
-        return nullptr;
     }
-    if (error) g_error_free(error);
-
-    GstElement *tee  = gst_element_factory_make("tee", nullptr);
-    GstElement *q1   = gst_element_factory_make("queue", nullptr);
-    GstElement *pay  = gst_element_factory_make("rtph264pay", nullptr);
-    GstElement *udp  = gst_element_factory_make("udpsink", nullptr);
-    GstElement *q2   = gst_element_factory_make("queue", nullptr);
-    GstElement *id   = gst_element_factory_make("identity", nullptr);
-    GstElement *sink = gst_element_factory_make("fakesink", nullptr);
-
-    g_object_set(udp, "host", host.c_str(), "port", port, "sync", FALSE, nullptr);
-    g_object_set(id, "signal-handoffs", TRUE, nullptr);
-    std::cout << "Before adding elements to bin." << std::endl;
-    gst_bin_add_many(GST_BIN(pipe),
-                     tee, q1, pay, udp,
-                     q2, id, sink,
-                     nullptr);
-   
-    
-    GstElement *parser = gst_bin_get_by_name(GST_BIN(pipe), "parser");
-    std::cout << "Parser:" << parser << std::endl;
-    std::cout << "Before elements link." << std::endl;
-    gst_element_link(parser, tee);
-    std::cout << "After elements link." << std::endl;
-    gst_object_unref(parser);
-    
-    link_tee_to_queue(tee, q1);
-    std::cout << "Parser linked to tee." << std::endl;
-    gst_element_link_many(q1, pay, udp, nullptr);
-    link_tee_to_queue(tee, q2);
-    gst_element_link_many(q2, id, sink, nullptr);
-    std::cout << "q2 link many." << std::endl;
-    g_signal_connect(id, "handoff", G_CALLBACK(on_handoff), nullptr);
-    return pipe;
+    return graph.release();
 }
 
 /*
@@ -271,17 +341,34 @@ int main(int argc, char *argv[]) {
     phase_mode = 3;
 //  int gst_cycle_main(int argc, char *argv[]) {
 
-    pipeline_base = main_media_runner(argc, argv);
+    if (!main_media_runner(argc, argv, runner_spec)) return -1;
     argc=3;
     argv[1]= (char *) std::string("--phase").c_str();
     argv[2]= (char *) std::string("3").c_str();
-    gst_init(&argc, &argv);
+    // Reuse the registry snapshot when no plugin changed, then preload only what the pipeline needs
+    const PipelineConfig &cfg = runner_spec.config;
+    RegistryWarmStart registry = prepare_registry(
+        cfg.registry_cache_dir.empty() ? default_registry_cache_dir() : cfg.registry_cache_dir, cfg.registry_cold);
+    auto phase_start = PhaseTimeline::clock::now();
+    gst_init(&argc, &argv); // includes the plugin registry load
+    auto phase_end = PhaseTimeline::clock::now();
+    phase_timeline().record("gst_init", phase_start, phase_end);
+    registry.init_ms = std::chrono::duration<double, std::milli>(phase_end - phase_start).count();
+
+    phase_start = PhaseTimeline::clock::now();
+    finish_registry_init(registry, runner_pipeline_factories(cfg));
+    phase_timeline().record("plugin_preload", phase_start, PhaseTimeline::clock::now());
+    phase_timeline().annotate("registry", registry.warm ? (registry.rebuilt ? "warm-rebuilt" : "warm") : "cold");
     std::signal(SIGINT, handle_sigint);
 
-    pipeline = create_pipeline("10.0.0.2", 5000, pipeline_base);
+    phase_start = PhaseTimeline::clock::now();
+    pipeline = create_pipeline(runner_spec);
     if (!pipeline) return -1;
-    std::cout << "Created pipeline string" << std::endl;
+    phase_timeline().record("pipeline_construct", phase_start, PhaseTimeline::clock::now());
+    attach_timing(pipeline);
+    std::cout << "Created pipeline" << std::endl;
     loop = g_main_loop_new(nullptr, FALSE);
+    g_unix_signal_add(SIGTERM, handle_sigterm, nullptr);
     std::cout << "gst loop opened" << std::endl;
     g_timeout_add_seconds(5, fps_log_cb, nullptr);
     std::cout << "gst timeout for cb" << std::endl;
@@ -291,6 +378,9 @@ int main(int argc, char *argv[]) {
     g_main_loop_run(loop);
 
     gst_element_set_state(pipeline, GST_STATE_NULL);
+    print_record_stats();
+    phase_timeline().finish_run();
+    detach_timing(pipeline);
     gst_object_unref(pipeline);
     g_main_loop_unref(loop);
     return 0;
@@ -2,12 +2,18 @@
 #include "media_library/config_manager.hpp"
 #include "media_library/config_parser.hpp"
 #include "media_library/media_library_logger.hpp"
+#include "medialib_gst_runner.hpp"
+#include "config_watcher.hpp"
+#include "parallel_jobs.hpp"
+#include "phase_timing.hpp"
+#include "pipeline_graph.hpp"
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <filesystem>
 #include <sstream>
+#include <iomanip>
 #include <cstdlib>
 #include <unistd.h>
 #include <cstring>
@@ -16,6 +22,8 @@
 #include <cstdlib> // for exit()
 #include <unistd.h> // for sleep()
 #include <vector>
+#include <set>
+#include <memory>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <gst/gst.h>
@@ -27,7 +35,7 @@
  * The app extracts the frontend config and all the encoder configs 
  * (including OSD and privacy mask), then creates up a pipeline with 
  * hailofrontendbinsrc → hailoencodebin for each stream. 
- * The encoded streams get sent over UDP and you also get FPS display for monitoring.
+ * Every encoded stream is sent over RTP/UDP (one port per stream) and you also get FPS display for monitoring.
  * The app supports changing profile on the fly using signals.
  * 
  * "Usage: " << program_name << " <medialib_config_path> [options]" << std::endl;
@@ -35,7 +43,49 @@
  * --args_file <path> (default=None)
  * --profile <name>       Profile to use (default: current profile)
  * --udp-host <host>      UDP destination host (default:
- * --udp-port <port>      UDP destination port (default: 5000)
+ * --udp-port <port>      UDP base port, stream i is sent to port + i (default: 5000)
+ * --udp-pacing <mode>    Spread each frame's packets over the frame interval: none, txtime
+ *                        (SO_TXTIME, needs the fq qdisc) or sleep (default: none)
+ * --udp-gso              Batch RTP packets with UDP GSO (pacedudpsink)
+ * --udp-extra-hosts <h,..> Also send every stream to these hosts (same ports); packetized once,
+ *                        pacedudpsink fans out with a sender thread and drop counter per host
+ * --timestamp-sei        Insert the capture time as SEI into every frame (rtp_analyzer latency)
+ * --sei-sync-port <port> UDP port answering rtp_analyzer --sync requests (default: 5990, 0 = off)
+ * --abr                  Adapt each stream's bitrate to RTCP receiver reports (medialib_gst_runner only)
+ * --abr-port <port>      UDP port the receiver reports arrive on (default: 5100)
+ * --abr-min <bps>        Lowest bitrate (default: configured target_bitrate / 4)
+ * --abr-max <bps>        Highest bitrate (default: configured target_bitrate)
+ * --config-workers <n>   Threads used to extract encoder configs (default: 0 = auto)
+ * --timing-log <path>    Append the startup/switch phase timing (JSON lines) to a file
+ * --registry-cache <dir> GStreamer registry snapshot directory (default: ~/.cache/medialib_gst_runner)
+ * --registry-cold        Rescan all plugins instead of reusing the registry snapshot
+ * --control-socket <path> Unix socket of the JSON control API (medialib_gst_runner only)
+ * --raw-capture          Insert rawcapturebypass before every encoder (capture via control API)
+ * --shm-dir <dir>        Also hand every encoded stream to local processes over shared memory
+ *                        (memfdsink, <dir>/<stream_id>.sock, leaky so consumers never stall the stream)
+ * --shm-raw              With --shm-dir, also the NV12 frames before each encoder (<stream_id>_raw.sock)
+ * --record-dir <dir>     Record every encoded stream as segment files (<dir>/<stream_id>_<index>.ts|mp4),
+ *                        segmentsink behind a leaky queue, so a slow disk drops recorded frames only
+ * --record-format <fmt>  ts (mpegtsmux) or mp4 (splitmuxsink + mp4mux) (default: ts)
+ * --record-segment <s>   Segment duration, cut at the next keyframe (default: 60)
+ * --record-budget <MB>   Storage of all recordings, oldest segments are deleted (default: 1024)
+ * --record-max-rate <kB/s> Disk bandwidth of each stream's writer (default: 0 = unlimited)
+ * --record-direct-io     Write the segments with O_DIRECT instead of buffered with flush-behind
+ * --queue-policy <p>     Drop instead of blocking when a stream's raw or RTP queue is full (policyqueue):
+ *                        none (plain queues), drop-oldest, drop-new or drop-to-keyframe (default: none)
+ * --sharpness <n>        Score focus / sharpness of every n-th frame before each encoder (sharpnessmeter,
+ *                        [SHARPNESS] lines; gst_cycle also prints the last score per cycle) (default: 0 = off)
+ * --watch                Apply args file / medialib config edits automatically (medialib_gst_runner only)
+ * --watch-debounce <ms>  Quiet period after the last edit before it is applied (default: 200)
+ * --stub-config          Synthesize the frontend/encoder configs (no ConfigManagerInteractor, host runs)
+ * --sw-elements          Use videotestsrc / x264enc instead of the Hailo elements (host runs)
+ * --bench-profiles <a,b> Profile switch benchmark over the listed profiles (medialib_gst_runner only)
+ * --bench-cycles <n>     Benchmark rounds over the profile list (default: 3)
+ * --bench-dwell <ms>     Time spent in each profile (default: 5000)
+ * --bench-report <path>  Write the benchmark transitions and matrix as JSON
+ *
+ * Every startup and profile switch prints a [TIMING] JSON line with the
+ * duration of each phase (see phase_timing.hpp).
  *
  * In case the args file option is selected the pipeline can be 
  * triggered to change profiles at the process level. 
@@ -61,22 +111,10 @@ bool run_flag = true;
 
 
 
+// Only async-signal-safe work here (no iostream, no exit): the loops waiting
+// on gSignalStatus restart or terminate the pipeline.
 void signalHandler(int signum) {
-    std::cout << "Interrupt signal (" << signum << ") received." << std::endl;
     gSignalStatus = signum;
-
-
-    if (signum == SIGUSR1 || signum == SIGINT) {
-        std::cout << "Restarting pipeline..." << std::endl;
-        gSignalStatus = signum;
-        return;
-    }
-
-    if (signum == SIGTERM  ) {
-        std::cout << "Terminating the pipeline..." << std::endl;
-        // Terminate program
-        exit(signum); 
-    }
 }
 
 // The signature for a signal handler function
@@ -84,15 +122,6 @@ typedef void (*SignalHandlerPointer)(int);
 
 namespace fs = std::filesystem;
 
-struct PipelineConfig
-{
-    std::string output_dir;
-    std::string profile_name;
-    std::string udp_host = "10.0.0.2";
-    int udp_port = 5000;
-};
-
-
 void print_usage(const char *program_name)
 {
     std::cerr << "Usage: " << program_name << " <medialib_config_path> [options]" << std::endl;
@@ -102,7 +131,40 @@ void print_usage(const char *program_name)
     std::cerr << "  --args_file <path> (default=None)" << std::endl;
     std::cerr << "  --profile <name>       Profile to use (default: current profile)" << std::endl;
     std::cerr << "  --udp-host <host>      UDP destination host (default: 127.0.0.1)" << std::endl;
-    std::cerr << "  --udp-port <port>      UDP destination port (default: 5000)" << std::endl;
+    std::cerr << "  --udp-port <port>      UDP base port, stream i is sent to port + i (default: 5000)" << std::endl;
+    std::cerr << "  --udp-pacing <mode>    Pace each frame's packets: none, txtime (fq qdisc) or sleep (default: none)" << std::endl;
+    std::cerr << "  --udp-gso              Batch RTP packets with UDP GSO" << std::endl;
+    std::cerr << "  --udp-extra-hosts <h,..> Also send every stream to these hosts, packetized once" << std::endl;
+    std::cerr << "  --timestamp-sei        Insert the capture time as SEI into every frame" << std::endl;
+    std::cerr << "  --sei-sync-port <port> Clock sync port for rtp_analyzer --sync (default: 5990, 0 = off)" << std::endl;
+    std::cerr << "  --abr                  Adapt each stream's bitrate to RTCP receiver reports" << std::endl;
+    std::cerr << "  --abr-port <port>      UDP port for the receiver reports (default: 5100)" << std::endl;
+    std::cerr << "  --abr-min <bps>        Lowest bitrate (default: configured target_bitrate / 4)" << std::endl;
+    std::cerr << "  --abr-max <bps>        Highest bitrate (default: configured target_bitrate)" << std::endl;
+    std::cerr << "  --config-workers <n>   Threads used to extract encoder configs (default: 0 = auto)" << std::endl;
+    std::cerr << "  --timing-log <path>    Append startup/switch phase timing (JSON lines) to a file" << std::endl;
+    std::cerr << "  --registry-cache <dir> Registry snapshot directory (default: ~/.cache/medialib_gst_runner)" << std::endl;
+    std::cerr << "  --registry-cold        Rescan all plugins instead of reusing the registry snapshot" << std::endl;
+    std::cerr << "  --control-socket <path> Unix socket of the JSON control API (medialib_gst_runner only)" << std::endl;
+    std::cerr << "  --raw-capture          Insert rawcapturebypass before every encoder" << std::endl;
+    std::cerr << "  --shm-dir <dir>        Serve every encoded stream to local processes (memfdsink sockets)" << std::endl;
+    std::cerr << "  --shm-raw              With --shm-dir, also serve the NV12 frames before each encoder" << std::endl;
+    std::cerr << "  --record-dir <dir>     Record every encoded stream as segment files (segmentsink)" << std::endl;
+    std::cerr << "  --record-format <fmt>  ts or mp4 (default: ts)" << std::endl;
+    std::cerr << "  --record-segment <s>   Segment duration, cut at the next keyframe (default: 60)" << std::endl;
+    std::cerr << "  --record-budget <MB>   Storage of all recordings, oldest segments deleted (default: 1024)" << std::endl;
+    std::cerr << "  --record-max-rate <kB/s> Disk bandwidth of each stream's writer (default: 0 = unlimited)" << std::endl;
+    std::cerr << "  --record-direct-io     Write the segments with O_DIRECT" << std::endl;
+    std::cerr << "  --queue-policy <p>     none, drop-oldest, drop-new or drop-to-keyframe (default: none)" << std::endl;
+    std::cerr << "  --sharpness <n>        Score focus / sharpness of every n-th frame (default: 0 = off)" << std::endl;
+    std::cerr << "  --watch                Apply args file / medialib config edits automatically" << std::endl;
+    std::cerr << "  --watch-debounce <ms>  Quiet period after the last edit (default: 200)" << std::endl;
+    std::cerr << "  --stub-config          Synthesize configs instead of using ConfigManagerInteractor" << std::endl;
+    std::cerr << "  --sw-elements          Use videotestsrc / x264enc instead of the Hailo elements" << std::endl;
+    std::cerr << "  --bench-profiles <a,b> Profile switch benchmark over the listed profiles (at least two)" << std::endl;
+    std::cerr << "  --bench-cycles <n>     Benchmark rounds over the profile list (default: 3)" << std::endl;
+    std::cerr << "  --bench-dwell <ms>     Time spent in each profile (default: 5000)" << std::endl;
+    std::cerr << "  --bench-report <path>  Write the benchmark results as JSON" << std::endl;
     std::cerr << "  -h, --help             Show this help" << std::endl;
 
 }
@@ -124,7 +186,8 @@ vector<std::string> read_args_file_to_string(std::string file_path)
     return argslist;
 }
 
-bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path, std::string &args_file_path, PipelineConfig &config)
+static bool parse_argument_list(int argc, char *argv[], std::string &medialib_config_path, std::string &args_file_path,
+                                PipelineConfig &config, bool exit_on_help)
 {
 
     int argc_n = argc;
@@ -145,11 +208,20 @@ bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path,
         if (arg == "-h" || arg == "--help")
         {
             print_usage(argv[0]);
-            exit(0);
+            if (exit_on_help)
+            {
+                exit(0);
+            }
+            return false;
         }
 
         if (arg == "-f" || arg == "--args_file")
         {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing path after " << arg << std::endl;
+                return false;
+            }
             args_file_path = argv[i + 1];
             std::cout << "Reading arguments from file: " << args_file_path << std::endl;
             argslist = read_args_file_to_string(args_file_path);
@@ -175,7 +247,11 @@ bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path,
 
     }
 
-    
+    if (argslist.size() < 2)
+    {
+        std::cerr << "Missing medialib config path" << (file_args_used ? " in " + args_file_path : "") << std::endl;
+        return false;
+    }
     medialib_config_path = argslist[1];
     config.output_dir = "/tmp/medialib_gst_" + std::to_string(getpid());
 
@@ -195,6 +271,180 @@ bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path,
         {
             config.udp_port = std::stoi(argslist[++i]);
         }
+        else if (arg == "--udp-pacing" && i + 1 < argc_n)
+        {
+            config.udp_pacing = argslist[++i];
+            if (config.udp_pacing != "none" && config.udp_pacing != "txtime" && config.udp_pacing != "sleep")
+            {
+                std::cerr << "Invalid --udp-pacing: " << config.udp_pacing << " (none, txtime or sleep)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--udp-gso")
+        {
+            config.udp_gso = true;
+        }
+        else if (arg == "--udp-extra-hosts" && i + 1 < argc_n)
+        {
+            std::stringstream hosts(argslist[++i]);
+            std::string host;
+            while (std::getline(hosts, host, ','))
+            {
+                if (!host.empty())
+                {
+                    config.udp_extra_hosts.push_back(host);
+                }
+            }
+        }
+        else if (arg == "--timestamp-sei")
+        {
+            config.timestamp_sei = true;
+        }
+        else if (arg == "--sei-sync-port" && i + 1 < argc_n)
+        {
+            config.sei_sync_port = std::stoi(argslist[++i]);
+        }
+        else if (arg == "--abr")
+        {
+            config.abr = true;
+        }
+        else if (arg == "--abr-port" && i + 1 < argc_n)
+        {
+            config.abr_port = std::stoi(argslist[++i]);
+        }
+        else if (arg == "--abr-min" && i + 1 < argc_n)
+        {
+            config.abr_min_bitrate = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--abr-max" && i + 1 < argc_n)
+        {
+            config.abr_max_bitrate = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--config-workers" && i + 1 < argc_n)
+        {
+            config.config_workers = std::stoi(argslist[++i]);
+        }
+        else if (arg == "--timing-log" && i + 1 < argc_n)
+        {
+            config.timing_log = argslist[++i];
+        }
+        else if (arg == "--registry-cache" && i + 1 < argc_n)
+        {
+            config.registry_cache_dir = argslist[++i];
+        }
+        else if (arg == "--registry-cold")
+        {
+            config.registry_cold = true;
+        }
+        else if (arg == "--control-socket" && i + 1 < argc_n)
+        {
+            config.control_socket = argslist[++i];
+        }
+        else if (arg == "--raw-capture")
+        {
+            config.raw_capture = true;
+        }
+        else if (arg == "--shm-dir" && i + 1 < argc_n)
+        {
+            config.shm_dir = argslist[++i];
+        }
+        else if (arg == "--shm-raw")
+        {
+            config.shm_raw = true;
+        }
+        else if (arg == "--record-dir" && i + 1 < argc_n)
+        {
+            config.record_dir = argslist[++i];
+        }
+        else if (arg == "--record-format" && i + 1 < argc_n)
+        {
+            config.record_format = argslist[++i];
+            if (config.record_format != "ts" && config.record_format != "mp4")
+            {
+                std::cerr << "Invalid --record-format: " << config.record_format << " (ts or mp4)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--record-segment" && i + 1 < argc_n)
+        {
+            config.record_segment_s = static_cast<unsigned int>(std::stoul(argslist[++i]));
+            if (config.record_segment_s == 0)
+            {
+                std::cerr << "Invalid --record-segment: must be at least 1 s" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--record-budget" && i + 1 < argc_n)
+        {
+            config.record_budget_mb = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--record-max-rate" && i + 1 < argc_n)
+        {
+            config.record_max_rate_kbps = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--record-direct-io")
+        {
+            config.record_direct_io = true;
+        }
+        else if (arg == "--queue-policy" && i + 1 < argc_n)
+        {
+            config.queue_policy = argslist[++i];
+            if (config.queue_policy != "none" && config.queue_policy != "drop-oldest" &&
+                config.queue_policy != "drop-new" && config.queue_policy != "drop-to-keyframe")
+            {
+                std::cerr << "Invalid --queue-policy: " << config.queue_policy
+                          << " (none, drop-oldest, drop-new or drop-to-keyframe)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--sharpness" && i + 1 < argc_n)
+        {
+            config.sharpness_interval = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--watch")
+        {
+            config.watch = true;
+        }
+        else if (arg == "--watch-debounce" && i + 1 < argc_n)
+        {
+            config.watch_debounce_ms = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--stub-config")
+        {
+            config.stub_config = true;
+        }
+        else if (arg == "--sw-elements")
+        {
+            config.sw_elements = true;
+        }
+        else if (arg == "--bench-profiles" && i + 1 < argc_n)
+        {
+            config.bench_profiles = argslist[++i];
+            std::stringstream profiles(config.bench_profiles);
+            size_t count = 0;
+            for (std::string profile; std::getline(profiles, profile, ',');)
+            {
+                count += profile.empty() ? 0 : 1;
+            }
+            if (count < 2)
+            {
+                std::cerr << "Invalid --bench-profiles: " << config.bench_profiles
+                          << " (a switch benchmark needs at least two profiles)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--bench-cycles" && i + 1 < argc_n)
+        {
+            config.bench_cycles = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--bench-dwell" && i + 1 < argc_n)
+        {
+            config.bench_dwell_ms = static_cast<unsigned int>(std::stoul(argslist[++i]));
+        }
+        else if (arg == "--bench-report" && i + 1 < argc_n)
+        {
+            config.bench_report = argslist[++i];
+        }
         else
         {
             std::cerr << "Unknown argument: " << arg << std::endl;
@@ -207,6 +457,20 @@ bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path,
     return true;
 }
 
+bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path, std::string &args_file_path,
+                     PipelineConfig &config, bool exit_on_help)
+{
+    try
+    {
+        return parse_argument_list(argc, argv, medialib_config_path, args_file_path, config, exit_on_help);
+    }
+    catch (const std::logic_error &e) // std::stoi / std::stoul on a malformed or out of range number
+    {
+        std::cerr << "Invalid numeric argument value (" << e.what() << ")" << std::endl;
+        return false;
+    }
+}
+
 std::string read_file_to_string(const std::string &path)
 {
     std::ifstream file(path);
@@ -234,48 +498,581 @@ bool write_string_to_file(const std::string &content, const std::string &path)
     return true;
 }
 
-std::string build_gst_pipeline(const PipelineConfig &config, const std::string &frontend_config_path,
-                               const std::vector<std::pair<std::string, std::string>> &encoder_configs,
-                               const std::vector<std::string> &all_frontend_stream_ids)
+std::vector<std::string> runner_pipeline_factories(const PipelineConfig &config)
+{
+    // Only what the options put into the pipeline: a factory that is missing on the target (no custom
+    // plugin) would force a registry rescan on every start, and an unused one would be loaded for nothing
+    std::vector<std::string> factories = {"queue", "tee", "h264parse", "capsfilter", "fakesink", "rtph264pay",
+                                          "identity"};
+    if (config.sw_elements)
+    {
+        factories.insert(factories.end(), {"videotestsrc", "x264enc"});
+    }
+    else
+    {
+        factories.insert(factories.end(), {"hailofrontendbinsrc", "hailoencodebin"});
+    }
+    bool paced = config.udp_pacing != "none" || config.udp_gso || !config.udp_extra_hosts.empty();
+    factories.push_back(paced ? "pacedudpsink" : "udpsink");
+    if (config.raw_capture)
+    {
+        factories.push_back("rawcapturebypass");
+    }
+    if (config.timestamp_sei)
+    {
+        factories.push_back("timestampsei");
+    }
+    if (!config.shm_dir.empty())
+    {
+        factories.push_back("memfdsink");
+    }
+    if (config.queue_policy != "none" || !config.record_dir.empty())
+    {
+        factories.push_back("policyqueue");
+    }
+    if (config.sharpness_interval > 0)
+    {
+        factories.push_back("sharpnessmeter");
+    }
+    if (!config.record_dir.empty() && config.record_format == "ts")
+    {
+        factories.insert(factories.end(), {"mpegtsmux", "segmentsink"});
+    }
+    else if (!config.record_dir.empty() && config.record_format == "mp4")
+    {
+        factories.insert(factories.end(), {"splitmuxsink", "mp4mux", "segmentsink"});
+    }
+    return factories;
+}
+
+const char *stream_encoder_factory(const PipelineConfig &config)
+{
+    return config.sw_elements ? "x264enc" : "hailoencodebin";
+}
+
+// First value of key anywhere below node (depth first), nullptr if absent.
+static const nlohmann::json *find_json_key(const nlohmann::json &node, const std::string &key)
+{
+    if (!node.is_object())
+    {
+        return nullptr;
+    }
+    auto it = node.find(key);
+    if (it != node.end())
+    {
+        return &*it;
+    }
+    for (const auto &child : node)
+    {
+        if (const auto *found = find_json_key(child, key))
+        {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+void configure_stream_encoder(GstElement *encoder, const PipelineConfig &config, const std::string &encoder_config_path)
 {
-    std::stringstream pipeline;
+    if (!config.sw_elements)
+    {
+        g_object_set(encoder, "config-file-path", encoder_config_path.c_str(), nullptr);
+        return;
+    }
+
+    nlohmann::json encoder_config = nlohmann::json::parse(read_file_to_string(encoder_config_path));
+    gst_util_set_object_arg(G_OBJECT(encoder), "tune", "zerolatency");
+    gst_util_set_object_arg(G_OBJECT(encoder), "speed-preset", "ultrafast");
+    if (const auto *bitrate = find_json_key(encoder_config, "target_bitrate"))
+    {
+        g_object_set(encoder, "bitrate", static_cast<guint>(bitrate->get<uint64_t>() / 1000), nullptr); // kbit/s
+    }
+    if (const auto *gop_size = find_json_key(encoder_config, "gop_size"))
+    {
+        g_object_set(encoder, "key-int-max", gop_size->get<guint>(), nullptr);
+    }
+}
 
-    std::cout << config.udp_host << std::endl;
-    //pipeline << "gst-launch-1.0 -e \\\n";
-    pipeline << "  hailofrontendbinsrc config-file-path=\"" << frontend_config_path << "\" name=frontend";
+bool build_gst_pipeline_graph(PipelineGraph &graph, const RunnerPipelineSpec &spec,
+                              std::vector<RunnerStreamBranch> &branches)
+{
+    GstElement *frontend;
+    if (spec.config.sw_elements)
+    {
+        // Host stand-in for the frontend: one live NV12 source fanned out to every stream
+        GstElement *source = graph.add("videotestsrc", "frontend_src");
+        graph.set(source, "is-live", true);
+        graph.set(source, "pattern", "ball");
+        GstElement *caps = graph.add_caps_filter("video/x-raw,format=NV12,width=1280,height=720,framerate=30/1");
+        frontend = graph.add("tee", "frontend");
+        graph.link_chain({source, caps, frontend});
+    }
+    else
+    {
+        frontend = graph.add("hailofrontendbinsrc", "frontend");
+        graph.set(frontend, "config-file-path", spec.frontend_config_path);
+    }
 
     std::set<std::string> encoder_stream_ids;
-    for (const auto &[stream_id, encoder_path] : encoder_configs)
+    for (const auto &[stream_id, encoder_path] : spec.encoder_configs)
     {
         encoder_stream_ids.insert(stream_id);
     }
 
-    for (size_t i = 0; i < encoder_configs.size(); i++)
+    // Same topology (and frontend pad order) as the former gst-launch string:
+    // frontend. ! queue ! hailoencodebin ! tee  t. ! queue ! h264parse ! video/x-h264,framerate=30/1
+    for (size_t i = 0; i < spec.encoder_configs.size(); i++)
     {
-        const auto &[stream_id, encoder_path] = encoder_configs[i];
+        const auto &[stream_id, encoder_path] = spec.encoder_configs[i];
 
-        pipeline << "   frontend. ! queue ! hailoencodebin config-file-path=\"" << encoder_path << "\" ! tee name=t"
-                 << i;
+        RunnerStreamBranch branch;
+        branch.stream_id = stream_id;
+        branch.encoder_config_path = encoder_path;
+        if (spec.config.queue_policy != "none")
+        {
+            // Frames the encoder cannot take go back to the frontend pool, counted by reason
+            branch.queue = graph.add("policyqueue", "rawq_" + stream_id);
+            graph.set(branch.queue, "policy", spec.config.queue_policy);
+            graph.set(branch.queue, "max-size-buffers", 5u);
+        }
+        else
+        {
+            branch.queue = graph.add("queue");
+        }
+        branch.encoder = graph.add(stream_encoder_factory(spec.config), "enc_" + stream_id);
+        if (branch.encoder)
+        {
+            configure_stream_encoder(branch.encoder, spec.config, encoder_path);
+        }
+        branch.tee = graph.add("tee", "t" + std::to_string(i));
+        GstElement *parse_queue = graph.add("queue");
+        GstElement *parser = graph.add("h264parse", "parser_" + stream_id);
+        graph.set(parser, "config-interval", -1);
+        branch.tail = graph.add_caps_filter("video/x-h264,framerate=30/1", "caps_" + stream_id);
+
+        graph.link(frontend, branch.queue);
+        GstElement *encoder_input = branch.queue;
+        if (spec.config.sharpness_interval > 0)
+        {
+            // Passthrough, reads the luma of every n-th frame and posts its scores on the bus
+            branch.sharpness = graph.add("sharpnessmeter", "sharp_" + stream_id);
+            graph.set(branch.sharpness, "interval", spec.config.sharpness_interval);
+            graph.link(encoder_input, branch.sharpness);
+            encoder_input = branch.sharpness;
+        }
+        if (spec.config.raw_capture)
+        {
+            branch.capture = graph.add("rawcapturebypass", "rawcapture_" + stream_id);
+            const std::string &capture_dir =
+                spec.config.capture_dir.empty() ? spec.config.output_dir : spec.config.capture_dir;
+            graph.set(branch.capture, "location", capture_dir + "/capture_" + stream_id + "_%u.nv12");
+            graph.link(encoder_input, branch.capture);
+            encoder_input = branch.capture;
+        }
+        if (!spec.config.shm_dir.empty() && spec.config.shm_raw)
+        {
+            // NV12 for local analytics: frontend dmabufs go out as they are, frames in any other
+            // memory are copied once by memfdsink; the leaky queue keeps the encoder from waiting
+            GstElement *raw_tee = graph.add("tee", "raw_t_" + stream_id);
+            graph.link(encoder_input, raw_tee);
+            encoder_input = raw_tee;
+            GstElement *shm_queue = graph.add("queue");
+            graph.set(shm_queue, "leaky", "downstream");
+            graph.set(shm_queue, "max-size-buffers", 2u);
+            graph.set(shm_queue, "max-size-bytes", 0u);
+            graph.set(shm_queue, "max-size-time", 0ll);
+            branch.shm_raw_sink = graph.add("memfdsink", "shm_raw_" + stream_id);
+            graph.set(branch.shm_raw_sink, "socket-path", spec.config.shm_dir + "/" + stream_id + "_raw.sock");
+            graph.set(branch.shm_raw_sink, "leaky", true);
+            graph.set(branch.shm_raw_sink, "sync", false);
+            graph.set(branch.shm_raw_sink, "async", false);
+            graph.link(raw_tee, shm_queue);
+            graph.link(shm_queue, branch.shm_raw_sink);
+        }
+        graph.link(encoder_input, branch.encoder);
+        graph.link_chain({branch.encoder, branch.tee, parse_queue, parser, branch.tail});
+        branches.push_back(branch);
+    }
 
-        //pipeline << "   t" << i << ". ! queue ! h264parse name=parser config-interval=-1 ! rtph264pay ! udpsink host=" << config.udp_host
-          //<< " port=" << (config.udp_port + i);
-        pipeline << "   t" << i << ". ! queue ! h264parse name=parser config-interval=-1 !  video/x-h264,framerate=30/1 !";
-               
+    for (const auto &stream_id : spec.all_frontend_stream_ids)
+    {
+        if (encoder_stream_ids.find(stream_id) == encoder_stream_ids.end())
+        {
+            GstElement *queue = graph.add("queue");
+            GstElement *sink = graph.add("fakesink", "hailo_display_" + stream_id);
+            graph.set(sink, "sync", false);
+            graph.set(sink, "async", false);
+            graph.link(frontend, queue);
+            graph.link(queue, sink);
+        }
+    }
 
-        //pipeline << "  t" << i << ". ! queue ! fakesink sync=false async=false"
-        //         << " name=hailo_display_" << stream_id;
+    if (!graph.ok())
+    {
+        std::cerr << "Error: Failed to build pipeline: " << graph.error() << std::endl;
+        return false;
     }
-    
-    for (const auto &stream_id : all_frontend_stream_ids)
+
+    std::cout << "\n=== GStreamer Pipeline ===" << std::endl;
+    std::cout << graph.describe();
+    std::cout << "==========================\n" << std::endl;
+    return true;
+}
+
+// First index after the <prefix><digits><suffix> files in dir, so a restart does not overwrite the
+// segments of the previous run (splitmuxsink counts from start-index, segmentsink scans by itself)
+static unsigned int next_segment_index(const std::string &dir, const std::string &prefix, const std::string &suffix)
+{
+    unsigned int next = 0;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec))
     {
-        if (encoder_stream_ids.find(stream_id) == encoder_stream_ids.end())
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        {
+            continue;
+        }
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (digits.size() > 9 || digits.find_first_not_of("0123456789") != std::string::npos)
         {
-            pipeline << "  frontend. ! queue ! fakesink sync=false async=false"
-                     << " name=hailo_display_" << stream_id;
+            continue;
+        }
+        next = std::max(next, static_cast<unsigned int>(std::stoul(digits)) + 1);
+    }
+    return next;
+}
+
+// tee -> policyqueue -> mpegtsmux -> segmentsink, or -> splitmuxsink (mp4mux, sink=segmentsink)
+static bool attach_record_branch(PipelineGraph &graph, const PipelineConfig &config, GstElement *tee,
+                                 RunnerStreamBranch &branch, size_t stream_count)
+{
+    std::error_code ec;
+    fs::create_directories(config.record_dir, ec);
+
+    // Drops whole frames up to the next keyframe when the disk falls behind, so the recording stays
+    // decodable; in front of the muxer, which must not lose bytes (segmentsink waits in mp4 mode)
+    GstElement *record_queue = graph.add("policyqueue", "recq_" + branch.stream_id);
+    graph.set(record_queue, "policy", "drop-to-keyframe");
+    graph.set(record_queue, "max-size-time", 1000000000ll);
+    graph.set(record_queue, "max-size-buffers", 0u);
+    graph.set(record_queue, "max-size-bytes", 0u);
+
+    const std::string prefix = config.record_dir + "/" + branch.stream_id + "_";
+    const std::string suffix = "." + config.record_format;
+    long long segment_ns = static_cast<long long>(config.record_segment_s) * 1000000000ll;
+    if (config.record_format == "mp4")
+    {
+        // splitmuxsink cuts at keyframes and finishes each MP4, segmentsink only writes the files
+        GstElement *splitmux = graph.add("splitmuxsink", "rec_" + branch.stream_id);
+        graph.set(splitmux, "location", prefix + "%05d" + suffix);
+        graph.set(splitmux, "max-size-time", segment_ns);
+        graph.set(splitmux, "start-index",
+                  static_cast<int>(next_segment_index(config.record_dir, branch.stream_id + "_", suffix)));
+        GstElementFactory *factory = cached_element_factory("segmentsink");
+        branch.record_sink = factory ? gst_element_factory_create(factory, ("recsink_" + branch.stream_id).c_str())
+                                     : nullptr;
+        if (!branch.record_sink)
+        {
+            std::cerr << "Error: segmentsink not found (gstrawcapturebypass plugin)" << std::endl;
+            return false;
         }
+        graph.set(branch.record_sink, "segment-duration", 0ll);
+        graph.set(branch.record_sink, "storage-pattern", prefix + "%u" + suffix);
+        g_object_set(splitmux, "sink", branch.record_sink, nullptr);
+        graph.link_chain({tee, record_queue, splitmux});
+    }
+    else
+    {
+        GstElement *mux = graph.add("mpegtsmux", "recmux_" + branch.stream_id);
+        graph.set(mux, "alignment", 7);
+        branch.record_sink = graph.add("segmentsink", "rec_" + branch.stream_id);
+        graph.set(branch.record_sink, "location", prefix + "%u" + suffix);
+        graph.set(branch.record_sink, "segment-duration", segment_ns);
+        graph.link_chain({tee, record_queue, mux, branch.record_sink});
+    }
+    if (!branch.record_sink)
+    {
+        return false;
+    }
+    graph.set(branch.record_sink, "max-storage",
+              static_cast<long long>(config.record_budget_mb) * 1024 * 1024 / static_cast<long long>(stream_count));
+    graph.set(branch.record_sink, "max-write-rate", static_cast<long long>(config.record_max_rate_kbps) * 1000);
+    graph.set(branch.record_sink, "direct-io", config.record_direct_io);
+    graph.set(branch.record_sink, "sync", false);
+    graph.set(branch.record_sink, "async", false);
+    return true;
+}
+
+std::string describe_record_message(GstMessage *msg)
+{
+    const GstStructure *s = gst_message_get_structure(msg);
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT || !s || !gst_structure_has_name(s, "segmentsink-segment"))
+    {
+        return "";
+    }
+    guint64 bytes = 0, duration = GST_CLOCK_TIME_NONE, dropped = 0, latency_us = 0, storage = 0, deleted = 0;
+    gst_structure_get_uint64(s, "bytes", &bytes);
+    gst_structure_get_uint64(s, "duration", &duration);
+    gst_structure_get_uint64(s, "buffers-dropped", &dropped);
+    gst_structure_get_uint64(s, "write-latency-max-us", &latency_us);
+    gst_structure_get_uint64(s, "storage-used", &storage);
+    gst_structure_get_uint64(s, "segments-deleted", &deleted);
+
+    std::ostringstream line;
+    line << "[RECORD] " << gst_structure_get_string(s, "location") << " " << bytes / 1024 << " KiB";
+    if (GST_CLOCK_TIME_IS_VALID(duration))
+    {
+        line << " " << duration / 1e9 << " s";
+    }
+    line << " dropped=" << dropped << " write_max_ms=" << latency_us / 1000.0
+         << " storage_mb=" << storage / (1024 * 1024) << " deleted=" << deleted;
+    return line.str();
+}
+
+std::string describe_record_stats(GstElement *record_sink)
+{
+    GstStructure *stats = nullptr;
+    g_object_get(record_sink, "stats", &stats, nullptr);
+    if (!stats)
+    {
+        return "";
+    }
+    auto field = [stats](const char *name) {
+        guint64 value = 0;
+        gst_structure_get_uint64(stats, name, &value);
+        return value;
+    };
+    guint queue_max = 0;
+    gst_structure_get_uint(stats, "queue-max", &queue_max);
+
+    std::ostringstream line;
+    line << "[RECORD] " << GST_OBJECT_NAME(record_sink) << " segments=" << field("segments-written")
+         << " deleted=" << field("segments-deleted") << " written_mb=" << field("bytes-written") / (1024 * 1024)
+         << " dropped=" << field("buffers-dropped") << " errors=" << field("write-errors")
+         << " write_us(avg/p99/max)=" << field("write-latency-avg-us") << "/" << field("write-latency-p99-us") << "/"
+         << field("write-latency-max-us") << " render_max_us=" << field("render-max-us")
+         << " queue_max=" << queue_max;
+    gst_structure_free(stats);
+    return line.str();
+}
+
+std::string describe_queue_stats(GstElement *queue)
+{
+    GstStructure *stats = nullptr;
+    g_object_get(queue, "stats", &stats, nullptr);
+    if (!stats)
+    {
+        return "";
+    }
+    auto field = [stats](const char *name) {
+        guint64 value = 0;
+        gst_structure_get_uint64(stats, name, &value);
+        return value;
+    };
+    guint level_max = 0;
+    gst_structure_get_uint(stats, "level-buffers-max", &level_max);
+
+    std::ostringstream line;
+    line << "[QUEUE] " << GST_OBJECT_NAME(queue) << " in=" << field("buffers-in") << " out=" << field("buffers-out")
+         << " dropped(oldest/new/to_keyframe/dependent)=" << field("dropped-oldest") << "/" << field("dropped-new")
+         << "/" << field("dropped-to-keyframe") << "/" << field("dropped-dependent")
+         << " over(buffers/bytes/time)=" << field("over-buffers") << "/" << field("over-bytes") << "/"
+         << field("over-time") << " blocked=" << field("blocked") << " level_max=" << level_max
+         << " residence_us(avg/max)=" << field("residence-avg-us") << "/" << field("residence-max-us");
+    gst_structure_free(stats);
+    return line.str();
+}
+
+std::string describe_sharpness_message(GstMessage *msg)
+{
+    const GstStructure *s = gst_message_get_structure(msg);
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT || !s || !gst_structure_has_name(s, "sharpness"))
+    {
+        return "";
     }
+    guint64 frame = 0, measure_us = 0;
+    gdouble center = 0, tile_min = 0, tile_mean = 0, tile_max = 0;
+    gst_structure_get_uint64(s, "frame", &frame);
+    gst_structure_get_uint64(s, "measure-us", &measure_us);
+    gst_structure_get_double(s, "center", &center);
+    gst_structure_get_double(s, "tile-min", &tile_min);
+    gst_structure_get_double(s, "tile-mean", &tile_mean);
+    gst_structure_get_double(s, "tile-max", &tile_max);
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "[SHARPNESS] " << GST_MESSAGE_SRC_NAME(msg) << " frame=" << frame
+         << " center=" << center << " tiles(min/mean/max)=" << tile_min << "/" << tile_mean << "/" << tile_max
+         << " tiles=";
+    const GValue *tiles = gst_structure_get_value(s, "tiles");
+    guint count = tiles ? gst_value_array_get_size(tiles) : 0;
+    for (guint i = 0; i < count; i++)
+    {
+        line << (i ? "," : "") << g_value_get_double(gst_value_array_get_value(tiles, i));
+    }
+    line << " cost_us=" << measure_us;
+    return line.str();
+}
 
-    return pipeline.str();
+std::string describe_sharpness_stats(GstElement *meter)
+{
+    GstStructure *stats = nullptr;
+    g_object_get(meter, "stats", &stats, nullptr);
+    if (!stats)
+    {
+        return "";
+    }
+    auto field = [stats](const char *name) {
+        guint64 value = 0;
+        gst_structure_get_uint64(stats, name, &value);
+        return value;
+    };
+    gdouble center = 0;
+    gst_structure_get_double(stats, "center", &center);
+
+    std::ostringstream line;
+    line << "[SHARPNESS] " << GST_OBJECT_NAME(meter) << " frames=" << field("frames")
+         << " measured=" << field("frames-measured") << " last_center=" << std::fixed << std::setprecision(1)
+         << center << " cost_us(avg/max)=" << field("measure-avg-us") << "/" << field("measure-max-us");
+    gst_structure_free(stats);
+    return line.str();
+}
+
+bool attach_stream_outputs(PipelineGraph &graph, const RunnerPipelineSpec &spec,
+                           std::vector<RunnerStreamBranch> &branches)
+{
+    if (branches.empty())
+    {
+        std::cerr << "Error: No encoded stream in the media library config" << std::endl;
+        return false;
+    }
+
+    // Every encoded stream is sent to udp_port + i. rtph264pay pushes the FU-A fragments of a
+    // frame as one buffer list and udpsink sends a list with one sendmmsg call, so nothing in
+    // between may split lists (queue keeps them). The socket buffer absorbs I-frame bursts.
+    // With --udp-pacing / --udp-gso pacedudpsink (gstrawcapturebypass plugin) spreads each list
+    // over the frame interval instead, so receivers do not see the I-frame as one burst.
+    // --timestamp-sei puts timestampsei in front of the payloader: every access unit carries its
+    // capture time for rtp_analyzer; only one element can own the clock sync port, the first stream's.
+    // --udp-extra-hosts does not add branches: the one rtph264pay output goes to every host through
+    // pacedudpsink extra-destinations, where a slow host only drops its own frames.
+    // --shm-dir adds a leaky queue -> memfdsink per stream: local consumers get the access units
+    // as fds without a copy, and one that stops releasing frames loses frames, not the stream.
+    // --record-dir adds a leaky queue -> segmentsink per stream. The sink hands the data to its
+    // writer thread and drops up to the next keyframe when the disk falls behind, so recording
+    // never holds up the tee; render_max_us in the [RECORD] summary shows it.
+    // --queue-policy makes the RTP queue a policyqueue: a slow network costs counted drops (whole
+    // frames up to the next keyframe) instead of blocking the encoder; see the [QUEUE] summary.
+    const PipelineConfig &config = spec.config;
+    bool paced = config.udp_pacing != "none" || config.udp_gso || !config.udp_extra_hosts.empty();
+    for (size_t i = 0; i < branches.size(); i++)
+    {
+        RunnerStreamBranch &branch = branches[i];
+        GstElement *tee = graph.add("tee");
+        bool policy_queue = config.queue_policy != "none";
+        GstElement *udp_queue = policy_queue ? graph.add("policyqueue", "udpq_" + branch.stream_id) : graph.add("queue");
+        GstElement *pay = graph.add("rtph264pay", "pay_" + branch.stream_id);
+        branch.udp_queue = udp_queue;
+        branch.pay = pay;
+        branch.udpsink = graph.add(paced ? "pacedudpsink" : "udpsink", "udp_" + branch.stream_id);
+        if (paced)
+        {
+            graph.set(branch.udpsink, "pacing", config.udp_pacing);
+            graph.set(branch.udpsink, "gso", config.udp_gso);
+        }
+
+        graph.set(udp_queue, "max-size-time", 200000000ll);
+        graph.set(udp_queue, "max-size-buffers", 0u);
+        graph.set(udp_queue, "max-size-bytes", 0u);
+        if (policy_queue)
+        {
+            graph.set(udp_queue, "policy", config.queue_policy);
+        }
+        graph.set(pay, "config-interval", -1);
+        graph.set(pay, "mtu", 1400u);
+        graph.set(branch.udpsink, "host", spec.config.udp_host);
+        graph.set(branch.udpsink, "port", spec.config.udp_port + static_cast<int>(i));
+        graph.set(branch.udpsink, "sync", false);
+        graph.set(branch.udpsink, "async", false);
+        graph.set(branch.udpsink, "buffer-size", 4 * 1024 * 1024);
+        std::string extra_destinations;
+        for (const auto &host : config.udp_extra_hosts)
+        {
+            extra_destinations += (extra_destinations.empty() ? "" : ",") + host + ":" +
+                                  std::to_string(spec.config.udp_port + static_cast<int>(i));
+        }
+        if (!extra_destinations.empty())
+        {
+            graph.set(branch.udpsink, "extra-destinations", extra_destinations);
+        }
+
+        graph.link(branch.tail, tee);
+        if (config.timestamp_sei)
+        {
+            branch.timestamp_sei = graph.add("timestampsei", "sei_" + branch.stream_id);
+            graph.set(branch.timestamp_sei, "sync-port", i == 0 ? config.sei_sync_port : 0);
+            graph.link_chain({tee, udp_queue, branch.timestamp_sei, pay, branch.udpsink});
+        }
+        else
+        {
+            graph.link_chain({tee, udp_queue, pay, branch.udpsink});
+        }
+
+        if (!config.shm_dir.empty())
+        {
+            GstElement *shm_queue = graph.add("queue");
+            graph.set(shm_queue, "leaky", "downstream");
+            graph.set(shm_queue, "max-size-buffers", 8u);
+            graph.set(shm_queue, "max-size-bytes", 0u);
+            graph.set(shm_queue, "max-size-time", 0ll);
+            branch.shm_sink = graph.add("memfdsink", "shm_" + branch.stream_id);
+            graph.set(branch.shm_sink, "socket-path", config.shm_dir + "/" + branch.stream_id + ".sock");
+            graph.set(branch.shm_sink, "leaky", true);
+            graph.set(branch.shm_sink, "sync", false);
+            graph.set(branch.shm_sink, "async", false);
+            graph.link_chain({tee, shm_queue, branch.shm_sink});
+        }
+
+        if (!config.record_dir.empty() && !attach_record_branch(graph, config, tee, branch, branches.size()))
+        {
+            return false;
+        }
+
+        // FPS monitoring on the first stream only
+        if (i == 0)
+        {
+            GstElement *fps_queue = graph.add("queue");
+            branch.fps_identity = graph.add("identity", "fps_" + branch.stream_id);
+            GstElement *sink = graph.add("fakesink");
+            graph.set(branch.fps_identity, "signal-handoffs", true);
+            graph.link_chain({tee, fps_queue, branch.fps_identity, sink});
+        }
+        std::cout << "Stream " << branch.stream_id << " -> udp://" << spec.config.udp_host << ":"
+                  << spec.config.udp_port + static_cast<int>(i)
+                  << (paced ? " (pacing " + config.udp_pacing + (config.udp_gso ? ", gso)" : ")") : "")
+                  << (extra_destinations.empty() ? "" : " + " + extra_destinations)
+                  << (config.shm_dir.empty() ? "" : " + shm://" + config.shm_dir + "/" + branch.stream_id + ".sock")
+                  << (config.record_dir.empty() ? ""
+                                                : " + " + config.record_dir + "/" + branch.stream_id + "_*." +
+                                                      config.record_format)
+                  << std::endl;
+    }
+
+    if (!graph.ok())
+    {
+        std::cerr << "Error: Failed to link stream outputs: " << graph.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string merge_encoder_config(const std::string &encoder_config_string, const std::string &osd_config_string,
+                                 const std::string &masking_config_string)
+{
+    nlohmann::json unified_config = nlohmann::json::parse(encoder_config_string);
+    unified_config["osd"] = nlohmann::json::parse(osd_config_string)["osd"];
+    unified_config["privacy_mask"] = nlohmann::json::parse(masking_config_string);
+    return unified_config.dump(2);
 }
 
 bool setup_profile(std::unique_ptr<ConfigManagerInteractor> &config_manager_interactor, const std::string &profile_name)
@@ -341,37 +1138,58 @@ bool extract_configs(std::unique_ptr<ConfigManagerInteractor> &config_manager_in
     }
     std::cout << "Saved frontend config to: " << frontend_config_path << std::endl;
 
-    std::set<std::string> encoder_stream_ids;
-    ConfigParser config_parser_osd = ConfigParser(ConfigSchema::CONFIG_SCHEMA_OSD);
-    ConfigParser config_parser_masking = ConfigParser(ConfigSchema::CONFIG_SCHEMA_PRIVACY_MASK);
-
+    // The per-stream work (read, parse, merge OSD/masking, dump, write) is independent,
+    // so it runs on a few worker threads. Results are stored by stream index and
+    // reported in the original order once all jobs are done.
+    std::vector<std::pair<output_stream_id_t, const config_encoded_output_stream_t *>> streams;
     for (const auto &entry : encoded_output_streams)
     {
-        output_stream_id_t stream_id = entry.first;
-        const config_encoded_output_stream_t &stream_config = entry.second;
+        streams.push_back({entry.first, &entry.second});
+    }
 
-        encoder_stream_ids.insert(stream_id);
+    size_t workers = config.config_workers > 0 ? static_cast<size_t>(config.config_workers)
+                                               : default_job_workers(streams.size());
+    workers = std::max<size_t>(1, std::min(workers, streams.size()));
+
+    // ConfigParser instances are not shared between threads, each worker gets its own pair
+    std::vector<std::unique_ptr<ConfigParser>> osd_parsers(workers);
+    std::vector<std::unique_ptr<ConfigParser>> masking_parsers(workers);
+    std::vector<std::string> encoder_config_paths(streams.size());
+    std::vector<char> written(streams.size(), 0); // not vector<bool>: written from several threads
+
+    run_ordered_jobs(streams.size(), workers, [&](size_t index, size_t worker) {
+        if (!osd_parsers[worker])
+        {
+            osd_parsers[worker] = std::make_unique<ConfigParser>(ConfigSchema::CONFIG_SCHEMA_OSD);
+            masking_parsers[worker] = std::make_unique<ConfigParser>(ConfigSchema::CONFIG_SCHEMA_PRIVACY_MASK);
+        }
+
+        const auto &[stream_id, stream_config] = streams[index];
+        ScopedPhase stream_phase("extract_configs.stream", stream_id);
         std::string encoder_config_string =
             std::visit([](const auto &config) -> std::string { return read_string_from_file(config.config_path); },
-                       stream_config.encoding);
+                       stream_config->encoding);
 
-        nlohmann::json unified_config = nlohmann::json::parse(encoder_config_string);
-        unified_config["osd"] = nlohmann::json::parse(
-            config_parser_osd.config_struct_to_string<config_stream_osd_t>(stream_config.osd))["osd"];
-        unified_config["privacy_mask"] = nlohmann::json::parse(
-            config_parser_masking.config_struct_to_string<privacy_mask_config_t>(stream_config.masking));
+        std::string unified_config_string = merge_encoder_config(
+            encoder_config_string,
+            osd_parsers[worker]->config_struct_to_string<config_stream_osd_t>(stream_config->osd),
+            masking_parsers[worker]->config_struct_to_string<privacy_mask_config_t>(stream_config->masking));
 
-        std::string unified_config_string = unified_config.dump(2);
-        std::string encoder_config_path = config.output_dir + "/encoder_stream_" + stream_id + "_config.json";
+        encoder_config_paths[index] = config.output_dir + "/encoder_stream_" + stream_id + "_config.json";
+        written[index] = write_string_to_file(unified_config_string, encoder_config_paths[index]);
+    });
 
-        if (!write_string_to_file(unified_config_string, encoder_config_path))
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        const output_stream_id_t &stream_id = streams[i].first;
+        if (!written[i])
         {
             std::cerr << "Error: Failed to save encoder config for stream " << stream_id << std::endl;
             return false;
         }
 
-        std::cout << "Saved encoder config for stream " << stream_id << " to: " << encoder_config_path << std::endl;
-        encoder_configs.push_back({stream_id, encoder_config_path});
+        std::cout << "Saved encoder config for stream " << stream_id << " to: " << encoder_config_paths[i] << std::endl;
+        encoder_configs.push_back({stream_id, encoder_config_paths[i]});
     }
 
     return true;
@@ -405,7 +1223,62 @@ int configHandler(SignalHandlerPointer signalHandler)
     return 0;
 }
 
-std::string config_pipeline(PipelineConfig config, std::string medialib_config_path)
+// Host stand-in for ConfigManagerInteractor (--stub-config). The medialib config may list
+// "profiles" (objects with "name") and "stub_streams"; every profile gets a frontend config
+// (HDR profiles differ) and per stream encoder configs with a profile dependent bitrate,
+// so switches exercise both the full rebuild and the encoder-only paths.
+static bool stub_config_pipeline(const PipelineConfig &config, const std::string &medialib_config_string,
+                                 RunnerPipelineSpec &spec)
+{
+    nlohmann::json medialib_config = nlohmann::json::parse(medialib_config_string);
+    std::string profile = config.profile_name.empty() ? "Daylight" : config.profile_name;
+    if (medialib_config.contains("profiles"))
+    {
+        bool known = false;
+        for (const auto &entry : medialib_config["profiles"])
+        {
+            known |= entry.value("name", "") == profile;
+        }
+        if (!known)
+        {
+            std::cerr << "Error: Failed to switch to profile '" << profile << "'" << std::endl;
+            return false;
+        }
+    }
+
+    bool hdr = profile.find("High_Dynamic_Range") != std::string::npos || profile.find("HDR") != std::string::npos;
+    unsigned int bitrate = profile.find("Lowlight") != std::string::npos ? 2000000 : 4000000;
+    size_t streams = medialib_config.value("stub_streams", 2);
+
+    spec = RunnerPipelineSpec();
+    spec.config = config;
+    spec.frontend_config_path = config.output_dir + "/frontend_config.json";
+    nlohmann::json frontend = {{"stub", true}, {"hdr", hdr}};
+    for (size_t i = 0; i < streams; i++)
+    {
+        std::string stream_id = "sink" + std::to_string(i);
+        spec.all_frontend_stream_ids.push_back(stream_id);
+        frontend["application_input_streams"]["resolutions"].push_back({{"stream_id", stream_id}});
+
+        nlohmann::json encoder = {
+            {"encoding",
+             {{"hailo_encoder",
+               {{"rate_control", {{"rc_mode", "CVBR"}, {"bitrate", {{"target_bitrate", bitrate / (i + 1)}}}}},
+                {"gop_config", {{"gop_size", 30}}}}}}},
+            {"osd", nlohmann::json::object()},
+            {"privacy_mask", nlohmann::json::object()}};
+        std::string encoder_path = config.output_dir + "/encoder_stream_" + stream_id + "_config.json";
+        if (!write_string_to_file(encoder.dump(2), encoder_path))
+        {
+            return false;
+        }
+        spec.encoder_configs.push_back({stream_id, encoder_path});
+    }
+    std::cout << "Using stub profile: " << profile << std::endl;
+    return write_string_to_file(frontend.dump(2), spec.frontend_config_path);
+}
+
+bool config_pipeline(const PipelineConfig &config, const std::string &medialib_config_path, RunnerPipelineSpec &spec)
 {
    try
     {
@@ -414,62 +1287,71 @@ std::string config_pipeline(PipelineConfig config, std::string medialib_config_p
     catch (const fs::filesystem_error &e)
     {
         std::cerr << "Error: Failed to create output directory: " << e.what() << std::endl;
-        return "";
+        return false;
     }
 
     try
     {
         // Read the media library config file
+        auto phase_start = PhaseTimeline::clock::now();
         std::string medialib_config_string = read_file_to_string(medialib_config_path);
+        phase_timeline().record("file_read", phase_start, PhaseTimeline::clock::now());
         std::cout << "Loaded media library config from: " << medialib_config_path << std::endl;
         std::cout << "Config string length: " << medialib_config_string.length() << " bytes" << std::endl;
 
+        if (config.stub_config)
+        {
+            auto stub_start = PhaseTimeline::clock::now();
+            bool configured = stub_config_pipeline(config, medialib_config_string, spec);
+            phase_timeline().record("extract_configs", stub_start, PhaseTimeline::clock::now());
+            phase_timeline().expect_first_buffers(spec.encoder_configs.size());
+            return configured;
+        }
+
         // Create ConfigManagerInteractor
+        phase_start = PhaseTimeline::clock::now();
         auto config_manager_interactor_res = ConfigManagerInteractor::create(medialib_config_string);
+        phase_timeline().record("config_manager_create", phase_start, PhaseTimeline::clock::now());
         if (!config_manager_interactor_res.has_value())
         {
             std::cerr << "Error: Failed to create ConfigManagerInteractor" << std::endl;
-            return "";
+            return false;
         }
         auto config_manager_interactor = std::move(config_manager_interactor_res.value());
 
         // Setup profile
+        phase_start = PhaseTimeline::clock::now();
         if (!setup_profile(config_manager_interactor, config.profile_name))
         {
-            return "";
+            return false;
         }
+        phase_timeline().record("setup_profile", phase_start, PhaseTimeline::clock::now());
 
         // Extract configs
-        std::string frontend_config_path;
-        std::vector<std::pair<std::string, std::string>> encoder_configs;
-        std::vector<std::string> all_frontend_stream_ids;
+        spec = RunnerPipelineSpec();
+        spec.config = config;
 
-        if (!extract_configs(config_manager_interactor, config, frontend_config_path, encoder_configs,
-                             all_frontend_stream_ids))
+        phase_start = PhaseTimeline::clock::now();
+        if (!extract_configs(config_manager_interactor, config, spec.frontend_config_path, spec.encoder_configs,
+                             spec.all_frontend_stream_ids))
         {
-            return "";
+            return false;
         }
-
-        // Build GStreamer pipeline
-        std::string pipeline =
-            build_gst_pipeline(config, frontend_config_path, encoder_configs, all_frontend_stream_ids);
-
-        std::cout << "\n=== GStreamer Pipeline ===" << std::endl;
-        std::cout << pipeline << std::endl;
-        std::cout << "==========================\n" << std::endl;
-        return pipeline;
+        phase_timeline().record("extract_configs", phase_start, PhaseTimeline::clock::now());
+        phase_timeline().expect_first_buffers(spec.encoder_configs.size());
+        return true;
     }
     catch (const std::out_of_range &e)
     {
         std::cerr << "\n[ERROR] std::out_of_range exception caught: " << e.what() << std::endl;
         std::cerr << "[ERROR] This typically means a required configuration key is missing from the JSON" << std::endl;
         std::cerr << "[ERROR] Check that all profile files exist and contain the required fields" << std::endl;
-        return "";
+        return false;
     }
     catch (const std::exception &e)
     {
         std::cerr << "\n[ERROR] Exception caught: " << e.what() << std::endl;
-        return "";
+        return false;
     }
 
 }
@@ -566,94 +1448,33 @@ int run_pipeline(std::vector<std::string> pipe_argv)
 
 
 
-std::string main_media_runner(int argc, char *argv[])
+bool main_media_runner(int argc, char *argv[], RunnerPipelineSpec &spec)
 {
-
     std::string medialib_config_path;
     std::string args_file_path;
-    std::string pipeline;
     PipelineConfig config;
 
-    bool first_run = true;
-    bool run_flag = true;
-
-
-//  int gst_cycle_main(int argc, char *argv[]) {
-    //gst_init(&argc, &argv);
-    //std::signal(SIGINT, handle_sigint);
-
-    //pipeline2 = create_pipeline("10.0.0.2", 5000);
-    //if (!pipeline) return -1;
-
-
-
+    // Single pass: reloads (SIGUSR1, args file / config edits) are handled by the callers' main loops
     if (0 != configHandler(signalHandler))
     {
         std::cerr << "Error: Signal handler config problem" << std::endl;
-        return "";
+        return false;
     }
 
-    while (run_flag)
+    if (!parse_arguments(argc, argv, medialib_config_path, args_file_path, config))
     {
+        return false;
+    }
 
-        if ( ! first_run)
-        {   
-            //## Busy wait on second signal ##
-            while (gSignalStatus != SIGUSR1 && gSignalStatus != SIGINT) {
-                std::cout << "Busy waiting on another signal." << std::endl;
-                sleep(1);
-            }
-            gSignalStatus = 0; // Reset signal status
-            
-        } else {
-            first_run = false;
-        } 
-
-        if (!parse_arguments(argc, argv, medialib_config_path, args_file_path, config))
-        {
-            return "";
-        }
-
-        if (!fs::exists(medialib_config_path))
-        {
-            std::cerr << "Error: Media library config file does not exist: " << medialib_config_path << std::endl;
-            return "";
-        }
-        std::cout << "Calling config pipe: MediaLib Config Path: " << medialib_config_path << std::endl;
-        pipeline = config_pipeline(config, medialib_config_path);
-        std::cout << "After Calling config pipe: MediaLib Config Path: " << medialib_config_path << std::endl;
-        if (pipeline.empty())
-        {
-            return "";
-        }
-        else 
-        return pipeline;
-        /*
-        vector<std::string> pipe_argv = get_string_vector_from_commandline(pipeline);
-        if (pipe_argv.empty())
-        {
-            std::cerr << "Error: Failed to parse pipeline command line into arguments." << std::endl;
-            return 1;
-        }
-        // Run the pipeline and monitor for signals
-        std::cout << "==>>Pipe argv contents:\n" << std::endl;
-        for (int i =0; i< (int) pipe_argv.size(); i++)
-        {
-            std::cout << "Argv[" << i << "]: " << pipe_argv[i] << std::endl;
-        }
-
-        if (args_file_path != "") {
-            
-
-            std::cout << "Running by args file change: " << args_file_path << std::endl;
-            run_pipeline(pipe_argv);
-        } 
-        else {
-            run_flag = false; // Exit after one run if no args file is used    
-            std::cout << "Starting GStreamer pipeline..." << std::endl;
-            run_pipeline(pipe_argv);
-        }
-            */
+    if (!fs::exists(medialib_config_path))
+    {
+        std::cerr << "Error: Media library config file does not exist: " << medialib_config_path << std::endl;
+        return false;
     }
-    return 0;
+    phase_timeline().set_log_path(config.timing_log);
+    phase_timeline().begin_run("startup", config.profile_name);
+    std::cout << "Calling config pipe: MediaLib Config Path: " << medialib_config_path << std::endl;
+    bool configured = config_pipeline(config, medialib_config_path, spec);
+    std::cout << "After Calling config pipe: MediaLib Config Path: " << medialib_config_path << std::endl;
+    return configured;
 }
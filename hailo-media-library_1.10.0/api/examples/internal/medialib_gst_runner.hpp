@@ -0,0 +1,136 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class PipelineGraph;
+
+/*********************************************************************
+ * Shared declarations of the medialib_gst_runner helpers, used by
+ * gst_cycle and the internal benchmarks linking medialib_gst_lib.
+ *********************************************************************/
+
+struct PipelineConfig
+{
+    std::string output_dir;
+    std::string profile_name;
+    std::string udp_host = "10.0.0.2";
+    int udp_port = 5000;
+    std::string udp_pacing = "none"; // none / txtime / sleep, anything but none uses pacedudpsink
+    bool udp_gso = false;            // UDP GSO batching in pacedudpsink
+    std::vector<std::string> udp_extra_hosts; // more receivers of every stream (same ports), pacedudpsink fan-out
+    bool timestamp_sei = false;      // timestampsei before every rtph264pay (capture time SEI)
+    int sei_sync_port = 5990;        // clock sync responder of the first stream's timestampsei, 0 = off
+    bool abr = false;                // adaptive bitrate from receiver feedback (medialib_gst_runner only)
+    int abr_port = 5100;             // UDP port the RTCP receiver reports are received on
+    unsigned int abr_min_bitrate = 0; // bps, 0 = a quarter of the configured target_bitrate
+    unsigned int abr_max_bitrate = 0; // bps, 0 = the configured target_bitrate
+    int config_workers = 0; // 0 = pick from core count
+    std::string timing_log; // JSONL file the phase timing runs are appended to
+    std::string registry_cache_dir; // empty = default_registry_cache_dir()
+    bool registry_cold = false;     // force a plugin rescan instead of reusing the snapshot
+    std::string control_socket;     // Unix socket path of the JSON control API (medialib_gst_runner)
+    bool raw_capture = false;       // insert rawcapturebypass in front of every encoder
+    std::string capture_dir;        // raw capture files, empty = output_dir
+    std::string shm_dir;            // memfdsink socket per encoded stream (<dir>/<stream_id>.sock), empty = off
+    bool shm_raw = false;           // with shm_dir, also the NV12 frames before each encoder (<stream_id>_raw.sock)
+    std::string record_dir;         // segmentsink per encoded stream (<dir>/<stream_id>_<index>.<format>), empty = off
+    std::string record_format = "ts"; // ts (mpegtsmux, cut by segmentsink) or mp4 (splitmuxsink + mp4mux)
+    unsigned int record_segment_s = 60; // segment duration, cut at the next keyframe
+    unsigned int record_budget_mb = 1024; // storage of all recorded streams together, split evenly
+    unsigned int record_max_rate_kbps = 0; // disk bandwidth of each stream's writer, 0 = unlimited
+    bool record_direct_io = false;  // O_DIRECT instead of buffered writes with flush-behind
+    std::string queue_policy = "none"; // policyqueue drop policy of the raw and RTP queues, none = plain queues
+    unsigned int sharpness_interval = 0; // sharpnessmeter in front of every encoder, scores every n-th frame, 0 = off
+    bool watch = false;             // reload on args file / medialib config changes (inotify)
+    unsigned int watch_debounce_ms = 200;
+    bool stub_config = false;       // synthesize configs instead of ConfigManagerInteractor (host runs)
+    bool sw_elements = false;       // videotestsrc / x264enc instead of the Hailo elements (host runs)
+    std::string bench_profiles;     // comma separated profiles cycled by the switch benchmark
+    unsigned int bench_cycles = 3;
+    unsigned int bench_dwell_ms = 5000; // time spent in each profile before the next switch
+    std::string bench_report;       // JSON report of the switch benchmark
+};
+
+// Everything needed to construct the runner pipeline once the configs were extracted.
+struct RunnerPipelineSpec
+{
+    PipelineConfig config;
+    std::string frontend_config_path;
+    std::vector<std::pair<std::string, std::string>> encoder_configs; // stream id, encoder config path
+    std::vector<std::string> all_frontend_stream_ids;
+};
+
+// Elements of one encoded stream branch, as created by build_gst_pipeline_graph / attach_stream_outputs.
+struct RunnerStreamBranch
+{
+    std::string stream_id;
+    std::string encoder_config_path;
+    GstElement *queue = nullptr;        // frontend -> queue (policyqueue with --queue-policy)
+    GstElement *sharpness = nullptr;    // sharpnessmeter sharp_<id>, only with --sharpness
+    GstElement *capture = nullptr;      // rawcapturebypass rawcapture_<id>, only with --raw-capture
+    GstElement *encoder = nullptr;      // hailoencodebin enc_<id>
+    GstElement *tee = nullptr;
+    GstElement *tail = nullptr;         // caps filter after h264parse, outputs are linked here
+    GstElement *udp_queue = nullptr;    // queue in front of the payloader (policyqueue with --queue-policy),
+                                        // set by attach_stream_outputs
+    GstElement *pay = nullptr;          // rtph264pay pay_<id>, set by attach_stream_outputs
+    GstElement *udpsink = nullptr;      // udpsink / pacedudpsink, set by attach_stream_outputs
+    GstElement *timestamp_sei = nullptr; // timestampsei, only with --timestamp-sei
+    GstElement *fps_identity = nullptr; // identity with signal-handoffs, set by attach_stream_outputs
+    GstElement *shm_sink = nullptr;     // memfdsink shm_<id>, only with --shm-dir
+    GstElement *shm_raw_sink = nullptr; // memfdsink shm_raw_<id>, only with --shm-dir --shm-raw
+    GstElement *record_sink = nullptr;  // segmentsink rec_<id> (inside splitmuxsink with mp4), only with --record-dir
+};
+
+// Async-signal-safe handler: only records the signal in gSignalStatus.
+void signalHandler(int signum);
+
+// Reports every error by returning false; only -h/--help exits the process, and only when exit_on_help is set
+// (reloads from the args file pass false, they run on the main loop or a worker thread).
+bool parse_arguments(int argc, char *argv[], std::string &medialib_config_path, std::string &args_file_path,
+                     PipelineConfig &config, bool exit_on_help = true);
+// Reads the medialib config, switches profile and extracts the frontend/encoder configs into spec.
+bool config_pipeline(const PipelineConfig &config, const std::string &medialib_config_path, RunnerPipelineSpec &spec);
+
+std::string read_file_to_string(const std::string &path);
+bool write_string_to_file(const std::string &content, const std::string &path);
+
+// Merges the OSD and privacy mask sections into an encoder config and dumps it (indent 2).
+std::string merge_encoder_config(const std::string &encoder_config_string, const std::string &osd_config_string,
+                                 const std::string &masking_config_string);
+
+// Parses the arguments, switches profile and extracts all configs into spec.
+bool main_media_runner(int argc, char *argv[], RunnerPipelineSpec &spec);
+
+// Element factories the runner pipeline of config uses, preloaded at startup.
+std::vector<std::string> runner_pipeline_factories(const PipelineConfig &config);
+
+// Encoder of a stream branch: hailoencodebin, or x264enc with --sw-elements.
+const char *stream_encoder_factory(const PipelineConfig &config);
+// Points the encoder at its config (hailoencodebin) or maps bitrate / gop of the config to x264enc.
+void configure_stream_encoder(GstElement *encoder, const PipelineConfig &config, const std::string &encoder_config_path);
+
+// Adds frontend -> queue [-> sharpnessmeter] [-> rawcapturebypass] [-> tee -> memfdsink] -> hailoencodebin (enc_<id>) -> tee -> queue -> h264parse -> caps
+// for every encoded stream to graph and returns the elements of each branch.
+bool build_gst_pipeline_graph(PipelineGraph &graph, const RunnerPipelineSpec &spec,
+                              std::vector<RunnerStreamBranch> &branches);
+
+// Links the outputs of every encoded stream: tee -> rtph264pay -> udpsink (udp_port + stream index),
+// plus identity -> fakesink for FPS monitoring on the first stream and, with --record-dir,
+// tee -> leaky queue -> mpegtsmux -> segmentsink (or splitmuxsink with segmentsink).
+bool attach_stream_outputs(PipelineGraph &graph, const RunnerPipelineSpec &spec,
+                           std::vector<RunnerStreamBranch> &branches);
+
+// "[RECORD] ..." line of a segmentsink-segment element message, empty for other messages.
+std::string describe_record_message(GstMessage *msg);
+// Totals of a segmentsink (stats property) as one line, for the exit / cycle summary.
+std::string describe_record_stats(GstElement *record_sink);
+// Drops per reason and residence time of a policyqueue (stats property) as one line.
+std::string describe_queue_stats(GstElement *queue);
+// "[SHARPNESS] ..." line of a sharpnessmeter score message, empty for other messages.
+std::string describe_sharpness_message(GstMessage *msg);
+// Measurements, cost and last center score of a sharpnessmeter (stats property) as one line.
+std::string describe_sharpness_stats(GstElement *meter);
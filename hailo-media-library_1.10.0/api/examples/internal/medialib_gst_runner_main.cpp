@@ -0,0 +1,171 @@
+#include "bitrate_controller.hpp"
+#include "config_watcher.hpp"
+#include "control_socket.hpp"
+#include "medialib_gst_runner.hpp"
+#include "phase_timing.hpp"
+#include "profile_switch_bench.hpp"
+#include "registry_cache.hpp"
+#include "runner_session.hpp"
+#include <glib-unix.h>
+#include <gst/gst.h>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+/*********************************************************************
+ * medialib_gst_runner: runs the medialib config pipeline until stopped
+ * and applies profile switches / live tuning without restarting the
+ * process.
+ *
+ * Control is the JSON control socket (--control-socket <path>, see
+ * control_socket.hpp), --watch (edits of the args file / medialib config
+ * are applied automatically, see config_watcher.hpp) or SIGUSR1, which
+ * re-reads --args_file and switches to its profile. Signals are handled
+ * through g_unix_signal_add, so every switch runs from the main loop.
+ *
+ * --bench-profiles runs the profile switch benchmark instead
+ * (profile_switch_bench.hpp) and exits when it is done. On a host:
+ *   medialib_gst_runner medialib_config.json --stub-config --sw-elements \
+ *       --bench-profiles Daylight,High_Dynamic_Range,Lowlight_Bayer --bench-report bench.json
+ *
+ * --abr adapts the encoder bitrates to RTCP receiver feedback
+ * (bitrate_controller.hpp).
+ *********************************************************************/
+
+static GMainLoop *loop = nullptr;
+
+static gboolean on_quit_signal(gpointer)
+{
+    std::cerr << "\n[SIGNAL] Stopping..." << std::endl;
+    g_main_loop_quit(loop);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_reload_signal(gpointer user_data)
+{
+    auto *session = static_cast<RunnerSession *>(user_data);
+    std::cout << "[SIGNAL] SIGUSR1, reloading the args file" << std::endl;
+    try
+    {
+        session->reload_args_file();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[SIGNAL] Reload failed: " << e.what() << std::endl;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string medialib_config_path;
+    std::string args_file_path;
+    PipelineConfig config;
+    if (!parse_arguments(argc, argv, medialib_config_path, args_file_path, config))
+    {
+        return -1;
+    }
+    phase_timeline().set_log_path(config.timing_log);
+
+    std::vector<std::string> bench_profiles;
+    std::stringstream profile_list(config.bench_profiles);
+    for (std::string profile; std::getline(profile_list, profile, ',');)
+    {
+        if (!profile.empty())
+        {
+            bench_profiles.push_back(profile);
+        }
+    }
+    if (!bench_profiles.empty())
+    {
+        config.profile_name = bench_profiles.front();
+    }
+
+    // The startup run covers gst_init and the registry warm start, the session continues it
+    phase_timeline().begin_run("startup", config.profile_name);
+    auto phase_start = PhaseTimeline::clock::now();
+    RegistryWarmStart registry = prepare_registry(
+        config.registry_cache_dir.empty() ? default_registry_cache_dir() : config.registry_cache_dir,
+        config.registry_cold);
+    auto phase_end = PhaseTimeline::clock::now();
+    phase_timeline().record("registry", phase_start, phase_end);
+
+    phase_start = phase_end;
+    gst_init(nullptr, nullptr); // includes the plugin registry load
+    phase_end = PhaseTimeline::clock::now();
+    phase_timeline().record("gst_init", phase_start, phase_end);
+    registry.init_ms = std::chrono::duration<double, std::milli>(phase_end - phase_start).count();
+
+    phase_start = PhaseTimeline::clock::now();
+    finish_registry_init(registry, runner_pipeline_factories(config));
+    phase_timeline().record("plugin_preload", phase_start, PhaseTimeline::clock::now());
+    phase_timeline().annotate("registry", registry.warm ? (registry.rebuilt ? "warm-rebuilt" : "warm") : "cold");
+
+    loop = g_main_loop_new(nullptr, FALSE);
+    auto session = std::make_unique<RunnerSession>(medialib_config_path, args_file_path, config);
+    if (!session->start(loop))
+    {
+        g_main_loop_unref(loop);
+        return -1;
+    }
+
+    std::unique_ptr<ControlSocket> control;
+    if (!config.control_socket.empty())
+    {
+        control = std::make_unique<ControlSocket>(
+            config.control_socket, [&session](const nlohmann::json &request) { return session->handle_command(request); });
+        if (!control->start())
+        {
+            session->stop();
+            g_main_loop_unref(loop);
+            return -1;
+        }
+    }
+
+    std::unique_ptr<ConfigWatcher> watcher;
+    if (config.watch)
+    {
+        watcher = std::make_unique<ConfigWatcher>(*session, config.watch_debounce_ms);
+        if (!watcher->start())
+        {
+            session->stop();
+            g_main_loop_unref(loop);
+            return -1;
+        }
+    }
+
+    std::unique_ptr<BitrateController> abr;
+    if (config.abr)
+    {
+        abr = std::make_unique<BitrateController>(*session, config.abr_port, config.abr_min_bitrate,
+                                                  config.abr_max_bitrate);
+        if (!abr->start())
+        {
+            session->stop();
+            g_main_loop_unref(loop);
+            return -1;
+        }
+    }
+
+    std::unique_ptr<ProfileSwitchBench> bench;
+    if (bench_profiles.size() > 1)
+    {
+        bench = std::make_unique<ProfileSwitchBench>(*session, loop, bench_profiles, config.bench_cycles,
+                                                     config.bench_dwell_ms, config.bench_report);
+        bench->start();
+    }
+
+    g_unix_signal_add(SIGINT, on_quit_signal, nullptr);
+    g_unix_signal_add(SIGTERM, on_quit_signal, nullptr);
+    g_unix_signal_add(SIGUSR1, on_reload_signal, session.get());
+
+    g_main_loop_run(loop);
+
+    abr.reset();
+    watcher.reset();
+    control.reset();
+    session->stop();
+    g_main_loop_unref(loop);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/*********************************************************************
+ * Small fork/join helper used by the runner to spread independent
+ * per-stream work (config read, JSON merge, dump, write) over a few
+ * threads. Jobs are claimed in index order and callers store results
+ * by index, so the output ordering does not depend on which worker
+ * finished first.
+ *********************************************************************/
+
+// Upper bound on worker threads; the device has few cores and the jobs are short.
+static constexpr size_t MAX_JOB_WORKERS = 4;
+
+inline size_t default_job_workers(size_t job_count)
+{
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min({job_count, hw, MAX_JOB_WORKERS}));
+}
+
+// Runs job(index, worker) for every index in [0, job_count).
+// worker is in [0, workers) and identifies the thread, so callers can keep
+// per-thread state (e.g. parsers) without locking. Worker 0 is the calling thread.
+// If jobs throw, the exception of the lowest failing index is rethrown after all
+// workers joined, which keeps error reporting deterministic as well.
+inline void run_ordered_jobs(size_t job_count, size_t workers, const std::function<void(size_t, size_t)> &job)
+{
+    if (job_count == 0)
+    {
+        return;
+    }
+    workers = std::max<size_t>(1, std::min(workers, job_count));
+
+    std::atomic<size_t> next_index{0};
+    std::vector<std::exception_ptr> errors(job_count);
+
+    auto worker_loop = [&](size_t worker) {
+        for (size_t index = next_index++; index < job_count; index = next_index++)
+        {
+            try
+            {
+                job(index, worker);
+            }
+            catch (...)
+            {
+                errors[index] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t worker = 1; worker < workers; worker++)
+    {
+        threads.emplace_back(worker_loop, worker);
+    }
+    worker_loop(0);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
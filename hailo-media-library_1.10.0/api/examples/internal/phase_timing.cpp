@@ -0,0 +1,155 @@
+#include "phase_timing.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+static double ms_between(PhaseTimeline::clock::time_point from, PhaseTimeline::clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+PhaseTimeline &phase_timeline()
+{
+    static PhaseTimeline timeline;
+    return timeline;
+}
+
+void PhaseTimeline::set_log_path(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_log_path = path;
+}
+
+void PhaseTimeline::begin_run(const std::string &trigger, const std::string &profile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_run_open)
+    {
+        finish_run_locked();
+    }
+
+    m_run_start = clock::now();
+    m_playing_requested = m_run_start;
+    m_expected_first_buffers = 0;
+    m_first_buffer_streams.clear();
+    m_run = {{"run", m_run_index++},
+             {"trigger", trigger},
+             {"profile", profile},
+             {"sdk", MEDIALIB_SDK_VERSION},
+             {"wall_time_s", std::chrono::duration_cast<std::chrono::seconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count()},
+             {"phases", nlohmann::json::array()}};
+    m_run_open = true;
+}
+
+void PhaseTimeline::expect_first_buffers(size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_expected_first_buffers = count;
+}
+
+void PhaseTimeline::record(const std::string &phase, clock::time_point start, clock::time_point end,
+                           const std::string &stream_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_run_open)
+    {
+        return;
+    }
+
+    nlohmann::json entry = {{"phase", phase},
+                            {"start_ms", ms_between(m_run_start, start)},
+                            {"duration_ms", ms_between(start, end)}};
+    if (!stream_id.empty())
+    {
+        entry["stream"] = stream_id;
+    }
+    m_run["phases"].push_back(entry);
+}
+
+void PhaseTimeline::mark_playing_requested()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_playing_requested = clock::now();
+}
+
+void PhaseTimeline::annotate(const std::string &key, const nlohmann::json &value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_run_open)
+    {
+        m_run[key] = value;
+    }
+}
+
+void PhaseTimeline::record_first_buffer(const std::string &stream_id)
+{
+    auto now = clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_run_open ||
+        std::find(m_first_buffer_streams.begin(), m_first_buffer_streams.end(), stream_id) !=
+            m_first_buffer_streams.end())
+    {
+        return;
+    }
+
+    m_first_buffer_streams.push_back(stream_id);
+    m_run["phases"].push_back({{"phase", "first_buffer"},
+                               {"stream", stream_id},
+                               {"start_ms", ms_between(m_run_start, m_playing_requested)},
+                               {"duration_ms", ms_between(m_playing_requested, now)}});
+
+    if (m_expected_first_buffers > 0 && m_first_buffer_streams.size() >= m_expected_first_buffers)
+    {
+        finish_run_locked();
+    }
+}
+
+void PhaseTimeline::finish_run()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_run_open)
+    {
+        finish_run_locked();
+    }
+}
+
+void PhaseTimeline::finish_run_locked()
+{
+    m_run_open = false;
+    m_run["total_ms"] = ms_between(m_run_start, clock::now());
+    if (m_expected_first_buffers > m_first_buffer_streams.size())
+    {
+        m_run["missing_first_buffers"] = m_expected_first_buffers - m_first_buffer_streams.size();
+    }
+
+    std::string line = m_run.dump();
+    std::cout << "[TIMING] " << line << std::endl;
+    if (!m_log_path.empty())
+    {
+        std::ofstream log(m_log_path, std::ios::app);
+        if (log.is_open())
+        {
+            log << line << "\n";
+        }
+        else
+        {
+            std::cerr << "[TIMING] Failed to open timing log: " << m_log_path << std::endl;
+        }
+    }
+    m_history.push_back(std::move(m_run));
+    m_run = nlohmann::json();
+}
+
+nlohmann::json PhaseTimeline::current_run() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_run;
+}
+
+std::vector<nlohmann::json> PhaseTimeline::history() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_history;
+}
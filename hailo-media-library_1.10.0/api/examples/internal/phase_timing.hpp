@@ -0,0 +1,87 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef MEDIALIB_SDK_VERSION
+#define MEDIALIB_SDK_VERSION "1.10.0"
+#endif
+
+/*********************************************************************
+ * Phase timing for startups and profile switches.
+ *
+ * Every startup / switch opens a "run" on the global timeline. Code paths
+ * record named phases into the current run (optionally per stream), e.g.
+ * file_read, config_manager_create, setup_profile, extract_configs,
+ * gst_init, pipeline_construct, state_playing, first_buffer.
+ * When a run is finished it is printed as one JSON line prefixed with
+ * [TIMING] and, if a log path is set, appended to that JSONL file.
+ * Finished runs are kept in memory so later switches can be compared
+ * with earlier ones (and logs from different SDK builds diffed).
+ *********************************************************************/
+
+class PhaseTimeline
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    void set_log_path(const std::string &path);
+
+    // Starts a new run. An unfinished previous run is finished first.
+    void begin_run(const std::string &trigger, const std::string &profile = "");
+    // Number of per-stream first_buffer phases after which the run finishes by itself.
+    void expect_first_buffers(size_t count);
+
+    void record(const std::string &phase, clock::time_point start, clock::time_point end,
+                const std::string &stream_id = "");
+    // Records first_buffer for a stream, measured from the last state_playing request.
+    void record_first_buffer(const std::string &stream_id);
+    void mark_playing_requested();
+    // Adds a run level attribute (e.g. registry mode) to the current run.
+    void annotate(const std::string &key, const nlohmann::json &value);
+
+    void finish_run();
+
+    nlohmann::json current_run() const;
+    std::vector<nlohmann::json> history() const;
+
+  private:
+    void finish_run_locked();
+
+    mutable std::mutex m_mutex;
+    std::string m_log_path;
+    std::vector<nlohmann::json> m_history;
+    nlohmann::json m_run;
+    clock::time_point m_run_start;
+    clock::time_point m_playing_requested;
+    size_t m_run_index = 0;
+    size_t m_expected_first_buffers = 0;
+    std::vector<std::string> m_first_buffer_streams;
+    bool m_run_open = false;
+};
+
+PhaseTimeline &phase_timeline();
+
+// Records the lifetime of the object as one phase of the current run.
+class ScopedPhase
+{
+  public:
+    explicit ScopedPhase(std::string phase, std::string stream_id = "")
+        : m_phase(std::move(phase)), m_stream_id(std::move(stream_id)), m_start(PhaseTimeline::clock::now())
+    {
+    }
+    ~ScopedPhase()
+    {
+        phase_timeline().record(m_phase, m_start, PhaseTimeline::clock::now(), m_stream_id);
+    }
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+  private:
+    std::string m_phase;
+    std::string m_stream_id;
+    PhaseTimeline::clock::time_point m_start;
+};
@@ -0,0 +1,294 @@
+#include "pipeline_graph.hpp"
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+GstElementFactory *cached_element_factory(const std::string &factory_name)
+{
+    static std::mutex cache_mutex;
+    static std::unordered_map<std::string, GstElementFactory *> cache;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(factory_name);
+    if (it != cache.end())
+    {
+        return it->second;
+    }
+
+    // Keeps the reference returned by gst_element_factory_find for the process lifetime
+    GstElementFactory *factory = gst_element_factory_find(factory_name.c_str());
+    if (factory)
+    {
+        cache.emplace(factory_name, factory);
+    }
+    return factory;
+}
+
+static std::string element_name(GstElement *element)
+{
+    gchar *name = gst_element_get_name(element);
+    std::string result = name ? name : "";
+    g_free(name);
+    return result;
+}
+
+PipelineGraph::PipelineGraph(const std::string &name)
+{
+    m_pipeline = gst_pipeline_new(name.c_str());
+    if (!m_pipeline)
+    {
+        m_error = "Failed to create pipeline " + name;
+    }
+}
+
+PipelineGraph::~PipelineGraph()
+{
+    if (m_pipeline)
+    {
+        gst_object_unref(m_pipeline);
+    }
+}
+
+void PipelineGraph::fail(const std::string &message)
+{
+    if (m_error.empty())
+    {
+        m_error = message;
+    }
+}
+
+GstElement *PipelineGraph::add(const std::string &factory_name, const std::string &name)
+{
+    if (!ok())
+    {
+        return nullptr;
+    }
+
+    GstElementFactory *factory = cached_element_factory(factory_name);
+    if (!factory)
+    {
+        fail("No such element factory: " + factory_name);
+        return nullptr;
+    }
+
+    GstElement *element = gst_element_factory_create(factory, name.empty() ? nullptr : name.c_str());
+    if (!element)
+    {
+        fail("Failed to create element " + factory_name);
+        return nullptr;
+    }
+    if (!gst_bin_add(GST_BIN(m_pipeline), element))
+    {
+        fail("Failed to add element " + factory_name + " (duplicate name '" + name + "'?)");
+        return nullptr;
+    }
+
+    m_description.push_back(element_name(element) + " (" + factory_name + ")");
+    return element;
+}
+
+GstElement *PipelineGraph::add_caps_filter(const std::string &caps, const std::string &name)
+{
+    GstElement *filter = add("capsfilter", name);
+    if (!filter)
+    {
+        return nullptr;
+    }
+
+    GstCaps *parsed = gst_caps_from_string(caps.c_str());
+    if (!parsed)
+    {
+        fail("Invalid caps: " + caps);
+        return nullptr;
+    }
+    g_object_set(filter, "caps", parsed, nullptr);
+    gst_caps_unref(parsed);
+    m_description.push_back("  " + element_name(filter) + ".caps=" + caps);
+    return filter;
+}
+
+void PipelineGraph::set_value(GstElement *element, const char *property, const GValue *value)
+{
+    if (!ok() || !element)
+    {
+        return;
+    }
+
+    GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), property);
+    if (!pspec)
+    {
+        fail(element_name(element) + " has no property '" + property + "'");
+        return;
+    }
+
+    GValue target = G_VALUE_INIT;
+    g_value_init(&target, G_PARAM_SPEC_VALUE_TYPE(pspec));
+    bool converted = false;
+    if (G_VALUE_HOLDS_STRING(value) && G_PARAM_SPEC_VALUE_TYPE(pspec) != G_TYPE_STRING)
+    {
+        // Same rules as gst-launch: enum nicks, flags, caps, fractions...
+        converted = gst_value_deserialize(&target, g_value_get_string(value));
+    }
+    else
+    {
+        converted = g_value_transform(value, &target);
+    }
+
+    if (!converted)
+    {
+        fail("Cannot convert value for " + element_name(element) + "." + property);
+        g_value_unset(&target);
+        return;
+    }
+
+    g_object_set_property(G_OBJECT(element), property, &target);
+    gchar *contents = g_strdup_value_contents(&target);
+    m_description.push_back("  " + element_name(element) + "." + property + "=" + contents);
+    g_free(contents);
+    g_value_unset(&target);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, const char *value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_STRING);
+    g_value_set_string(&v, value);
+    set_value(element, property, &v);
+    g_value_unset(&v);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, const std::string &value)
+{
+    set(element, property, value.c_str());
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, int value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_INT);
+    g_value_set_int(&v, value);
+    set_value(element, property, &v);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, unsigned int value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_UINT);
+    g_value_set_uint(&v, value);
+    set_value(element, property, &v);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, long long value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_INT64);
+    g_value_set_int64(&v, value);
+    set_value(element, property, &v);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, double value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_DOUBLE);
+    g_value_set_double(&v, value);
+    set_value(element, property, &v);
+}
+
+void PipelineGraph::set(GstElement *element, const char *property, bool value)
+{
+    GValue v = G_VALUE_INIT;
+    g_value_init(&v, G_TYPE_BOOLEAN);
+    g_value_set_boolean(&v, value);
+    set_value(element, property, &v);
+}
+
+bool PipelineGraph::link(GstElement *src, GstElement *sink)
+{
+    if (!ok() || !src || !sink)
+    {
+        fail("Link with a missing element");
+        return false;
+    }
+    if (!gst_element_link(src, sink))
+    {
+        fail("Failed to link " + element_name(src) + " -> " + element_name(sink));
+        return false;
+    }
+    m_description.push_back(element_name(src) + " -> " + element_name(sink));
+    return true;
+}
+
+bool PipelineGraph::link_chain(std::initializer_list<GstElement *> elements)
+{
+    GstElement *previous = nullptr;
+    for (GstElement *element : elements)
+    {
+        if (previous && !link(previous, element))
+        {
+            return false;
+        }
+        previous = element;
+    }
+    return ok();
+}
+
+GstPad *PipelineGraph::get_pad(GstElement *element, const char *pad_name)
+{
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad)
+    {
+        pad = gst_element_request_pad_simple(element, pad_name);
+    }
+    return pad;
+}
+
+bool PipelineGraph::link_pads(GstElement *src, const char *src_pad, GstElement *sink, const char *sink_pad)
+{
+    if (!ok() || !src || !sink)
+    {
+        fail("Link with a missing element");
+        return false;
+    }
+
+    GstPad *src_p = get_pad(src, src_pad);
+    GstPad *sink_p = get_pad(sink, sink_pad);
+    std::string what = element_name(src) + "." + src_pad + " -> " + element_name(sink) + "." + sink_pad;
+    bool linked = src_p && sink_p && gst_pad_link(src_p, sink_p) == GST_PAD_LINK_OK;
+    if (src_p)
+    {
+        gst_object_unref(src_p);
+    }
+    if (sink_p)
+    {
+        gst_object_unref(sink_p);
+    }
+
+    if (!linked)
+    {
+        fail("Failed to link " + what);
+        return false;
+    }
+    m_description.push_back(what);
+    return true;
+}
+
+std::string PipelineGraph::describe() const
+{
+    std::stringstream description;
+    for (const auto &line : m_description)
+    {
+        description << line << "\n";
+    }
+    return description.str();
+}
+
+GstElement *PipelineGraph::release()
+{
+    if (!ok())
+    {
+        return nullptr;
+    }
+    GstElement *pipeline = m_pipeline;
+    m_pipeline = nullptr;
+    return pipeline;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * PipelineGraph builds a GstPipeline element by element instead of
+ * concatenating a gst-launch string for gst_parse_launch:
+ *  - elements are created from cached GstElementFactory handles,
+ *  - properties are set directly (values are converted to the exact
+ *    GParamSpec type, so "int for guint64" mistakes cannot happen),
+ *  - pads are linked explicitly, no lookups of elements by name.
+ * The first failure is kept in error() and makes every later call a no-op,
+ * so a builder can chain calls and check ok() once at the end.
+ * Used by gst_cycle, gst_cycle_onoff and medialib_gst_runner.
+ *********************************************************************/
+
+// Returns a process-wide cached factory (reference owned by the cache), nullptr if unknown.
+GstElementFactory *cached_element_factory(const std::string &factory_name);
+
+class PipelineGraph
+{
+  public:
+    explicit PipelineGraph(const std::string &name = "pipeline");
+    ~PipelineGraph();
+    PipelineGraph(const PipelineGraph &) = delete;
+    PipelineGraph &operator=(const PipelineGraph &) = delete;
+
+    GstElement *add(const std::string &factory_name, const std::string &name = "");
+    GstElement *add_caps_filter(const std::string &caps, const std::string &name = "");
+
+    void set(GstElement *element, const char *property, const char *value);
+    void set(GstElement *element, const char *property, const std::string &value);
+    void set(GstElement *element, const char *property, int value);
+    void set(GstElement *element, const char *property, unsigned int value);
+    void set(GstElement *element, const char *property, long long value);
+    void set(GstElement *element, const char *property, double value);
+    void set(GstElement *element, const char *property, bool value);
+
+    // Links src -> sink on any compatible pads, requesting pads (tee src_%u etc.) when needed.
+    bool link(GstElement *src, GstElement *sink);
+    bool link_chain(std::initializer_list<GstElement *> elements);
+    // Links explicitly named pads; a template name (e.g. "src_%u") requests a new pad.
+    bool link_pads(GstElement *src, const char *src_pad, GstElement *sink, const char *sink_pad);
+
+    bool ok() const { return m_error.empty(); }
+    const std::string &error() const { return m_error; }
+    // Human readable list of elements, properties and links, for logs.
+    std::string describe() const;
+
+    GstElement *pipeline() const { return m_pipeline; }
+    // Transfers ownership of the pipeline to the caller (nullptr if building failed).
+    GstElement *release();
+
+  private:
+    void set_value(GstElement *element, const char *property, const GValue *value);
+    GstPad *get_pad(GstElement *element, const char *pad_name);
+    void fail(const std::string &message);
+
+    GstElement *m_pipeline = nullptr;
+    std::string m_error;
+    std::vector<std::string> m_description;
+};
@@ -0,0 +1,141 @@
+#include "pipeline_graph.hpp"
+#include <gst/gst.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*********************************************************************
+ * pipeline_graph_bench compares pipeline construction time of
+ * gst_parse_launch (string) against PipelineGraph (cached factories,
+ * direct properties, explicit links) for 1..16 stream pipelines.
+ *
+ * Both builders create the same runner-like topology out of core
+ * elements, so it runs on a host without the Hailo plugins:
+ *   src ! tee  (per stream) t. ! queue ! identity ! tee ! queue ! capsfilter ! fakesink
+ * Only construction is timed (pipeline stays in NULL).
+ *
+ * Usage: pipeline_graph_bench [--max-streams <n>] [--repeat <n>]
+ *********************************************************************/
+
+using bench_clock = std::chrono::steady_clock;
+
+static std::string launch_description(int streams)
+{
+    std::stringstream desc;
+    desc << "videotestsrc name=frontend is-live=false ! tee name=frontend_tee ";
+    for (int i = 0; i < streams; i++)
+    {
+        desc << " frontend_tee. ! queue max-size-buffers=5 ! identity name=enc_" << i << " silent=true ! tee name=t" << i
+             << "  t" << i << ". ! queue ! capsfilter caps=\"video/x-raw,framerate=30/1\" ! fakesink name=sink_" << i
+             << " sync=false async=false";
+    }
+    return desc.str();
+}
+
+static GstElement *build_with_parse(int streams)
+{
+    GError *error = nullptr;
+    GstElement *pipe = gst_parse_launch(launch_description(streams).c_str(), &error);
+    if (error)
+    {
+        std::cerr << "[BENCH] parse error: " << error->message << std::endl;
+        g_error_free(error);
+    }
+    return pipe;
+}
+
+static GstElement *build_with_graph(int streams)
+{
+    PipelineGraph graph;
+    GstElement *frontend = graph.add("videotestsrc", "frontend");
+    graph.set(frontend, "is-live", false);
+    GstElement *frontend_tee = graph.add("tee", "frontend_tee");
+    graph.link(frontend, frontend_tee);
+
+    for (int i = 0; i < streams; i++)
+    {
+        std::string index = std::to_string(i);
+        GstElement *queue = graph.add("queue");
+        graph.set(queue, "max-size-buffers", 5);
+        GstElement *encoder = graph.add("identity", "enc_" + index);
+        graph.set(encoder, "silent", true);
+        GstElement *tee = graph.add("tee", "t" + index);
+        GstElement *out_queue = graph.add("queue");
+        GstElement *caps = graph.add_caps_filter("video/x-raw,framerate=30/1");
+        GstElement *sink = graph.add("fakesink", "sink_" + index);
+        graph.set(sink, "sync", false);
+        graph.set(sink, "async", false);
+        graph.link_chain({frontend_tee, queue, encoder, tee, out_queue, caps, sink});
+    }
+
+    if (!graph.ok())
+    {
+        std::cerr << "[BENCH] graph error: " << graph.error() << std::endl;
+    }
+    return graph.release();
+}
+
+static double time_build(GstElement *(*build)(int), int streams, int repeat)
+{
+    double total_us = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        auto start = bench_clock::now();
+        GstElement *pipe = build(streams);
+        total_us += std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+        if (pipe)
+        {
+            gst_object_unref(pipe);
+        }
+    }
+    return total_us / repeat;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_streams = 16;
+    int repeat = 50;
+
+    gst_init(&argc, &argv);
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--max-streams" && i + 1 < argc)
+        {
+            max_streams = std::stoi(argv[++i]);
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::stoi(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--max-streams <n>] [--repeat <n>]" << std::endl;
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // Cold: the first graph build also fills the factory cache
+    auto start = bench_clock::now();
+    GstElement *cold = build_with_graph(1);
+    double cold_us = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+    if (!cold)
+    {
+        return 1;
+    }
+    gst_object_unref(cold);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[BENCH] graph cold build (factory cache fill) us=" << cold_us << std::endl;
+
+    for (int streams = 1; streams <= max_streams; streams++)
+    {
+        double parse_us = time_build(build_with_parse, streams, repeat);
+        double graph_us = time_build(build_with_graph, streams, repeat);
+        std::cout << "[BENCH] streams=" << streams << " parse_launch_us=" << parse_us << " graph_us=" << graph_us
+                  << " speedup=" << (graph_us > 0 ? parse_us / graph_us : 0) << std::endl;
+    }
+
+    return 0;
+}
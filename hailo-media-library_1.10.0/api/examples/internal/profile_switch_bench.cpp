@@ -0,0 +1,251 @@
+#include "profile_switch_bench.hpp"
+#include "runner_session.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+std::map<std::string, long long> read_meminfo()
+{
+    std::map<std::string, long long> values;
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        long long kb = 0;
+        fields >> key >> kb;
+        if (!key.empty() && key.back() == ':')
+        {
+            key.pop_back();
+        }
+        if (key == "MemAvailable" || key == "MemFree" || key == "CmaFree")
+        {
+            values[key] = kb;
+        }
+    }
+    return values;
+}
+
+static nlohmann::json find_stream(const nlohmann::json &stats, const std::string &stream_id)
+{
+    for (const auto &stream : stats["streams"])
+    {
+        if (stream["stream"] == stream_id)
+        {
+            return stream;
+        }
+    }
+    return nullptr;
+}
+
+static double mean_of(const std::vector<double> &values)
+{
+    double sum = 0;
+    for (double value : values)
+    {
+        sum += value;
+    }
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+ProfileSwitchBench::ProfileSwitchBench(RunnerSession &session, GMainLoop *loop, std::vector<std::string> profiles,
+                                       unsigned int cycles, unsigned int dwell_ms, std::string report_path)
+    : m_session(session), m_loop(loop), m_profiles(std::move(profiles)), m_cycles(cycles), m_dwell_ms(dwell_ms),
+      m_report_path(std::move(report_path))
+{
+}
+
+void ProfileSwitchBench::start()
+{
+    std::cout << "[BENCH] " << m_profiles.size() << " profiles x " << m_cycles << " cycles, dwell " << m_dwell_ms
+              << " ms" << std::endl;
+    g_timeout_add(m_dwell_ms, on_switch, this);
+}
+
+gboolean ProfileSwitchBench::on_switch(gpointer user_data)
+{
+    auto *self = static_cast<ProfileSwitchBench *>(user_data);
+    if (self->m_transition >= self->m_cycles * self->m_profiles.size())
+    {
+        self->finish();
+        return G_SOURCE_REMOVE;
+    }
+
+    std::string from = self->m_session.config().profile_name;
+    std::string to = self->m_profiles[(self->m_transition + 1) % self->m_profiles.size()];
+
+    nlohmann::json before = self->m_session.stats();
+    self->m_last_before_us = 0;
+    for (const auto &stream : before["streams"])
+    {
+        self->m_last_before_us = std::max<gint64>(self->m_last_before_us, stream["last_buffer_us"].get<gint64>());
+    }
+    self->m_mem_before = read_meminfo();
+    self->m_session.reset_interval_stats();
+
+    self->m_current = {{"index", self->m_transition}, {"from", from}, {"to", to}};
+    self->m_switch_start_us = g_get_monotonic_time();
+    try
+    {
+        nlohmann::json report = self->m_session.switch_profile(to, "bench");
+        self->m_current["method"] = report.value("method", "");
+        self->m_current["change"] = report.value("change", "");
+    }
+    catch (const std::exception &e)
+    {
+        self->m_current["error"] = e.what();
+    }
+    self->m_current["switch_ms"] = (g_get_monotonic_time() - self->m_switch_start_us) / 1000.0;
+
+    g_timeout_add(self->m_dwell_ms / 2, on_mid_dwell, self);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean ProfileSwitchBench::on_mid_dwell(gpointer user_data)
+{
+    auto *self = static_cast<ProfileSwitchBench *>(user_data);
+    self->m_mid_stats = self->m_session.stats();
+    self->m_mid_us = g_get_monotonic_time();
+    g_timeout_add(self->m_dwell_ms - self->m_dwell_ms / 2, on_end_dwell, self);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean ProfileSwitchBench::on_end_dwell(gpointer user_data)
+{
+    auto *self = static_cast<ProfileSwitchBench *>(user_data);
+    nlohmann::json end = self->m_session.stats();
+    double window_s = (g_get_monotonic_time() - self->m_mid_us) / 1e6;
+    nlohmann::json &result = self->m_current;
+
+    double first_frame_ms = 0;
+    double gap_ms = 0;
+    nlohmann::json steady_fps = nlohmann::json::object();
+    for (const auto &stream : end["streams"])
+    {
+        std::string stream_id = stream["stream"];
+        gint64 first_us = stream["first_buffer_us"];
+        if (first_us >= self->m_switch_start_us)
+        {
+            // Encoder (re)started by the switch: the gap spans the last old and first new buffer
+            first_frame_ms = std::max(first_frame_ms, (first_us - self->m_switch_start_us) / 1000.0);
+            if (self->m_last_before_us)
+            {
+                gap_ms = std::max(gap_ms, (first_us - self->m_last_before_us) / 1000.0);
+            }
+        }
+        gap_ms = std::max(gap_ms, stream["max_interval_ms"].get<double>());
+
+        nlohmann::json mid = find_stream(self->m_mid_stats, stream_id);
+        if (!mid.is_null() && window_s > 0)
+        {
+            steady_fps[stream_id] =
+                (stream["frames"].get<uint64_t>() - mid["frames"].get<uint64_t>()) / window_s;
+        }
+    }
+    result["first_frame_ms"] = first_frame_ms;
+    result["gap_ms"] = gap_ms;
+    result["steady_fps"] = steady_fps;
+
+    auto mem_after = read_meminfo();
+    for (const auto &[key, before_kb] : self->m_mem_before)
+    {
+        std::string name = key == "MemAvailable" ? "mem_available_kb" : key == "MemFree" ? "mem_free_kb" : "cma_free_kb";
+        result[name] = mem_after[key] - before_kb;
+    }
+
+    std::cout << "[BENCH] " << result.dump() << std::endl;
+    self->m_results.push_back(result);
+    self->m_transition++;
+    return on_switch(self);
+}
+
+nlohmann::json ProfileSwitchBench::transition_matrix() const
+{
+    struct Samples
+    {
+        std::vector<double> switch_ms, gap_ms, fps;
+        size_t errors = 0;
+    };
+    std::map<std::pair<std::string, std::string>, Samples> cells;
+    for (const auto &result : m_results)
+    {
+        Samples &cell = cells[{result["from"], result["to"]}];
+        if (result.contains("error"))
+        {
+            cell.errors++;
+            continue;
+        }
+        cell.switch_ms.push_back(result["switch_ms"]);
+        cell.gap_ms.push_back(result["gap_ms"]);
+        std::vector<double> fps;
+        for (const auto &[stream_id, value] : result["steady_fps"].items())
+        {
+            fps.push_back(value);
+        }
+        cell.fps.push_back(mean_of(fps));
+    }
+
+    nlohmann::json matrix = nlohmann::json::array();
+    for (const auto &[key, cell] : cells)
+    {
+        auto max_of = [](const std::vector<double> &values) {
+            return values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+        };
+        matrix.push_back({{"from", key.first},
+                          {"to", key.second},
+                          {"samples", cell.switch_ms.size()},
+                          {"errors", cell.errors},
+                          {"switch_ms_mean", mean_of(cell.switch_ms)},
+                          {"switch_ms_max", max_of(cell.switch_ms)},
+                          {"gap_ms_mean", mean_of(cell.gap_ms)},
+                          {"gap_ms_max", max_of(cell.gap_ms)},
+                          {"steady_fps_mean", mean_of(cell.fps)}});
+    }
+    return matrix;
+}
+
+void ProfileSwitchBench::finish()
+{
+    nlohmann::json matrix = transition_matrix();
+
+    // from (rows) x to (columns): mean switch_ms / gap_ms / fps
+    const int width = 26;
+    std::cout << "\n[BENCH] Transition matrix (switch_ms / gap_ms / fps, mean)" << std::endl;
+    std::cout << std::left << std::setw(width) << "from \\ to";
+    for (const auto &to : m_profiles)
+    {
+        std::cout << std::setw(width) << to;
+    }
+    std::cout << std::endl;
+    for (const auto &from : m_profiles)
+    {
+        std::cout << std::setw(width) << from;
+        for (const auto &to : m_profiles)
+        {
+            std::string cell = "-";
+            for (const auto &entry : matrix)
+            {
+                if (entry["from"] == from && entry["to"] == to)
+                {
+                    std::stringstream text;
+                    text << std::fixed << std::setprecision(1) << entry["switch_ms_mean"].get<double>() << " / "
+                         << entry["gap_ms_mean"].get<double>() << " / " << entry["steady_fps_mean"].get<double>();
+                    cell = text.str();
+                }
+            }
+            std::cout << std::setw(width) << cell;
+        }
+        std::cout << std::endl;
+    }
+
+    if (!m_report_path.empty())
+    {
+        std::ofstream report(m_report_path, std::ios::trunc);
+        report << nlohmann::json({{"transitions", m_results}, {"matrix", matrix}}).dump(2) << std::endl;
+        std::cout << "[BENCH] Report written to " << m_report_path << std::endl;
+    }
+    g_main_loop_quit(m_loop);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glib.h>
+#include <nlohmann/json.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+class RunnerSession;
+
+/*********************************************************************
+ * Profile switch benchmark of medialib_gst_runner (--bench-profiles).
+ *
+ * Cycles the session through the profile list (A -> B -> C -> A ...)
+ * --bench-cycles times, staying --bench-dwell ms in each profile. For
+ * every transition it records:
+ *   switch_ms        switch_profile call (extract + rebuild / update)
+ *   first_frame_ms   switch start -> first encoded buffer of the slowest
+ *                    stream (0 when no encoder was restarted)
+ *   gap_ms           longest time without an encoded buffer on any stream
+ *                    around the switch (output gap)
+ *   mem_available_kb / mem_free_kb / cma_free_kb deltas over the switch
+ *                    and dwell (/proc/meminfo)
+ *   steady_fps       per stream fps over the second half of the dwell
+ *   method / change  full rebuild or encoder-only, from the session
+ * At the end a from x to matrix (mean switch_ms / gap_ms / fps) is
+ * printed with [BENCH] and everything is written to --bench-report.
+ * With --stub-config --sw-elements it runs on a host without Hailo
+ * hardware, on the device it uses the real configs and elements.
+ *********************************************************************/
+
+class ProfileSwitchBench
+{
+  public:
+    ProfileSwitchBench(RunnerSession &session, GMainLoop *loop, std::vector<std::string> profiles, unsigned int cycles,
+                       unsigned int dwell_ms, std::string report_path);
+
+    // Schedules the first switch after one dwell in the starting profile.
+    void start();
+
+  private:
+    static gboolean on_switch(gpointer user_data);
+    static gboolean on_mid_dwell(gpointer user_data);
+    static gboolean on_end_dwell(gpointer user_data);
+    void finish();
+    nlohmann::json transition_matrix() const;
+
+    RunnerSession &m_session;
+    GMainLoop *m_loop;
+    std::vector<std::string> m_profiles;
+    unsigned int m_cycles;
+    unsigned int m_dwell_ms;
+    std::string m_report_path;
+
+    size_t m_transition = 0;
+    nlohmann::json m_current;     // transition being measured
+    nlohmann::json m_mid_stats;   // stats() at mid dwell
+    gint64 m_mid_us = 0;
+    gint64 m_switch_start_us = 0;
+    gint64 m_last_before_us = 0;  // last encoded buffer before the switch
+    std::map<std::string, long long> m_mem_before;
+    std::vector<nlohmann::json> m_results;
+};
+
+// Reads MemAvailable, MemFree and CmaFree (kB) from /proc/meminfo; missing fields are left out.
+std::map<std::string, long long> read_meminfo();
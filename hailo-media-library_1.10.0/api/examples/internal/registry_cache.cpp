@@ -0,0 +1,216 @@
+#include "registry_cache.hpp"
+#include <gst/gst.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static std::vector<std::string> split_search_path(const char *value)
+{
+    std::vector<std::string> dirs;
+    if (!value)
+    {
+        return dirs;
+    }
+    std::stringstream stream(value);
+    std::string dir;
+    while (std::getline(stream, dir, ':'))
+    {
+        if (!dir.empty())
+        {
+            dirs.push_back(dir);
+        }
+    }
+    return dirs;
+}
+
+static const char *first_env(const char *name, const char *fallback_name)
+{
+    const char *value = std::getenv(name);
+    return value ? value : std::getenv(fallback_name);
+}
+
+// Same search path as the GStreamer registry scan: GST_PLUGIN_PATH, then the system path.
+static std::vector<std::string> plugin_scan_dirs()
+{
+    std::vector<std::string> dirs = split_search_path(first_env("GST_PLUGIN_PATH_1_0", "GST_PLUGIN_PATH"));
+
+    const char *system_path = first_env("GST_PLUGIN_SYSTEM_PATH_1_0", "GST_PLUGIN_SYSTEM_PATH");
+    if (system_path)
+    {
+        auto system_dirs = split_search_path(system_path);
+        dirs.insert(dirs.end(), system_dirs.begin(), system_dirs.end());
+    }
+    else
+    {
+        const char *home = std::getenv("HOME");
+        if (home)
+        {
+            dirs.push_back(std::string(home) + "/.local/share/gstreamer-1.0/plugins");
+        }
+        for (const char *dir : {"/usr/lib/gstreamer-1.0", "/usr/lib64/gstreamer-1.0", "/usr/local/lib/gstreamer-1.0",
+                                "/usr/lib/aarch64-linux-gnu/gstreamer-1.0", "/usr/lib/x86_64-linux-gnu/gstreamer-1.0"})
+        {
+            dirs.push_back(dir);
+        }
+    }
+    return dirs;
+}
+
+static std::string plugin_stamp()
+{
+    guint major, minor, micro, nano;
+    gst_version(&major, &minor, &micro, &nano);
+
+    std::set<std::string> entries;
+    for (const auto &dir : plugin_scan_dirs())
+    {
+        std::error_code ec;
+        if (!fs::is_directory(dir, ec))
+        {
+            continue;
+        }
+        for (auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (!it->is_regular_file(ec) || it->path().extension() != ".so")
+            {
+                continue;
+            }
+            auto size = it->file_size(ec);
+            auto mtime = it->last_write_time(ec).time_since_epoch().count();
+            entries.insert(it->path().string() + " " + std::to_string(size) + " " + std::to_string(mtime));
+        }
+    }
+
+    std::stringstream stamp;
+    stamp << "gstreamer " << major << "." << minor << "." << micro << "." << nano << "\n";
+    for (const auto &entry : entries)
+    {
+        stamp << entry << "\n";
+    }
+    return stamp.str();
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string default_registry_cache_dir()
+{
+    const char *xdg_cache = std::getenv("XDG_CACHE_HOME");
+    if (xdg_cache && *xdg_cache)
+    {
+        return std::string(xdg_cache) + "/medialib_gst_runner";
+    }
+    const char *home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/medialib_gst_runner";
+}
+
+RegistryWarmStart prepare_registry(const std::string &cache_dir, bool force_cold)
+{
+    RegistryWarmStart state;
+    state.registry_path = cache_dir + "/registry.bin";
+    state.stamp_path = cache_dir + "/registry.stamp";
+    state.stamp = plugin_stamp();
+
+    std::error_code ec;
+    fs::create_directories(cache_dir, ec);
+
+    std::string saved_stamp;
+    std::ifstream saved(state.stamp_path);
+    if (saved.is_open())
+    {
+        std::stringstream buffer;
+        buffer << saved.rdbuf();
+        saved_stamp = buffer.str();
+    }
+
+    state.warm = !force_cold && fs::exists(state.registry_path, ec) && saved_stamp == state.stamp;
+    if (!state.warm)
+    {
+        // Cold start: drop the snapshot so gst_init rebuilds it from scratch
+        fs::remove(state.registry_path, ec);
+        fs::remove(state.stamp_path, ec);
+    }
+
+    setenv("GST_REGISTRY", state.registry_path.c_str(), 1);
+    setenv("GST_REGISTRY_UPDATE", state.warm ? "no" : "yes", 1);
+    return state;
+}
+
+static std::vector<std::string> missing_factories(const std::vector<std::string> &required_factories)
+{
+    std::vector<std::string> missing;
+    for (const auto &name : required_factories)
+    {
+        GstPluginFeature *feature = gst_registry_lookup_feature(gst_registry_get(), name.c_str());
+        if (!feature)
+        {
+            missing.push_back(name);
+            continue;
+        }
+        gst_object_unref(feature);
+    }
+    return missing;
+}
+
+bool finish_registry_init(RegistryWarmStart &state, const std::vector<std::string> &required_factories)
+{
+    auto missing = missing_factories(required_factories);
+    if (state.warm && !missing.empty())
+    {
+        std::cerr << "[REGISTRY] Snapshot lacks " << missing.front() << ", rescanning plugins" << std::endl;
+        setenv("GST_REGISTRY_UPDATE", "yes", 1);
+        gst_update_registry();
+        state.rebuilt = true;
+        missing = missing_factories(required_factories);
+    }
+
+    if (!state.warm || state.rebuilt)
+    {
+        std::ofstream stamp(state.stamp_path, std::ios::trunc);
+        stamp << state.stamp;
+    }
+
+    // Load the plugins of the required factories now, instead of during pipeline construction
+    auto start = std::chrono::steady_clock::now();
+    std::set<std::string> plugins;
+    for (const auto &name : required_factories)
+    {
+        GstPluginFeature *feature = gst_registry_lookup_feature(gst_registry_get(), name.c_str());
+        if (!feature)
+        {
+            continue;
+        }
+        GstPluginFeature *loaded = gst_plugin_feature_load(feature);
+        if (loaded)
+        {
+            const gchar *plugin_name = gst_plugin_feature_get_plugin_name(loaded);
+            if (plugin_name)
+            {
+                plugins.insert(plugin_name);
+            }
+            gst_object_unref(loaded);
+        }
+        gst_object_unref(feature);
+    }
+    state.preload_ms = ms_since(start);
+    state.plugins_loaded = plugins.size();
+
+    std::cout << "[REGISTRY] mode=" << (state.warm ? (state.rebuilt ? "warm-rebuilt" : "warm") : "cold")
+              << " snapshot=" << state.registry_path << " gst_init_ms=" << state.init_ms
+              << " preload_ms=" << state.preload_ms << " plugins=" << state.plugins_loaded << std::endl;
+    for (const auto &name : missing)
+    {
+        std::cerr << "[REGISTRY] Missing element factory: " << name << std::endl;
+    }
+    return missing.empty();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Plugin registry warm start.
+ *
+ * gst_init normally stats every plugin in the scan paths and rescans the
+ * ones that changed, and the first use of an element loads its plugin
+ * during pipeline construction. For a process that is restarted often
+ * (profile switches, aging cycles) this is paid every time.
+ *
+ * prepare_registry() (before gst_init) points GST_REGISTRY at a snapshot
+ * in cache_dir and compares a stamp of the plugin files (path, size,
+ * mtime + GStreamer version) with the one saved next to it. If nothing
+ * changed the snapshot is used as-is (GST_REGISTRY_UPDATE=no).
+ * finish_registry_init() (after gst_init) verifies that the snapshot
+ * really provides every required factory, rebuilds it otherwise, saves
+ * the stamp, and preloads only the plugins of the required factories.
+ *********************************************************************/
+
+struct RegistryWarmStart
+{
+    std::string registry_path;
+    std::string stamp_path;
+    std::string stamp;
+    bool warm = false;         // snapshot reused without rescan
+    bool rebuilt = false;      // warm snapshot failed validation and was rescanned
+    double init_ms = 0;        // gst_init, filled by the caller
+    double preload_ms = 0;
+    size_t plugins_loaded = 0;
+};
+
+// Default snapshot directory: $XDG_CACHE_HOME/medialib_gst_runner or ~/.cache/medialib_gst_runner.
+std::string default_registry_cache_dir();
+
+RegistryWarmStart prepare_registry(const std::string &cache_dir, bool force_cold);
+bool finish_registry_init(RegistryWarmStart &state, const std::vector<std::string> &required_factories);
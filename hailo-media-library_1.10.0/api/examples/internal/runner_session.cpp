@@ -0,0 +1,845 @@
+#include "runner_session.hpp"
+#include "phase_timing.hpp"
+#include "pipeline_graph.hpp"
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+RunnerSession::RunnerSession(std::string medialib_config_path, std::string args_file_path, PipelineConfig config)
+    : m_medialib_config_path(std::move(medialib_config_path)), m_args_file_path(std::move(args_file_path)),
+      m_config(std::move(config))
+{
+}
+
+RunnerSession::~RunnerSession()
+{
+    stop();
+}
+
+bool RunnerSession::start(GMainLoop *loop)
+{
+    m_loop = loop;
+    // Captures stay in the startup output dir, staging directories are removed again
+    m_base_dir = m_config.output_dir;
+    if (m_config.capture_dir.empty())
+    {
+        m_config.capture_dir = m_base_dir;
+    }
+    return configure(m_config) && build_and_play();
+}
+
+void RunnerSession::stop()
+{
+    teardown();
+    phase_timeline().finish_run();
+}
+
+bool RunnerSession::configure(const PipelineConfig &config)
+{
+    if (!fs::exists(m_medialib_config_path))
+    {
+        std::cerr << "Error: Media library config file does not exist: " << m_medialib_config_path << std::endl;
+        return false;
+    }
+    RunnerPipelineSpec spec;
+    if (!config_pipeline(config, m_medialib_config_path, spec))
+    {
+        return false;
+    }
+    m_config = config;
+    m_spec = std::move(spec);
+    return true;
+}
+
+bool RunnerSession::build_and_play()
+{
+    PipelineGraph graph;
+    std::vector<RunnerStreamBranch> branches;
+    {
+        ScopedPhase construct("pipeline_construct");
+        if (!build_gst_pipeline_graph(graph, m_spec, branches) || !attach_stream_outputs(graph, m_spec, branches))
+        {
+            return false;
+        }
+        m_pipeline = graph.release();
+    }
+    m_branches = std::move(branches);
+    m_pipeline_dir = m_spec.config.output_dir;
+
+    // Frame/byte counters and first_buffer timing on every encoder src pad
+    for (auto &branch : m_branches)
+    {
+        auto &counters = m_counters[branch.stream_id];
+        counters = std::make_unique<StreamCounters>();
+        counters->stream_id = branch.stream_id;
+        add_encoder_probe(branch);
+    }
+    m_snapshot = snapshot_spec(m_spec);
+
+    GstBus *bus = gst_element_get_bus(m_pipeline);
+    m_bus_watch = gst_bus_add_watch(bus, bus_cb, this);
+    gst_object_unref(bus);
+
+    m_playing_requested = PhaseTimeline::clock::now();
+    phase_timeline().mark_playing_requested();
+    if (gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        std::cerr << "Error: Failed to set the pipeline to PLAYING" << std::endl;
+        teardown();
+        return false;
+    }
+    m_playing_since_us = g_get_monotonic_time();
+    std::cout << "[SESSION] Playing profile '" << m_config.profile_name << "' with " << m_branches.size()
+              << " encoded streams" << std::endl;
+    return true;
+}
+
+void RunnerSession::teardown()
+{
+    if (!m_pipeline)
+    {
+        return;
+    }
+
+    ScopedPhase phase("pipeline_teardown");
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    for (const auto &branch : m_branches)
+    {
+        if (branch.record_sink)
+        {
+            std::cout << describe_record_stats(branch.record_sink) << std::endl;
+        }
+        if (m_config.queue_policy != "none")
+        {
+            std::cout << describe_queue_stats(branch.queue) << std::endl;
+            std::cout << describe_queue_stats(branch.udp_queue) << std::endl;
+        }
+    }
+    if (m_bus_watch)
+    {
+        g_source_remove(m_bus_watch);
+        m_bus_watch = 0;
+    }
+    gst_object_unref(m_pipeline);
+    m_pipeline = nullptr;
+    m_playing_requested.reset();
+    // The probes went away with the pipeline, the counters can be released now
+    m_branches.clear();
+    m_counters.clear();
+}
+
+void RunnerSession::add_encoder_probe(RunnerStreamBranch &branch)
+{
+    GstPad *src = gst_element_get_static_pad(branch.encoder, "src");
+    if (src)
+    {
+        gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, encoder_probe, m_counters.at(branch.stream_id).get(),
+                          nullptr);
+        gst_object_unref(src);
+    }
+}
+
+RunnerStreamBranch &RunnerSession::find_branch(const std::string &stream_id)
+{
+    for (auto &branch : m_branches)
+    {
+        if (stream_id.empty() || branch.stream_id == stream_id)
+        {
+            return branch;
+        }
+    }
+    throw std::runtime_error("Unknown stream: " + stream_id);
+}
+
+GstPadProbeReturn RunnerSession::encoder_probe(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto *counters = static_cast<StreamCounters *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now_us = g_get_monotonic_time();
+    gint64 previous_us = counters->last_buffer_us.exchange(now_us);
+    if (previous_us && now_us - previous_us > counters->max_interval_us)
+    {
+        counters->max_interval_us = now_us - previous_us;
+    }
+    counters->bytes += gst_buffer_get_size(buffer);
+    counters->frames++;
+    if (counters->report_first.exchange(false))
+    {
+        counters->first_buffer_us = now_us;
+        phase_timeline().record_first_buffer(counters->stream_id);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean RunnerSession::bus_cb(GstBus *, GstMessage *msg, gpointer user_data)
+{
+    auto *self = static_cast<RunnerSession *>(user_data);
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+    case GST_MESSAGE_STATE_CHANGED:
+        if (GST_MESSAGE_SRC(msg) == GST_OBJECT(self->m_pipeline))
+        {
+            GstState old_state, new_state;
+            gst_message_parse_state_changed(msg, &old_state, &new_state, nullptr);
+            if (new_state == GST_STATE_PLAYING && old_state != GST_STATE_PLAYING && self->m_playing_requested)
+            {
+                phase_timeline().record("state_playing", *self->m_playing_requested, PhaseTimeline::clock::now());
+                self->m_playing_requested.reset();
+            }
+        }
+        break;
+    case GST_MESSAGE_ERROR: {
+        GError *err = nullptr;
+        gchar *debug = nullptr;
+        gst_message_parse_error(msg, &err, &debug);
+        std::cerr << "[SESSION] Error from " << GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)) << ": " << err->message
+                  << std::endl;
+        if (debug)
+        {
+            std::cerr << "[SESSION] " << debug << std::endl;
+        }
+        g_clear_error(&err);
+        g_free(debug);
+        if (self->m_loop)
+        {
+            g_main_loop_quit(self->m_loop);
+        }
+        break;
+    }
+    case GST_MESSAGE_ELEMENT: {
+        const GstStructure *s = gst_message_get_structure(msg);
+        if (s && gst_structure_has_name(s, "rawcapture-done"))
+        {
+            std::cout << "[SESSION] Captured " << gst_structure_get_string(s, "location") << std::endl;
+        }
+        std::string record = describe_record_message(msg);
+        if (!record.empty())
+        {
+            std::cout << record << std::endl;
+        }
+        std::string sharpness = describe_sharpness_message(msg);
+        if (!sharpness.empty())
+        {
+            std::cout << sharpness << std::endl;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+nlohmann::json RunnerSession::handle_command(const nlohmann::json &request)
+{
+    if (!request.is_object() || !request.contains("cmd"))
+    {
+        throw std::runtime_error("Expected a JSON object with a \"cmd\" field");
+    }
+
+    const std::string cmd = request["cmd"].get<std::string>();
+    if (cmd == "switch_profile")
+    {
+        return switch_profile(request.at("profile").get<std::string>());
+    }
+    if (cmd == "set_udp_target")
+    {
+        return set_udp_target(request.value("host", m_config.udp_host), request.value("port", m_config.udp_port));
+    }
+    if (cmd == "set_bitrate")
+    {
+        return set_bitrate(request.value("stream", ""), request.at("bitrate").get<unsigned int>());
+    }
+    if (cmd == "capture")
+    {
+        return trigger_capture(request.value("stream", ""), request.value("frames", 1u));
+    }
+    if (cmd == "stats")
+    {
+        return stats();
+    }
+    throw std::runtime_error("Unknown command: " + cmd);
+}
+
+nlohmann::json RunnerSession::switch_profile(const std::string &profile_name, const char *trigger)
+{
+    PipelineConfig config = m_config;
+    config.profile_name = profile_name;
+    config.output_dir = next_staging_dir();
+
+    phase_timeline().begin_run(trigger, profile_name);
+    // The running pipeline is only touched once the new configs were extracted
+    RunnerPipelineSpec spec;
+    if (!config_pipeline(config, m_medialib_config_path, spec))
+    {
+        std::error_code ec;
+        fs::remove_all(config.output_dir, ec);
+        phase_timeline().finish_run();
+        throw std::runtime_error("Failed to configure profile: " + profile_name);
+    }
+
+    nlohmann::json report;
+    bool applied = reconfigure(spec, report);
+    release_staging_dirs();
+    if (!applied)
+    {
+        throw std::runtime_error("Failed to start the pipeline of profile: " + profile_name);
+    }
+    report["profile"] = profile_name;
+    report["streams"] = m_branches.size();
+    return report;
+}
+
+bool RunnerSession::reconfigure(const RunnerPipelineSpec &spec, nlohmann::json &report)
+{
+    if (spec.config.output_dir != m_base_dir)
+    {
+        m_staging_dirs.insert(spec.config.output_dir);
+    }
+    ConfigSnapshot snapshot = snapshot_spec(spec);
+    ConfigDiff diff = diff_config_snapshots(m_snapshot, snapshot);
+    report["change"] = describe_config_diff(diff);
+    phase_timeline().annotate("change", report["change"]);
+    std::cout << "[RECONFIG] " << report["change"].get<std::string>() << std::endl;
+
+    bool full_rebuild = !m_pipeline || diff.needs_full_rebuild();
+    nlohmann::json updates = nlohmann::json::array();
+    size_t rebuilt = 0;
+    if (!full_rebuild)
+    {
+        // Encoder-only (or no) change: the frontend keeps running
+        try
+        {
+            // Unchanged streams move to the new directory as well, the previous one may be removed afterwards
+            for (const auto &[stream_id, path] : spec.encoder_configs)
+            {
+                find_branch(stream_id).encoder_config_path = path;
+            }
+            for (const auto &change : diff.encoders)
+            {
+                RunnerStreamBranch &branch = find_branch(change.stream_id);
+                // Recreated encoders are built from the new config (factory, --sw-elements parameters)
+                updates.push_back(apply_encoder_change(branch, change, snapshot.encoder_configs.at(change.stream_id),
+                                                       spec.config));
+                if (updates.back()["method"] == "rebuild")
+                {
+                    rebuilt++;
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[RECONFIG] " << e.what() << ", falling back to a full rebuild" << std::endl;
+            full_rebuild = true;
+        }
+    }
+
+    if (full_rebuild)
+    {
+        RunnerPipelineSpec previous = m_spec;
+        auto start = PhaseTimeline::clock::now();
+        teardown();
+        m_spec = spec;
+        m_config = spec.config;
+        if (!build_and_play())
+        {
+            // Keep streaming the previous configuration rather than nothing; its directory is still intact
+            // because the new configs were extracted into a fresh one
+            m_spec = previous;
+            m_config = previous.config;
+            build_and_play();
+            return false;
+        }
+        double apply_ms = std::chrono::duration<double, std::milli>(PhaseTimeline::clock::now() - start).count();
+        phase_timeline().record("full_rebuild", start, PhaseTimeline::clock::now());
+        report["method"] = "full_rebuild";
+        report["apply_ms"] = apply_ms;
+        return true;
+    }
+
+    m_spec = spec;
+    m_config = spec.config;
+    m_snapshot = std::move(snapshot);
+    report["method"] = "encoder_only";
+    report["updates"] = updates;
+    // The run ends with the first buffer of every recreated encoder, or now if none was recreated
+    phase_timeline().expect_first_buffers(rebuilt);
+    if (rebuilt == 0)
+    {
+        phase_timeline().finish_run();
+    }
+    return true;
+}
+
+nlohmann::json RunnerSession::apply_encoder_change(RunnerStreamBranch &branch, const EncoderChange &change,
+                                                   const nlohmann::json &encoder_config, const PipelineConfig &config)
+{
+    auto start = PhaseTimeline::clock::now();
+    std::string method = "live";
+    if (change.live && g_object_class_find_property(G_OBJECT_GET_CLASS(branch.encoder), "config-string"))
+    {
+        g_object_set(branch.encoder, "config-string", encoder_config.dump().c_str(), nullptr);
+    }
+    else
+    {
+        method = "rebuild";
+        if (!rebuild_encoder(branch, config))
+        {
+            throw std::runtime_error("Failed to recreate the encoder of stream " + branch.stream_id);
+        }
+    }
+    auto end = PhaseTimeline::clock::now();
+
+    for (const auto &kind : change.kinds)
+    {
+        phase_timeline().record("encoder_update." + kind, start, end, branch.stream_id);
+    }
+    double apply_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << "[RECONFIG] stream=" << branch.stream_id << " method=" << method << " apply_ms=" << apply_ms
+              << std::endl;
+    return {{"stream", branch.stream_id}, {"kinds", change.kinds}, {"method", method}, {"apply_ms", apply_ms}};
+}
+
+// Shared by rebuild_encoder and its probes; each probe holds a copy until GStreamer drops the probe,
+// so a probe firing after rebuild_encoder gave up never runs on a freed context.
+struct EncoderSwap
+{
+    enum State
+    {
+        PENDING,
+        BLOCKED,
+        CANCELLED
+    };
+    std::atomic<int> state{PENDING};
+    std::promise<void> blocked;
+    std::promise<void> drained;
+};
+
+static gpointer new_swap_ref(const std::shared_ptr<EncoderSwap> &swap)
+{
+    return new std::shared_ptr<EncoderSwap>(swap);
+}
+
+static void free_swap_ref(gpointer data)
+{
+    delete static_cast<std::shared_ptr<EncoderSwap> *>(data);
+}
+
+// Blocking probe on the pad feeding the encoder: holds the next item upstream until the probe is
+// removed, so nothing enters the branch while the encoder is drained and replaced.
+GstPadProbeReturn RunnerSession::block_encoder_input_probe(GstPad *, GstPadProbeInfo *, gpointer user_data)
+{
+    EncoderSwap &swap = **static_cast<std::shared_ptr<EncoderSwap> *>(user_data);
+    int expected = EncoderSwap::PENDING;
+    if (swap.state.compare_exchange_strong(expected, EncoderSwap::BLOCKED))
+    {
+        swap.blocked.set_value();
+        return GST_PAD_PROBE_OK;
+    }
+    // rebuild_encoder timed out and the branch may be gone, leave the old encoder alone
+    return expected == EncoderSwap::CANCELLED ? GST_PAD_PROBE_REMOVE : GST_PAD_PROBE_OK;
+}
+
+// On the old encoder's src pad: the EOS sent into it comes out once every queued frame was encoded
+// and pushed; it is dropped so the tee (and the muxers / sinks behind it) never see it.
+GstPadProbeReturn RunnerSession::encoder_eos_probe(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    (*static_cast<std::shared_ptr<EncoderSwap> *>(user_data))->drained.set_value();
+    return GST_PAD_PROBE_DROP;
+}
+
+bool RunnerSession::rebuild_encoder(RunnerStreamBranch &branch, const PipelineConfig &config)
+{
+    constexpr auto timeout = std::chrono::seconds(2);
+    GstElement *upstream = branch.capture ? branch.capture : branch.queue;
+    GstElement *old_encoder = branch.encoder;
+    GstPad *src = gst_element_get_static_pad(upstream, "src");
+    auto swap = std::make_shared<EncoderSwap>();
+    std::future<void> blocked = swap->blocked.get_future();
+    std::future<void> drained = swap->drained.get_future();
+
+    gulong block = gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, block_encoder_input_probe,
+                                     new_swap_ref(swap), free_swap_ref);
+    int expected = EncoderSwap::PENDING;
+    if (blocked.wait_for(timeout) != std::future_status::ready &&
+        swap->state.compare_exchange_strong(expected, EncoderSwap::CANCELLED))
+    {
+        // GStreamer keeps the probe's context until a running callback returns, removing it is safe
+        std::cerr << "[RECONFIG] Stream " << branch.stream_id << " did not deliver data to block on" << std::endl;
+        gst_pad_remove_probe(src, block);
+        gst_object_unref(src);
+        return false;
+    }
+
+    // Upstream is held: drain the frames already inside the encoder to the tee before it goes away
+    GstPad *encoder_src = gst_element_get_static_pad(old_encoder, "src");
+    GstPad *encoder_sink = gst_element_get_static_pad(old_encoder, "sink");
+    gulong eos = gst_pad_add_probe(encoder_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, encoder_eos_probe,
+                                   new_swap_ref(swap), free_swap_ref);
+    gst_pad_send_event(encoder_sink, gst_event_new_eos());
+    if (drained.wait_for(timeout) != std::future_status::ready)
+    {
+        std::cerr << "[RECONFIG] Stream " << branch.stream_id << " encoder did not drain, its queued frames are lost"
+                  << std::endl;
+    }
+    gst_pad_remove_probe(encoder_src, eos);
+    gst_object_unref(encoder_src);
+    gst_object_unref(encoder_sink);
+
+    gst_element_unlink(upstream, old_encoder);
+    gst_element_unlink(old_encoder, branch.tee);
+    gst_element_set_state(old_encoder, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(m_pipeline), old_encoder); // drops the last reference
+
+    std::string name = "enc_" + branch.stream_id;
+    GstElement *encoder =
+        gst_element_factory_create(cached_element_factory(stream_encoder_factory(config)), name.c_str());
+    bool ok = encoder != nullptr;
+    if (ok)
+    {
+        configure_stream_encoder(encoder, config, branch.encoder_config_path);
+        gst_bin_add(GST_BIN(m_pipeline), encoder);
+        ok = gst_element_link(upstream, encoder) && gst_element_link(encoder, branch.tee) &&
+             gst_element_sync_state_with_parent(encoder);
+    }
+    branch.encoder = encoder;
+
+    // The held item and the sticky events (caps, segment) go to the new encoder from here
+    gst_pad_remove_probe(src, block);
+    gst_object_unref(src);
+
+    if (ok)
+    {
+        m_counters.at(branch.stream_id)->report_first = true;
+        add_encoder_probe(branch);
+    }
+    return ok;
+}
+
+nlohmann::json RunnerSession::set_udp_target(const std::string &host, int port)
+{
+    if (port <= 0 || port > 65535)
+    {
+        throw std::runtime_error("Invalid UDP port: " + std::to_string(port));
+    }
+
+    if (m_branches.empty())
+    {
+        throw std::runtime_error("The pipeline has no UDP output");
+    }
+    // Stream i keeps sending to port + i; udpsink re-resolves the destination on property change.
+    // pacedudpsink moves only its primary destination, --udp-extra-hosts stay until the next rebuild
+    nlohmann::json streams = nlohmann::json::array();
+    for (size_t i = 0; i < m_branches.size(); i++)
+    {
+        int stream_port = port + static_cast<int>(i);
+        g_object_set(m_branches[i].udpsink, "host", host.c_str(), "port", stream_port, nullptr);
+        streams.push_back({{"stream", m_branches[i].stream_id}, {"port", stream_port}});
+    }
+    m_config.udp_host = host;
+    m_config.udp_port = port;
+    m_spec.config.udp_host = host;
+    m_spec.config.udp_port = port;
+    nlohmann::json result = {{"host", host}, {"port", port}, {"streams", streams}};
+    if (!m_config.udp_extra_hosts.empty())
+    {
+        result["extra_hosts_unchanged"] = m_config.udp_extra_hosts;
+    }
+    return result;
+}
+
+// Hailo encoder configs keep the bitrate at encoding.hailo_encoder.rate_control.bitrate
+static nlohmann::json *find_rate_control(nlohmann::json &node)
+{
+    if (!node.is_object())
+    {
+        return nullptr;
+    }
+    if (node.contains("rate_control") && node["rate_control"].is_object())
+    {
+        return &node["rate_control"];
+    }
+    for (auto &[key, child] : node.items())
+    {
+        if (auto *found = find_rate_control(child))
+        {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+nlohmann::json RunnerSession::set_bitrate(const std::string &stream_id, unsigned int bitrate)
+{
+    RunnerStreamBranch &branch = find_branch(stream_id);
+
+    nlohmann::json encoder_config = nlohmann::json::parse(read_file_to_string(branch.encoder_config_path));
+    nlohmann::json *rate_control = find_rate_control(encoder_config);
+    if (!rate_control)
+    {
+        throw std::runtime_error("No rate_control section in " + branch.encoder_config_path);
+    }
+    (*rate_control)["bitrate"]["target_bitrate"] = bitrate;
+    m_snapshot.encoder_configs[branch.stream_id] = encoder_config;
+
+    std::string config_string = encoder_config.dump(2);
+    if (!write_string_to_file(config_string, branch.encoder_config_path))
+    {
+        throw std::runtime_error("Failed to write " + branch.encoder_config_path);
+    }
+
+    // Prefer the in-memory config when the encoder bin supports it; a PLAYING hailoencodebin does not
+    // re-read config-file-path, so without config-string the encoder is recreated from the written file.
+    // x264enc (--sw-elements) takes the bitrate property directly
+    const char *applied_via = "rebuild";
+    if (m_config.sw_elements)
+    {
+        g_object_set(branch.encoder, "bitrate", bitrate / 1000, nullptr); // kbit/s
+        applied_via = "bitrate";
+    }
+    else if (g_object_class_find_property(G_OBJECT_GET_CLASS(branch.encoder), "config-string"))
+    {
+        g_object_set(branch.encoder, "config-string", config_string.c_str(), nullptr);
+        applied_via = "config-string";
+    }
+    else if (!rebuild_encoder(branch, m_config))
+    {
+        throw std::runtime_error("Failed to recreate the encoder of stream " + branch.stream_id);
+    }
+    return {{"stream", branch.stream_id}, {"bitrate", bitrate}, {"applied_via", applied_via}};
+}
+
+unsigned int RunnerSession::target_bitrate(const std::string &stream_id) const
+{
+    auto it = m_snapshot.encoder_configs.find(stream_id);
+    if (it == m_snapshot.encoder_configs.end())
+    {
+        return 0;
+    }
+    nlohmann::json encoder_config = it->second;
+    const nlohmann::json *rate_control = find_rate_control(encoder_config);
+    if (!rate_control || !rate_control->contains("bitrate") || !(*rate_control)["bitrate"].contains("target_bitrate"))
+    {
+        return 0;
+    }
+    return (*rate_control)["bitrate"]["target_bitrate"].get<unsigned int>();
+}
+
+nlohmann::json RunnerSession::trigger_capture(const std::string &stream_id, unsigned int frames)
+{
+    if (!m_config.raw_capture)
+    {
+        throw std::runtime_error("Capture needs --raw-capture");
+    }
+    if (frames == 0)
+    {
+        throw std::runtime_error("frames must be at least 1");
+    }
+
+    nlohmann::json streams = nlohmann::json::array();
+    for (auto &branch : m_branches)
+    {
+        if (branch.capture && (stream_id.empty() || branch.stream_id == stream_id))
+        {
+            g_object_set(branch.capture, "capture-frames", frames, nullptr);
+            streams.push_back(branch.stream_id);
+        }
+    }
+    if (streams.empty())
+    {
+        throw std::runtime_error("Unknown stream: " + stream_id);
+    }
+    m_captures++;
+    return {{"streams", streams}, {"frames", frames}, {"output_dir", m_config.capture_dir}};
+}
+
+nlohmann::json RunnerSession::stats() const
+{
+    double seconds = m_pipeline ? (g_get_monotonic_time() - m_playing_since_us) / 1e6 : 0.0;
+
+    nlohmann::json streams = nlohmann::json::array();
+    for (const auto &[stream_id, counters] : m_counters)
+    {
+        uint64_t frames = counters->frames.load();
+        uint64_t bytes = counters->bytes.load();
+        streams.push_back({{"stream", stream_id},
+                           {"frames", frames},
+                           {"bytes", bytes},
+                           {"fps", seconds > 0 ? frames / seconds : 0.0},
+                           {"kbps", seconds > 0 ? bytes * 8 / 1000.0 / seconds : 0.0},
+                           {"first_buffer_us", counters->first_buffer_us.load()},
+                           {"last_buffer_us", counters->last_buffer_us.load()},
+                           {"max_interval_ms", counters->max_interval_us.load() / 1000.0}});
+    }
+
+    GstState state = GST_STATE_NULL;
+    if (m_pipeline)
+    {
+        gst_element_get_state(m_pipeline, &state, nullptr, 0);
+    }
+
+    nlohmann::json result = {{"profile", m_config.profile_name},
+                             {"state", gst_element_state_get_name(state)},
+                             {"uptime_s", seconds},
+                             {"udp", {{"host", m_config.udp_host}, {"port", m_config.udp_port}}},
+                             {"captures", m_captures},
+                             {"streams", streams}};
+    nlohmann::json recording = nlohmann::json::array();
+    for (const auto &branch : m_branches)
+    {
+        GstStructure *record_stats = nullptr;
+        if (branch.record_sink)
+        {
+            g_object_get(branch.record_sink, "stats", &record_stats, nullptr);
+        }
+        if (!record_stats)
+        {
+            continue;
+        }
+        nlohmann::json entry = {{"stream", branch.stream_id}};
+        for (const char *name : {"segments-written", "segments-deleted", "storage-used", "bytes-written",
+                                 "buffers-dropped", "write-errors", "write-latency-avg-us", "write-latency-p99-us",
+                                 "write-latency-max-us", "render-max-us"})
+        {
+            guint64 value = 0;
+            gst_structure_get_uint64(record_stats, name, &value);
+            std::string key = name;
+            std::replace(key.begin(), key.end(), '-', '_');
+            entry[key] = value;
+        }
+        gst_structure_free(record_stats);
+        recording.push_back(entry);
+    }
+    if (!recording.empty())
+    {
+        result["recording"] = recording;
+    }
+    nlohmann::json queues = nlohmann::json::array();
+    for (const auto &branch : m_branches)
+    {
+        if (m_config.queue_policy == "none")
+        {
+            break;
+        }
+        for (GstElement *queue : {branch.queue, branch.udp_queue})
+        {
+            GstStructure *queue_stats = nullptr;
+            if (queue)
+            {
+                g_object_get(queue, "stats", &queue_stats, nullptr);
+            }
+            if (!queue_stats)
+            {
+                continue;
+            }
+            nlohmann::json entry = {{"stream", branch.stream_id}, {"queue", GST_OBJECT_NAME(queue)}};
+            for (const char *name : {"buffers-in", "buffers-out", "dropped-oldest", "dropped-new",
+                                     "dropped-to-keyframe", "dropped-dependent", "bytes-dropped", "over-buffers",
+                                     "over-bytes", "over-time", "blocked", "residence-avg-us", "residence-max-us"})
+            {
+                guint64 value = 0;
+                gst_structure_get_uint64(queue_stats, name, &value);
+                std::string key = name;
+                std::replace(key.begin(), key.end(), '-', '_');
+                entry[key] = value;
+            }
+            gst_structure_free(queue_stats);
+            queues.push_back(entry);
+        }
+    }
+    if (!queues.empty())
+    {
+        result["queues"] = queues;
+    }
+
+    auto history = phase_timeline().history();
+    if (!history.empty())
+    {
+        result["last_timing"] = history.back();
+    }
+    return result;
+}
+
+void RunnerSession::reset_interval_stats()
+{
+    for (auto &[stream_id, counters] : m_counters)
+    {
+        counters->max_interval_us = 0;
+    }
+}
+
+bool RunnerSession::apply_spec(const RunnerPipelineSpec &spec, const std::string &medialib_config_path)
+{
+    nlohmann::json report;
+    bool applied = false;
+    try
+    {
+        applied = reconfigure(spec, report);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[SESSION] " << e.what() << std::endl;
+    }
+    release_staging_dirs();
+    if (applied)
+    {
+        m_medialib_config_path = medialib_config_path;
+    }
+    return applied;
+}
+
+std::string RunnerSession::next_staging_dir()
+{
+    return m_base_dir + "/staging_" + std::to_string(m_stage_index++);
+}
+
+void RunnerSession::release_staging_dirs()
+{
+    for (auto it = m_staging_dirs.begin(); it != m_staging_dirs.end();)
+    {
+        if (*it == m_pipeline_dir || *it == m_spec.config.output_dir)
+        {
+            ++it;
+            continue;
+        }
+        std::error_code ec;
+        fs::remove_all(*it, ec);
+        it = m_staging_dirs.erase(it);
+    }
+}
+
+void RunnerSession::reload_args_file()
+{
+    if (m_args_file_path.empty())
+    {
+        std::cout << "[SESSION] SIGUSR1 without --args_file, restarting the current profile" << std::endl;
+        switch_profile(m_config.profile_name, "signal");
+        return;
+    }
+
+    std::string program = "medialib_gst_runner";
+    std::string option = "--args_file";
+    char *argv[] = {program.data(), option.data(), m_args_file_path.data(), nullptr};
+    std::string medialib_config_path;
+    std::string args_file_path;
+    PipelineConfig config;
+    if (!parse_arguments(3, argv, medialib_config_path, args_file_path, config, false))
+    {
+        std::cerr << "[SESSION] Ignoring SIGUSR1, args file is invalid: " << m_args_file_path << std::endl;
+        return;
+    }
+
+    // Only the profile and the UDP target can change at runtime
+    m_medialib_config_path = medialib_config_path;
+    m_config.udp_host = config.udp_host;
+    m_config.udp_port = config.udp_port;
+    switch_profile(config.profile_name, "signal");
+}
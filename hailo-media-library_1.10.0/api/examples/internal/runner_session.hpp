@@ -0,0 +1,138 @@
+#pragma once
+
+#include "config_diff.hpp"
+#include "medialib_gst_runner.hpp"
+#include "phase_timing.hpp"
+#include <gst/gst.h>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Long running medialib_gst_runner pipeline.
+ *
+ * Owns the pipeline built from the medialib config and applies the
+ * control commands (see control_socket.hpp) to it. All methods must be
+ * called from the GLib main loop thread; the only state touched from the
+ * streaming threads are the per-stream counters.
+ *
+ * switch_profile re-extracts the configs and compares them with the
+ * running ones (config_diff.hpp). Only a changed frontend config or stream
+ * set rebuilds the whole pipeline. Encoder-only changes are applied per
+ * branch while hailofrontendbinsrc keeps streaming:
+ *  - bitrate / rate_control / osd / privacy_mask are passed to the
+ *    running hailoencodebin through config-string,
+ *  - other encoder changes (or an encoder bin without config-string)
+ *    recreate just that hailoencodebin: the pad feeding it is blocked,
+ *    the old encoder drained with an EOS that is dropped at its src pad,
+ *    and the new one linked in before the pad is released.
+ * Each change kind gets an encoder_update.<kind> phase, so the
+ * time-to-apply per kind is in the [TIMING] log.
+ * Every reconfigure extracts into its own staging_<n> directory below the
+ * startup output dir and repoints all branches at it, so the files of the
+ * running pipeline are never rewritten and stay usable for a rollback. A
+ * staging directory is removed once neither the running pipeline nor the
+ * current spec refers to it.
+ * set_udp_target, set_bitrate and trigger_capture change properties of the
+ * running pipeline without restarting it; set_bitrate is also what the
+ * adaptive bitrate controller (bitrate_controller.hpp) drives.
+ *********************************************************************/
+
+class RunnerSession
+{
+  public:
+    RunnerSession(std::string medialib_config_path, std::string args_file_path, PipelineConfig config);
+    ~RunnerSession();
+    RunnerSession(const RunnerSession &) = delete;
+    RunnerSession &operator=(const RunnerSession &) = delete;
+
+    // Extracts the configs of the current profile, builds the pipeline and sets it to PLAYING.
+    // Phases are recorded into the startup run, which the caller opens before gst_init.
+    bool start(GMainLoop *loop);
+    void stop();
+
+    // Control socket entry point, throws std::runtime_error on a bad or failed command.
+    nlohmann::json handle_command(const nlohmann::json &request);
+
+    nlohmann::json switch_profile(const std::string &profile_name, const char *trigger = "profile_switch");
+    nlohmann::json set_udp_target(const std::string &host, int port);
+    nlohmann::json set_bitrate(const std::string &stream_id, unsigned int bitrate);
+    nlohmann::json trigger_capture(const std::string &stream_id, unsigned int frames);
+    nlohmann::json stats() const;
+    // Restarts the max_interval_ms window reported by stats().
+    void reset_interval_stats();
+
+    // Fresh directory to extract the configs of the next reconfigure into; owned by the session once
+    // a spec extracted into it is applied, removed by the caller otherwise.
+    std::string next_staging_dir();
+
+    // Replaces the pipeline with one built from an already extracted spec (see config_watcher.hpp).
+    bool apply_spec(const RunnerPipelineSpec &spec, const std::string &medialib_config_path);
+
+    // Current target_bitrate of a stream's encoder config (bps), 0 when it has none.
+    unsigned int target_bitrate(const std::string &stream_id) const;
+    // Branches of the running pipeline; replaced by full rebuilds, so do not keep references.
+    const std::vector<RunnerStreamBranch> &branches() const { return m_branches; }
+
+    const PipelineConfig &config() const { return m_config; }
+    const RunnerPipelineSpec &spec() const { return m_spec; }
+    const std::string &medialib_config_path() const { return m_medialib_config_path; }
+    const std::string &args_file_path() const { return m_args_file_path; }
+
+    // SIGUSR1: re-reads the args file (when one is used) and applies its profile; throws like switch_profile.
+    void reload_args_file();
+
+  private:
+    struct StreamCounters
+    {
+        std::string stream_id;
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<bool> report_first{true}; // next buffer is reported as first_buffer (new encoder)
+        std::atomic<gint64> first_buffer_us{0}; // monotonic time of the first buffer of the current encoder
+        std::atomic<gint64> last_buffer_us{0};
+        std::atomic<gint64> max_interval_us{0}; // largest gap between two buffers since reset_interval_stats
+    };
+
+    bool configure(const PipelineConfig &config);
+    bool build_and_play();
+    void teardown();
+    // Applies an extracted spec with the least restart needed, fills report with what was done.
+    bool reconfigure(const RunnerPipelineSpec &spec, nlohmann::json &report);
+    nlohmann::json apply_encoder_change(RunnerStreamBranch &branch, const EncoderChange &change,
+                                        const nlohmann::json &encoder_config, const PipelineConfig &config);
+    bool rebuild_encoder(RunnerStreamBranch &branch, const PipelineConfig &config);
+    void add_encoder_probe(RunnerStreamBranch &branch);
+    RunnerStreamBranch &find_branch(const std::string &stream_id);
+    // Removes the applied staging directories the running pipeline and the current spec no longer use.
+    void release_staging_dirs();
+
+    static GstPadProbeReturn block_encoder_input_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn encoder_eos_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn encoder_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data);
+
+    std::string m_medialib_config_path;
+    std::string m_args_file_path;
+    PipelineConfig m_config;
+    RunnerPipelineSpec m_spec;
+    GMainLoop *m_loop = nullptr;
+    GstElement *m_pipeline = nullptr;
+    guint m_bus_watch = 0;
+    std::vector<RunnerStreamBranch> m_branches;
+    ConfigSnapshot m_snapshot; // config contents the running pipeline was built/updated with
+    std::map<std::string, std::unique_ptr<StreamCounters>> m_counters; // by stream id, owned across probes
+    gint64 m_playing_since_us = 0;
+    std::string m_base_dir;       // output dir at startup, staging directories are created below it
+    std::string m_pipeline_dir;   // output dir the running pipeline was built from (frontend config)
+    std::set<std::string> m_staging_dirs; // staging directories of applied specs, not removed yet
+    unsigned int m_stage_index = 0;
+    // PLAYING request of the current pipeline, cleared once its state_playing phase is recorded
+    std::optional<PhaseTimeline::clock::time_point> m_playing_requested;
+    unsigned int m_captures = 0;
+};
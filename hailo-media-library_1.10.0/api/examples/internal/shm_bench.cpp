@@ -0,0 +1,522 @@
+#include "pipeline_graph.hpp"
+#include <gst/gst.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/*********************************************************************
+ * shm_bench compares the two ways a local process can consume the
+ * runner's streams: memfdsink / memfdsrc (shared memory, fd passing)
+ * against RTP/UDP over loopback.
+ *
+ * Producer: appsrc (synthetic frames at --fps) ! memfdsink, or
+ *           ! rtph264pay / rtpgstpay ! udpsink 127.0.0.1:<port>
+ * Consumer: memfdsrc ! fakesink, or udpsrc ! rtph264depay / rtpgstdepay
+ *           ! fakesink, a second pipeline in the same process (fds are
+ *           passed the same way as between processes)
+ *
+ * --formats h264  access units of bitrate/fps bytes, 4x I-frames
+ *           nv12  raw frames of --width x --height (analytics input)
+ * --alloc   pool    (shm only) frames are written into a buffer pool
+ *                   built on the allocator memfdsink proposes in the
+ *                   ALLOCATION query: passed to the consumer without copy
+ *           system  plain system memory, memfdsink copies it once into
+ *                   its own memfd (frames_copied)
+ *
+ * Every frame carries its index and send time, the consumer reports
+ * latency (send -> consumer handoff, p50/p99/max) and lost frames
+ * (sent but never received). CPU is the process CPU time (producer,
+ * consumer and the GStreamer threads) per received frame.
+ *
+ * Usage: shm_bench [--paths shm,udp] [--formats h264,nv12] [--alloc pool,system]
+ *                  [--width <n>] [--height <n>] [--fps <n>] [--bitrate <bps>]
+ *                  [--seconds <n>] [--port <port>] [--socket <path>]
+ *********************************************************************/
+
+using bench_clock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+    std::vector<std::string> paths = {"shm", "udp"};
+    std::vector<std::string> formats = {"h264", "nv12"};
+    std::vector<std::string> alloc_modes = {"pool", "system"};
+    int width = 1920;
+    int height = 1080;
+    int fps = 30;
+    long long bitrate = 8000000;
+    int gop = 30;
+    int seconds = 10;
+    int port = 5700;
+    std::string socket_path = "/tmp/shm_bench.sock";
+};
+
+// One run of the sweep
+struct BenchRun
+{
+    std::string path;
+    std::string format;
+    std::string alloc;
+};
+
+// Marker + index + send time, each value 7 bits per byte with the high bit set: no zero bytes,
+// so the tag cannot form an H.264 start code and survives rtph264pay / depay unchanged.
+static constexpr guint8 TAG_MARKER[] = {0xfe, 0xd3, 0xc8, 0xc2};
+static constexpr size_t TAG_VALUE_BYTES = 10;
+static constexpr size_t TAG_OFFSET = 8;
+static constexpr size_t TAG_SIZE = sizeof(TAG_MARKER) + 2 * TAG_VALUE_BYTES;
+static constexpr size_t TAG_SEARCH = 256;
+
+static void write_tag_value(guint8 *data, uint64_t value)
+{
+    for (size_t i = 0; i < TAG_VALUE_BYTES; i++)
+    {
+        data[i] = static_cast<guint8>(0x80 | ((value >> (7 * i)) & 0x7f));
+    }
+}
+
+static uint64_t read_tag_value(const guint8 *data)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < TAG_VALUE_BYTES; i++)
+    {
+        value |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+    }
+    return value;
+}
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<std::string> split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static double process_cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Writes one frame into buffer: H.264 start code + slice header, or NV12 planes, then the tag
+static void fill_frame(GstBuffer *buffer, const BenchRun &run, bool keyframe, uint64_t index)
+{
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    if (run.format == "h264")
+    {
+        const guint8 header[] = {0x00, 0x00, 0x00, 0x01, static_cast<guint8>(keyframe ? 0x65 : 0x41)};
+        std::copy(header, header + sizeof(header), map.data);
+        for (size_t i = sizeof(header); i < map.size; i++)
+        {
+            map.data[i] = static_cast<guint8>(0x80 | ((i + index) & 0x7f));
+        }
+    }
+    else
+    {
+        memset(map.data, static_cast<int>(0x80 | (index & 0x7f)), map.size);
+    }
+    guint8 *tag = map.data + TAG_OFFSET;
+    std::copy(TAG_MARKER, TAG_MARKER + sizeof(TAG_MARKER), tag);
+    write_tag_value(tag + sizeof(TAG_MARKER), index);
+    write_tag_value(tag + sizeof(TAG_MARKER) + TAG_VALUE_BYTES, static_cast<uint64_t>(now_ns()));
+    gst_buffer_unmap(buffer, &map);
+    if (!keyframe)
+    {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+}
+
+struct ConsumerStats
+{
+    std::mutex lock;
+    uint64_t frames = 0;
+    uint64_t last_index = 0;
+    uint64_t reordered = 0; // frames arriving after a later one
+    std::vector<double> latencies_ms;
+};
+
+static void on_handoff(GstElement *, GstBuffer *buffer, GstPad *, gpointer user_data)
+{
+    auto *stats = static_cast<ConsumerStats *>(user_data);
+    int64_t arrival_ns = now_ns();
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+    {
+        return;
+    }
+    // Depayloaders may put the AU behind another start code, so the tag is searched for
+    size_t limit = std::min(map.size, TAG_SEARCH + TAG_SIZE);
+    for (size_t i = 0; i + TAG_SIZE <= limit; i++)
+    {
+        if (memcmp(map.data + i, TAG_MARKER, sizeof(TAG_MARKER)) == 0)
+        {
+            const guint8 *values = map.data + i + sizeof(TAG_MARKER);
+            uint64_t index = read_tag_value(values);
+            int64_t sent_ns = static_cast<int64_t>(read_tag_value(values + TAG_VALUE_BYTES));
+            std::lock_guard<std::mutex> guard(stats->lock);
+            if (stats->frames && index <= stats->last_index)
+            {
+                stats->reordered++;
+            }
+            stats->last_index = std::max(stats->last_index, index);
+            stats->frames++;
+            stats->latencies_ms.push_back((arrival_ns - sent_ns) / 1e6);
+            break;
+        }
+    }
+    gst_buffer_unmap(buffer, &map);
+}
+
+static std::string source_caps(const BenchOptions &options, const BenchRun &run)
+{
+    if (run.format == "h264")
+    {
+        return "video/x-h264,stream-format=byte-stream,alignment=au";
+    }
+    return "video/x-raw,format=NV12,width=" + std::to_string(options.width) + ",height=" +
+           std::to_string(options.height) + ",framerate=" + std::to_string(options.fps) + "/1";
+}
+
+static GstElement *build_producer(const BenchOptions &options, const BenchRun &run, GstElement *&source,
+                                  GstElement *&sink)
+{
+    PipelineGraph graph("shm_bench_producer");
+    source = graph.add("appsrc", "src");
+    graph.set(source, "caps", source_caps(options, run));
+    graph.set(source, "is-live", true);
+    graph.set(source, "format", "time");
+    graph.set(source, "do-timestamp", true);
+    if (run.path == "shm")
+    {
+        sink = graph.add("memfdsink", "shm");
+        graph.set(sink, "socket-path", options.socket_path);
+        graph.set(sink, "sync", false);
+        graph.set(sink, "async", false);
+        graph.link(source, sink);
+    }
+    else
+    {
+        // Raw frames have no RTP mapping for NV12 in rtpvrawpay, rtpgstpay carries any buffer
+        GstElement *pay = graph.add(run.format == "h264" ? "rtph264pay" : "rtpgstpay", "pay");
+        if (run.format == "h264")
+        {
+            graph.set(pay, "config-interval", -1);
+        }
+        else
+        {
+            graph.set(pay, "config-interval", 1u);
+        }
+        graph.set(pay, "mtu", 1400u);
+        sink = graph.add("udpsink", "udp");
+        graph.set(sink, "host", "127.0.0.1");
+        graph.set(sink, "port", options.port);
+        graph.set(sink, "sync", false);
+        graph.set(sink, "async", false);
+        graph.set(sink, "buffer-size", 4 * 1024 * 1024);
+        graph.link_chain({source, pay, graph.add("queue"), sink});
+    }
+    if (!graph.ok())
+    {
+        std::cerr << "[BENCH] producer graph error: " << graph.error() << std::endl;
+        return nullptr;
+    }
+    return graph.release();
+}
+
+static GstElement *build_consumer(const BenchOptions &options, const BenchRun &run, ConsumerStats &stats)
+{
+    PipelineGraph graph("shm_bench_consumer");
+    GstElement *sink = graph.add("fakesink", "consumer");
+    graph.set(sink, "sync", false);
+    graph.set(sink, "async", false);
+    graph.set(sink, "signal-handoffs", true);
+    if (run.path == "shm")
+    {
+        GstElement *source = graph.add("memfdsrc", "shm_src");
+        graph.set(source, "socket-path", options.socket_path);
+        graph.link(source, sink);
+    }
+    else
+    {
+        GstElement *source = graph.add("udpsrc", "udp_src");
+        graph.set(source, "port", options.port);
+        graph.set(source, "buffer-size", 16 * 1024 * 1024);
+        if (run.format == "h264")
+        {
+            graph.set(source, "caps", "application/x-rtp,media=video,encoding-name=H264,clock-rate=90000,payload=96");
+            GstElement *depay = graph.add("rtph264depay", "depay");
+            GstElement *caps = graph.add_caps_filter("video/x-h264,stream-format=byte-stream,alignment=au");
+            graph.link_chain({source, depay, caps, sink});
+        }
+        else
+        {
+            graph.set(source, "caps",
+                      "application/x-rtp,media=application,encoding-name=X-GST,clock-rate=90000,payload=96");
+            graph.link_chain({source, graph.add("rtpgstdepay", "depay"), sink});
+        }
+    }
+    if (!graph.ok())
+    {
+        std::cerr << "[BENCH] consumer graph error: " << graph.error() << std::endl;
+        return nullptr;
+    }
+    g_signal_connect(sink, "handoff", G_CALLBACK(on_handoff), &stats);
+    return graph.release();
+}
+
+// Buffer pool on the allocator the sink proposes, as an upstream element honouring the ALLOCATION query would
+static GstBufferPool *negotiate_pool(GstElement *source, const std::string &caps_string, size_t frame_bytes)
+{
+    GstCaps *caps = gst_caps_from_string(caps_string.c_str());
+    GstQuery *query = gst_query_new_allocation(caps, TRUE);
+    GstPad *pad = gst_element_get_static_pad(source, "src");
+    GstBufferPool *pool = nullptr;
+    if (gst_pad_peer_query(pad, query) && gst_query_get_n_allocation_params(query) > 0)
+    {
+        GstAllocator *allocator = nullptr;
+        GstAllocationParams params;
+        gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
+        pool = gst_buffer_pool_new();
+        GstStructure *config = gst_buffer_pool_get_config(pool);
+        gst_buffer_pool_config_set_params(config, caps, static_cast<guint>(frame_bytes), 8, 16);
+        gst_buffer_pool_config_set_allocator(config, allocator, &params);
+        if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+        {
+            gst_object_unref(pool);
+            pool = nullptr;
+        }
+        if (allocator)
+        {
+            gst_object_unref(allocator);
+        }
+    }
+    gst_object_unref(pad);
+    gst_query_unref(query);
+    gst_caps_unref(caps);
+    return pool;
+}
+
+static bool run_bench(const BenchOptions &options, const BenchRun &run)
+{
+    GstElement *source = nullptr;
+    GstElement *sink = nullptr;
+    ConsumerStats stats;
+    GstElement *producer = build_producer(options, run, source, sink);
+    GstElement *consumer = producer ? build_consumer(options, run, stats) : nullptr;
+    if (!consumer)
+    {
+        if (producer)
+        {
+            gst_object_unref(producer);
+        }
+        return false;
+    }
+
+    // The sink listens once started, the consumer connects to it
+    gst_element_set_state(producer, GST_STATE_PLAYING);
+    gst_element_set_state(consumer, GST_STATE_PLAYING);
+    if (run.path == "shm")
+    {
+        guint clients = 0;
+        for (int i = 0; i < 100 && !clients; i++)
+        {
+            g_usleep(10000);
+            g_object_get(sink, "clients", &clients, nullptr);
+        }
+        if (!clients)
+        {
+            std::cerr << "[BENCH] memfdsrc did not connect to " << options.socket_path << std::endl;
+        }
+    }
+
+    size_t frame_bytes = static_cast<size_t>(options.width) * options.height * 3 / 2;
+    size_t p_bytes = frame_bytes;
+    size_t i_bytes = frame_bytes;
+    if (run.format == "h264")
+    {
+        size_t average = static_cast<size_t>(options.bitrate / 8 / options.fps);
+        p_bytes = average * options.gop / (options.gop + 3);
+        i_bytes = p_bytes * 4;
+    }
+    GstBufferPool *pool = nullptr;
+    if (run.alloc == "pool")
+    {
+        pool = negotiate_pool(source, source_caps(options, run), i_bytes);
+        if (!pool)
+        {
+            std::cerr << "[BENCH] no allocator in the ALLOCATION query, using system memory" << std::endl;
+        }
+    }
+
+    double cpu_start = process_cpu_seconds();
+    auto start = bench_clock::now();
+    auto frame_interval = std::chrono::nanoseconds(1000000000LL / options.fps);
+    uint64_t frames = 0;
+    for (auto next = start; bench_clock::now() - start < std::chrono::seconds(options.seconds); next += frame_interval)
+    {
+        std::this_thread::sleep_until(next);
+        bool keyframe = frames % options.gop == 0;
+        size_t size = keyframe ? i_bytes : p_bytes;
+        GstBuffer *buffer = nullptr;
+        if (pool && gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) == GST_FLOW_OK)
+        {
+            gst_buffer_set_size(buffer, static_cast<gssize>(size));
+        }
+        else
+        {
+            buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+        }
+        fill_frame(buffer, run, keyframe, frames);
+        GST_BUFFER_DURATION(buffer) = frame_interval.count();
+        GstFlowReturn ret;
+        g_signal_emit_by_name(source, "push-buffer", buffer, &ret);
+        gst_buffer_unref(buffer);
+        frames++;
+    }
+    double wall_s = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // Let the last frames arrive before counting
+    g_usleep(300000);
+    double cpu_s = process_cpu_seconds() - cpu_start;
+
+    guint64 copied = 0, dropped = 0;
+    if (run.path == "shm")
+    {
+        g_object_get(sink, "frames-copied", &copied, "frames-dropped", &dropped, nullptr);
+    }
+    gst_element_set_state(consumer, GST_STATE_NULL);
+    gst_element_set_state(producer, GST_STATE_NULL);
+    gst_object_unref(consumer);
+    gst_object_unref(producer);
+    if (pool)
+    {
+        gst_buffer_pool_set_active(pool, FALSE);
+        gst_object_unref(pool);
+    }
+
+    std::vector<double> latencies = stats.latencies_ms;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[BENCH] path=" << run.path << " format=" << run.format
+              << " alloc=" << (run.path == "shm" ? (pool ? "pool" : "system") : "system")
+              << " frame_bytes=" << p_bytes << " frames=" << frames << " received=" << stats.frames
+              << " fps=" << stats.frames / wall_s << " lost=" << (frames > stats.frames ? frames - stats.frames : 0)
+              << " reordered=" << stats.reordered
+              << " cpu=" << cpu_s / wall_s
+              << " cpu_per_frame_us=" << (stats.frames ? cpu_s * 1e6 / stats.frames : 0)
+              << " latency_p50_ms=" << percentile(0.5) << " latency_p99_ms=" << percentile(0.99)
+              << " latency_max_ms=" << (latencies.empty() ? 0.0 : latencies.back());
+    if (run.path == "shm")
+    {
+        std::cout << " frames_copied=" << copied << " frames_dropped=" << dropped;
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    gst_init(&argc, &argv);
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--paths" && i + 1 < argc)
+        {
+            options.paths = split_list(argv[++i]);
+        }
+        else if (arg == "--formats" && i + 1 < argc)
+        {
+            options.formats = split_list(argv[++i]);
+        }
+        else if (arg == "--alloc" && i + 1 < argc)
+        {
+            options.alloc_modes = split_list(argv[++i]);
+        }
+        else if (arg == "--width" && i + 1 < argc)
+        {
+            options.width = std::stoi(argv[++i]);
+        }
+        else if (arg == "--height" && i + 1 < argc)
+        {
+            options.height = std::stoi(argv[++i]);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            options.fps = std::stoi(argv[++i]);
+        }
+        else if (arg == "--bitrate" && i + 1 < argc)
+        {
+            options.bitrate = std::stoll(argv[++i]);
+        }
+        else if (arg == "--seconds" && i + 1 < argc)
+        {
+            options.seconds = std::stoi(argv[++i]);
+        }
+        else if (arg == "--port" && i + 1 < argc)
+        {
+            options.port = std::stoi(argv[++i]);
+        }
+        else if (arg == "--socket" && i + 1 < argc)
+        {
+            options.socket_path = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--paths shm,udp] [--formats h264,nv12] [--alloc pool,system] [--width <n>] [--height <n>]"
+                         " [--fps <n>] [--bitrate <bps>] [--seconds <n>] [--port <port>] [--socket <path>]"
+                      << std::endl;
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    for (const auto &format : options.formats)
+    {
+        if (format != "h264" && format != "nv12")
+        {
+            std::cerr << "Invalid format: " << format << " (h264 or nv12)" << std::endl;
+            return 1;
+        }
+        for (const auto &path : options.paths)
+        {
+            for (const auto &alloc : options.alloc_modes)
+            {
+                // UDP always sends from system memory, only the first mode is run
+                if (path != "shm" && alloc != options.alloc_modes.front())
+                {
+                    continue;
+                }
+                if (!run_bench(options, {path, format, alloc}))
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
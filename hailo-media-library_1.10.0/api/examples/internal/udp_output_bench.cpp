@@ -0,0 +1,556 @@
+#include "pipeline_graph.hpp"
+#include <gst/gst.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*********************************************************************
+ * udp_output_bench measures the RTP/UDP output path of the runner over
+ * loopback: packets per second and sender CPU for N streams.
+ *
+ * Per stream: appsrc (synthetic H.264 access units of bitrate/fps bytes,
+ * every gop-th frame is an I-frame 4x the size) ! rtph264pay mtu=1400 !
+ * queue ! udpsink 127.0.0.1:<port + i>, same settings as
+ * attach_stream_outputs. A receiver thread drains all ports with
+ * recvmmsg and counts what arrived.
+ *
+ * --mode list   (default) rtph264pay pushes a frame's packets as one buffer
+ *               list, udpsink sends it with one sendmmsg call
+ * --mode single the lists are split into single buffers in front of
+ *               udpsink (one sendmsg per packet), for comparison
+ *
+ * --pacing none,txtime,sleep  runs once per listed mode; anything but
+ *               "none" (or --gso) sends with pacedudpsink (GST_PLUGIN_PATH
+ *               must contain the gstrawcapturebypass build). txtime needs the
+ *               fq qdisc on loopback: tc qdisc replace dev lo root fq
+ *
+ * --destinations 1,2,4  sends every stream to that many receivers
+ *               (port + d * streams + i), once per listed count, with each
+ *               --fanout mode:
+ *   tee         tee ! queue ! rtph264pay ! udpsink per receiver, the way a
+ *               second receiver is added without fan-out support
+ *   sink        one rtph264pay, pacedudpsink extra-destinations sends the
+ *               packets to all receivers (frames_dropped: frames a receiver's
+ *               sender thread fell too far behind for)
+ *
+ * Sender CPU is the process CPU time minus the receiver thread, per
+ * second of wall time (1.0 = one core).
+ * Burstiness and loss are measured on the receive side: peak_1ms is the
+ * most packets of one stream that arrived within 1 ms (kernel receive
+ * timestamps), burst_ratio that peak over the mean packets per ms, lost
+ * the RTP sequence gaps and rx_drops the receive buffer overflows
+ * reported by the kernel (SO_RXQ_OVFL). --rcvbuf shrinks the receive
+ * buffer to the size of a weak host's.
+ *
+ * Usage: udp_output_bench [--streams <n>] [--bitrate <bps>] [--fps <n>] [--gop <n>]
+ *                         [--seconds <n>] [--port <base>] [--mode list|single]
+ *                         [--pacing <mode,...>] [--gso] [--rcvbuf <bytes>]
+ *                         [--destinations <n,...>] [--fanout tee,sink]
+ *********************************************************************/
+
+using bench_clock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+    int streams = 4;
+    long long bitrate = 25000000;
+    int fps = 30;
+    int gop = 30;
+    int seconds = 10;
+    int port = 5600;
+    bool split_lists = false;
+    std::vector<std::string> pacing_modes = {"none"};
+    bool gso = false;
+    int rcvbuf = 8 * 1024 * 1024;
+    std::vector<int> destination_counts = {1};
+    std::vector<std::string> fanout_modes = {"tee"};
+};
+
+// One run of the sweep
+struct BenchRun
+{
+    std::string pacing;
+    std::string fanout;
+    int destinations = 1;
+};
+
+static int destination_port(const BenchOptions &options, int stream, int destination)
+{
+    return options.port + destination * options.streams + stream;
+}
+
+static std::vector<std::string> split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static double thread_cpu_seconds(int who)
+{
+    struct rusage usage;
+    getrusage(who, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// One H.264 access unit: start code, slice NAL header, payload without zero bytes (no start code emulation).
+static GstBuffer *make_access_unit(size_t size, bool keyframe, guint64 index)
+{
+    GstBuffer *buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    const guint8 header[] = {0x00, 0x00, 0x00, 0x01, static_cast<guint8>(keyframe ? 0x65 : 0x41)};
+    std::copy(header, header + sizeof(header), map.data);
+    for (size_t i = sizeof(header); i < size; i++)
+    {
+        map.data[i] = static_cast<guint8>(0x80 | ((i + index) & 0x7f));
+    }
+    gst_buffer_unmap(buffer, &map);
+    if (!keyframe)
+    {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+    return buffer;
+}
+
+// --mode single: push the packets of a list one by one and drop the list
+static GstPadProbeReturn split_list_probe(GstPad *pad, GstPadProbeInfo *info, gpointer)
+{
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+    for (guint i = 0; i < gst_buffer_list_length(list); i++)
+    {
+        gst_pad_push(pad, gst_buffer_ref(gst_buffer_list_get(list, i)));
+    }
+    return GST_PAD_PROBE_DROP;
+}
+
+// rtph264pay ! udpsink / pacedudpsink of one receiver (the first with fan-out), not linked yet
+static void add_output(PipelineGraph &graph, const BenchOptions &options, const BenchRun &run, int stream,
+                       int destination, GstElement *&pay, GstElement *&sink)
+{
+    std::string name = std::to_string(stream) + "_" + std::to_string(destination);
+    bool paced = run.pacing != "none" || options.gso || run.fanout == "sink";
+    pay = graph.add("rtph264pay", "pay_" + name);
+    sink = graph.add(paced ? "pacedudpsink" : "udpsink", "udp_" + name);
+    if (paced)
+    {
+        graph.set(sink, "pacing", run.pacing);
+        graph.set(sink, "gso", options.gso);
+        graph.set(sink, "frame-duration", 1000000000ll / options.fps);
+    }
+    graph.set(pay, "mtu", 1400u);
+    graph.set(pay, "config-interval", -1);
+    graph.set(sink, "host", "127.0.0.1");
+    graph.set(sink, "port", destination_port(options, stream, destination));
+    graph.set(sink, "sync", false);
+    graph.set(sink, "async", false);
+    graph.set(sink, "buffer-size", 4 * 1024 * 1024);
+
+    if (options.split_lists && pay)
+    {
+        GstPad *src = gst_element_get_static_pad(pay, "src");
+        gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER_LIST, split_list_probe, nullptr, nullptr);
+        gst_object_unref(src);
+    }
+}
+
+static GstElement *build_sender(const BenchOptions &options, const BenchRun &run, std::vector<GstElement *> &sources,
+                                std::vector<GstElement *> &sinks)
+{
+    PipelineGraph graph("udp_output_bench");
+    for (int i = 0; i < options.streams; i++)
+    {
+        GstElement *source = graph.add("appsrc", "src_" + std::to_string(i));
+        graph.set(source, "caps", "video/x-h264,stream-format=byte-stream,alignment=au");
+        graph.set(source, "is-live", true);
+        graph.set(source, "format", "time");
+        graph.set(source, "do-timestamp", true);
+        sources.push_back(source);
+
+        GstElement *pay = nullptr;
+        GstElement *sink = nullptr;
+        if (run.fanout == "sink" || run.destinations == 1)
+        {
+            add_output(graph, options, run, i, 0, pay, sink);
+            std::string extra;
+            for (int d = 1; d < run.destinations; d++)
+            {
+                extra += (extra.empty() ? "127.0.0.1:" : ",127.0.0.1:") + std::to_string(destination_port(options, i, d));
+            }
+            if (!extra.empty())
+            {
+                graph.set(sink, "extra-destinations", extra);
+            }
+            graph.link_chain({source, pay, graph.add("queue"), sink});
+            sinks.push_back(sink);
+            continue;
+        }
+
+        GstElement *tee = graph.add("tee");
+        graph.link(source, tee);
+        for (int d = 0; d < run.destinations; d++)
+        {
+            add_output(graph, options, run, i, d, pay, sink);
+            graph.link_chain({tee, graph.add("queue"), pay, sink});
+            sinks.push_back(sink);
+        }
+    }
+
+    if (!graph.ok())
+    {
+        std::cerr << "[BENCH] graph error: " << graph.error() << std::endl;
+        return nullptr;
+    }
+    return graph.release();
+}
+
+struct ReceiverStats
+{
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bytes{0};
+    uint64_t lost = 0;       // RTP sequence gaps, all streams
+    uint64_t rx_drops = 0;   // receive buffer overflows (SO_RXQ_OVFL), all streams
+    uint64_t peak_1ms = 0;   // most packets of one stream within 1 ms
+    double cpu_seconds = 0;
+};
+
+// Per stream receive state: extended RTP sequence numbers and the arrivals of the last millisecond
+struct StreamReceiver
+{
+    int fd = -1;
+    bool started = false;
+    uint16_t last_seq = 0;
+    int64_t extended_seq = 0;
+    int64_t first_seq = 0;
+    int64_t highest_seq = 0;
+    uint64_t received = 0;
+    uint32_t kernel_drops = 0;
+    uint64_t peak_1ms = 0;
+    std::deque<int64_t> window_ns;
+
+    void on_packet(const uint8_t *data, size_t length, int64_t arrival_ns)
+    {
+        received++;
+        window_ns.push_back(arrival_ns);
+        while (arrival_ns - window_ns.front() >= 1000000)
+        {
+            window_ns.pop_front();
+        }
+        peak_1ms = std::max<uint64_t>(peak_1ms, window_ns.size());
+
+        if (length < 12)
+        {
+            return;
+        }
+        uint16_t seq = static_cast<uint16_t>(data[2] << 8 | data[3]);
+        if (!started)
+        {
+            started = true;
+            first_seq = highest_seq = extended_seq = seq;
+        }
+        else
+        {
+            extended_seq += static_cast<int16_t>(seq - last_seq);
+            highest_seq = std::max(highest_seq, extended_seq);
+        }
+        last_seq = seq;
+    }
+
+    uint64_t lost() const
+    {
+        int64_t expected = started ? highest_seq - first_seq + 1 : 0;
+        return expected > static_cast<int64_t>(received) ? expected - received : 0;
+    }
+};
+
+// Drains the ports of all streams and receivers (port .. port + ports - 1)
+static void receive_loop(const BenchOptions &options, int ports, const std::atomic<bool> &running, ReceiverStats &stats)
+{
+    std::vector<StreamReceiver> streams(ports);
+    std::vector<struct pollfd> fds;
+    for (int i = 0; i < ports; i++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, sizeof(options.rcvbuf));
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(options.port + i);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            perror("[BENCH] bind");
+        }
+        fds.push_back({fd, POLLIN, 0});
+        streams[i].fd = fd;
+    }
+
+    constexpr int batch = 64;
+    constexpr size_t control_size = CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t));
+    static char buffers[batch][2048];
+    static char controls[batch][control_size];
+    struct mmsghdr messages[batch];
+    struct iovec iovecs[batch];
+    while (running)
+    {
+        if (poll(fds.data(), fds.size(), 100) <= 0)
+        {
+            continue;
+        }
+        for (size_t s = 0; s < fds.size(); s++)
+        {
+            if (!(fds[s].revents & POLLIN))
+            {
+                continue;
+            }
+            for (int i = 0; i < batch; i++)
+            {
+                iovecs[i] = {buffers[i], sizeof(buffers[i])};
+                messages[i] = {};
+                messages[i].msg_hdr.msg_iov = &iovecs[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+                messages[i].msg_hdr.msg_control = controls[i];
+                messages[i].msg_hdr.msg_controllen = control_size;
+            }
+            int received = recvmmsg(fds[s].fd, messages, batch, MSG_DONTWAIT, nullptr);
+            auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now().time_since_epoch()).count();
+            for (int i = 0; i < received; i++)
+            {
+                // Kernel arrival time, so the batching of recvmmsg does not hide bursts
+                int64_t arrival_ns = now_ns;
+                for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg;
+                     cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg))
+                {
+                    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+                    {
+                        struct timespec ts;
+                        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                        arrival_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+                    }
+                    else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+                    {
+                        memcpy(&streams[s].kernel_drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+                    }
+                }
+                streams[s].on_packet(reinterpret_cast<const uint8_t *>(buffers[i]), messages[i].msg_len, arrival_ns);
+                stats.packets++;
+                stats.bytes += messages[i].msg_len;
+            }
+        }
+    }
+    stats.cpu_seconds = thread_cpu_seconds(RUSAGE_THREAD);
+    for (auto &stream : streams)
+    {
+        stats.lost += stream.lost();
+        stats.rx_drops += stream.kernel_drops;
+        stats.peak_1ms = std::max(stats.peak_1ms, stream.peak_1ms);
+        close(stream.fd);
+    }
+}
+
+// One sender run of the sweep, prints its [BENCH] line.
+static bool run_bench(const BenchOptions &options, const BenchRun &run)
+{
+    std::vector<GstElement *> sources;
+    std::vector<GstElement *> sinks;
+    GstElement *pipeline = build_sender(options, run, sources, sinks);
+    if (!pipeline)
+    {
+        return false;
+    }
+
+    int ports = options.streams * run.destinations;
+    std::atomic<bool> running{true};
+    ReceiverStats received;
+    std::thread receiver(receive_loop, std::cref(options), ports, std::cref(running), std::ref(received));
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    // P-frame size such that the average over a gop matches the bitrate with 4x I-frames
+    size_t frame_bytes = static_cast<size_t>(options.bitrate / 8 / options.fps);
+    size_t p_bytes = frame_bytes * options.gop / (options.gop + 3);
+    size_t i_bytes = p_bytes * 4;
+
+    double cpu_start = thread_cpu_seconds(RUSAGE_SELF);
+    auto start = bench_clock::now();
+    auto frame_interval = std::chrono::nanoseconds(1000000000LL / options.fps);
+    guint64 frames = 0;
+    for (auto next = start; bench_clock::now() - start < std::chrono::seconds(options.seconds); next += frame_interval)
+    {
+        std::this_thread::sleep_until(next);
+        bool keyframe = frames % options.gop == 0;
+        for (GstElement *source : sources)
+        {
+            GstBuffer *buffer = make_access_unit(keyframe ? i_bytes : p_bytes, keyframe, frames);
+            GST_BUFFER_DURATION(buffer) = frame_interval.count();
+            GstFlowReturn ret;
+            g_signal_emit_by_name(source, "push-buffer", buffer, &ret);
+            gst_buffer_unref(buffer);
+        }
+        frames++;
+    }
+    double wall_s = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // Let the queues drain before the receiver stops counting
+    g_usleep(300000);
+    double cpu_s = thread_cpu_seconds(RUSAGE_SELF) - cpu_start;
+    running = false;
+    receiver.join();
+
+    guint64 send_errors = 0;
+    guint64 send_calls = 0;
+    guint64 frames_dropped = 0;
+    for (GstElement *sink : sinks)
+    {
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "send-errors"))
+        {
+            guint64 errors = 0, calls = 0, dropped = 0;
+            g_object_get(sink, "send-errors", &errors, "send-calls", &calls, "frames-dropped", &dropped, nullptr);
+            send_errors += errors;
+            send_calls += calls;
+            frames_dropped += dropped;
+        }
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    double sender_cpu = (cpu_s - received.cpu_seconds) / wall_s;
+    double mean_per_ms = received.packets / (wall_s * 1000.0) / ports;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[BENCH] mode=" << (options.split_lists ? "single" : "list") << " pacing=" << run.pacing
+              << " gso=" << (options.gso ? "on" : "off") << " fanout=" << run.fanout
+              << " destinations=" << run.destinations << " streams=" << options.streams
+              << " bitrate=" << options.bitrate << " fps=" << options.fps << " frames=" << frames
+              << " rx_packets=" << received.packets << " pps=" << received.packets / wall_s
+              << " rx_mbps=" << received.bytes * 8 / 1e6 / wall_s << " sender_cpu=" << sender_cpu
+              << " cpu_per_kpkt_us=" << (received.packets ? sender_cpu * wall_s * 1e9 / received.packets : 0)
+              << " peak_1ms=" << received.peak_1ms << " burst_ratio=" << (mean_per_ms > 0 ? received.peak_1ms / mean_per_ms : 0)
+              << " lost=" << received.lost << " rx_drops=" << received.rx_drops;
+    if (send_calls)
+    {
+        std::cout << " send_calls=" << send_calls << " send_errors=" << send_errors
+                  << " frames_dropped=" << frames_dropped;
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    gst_init(&argc, &argv);
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--streams" && i + 1 < argc)
+        {
+            options.streams = std::stoi(argv[++i]);
+        }
+        else if (arg == "--bitrate" && i + 1 < argc)
+        {
+            options.bitrate = std::stoll(argv[++i]);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            options.fps = std::stoi(argv[++i]);
+        }
+        else if (arg == "--gop" && i + 1 < argc)
+        {
+            options.gop = std::stoi(argv[++i]);
+        }
+        else if (arg == "--seconds" && i + 1 < argc)
+        {
+            options.seconds = std::stoi(argv[++i]);
+        }
+        else if (arg == "--port" && i + 1 < argc)
+        {
+            options.port = std::stoi(argv[++i]);
+        }
+        else if (arg == "--mode" && i + 1 < argc)
+        {
+            options.split_lists = std::string(argv[++i]) == "single";
+        }
+        else if (arg == "--pacing" && i + 1 < argc)
+        {
+            options.pacing_modes = split_list(argv[++i]);
+        }
+        else if (arg == "--destinations" && i + 1 < argc)
+        {
+            options.destination_counts.clear();
+            for (const auto &count : split_list(argv[++i]))
+            {
+                options.destination_counts.push_back(std::max(1, std::stoi(count)));
+            }
+        }
+        else if (arg == "--fanout" && i + 1 < argc)
+        {
+            options.fanout_modes = split_list(argv[++i]);
+            for (const auto &mode : options.fanout_modes)
+            {
+                if (mode != "tee" && mode != "sink")
+                {
+                    std::cerr << "Invalid --fanout: " << mode << " (tee or sink)" << std::endl;
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "--gso")
+        {
+            options.gso = true;
+        }
+        else if (arg == "--rcvbuf" && i + 1 < argc)
+        {
+            options.rcvbuf = std::stoi(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--streams <n>] [--bitrate <bps>] [--fps <n>] [--gop <n>] [--seconds <n>] [--port <base>]"
+                         " [--mode list|single] [--pacing <none,txtime,sleep>] [--gso] [--rcvbuf <bytes>]"
+                         " [--destinations <n,...>] [--fanout tee,sink]"
+                      << std::endl;
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    for (const auto &pacing : options.pacing_modes)
+    {
+        for (int destinations : options.destination_counts)
+        {
+            for (const auto &fanout : options.fanout_modes)
+            {
+                // One receiver needs no fan-out, only the first mode is run
+                if (destinations == 1 && fanout != options.fanout_modes.front())
+                {
+                    continue;
+                }
+                if (!run_bench(options, {pacing, fanout, destinations}))
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include "sim_config.hpp"
+#include "simulator.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * pipeline_sim: offline discrete-event simulator of a streaming
+ * pipeline such as detection_rawcapture.sh (configs/ has it), to tune
+ * queue depths, leaky policies and pool sizes without hardware time.
+ *
+ * The pipeline is described in a small text file (sim_config.hpp has
+ * the format): the source with its frame rate, jitter and buffer pool,
+ * every stage with the queue in front of it and its service time
+ * distribution (constant / uniform / normal / lognormal / exponential,
+ * or samples of a measurement: per-element processing times from the
+ * GstShark proctime tracer, hailo_display / rtp_analyzer frame intervals,
+ * ...), the pools stages take buffers from and return them to, and the
+ * tee branches. simulator.hpp has the model.
+ * One run prints per branch the throughput and capture-to-branch-end
+ * latency percentiles, the frames lost at the source (pool empty) and
+ * in leaky queues, per thread the queue occupancy and busy / blocked /
+ * pool wait time, per pool its use, and the bottleneck (the busiest
+ * thread). --set overrides any value of the file, --sweep runs once per
+ * value of one setting and prints a line per run.
+ *
+ * Usage: pipeline_sim <config> [--duration <s>] [--warmup <s>] [--seed <n>]
+ *                     [--set <name>.<key>=<value>]... [--sweep <name>.<key>=<v1>,<v2>,...]
+ * e.g.
+ *   pipeline_sim configs/detection_rawcapture.sim
+ *   pipeline_sim configs/detection_rawcapture.sim --set hailonet.service=trace:hailonet_proctime.csv#1
+ *   pipeline_sim configs/detection_rawcapture.sim --sweep frontend.size=3,4,5,6,8
+ *   pipeline_sim configs/detection_rawcapture.sim --sweep 'hailonet.service=lognormal:24,2|lognormal:34,3'
+ *   pipeline_sim configs/detection_rawcapture.sim --set rtph264pay.leaky=downstream --sweep encoder.size=2,3,4
+ *********************************************************************/
+
+struct SimOptions
+{
+    std::string config_path;
+    double duration_s = 60;
+    double warmup_s = 5;
+    uint64_t seed = 1;
+    std::vector<std::string> overrides;
+    std::string sweep;
+};
+
+static void print_usage(const char *program_name)
+{
+    std::cerr << "Usage: " << program_name << " <config> [options]" << std::endl;
+    std::cerr << "  --duration <s>         Simulated time (default: 60)" << std::endl;
+    std::cerr << "  --warmup <s>           Time excluded from the results (default: 5)" << std::endl;
+    std::cerr << "  --seed <n>             Random seed, equal seeds give equal results (default: 1)" << std::endl;
+    std::cerr << "  --set <name>.<key>=<v> Override a value of the config (repeatable)" << std::endl;
+    std::cerr << "  --sweep <name>.<key>=<v1>,<v2>,...  One run per value, one line each ('|' between values"
+              << std::endl;
+    std::cerr << "                         holding commas, e.g. hailonet.service='lognormal:24,2|lognormal:30,3')"
+              << std::endl;
+}
+
+static bool parse_options(int argc, char *argv[], SimOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--duration" && i + 1 < argc)
+        {
+            options.duration_s = std::stod(argv[++i]);
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            options.warmup_s = std::stod(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            options.seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--set" && i + 1 < argc)
+        {
+            options.overrides.push_back(argv[++i]);
+        }
+        else if (arg == "--sweep" && i + 1 < argc)
+        {
+            options.sweep = argv[++i];
+        }
+        else if (arg[0] != '-' && options.config_path.empty())
+        {
+            options.config_path = arg;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (options.config_path.empty() || options.duration_s <= options.warmup_s || options.warmup_s < 0)
+    {
+        std::cerr << "Error: a config is required and --duration must exceed --warmup" << std::endl;
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static std::string describe_latency(const std::vector<double> &sorted)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << "p50_ms=" << percentile(sorted, 0.5)
+         << " p90_ms=" << percentile(sorted, 0.9) << " p99_ms=" << percentile(sorted, 0.99)
+         << " p999_ms=" << percentile(sorted, 0.999) << " max_ms=" << (sorted.empty() ? 0.0 : sorted.back());
+    return text.str();
+}
+
+static uint64_t total_leaked(const SimResult &result)
+{
+    uint64_t leaked = 0;
+    for (const auto &thread : result.threads)
+    {
+        leaked += thread.leaked;
+    }
+    return leaked;
+}
+
+static void print_result(const SimResult &result, double offered_fps)
+{
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[SIM] offered_fps=" << offered_fps << " measured_s=" << result.seconds
+              << " captured=" << result.captured << " lost_at_source=" << result.lost_at_source
+              << " leaked_in_queues=" << total_leaked(result) << std::endl;
+    for (const auto &branch : result.branches)
+    {
+        std::cout << "[BRANCH] " << branch.name << " completed=" << branch.completed << " fps=" << branch.fps << " "
+                  << describe_latency(branch.latency_ms) << std::endl;
+    }
+    const ThreadResult *busiest = nullptr;
+    for (const auto &thread : result.threads)
+    {
+        std::cout << "[THREAD] " << thread.name;
+        if (thread.queue_capacity > 0)
+        {
+            std::cout << " queue=" << thread.queue_capacity;
+        }
+        std::cout << " queue_mean=" << thread.queue_mean << " queue_max=" << thread.queue_max
+                  << " busy=" << thread.busy * 100 << "% blocked=" << thread.blocked * 100
+                  << "% pool_wait=" << thread.pool_wait * 100 << "% leaked=" << thread.leaked << std::endl;
+        if (!busiest || thread.busy > busiest->busy)
+        {
+            busiest = &thread;
+        }
+    }
+    for (const auto &pool : result.pools)
+    {
+        std::cout << "[POOL] " << pool.name << " size=" << pool.size << " mean_in_use=" << pool.mean_in_use
+                  << " max_in_use=" << pool.max_in_use << " exhausted=" << pool.exhausted << std::endl;
+    }
+    if (busiest)
+    {
+        std::cout << "[BOTTLENECK] " << busiest->name << " busy=" << busiest->busy * 100 << "%"
+                  << (busiest->busy > 0.95 ? ", saturated" : "") << std::endl;
+    }
+}
+
+static void print_sweep_line(const std::string &setting, const SimResult &result)
+{
+    double min_fps = -1;
+    std::vector<double> worst;
+    for (const auto &branch : result.branches)
+    {
+        if (min_fps < 0 || branch.fps < min_fps)
+        {
+            min_fps = branch.fps;
+        }
+        if (worst.empty() || percentile(branch.latency_ms, 0.99) > percentile(worst, 0.99))
+        {
+            worst = branch.latency_ms;
+        }
+    }
+    std::cout << std::fixed << std::setprecision(1) << "[SWEEP] " << setting << " min_branch_fps=" << min_fps
+              << " " << describe_latency(worst) << " lost_at_source=" << result.lost_at_source
+              << " leaked_in_queues=" << total_leaked(result) << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    SimOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+
+    ConfigFile file;
+    std::string error;
+    if (!file.load(options.config_path, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    for (const auto &setting : options.overrides)
+    {
+        if (!file.apply_override(setting, error))
+        {
+            std::cerr << "Error: --set " << error << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> settings;
+    if (!options.sweep.empty())
+    {
+        size_t equal = options.sweep.find('=');
+        if (equal == std::string::npos)
+        {
+            std::cerr << "Error: --sweep expects <name>.<key>=<v1>,<v2>,..." << std::endl;
+            return 1;
+        }
+        // Values holding commas themselves (distributions) are separated by '|' instead
+        std::string list = options.sweep.substr(equal + 1);
+        char separator = list.find('|') != std::string::npos ? '|' : ',';
+        std::stringstream values(list);
+        std::string value;
+        while (std::getline(values, value, separator))
+        {
+            settings.push_back(options.sweep.substr(0, equal + 1) + value);
+        }
+    }
+
+    std::cout << "[SIM] " << options.config_path << " duration_s=" << options.duration_s
+              << " warmup_s=" << options.warmup_s << " seed=" << options.seed << std::endl;
+    if (settings.empty())
+    {
+        SimConfig config;
+        if (!file.build(config, error))
+        {
+            std::cerr << "Error: " << options.config_path << ": " << error << std::endl;
+            return 1;
+        }
+        std::cout << file.describe();
+        print_result(Simulator(config, options.seed).run(options.duration_s, options.warmup_s), config.fps);
+        return 0;
+    }
+
+    for (const auto &setting : settings)
+    {
+        ConfigFile variant = file;
+        SimConfig config;
+        if (!variant.apply_override(setting, error) || !variant.build(config, error))
+        {
+            std::cerr << "Error: " << setting << ": " << error << std::endl;
+            return 1;
+        }
+        print_sweep_line(setting, Simulator(config, options.seed).run(options.duration_s, options.warmup_s));
+    }
+    return 0;
+}
@@ -0,0 +1,473 @@
+#include "sim_config.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+// "<number>[us|ms|s]" -> microseconds, ms without a suffix
+static bool parse_time(const std::string &text, double &us)
+{
+    size_t used = 0;
+    double value;
+    try
+    {
+        value = std::stod(text, &used);
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    std::string unit = text.substr(used);
+    if (unit.empty() || unit == "ms")
+    {
+        us = value * 1000.0;
+    }
+    else if (unit == "us")
+    {
+        us = value;
+    }
+    else if (unit == "s")
+    {
+        us = value * 1000000.0;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static std::vector<std::string> split(const std::string &text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+static bool load_samples(const std::string &path, int column, std::vector<double> &samples, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot read trace " + path;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::vector<std::string> fields = split(line, ',');
+        double us;
+        if (column < static_cast<int>(fields.size()) && parse_time(fields[column], us))
+        {
+            samples.push_back(us); // header lines and other text do not parse and are skipped
+        }
+    }
+    if (samples.empty())
+    {
+        error = "no samples in column " + std::to_string(column) + " of " + path;
+        return false;
+    }
+    return true;
+}
+
+bool Distribution::parse(const std::string &spec, const std::string &base_dir, std::string &error)
+{
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string arguments = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    m_spec = spec;
+    m_samples.clear();
+    m_next = 0;
+
+    if (kind == "trace" || kind == "replay")
+    {
+        size_t hash = arguments.rfind('#');
+        std::string path = arguments.substr(0, hash);
+        int column = hash == std::string::npos ? 0 : std::atoi(arguments.c_str() + hash + 1);
+        if (!path.empty() && path[0] != '/')
+        {
+            path = base_dir + path;
+        }
+        m_kind = kind == "trace" ? Kind::Trace : Kind::Replay;
+        return load_samples(path, column, m_samples, error);
+    }
+
+    std::vector<std::string> values = split(arguments, ',');
+    std::vector<double> us(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (!parse_time(values[i], us[i]))
+        {
+            error = "invalid time \"" + values[i] + "\" in " + spec;
+            return false;
+        }
+    }
+    size_t expected = 2;
+    if (kind == "const" || kind == "exp")
+    {
+        expected = 1;
+        m_kind = kind == "const" ? Kind::Constant : Kind::Exponential;
+    }
+    else if (kind == "uniform")
+    {
+        m_kind = Kind::Uniform;
+    }
+    else if (kind == "normal")
+    {
+        m_kind = Kind::Normal;
+    }
+    else if (kind == "lognormal")
+    {
+        m_kind = Kind::LogNormal;
+    }
+    else
+    {
+        error = "unknown distribution " + spec;
+        return false;
+    }
+    if (us.size() != expected)
+    {
+        error = spec + " takes " + std::to_string(expected) + " value(s)";
+        return false;
+    }
+    m_a = us[0];
+    m_b = expected > 1 ? us[1] : 0;
+    if (m_kind == Kind::LogNormal)
+    {
+        if (m_a <= 0)
+        {
+            error = "lognormal needs a positive mean: " + spec;
+            return false;
+        }
+        // Parameters of the underlying normal from the mean / sd of the samples themselves
+        double sigma2 = std::log(1.0 + (m_b * m_b) / (m_a * m_a));
+        m_b = std::sqrt(sigma2);
+        m_a = std::log(m_a) - sigma2 / 2.0;
+    }
+    return true;
+}
+
+double Distribution::sample(std::mt19937_64 &rng)
+{
+    switch (m_kind)
+    {
+    case Kind::Constant:
+        return m_a;
+    case Kind::Uniform:
+        return std::uniform_real_distribution<double>(m_a, m_b)(rng);
+    case Kind::Normal:
+        return std::normal_distribution<double>(m_a, m_b)(rng);
+    case Kind::LogNormal:
+        return std::lognormal_distribution<double>(m_a, m_b)(rng);
+    case Kind::Exponential:
+        return m_a > 0 ? std::exponential_distribution<double>(1.0 / m_a)(rng) : 0.0;
+    case Kind::Trace:
+        return m_samples[std::uniform_int_distribution<size_t>(0, m_samples.size() - 1)(rng)];
+    case Kind::Replay:
+        return m_samples[m_next++ % m_samples.size()];
+    }
+    return 0;
+}
+
+double Distribution::mean_us() const
+{
+    switch (m_kind)
+    {
+    case Kind::Constant:
+    case Kind::Normal:
+    case Kind::Exponential:
+        return m_a;
+    case Kind::Uniform:
+        return (m_a + m_b) / 2.0;
+    case Kind::LogNormal:
+        return std::exp(m_a + m_b * m_b / 2.0);
+    case Kind::Trace:
+    case Kind::Replay: {
+        double sum = 0;
+        for (double sample : m_samples)
+        {
+            sum += sample;
+        }
+        return sum / static_cast<double>(m_samples.size());
+    }
+    }
+    return 0;
+}
+
+bool ConfigFile::load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot read " + path;
+        return false;
+    }
+    size_t slash = path.rfind('/');
+    m_base_dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    m_entries.clear();
+
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line))
+    {
+        number++;
+        std::istringstream tokens(line);
+        std::string token;
+        ConfigEntry entry;
+        entry.line = number;
+        while (tokens >> token)
+        {
+            if (token[0] == '#')
+            {
+                break; // comment to the end of the line
+            }
+            if (entry.kind.empty())
+            {
+                entry.kind = token;
+            }
+            else if (entry.name.empty() && token.find('=') == std::string::npos)
+            {
+                entry.name = token;
+            }
+            else
+            {
+                size_t equal = token.find('=');
+                if (equal == std::string::npos || equal == 0)
+                {
+                    error = path + ":" + std::to_string(number) + ": expected key=value, got \"" + token + "\"";
+                    return false;
+                }
+                entry.values[token.substr(0, equal)] = token.substr(equal + 1);
+            }
+        }
+        if (entry.kind.empty())
+        {
+            continue;
+        }
+        if (entry.kind != "source" && entry.kind != "pool" && entry.kind != "stage" && entry.kind != "branch")
+        {
+            error = path + ":" + std::to_string(number) + ": unknown element \"" + entry.kind + "\"";
+            return false;
+        }
+        if (entry.name.empty())
+        {
+            error = path + ":" + std::to_string(number) + ": " + entry.kind + " without a name";
+            return false;
+        }
+        m_entries.push_back(entry);
+    }
+    return true;
+}
+
+static std::set<std::string> allowed_keys(const std::string &kind)
+{
+    if (kind == "source")
+    {
+        return {"fps", "jitter", "pool"};
+    }
+    if (kind == "pool")
+    {
+        return {"size"};
+    }
+    if (kind == "stage")
+    {
+        return {"queue", "leaky", "service", "acquire", "release"};
+    }
+    return {};
+}
+
+bool ConfigFile::apply_override(const std::string &setting, std::string &error)
+{
+    size_t dot = setting.find('.');
+    size_t equal = setting.find('=');
+    if (dot == std::string::npos || equal == std::string::npos || dot > equal)
+    {
+        error = "expected <name>.<key>=<value>, got \"" + setting + "\"";
+        return false;
+    }
+    std::string name = setting.substr(0, dot);
+    std::string key = setting.substr(dot + 1, equal - dot - 1);
+    // A source and its pool may share a name, the key tells them apart
+    for (auto &entry : m_entries)
+    {
+        if (entry.name == name && allowed_keys(entry.kind).count(key))
+        {
+            entry.values[key] = setting.substr(equal + 1);
+            return true;
+        }
+    }
+    error = "no source, pool or stage named \"" + name + "\" with a key \"" + key + "\"";
+    return false;
+}
+
+static bool check_keys(const ConfigEntry &entry, std::string &error)
+{
+    std::set<std::string> allowed = allowed_keys(entry.kind);
+    for (const auto &value : entry.values)
+    {
+        if (!allowed.count(value.first))
+        {
+            error = "line " + std::to_string(entry.line) + ": " + entry.kind + " " + entry.name + " has no key \"" +
+                    value.first + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ConfigFile::build(SimConfig &config, std::string &error) const
+{
+    config = SimConfig();
+    bool have_source = false;
+    int branch = -1;
+    std::set<std::string> pools;
+    for (const auto &entry : m_entries)
+    {
+        auto value = [&entry](const std::string &key, const std::string &fallback) {
+            auto it = entry.values.find(key);
+            return it == entry.values.end() ? fallback : it->second;
+        };
+        std::string where = "line " + std::to_string(entry.line) + ": ";
+        if (entry.kind == "source")
+        {
+            if (have_source || !check_keys(entry, error))
+            {
+                error = error.empty() ? where + "a second source" : error;
+                return false;
+            }
+            have_source = true;
+            config.source_name = entry.name;
+            config.fps = std::atof(value("fps", "30").c_str());
+            config.source_pool = value("pool", "");
+            if (config.fps <= 0 || !config.jitter.parse(value("jitter", "const:0"), m_base_dir, error))
+            {
+                error = where + (error.empty() ? "fps must be positive" : error);
+                return false;
+            }
+        }
+        else if (entry.kind == "pool")
+        {
+            if (!check_keys(entry, error))
+            {
+                return false;
+            }
+            PoolConfig pool;
+            pool.name = entry.name;
+            pool.size = std::atoi(value("size", "0").c_str());
+            if (pool.size <= 0 || !pools.insert(pool.name).second)
+            {
+                error = where + "pool " + pool.name + " needs a unique name and size > 0";
+                return false;
+            }
+            config.pools.push_back(pool);
+        }
+        else if (entry.kind == "branch")
+        {
+            config.branches.push_back(entry.name);
+            branch = static_cast<int>(config.branches.size()) - 1;
+        }
+        else
+        {
+            if (!check_keys(entry, error))
+            {
+                return false;
+            }
+            StageConfig stage;
+            stage.name = entry.name;
+            stage.queue = std::atoi(value("queue", "0").c_str());
+            stage.acquire = value("acquire", "");
+            stage.release = value("release", "");
+            stage.branch = branch;
+            std::string leaky = value("leaky", "no");
+            if (leaky == "no")
+            {
+                stage.leaky = Leaky::No;
+            }
+            else if (leaky == "upstream")
+            {
+                stage.leaky = Leaky::Upstream;
+            }
+            else if (leaky == "downstream")
+            {
+                stage.leaky = Leaky::Downstream;
+            }
+            else
+            {
+                error = where + "leaky is no, upstream or downstream";
+                return false;
+            }
+            if (!stage.service.parse(value("service", "const:0"), m_base_dir, error))
+            {
+                error = where + error;
+                return false;
+            }
+            if (stage.queue < 0 || (stage.queue == 0 && stage.leaky != Leaky::No))
+            {
+                error = where + "leaky needs a queue";
+                return false;
+            }
+            bool first_of_branch = branch >= 0 && (config.stages.empty() || config.stages.back().branch != branch);
+            if (first_of_branch && stage.queue == 0)
+            {
+                error = where + "the first stage of branch " + config.branches[branch] + " needs a queue";
+                return false;
+            }
+            config.stages.push_back(stage);
+        }
+    }
+
+    if (!have_source)
+    {
+        error = "no source";
+        return false;
+    }
+    std::set<std::string> referenced = {config.source_pool};
+    for (const auto &stage : config.stages)
+    {
+        referenced.insert(stage.acquire);
+        referenced.insert(stage.release);
+    }
+    for (const auto &name : referenced)
+    {
+        if (!name.empty() && !pools.count(name))
+        {
+            error = "unknown pool " + name;
+            return false;
+        }
+    }
+    for (size_t b = 0; b < config.branches.size(); b++)
+    {
+        if (std::none_of(config.stages.begin(), config.stages.end(),
+                         [b](const StageConfig &stage) { return stage.branch == static_cast<int>(b); }))
+        {
+            error = "branch " + config.branches[b] + " has no stages";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ConfigFile::describe() const
+{
+    std::ostringstream text;
+    for (const auto &entry : m_entries)
+    {
+        text << entry.kind << " " << entry.name;
+        for (const auto &value : entry.values)
+        {
+            text << " " << value.first << "=" << value.second;
+        }
+        text << "\n";
+    }
+    return text.str();
+}
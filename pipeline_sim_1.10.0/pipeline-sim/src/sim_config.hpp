@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Pipeline description of pipeline_sim, one element per line:
+ *
+ *   source <name> fps=<n> [jitter=<dist>] [pool=<pool>]
+ *   pool   <name> size=<buffers>
+ *   stage  <name> [queue=<n>] [leaky=no|upstream|downstream]
+ *                 service=<dist> [acquire=<pool>] [release=<pool>]
+ *   branch <name>
+ *
+ * Stages run in order. queue=<n> puts a queue (max-size-buffers=n) in
+ * front of the stage, which then runs in a thread of its own; queue=0
+ * (the default) runs it in the thread of the stage before, like two
+ * elements linked without a queue. "branch" starts a tee branch: the
+ * stages after it belong to that branch until the next "branch", every
+ * branch gets each frame of the trunk (the stages before the first
+ * branch) and has to start with a queue.
+ * The source captures at fps and takes one buffer of its pool per frame;
+ * with no free buffer the frame is lost ("Buffer acquire failed").
+ * acquire= takes a buffer of a pool before the stage runs (waiting for
+ * one), release= returns the pool buffer the frame holds after it; the
+ * buffers still held when a frame leaves the last stage of every branch
+ * are returned then.
+ *
+ * <dist> is a service time distribution, times in ms unless suffixed
+ * with us / ms / s:
+ *   const:<t>  uniform:<min>,<max>  normal:<mean>,<sd>
+ *   lognormal:<mean>,<sd>  exp:<mean>
+ *   trace:<file>[#<column>]   samples of a measurement, one per line
+ *                             (CSV column, 0 based), drawn at random
+ *   replay:<file>[#<column>]  the same samples in file order, repeated
+ * Trace paths are relative to the config file. '#' starts a comment
+ * outside of values. Every key can be overridden from the command line
+ * as <name>.<key>=<value> (sim_config::apply_override).
+ *********************************************************************/
+
+class Distribution
+{
+  public:
+    // false with a message for an invalid spec; base_dir resolves trace files
+    bool parse(const std::string &spec, const std::string &base_dir, std::string &error);
+
+    // Microseconds; service times are never negative, a source jitter can be
+    double sample(std::mt19937_64 &rng);
+    double mean_us() const;
+    std::string describe() const { return m_spec; }
+
+  private:
+    enum class Kind
+    {
+        Constant,
+        Uniform,
+        Normal,
+        LogNormal,
+        Exponential,
+        Trace,
+        Replay
+    };
+
+    std::string m_spec = "const:0";
+    Kind m_kind = Kind::Constant;
+    double m_a = 0;
+    double m_b = 0;
+    std::vector<double> m_samples;
+    size_t m_next = 0;
+};
+
+enum class Leaky
+{
+    No,
+    Upstream,   // a full queue drops the new frame
+    Downstream  // a full queue drops its oldest frame
+};
+
+struct PoolConfig
+{
+    std::string name;
+    int size = 0;
+};
+
+struct StageConfig
+{
+    std::string name;
+    int queue = 0;
+    Leaky leaky = Leaky::No;
+    Distribution service;
+    std::string acquire;
+    std::string release;
+    int branch = -1; // -1 = trunk
+};
+
+struct SimConfig
+{
+    std::string source_name = "source";
+    double fps = 30;
+    Distribution jitter;
+    std::string source_pool;
+    std::vector<PoolConfig> pools;
+    std::vector<StageConfig> stages;
+    std::vector<std::string> branches;
+};
+
+// Lines of a config file with their key=value pairs, before they are typed
+struct ConfigEntry
+{
+    std::string kind;
+    std::string name;
+    std::map<std::string, std::string> values;
+    int line = 0;
+};
+
+class ConfigFile
+{
+  public:
+    bool load(const std::string &path, std::string &error);
+    // "<name>.<key>=<value>", the name of a source / pool / stage
+    bool apply_override(const std::string &setting, std::string &error);
+    bool build(SimConfig &config, std::string &error) const;
+    // One line per element, the values in effect
+    std::string describe() const;
+
+  private:
+    std::string m_base_dir;
+    std::vector<ConfigEntry> m_entries;
+};
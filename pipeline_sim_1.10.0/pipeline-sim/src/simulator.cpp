@@ -0,0 +1,515 @@
+#include "simulator.hpp"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <queue>
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+namespace
+{
+
+struct Frame
+{
+    double capture_us = 0;
+    bool measured = false;
+    std::vector<int> pools; // pool buffers held, by pool index
+    size_t copies = 1;      // branches still holding the frame
+};
+using FramePtr = std::shared_ptr<Frame>;
+
+struct SimQueue
+{
+    int capacity = -1; // -1 = unbounded (the source thread's captures)
+    Leaky leaky = Leaky::No;
+    int branch = -1;
+    std::deque<FramePtr> items;
+    double since_us = 0;
+    double area = 0;
+    size_t max = 0;
+    uint64_t leaked = 0;
+};
+
+struct SimThread
+{
+    enum class State
+    {
+        Idle,
+        Busy,
+        WaitPool,
+        Blocked
+    };
+
+    std::string name;
+    std::vector<int> stages;
+    int input = -1;
+    std::vector<int> outputs;
+    int branch = -1; // branch this thread ends, when it has no outputs
+    State state = State::Idle;
+    FramePtr frame;
+    size_t stage_pos = 0;
+    size_t output_pos = 0;
+    double since_us = 0;
+    double busy_us = 0;
+    double blocked_us = 0;
+    double pool_wait_us = 0;
+};
+
+struct SimPool
+{
+    int size = 0;
+    int free = 0;
+    double since_us = 0;
+    double area = 0;
+    int max_in_use = 0;
+    uint64_t exhausted = 0;
+};
+
+struct Event
+{
+    double us;
+    uint64_t sequence;
+    enum class Type
+    {
+        Capture,
+        ServiceDone
+    } type;
+    size_t index;
+
+    bool operator>(const Event &other) const
+    {
+        return us != other.us ? us > other.us : sequence > other.sequence;
+    }
+};
+
+class Engine
+{
+  public:
+    Engine(const SimConfig &config, uint64_t seed) : m_config(config), m_rng(seed) {}
+
+    SimResult run(double duration_s, double warmup_s)
+    {
+        build();
+        m_warmup_us = warmup_s * 1e6;
+        m_end_us = duration_s * 1e6;
+        double period_us = 1e6 / m_config.fps;
+
+        schedule_capture(0, period_us);
+        while (!m_events.empty() && m_events.top().us <= m_end_us)
+        {
+            Event event = m_events.top();
+            m_events.pop();
+            m_now = event.us;
+            if (event.type == Event::Type::Capture)
+            {
+                capture();
+                schedule_capture(event.index + 1, period_us);
+            }
+            else
+            {
+                service_done(m_threads[event.index]);
+            }
+            advance();
+        }
+        m_now = m_end_us;
+        return collect();
+    }
+
+  private:
+    void build()
+    {
+        for (const auto &pool_config : m_config.pools)
+        {
+            SimPool pool;
+            pool.size = pool.free = pool_config.size;
+            m_pools.push_back(pool);
+        }
+
+        // Source thread: unbounded input of captures, the stages before the first queue
+        m_queues.push_back(SimQueue());
+        SimThread source;
+        source.name = m_config.source_name;
+        source.input = 0;
+        m_threads.push_back(source);
+
+        std::vector<int> branch_queues(m_config.branches.size(), -1);
+        int trunk_end = 0;
+        for (size_t i = 0; i < m_config.stages.size(); i++)
+        {
+            const StageConfig &stage = m_config.stages[i];
+            if (stage.queue > 0)
+            {
+                SimQueue queue;
+                queue.capacity = stage.queue;
+                queue.leaky = stage.leaky;
+                queue.branch = stage.branch;
+                m_queues.push_back(queue);
+                SimThread thread;
+                thread.name = stage.name;
+                thread.input = static_cast<int>(m_queues.size()) - 1;
+                thread.branch = stage.branch;
+                bool first_of_branch = stage.branch >= 0 && branch_queues[stage.branch] < 0;
+                if (first_of_branch)
+                {
+                    branch_queues[stage.branch] = thread.input;
+                }
+                else
+                {
+                    m_threads.back().outputs.push_back(thread.input);
+                }
+                m_threads.push_back(thread);
+            }
+            else
+            {
+                m_threads.back().name += "+" + stage.name;
+            }
+            m_threads.back().stages.push_back(static_cast<int>(i));
+            if (stage.branch < 0)
+            {
+                trunk_end = static_cast<int>(m_threads.size()) - 1;
+            }
+        }
+        // The tee at the end of the trunk
+        for (int queue : branch_queues)
+        {
+            m_threads[trunk_end].outputs.push_back(queue);
+        }
+
+        m_branch_latency.resize(std::max<size_t>(m_config.branches.size(), 1));
+        m_branch_completed.resize(m_branch_latency.size());
+    }
+
+    int pool_index(const std::string &name) const
+    {
+        for (size_t i = 0; i < m_config.pools.size(); i++)
+        {
+            if (m_config.pools[i].name == name)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Time weighted statistics only count what happens after warmup
+    double measured_since(double since_us) const { return std::max(0.0, m_now - std::max(since_us, m_warmup_us)); }
+
+    void touch(SimQueue &queue)
+    {
+        queue.area += measured_since(queue.since_us) * static_cast<double>(queue.items.size());
+        queue.since_us = m_now;
+    }
+
+    void touch(SimPool &pool)
+    {
+        pool.area += measured_since(pool.since_us) * (pool.size - pool.free);
+        pool.since_us = m_now;
+    }
+
+    void set_state(SimThread &thread, SimThread::State state)
+    {
+        double spent = measured_since(thread.since_us);
+        if (thread.state == SimThread::State::Busy)
+        {
+            thread.busy_us += spent;
+        }
+        else if (thread.state == SimThread::State::Blocked)
+        {
+            thread.blocked_us += spent;
+        }
+        else if (thread.state == SimThread::State::WaitPool)
+        {
+            thread.pool_wait_us += spent;
+        }
+        thread.since_us = m_now;
+        thread.state = state;
+    }
+
+    bool take_buffer(int index, Frame &frame)
+    {
+        SimPool &pool = m_pools[index];
+        if (pool.free == 0)
+        {
+            return false;
+        }
+        touch(pool);
+        pool.free--;
+        if (m_now >= m_warmup_us)
+        {
+            pool.max_in_use = std::max(pool.max_in_use, pool.size - pool.free);
+        }
+        frame.pools.push_back(index);
+        return true;
+    }
+
+    void return_buffer(int index, Frame &frame)
+    {
+        auto it = std::find(frame.pools.begin(), frame.pools.end(), index);
+        if (it == frame.pools.end())
+        {
+            return; // release= of a pool the frame holds no buffer of
+        }
+        frame.pools.erase(it);
+        touch(m_pools[index]);
+        m_pools[index].free++;
+    }
+
+    void schedule_capture(size_t n, double period_us)
+    {
+        double us = std::max(m_now, static_cast<double>(n) * period_us + m_config.jitter.sample(m_rng));
+        m_events.push(Event{us, m_sequence++, Event::Type::Capture, n});
+    }
+
+    void capture()
+    {
+        auto frame = std::make_shared<Frame>();
+        frame->capture_us = m_now;
+        frame->measured = m_now >= m_warmup_us;
+        if (frame->measured)
+        {
+            m_captured++;
+        }
+        int pool = pool_index(m_config.source_pool);
+        if (pool >= 0 && !take_buffer(pool, *frame))
+        {
+            if (frame->measured)
+            {
+                m_pools[pool].exhausted++;
+                m_lost_at_source++;
+            }
+            return;
+        }
+        touch(m_queues[0]);
+        m_queues[0].items.push_back(frame);
+        m_queues[0].max = std::max(m_queues[0].max, frame->measured ? m_queues[0].items.size() : 0);
+    }
+
+    // Next stage of the thread's frame, or its outputs once all stages ran
+    void begin_stage(SimThread &thread)
+    {
+        if (thread.stage_pos == thread.stages.size())
+        {
+            thread.output_pos = 0;
+            if (thread.outputs.size() > 1)
+            {
+                thread.frame->copies += thread.outputs.size() - 1; // tee
+            }
+            push_outputs(thread);
+            return;
+        }
+        const StageConfig &stage = m_config.stages[thread.stages[thread.stage_pos]];
+        if (!stage.acquire.empty() && !take_buffer(pool_index(stage.acquire), *thread.frame))
+        {
+            set_state(thread, SimThread::State::WaitPool);
+            return;
+        }
+        start_service(thread);
+    }
+
+    void start_service(SimThread &thread)
+    {
+        StageConfig &stage = m_config.stages[thread.stages[thread.stage_pos]];
+        set_state(thread, SimThread::State::Busy);
+        double service_us = std::max(0.0, stage.service.sample(m_rng));
+        size_t index = static_cast<size_t>(&thread - m_threads.data());
+        m_events.push(Event{m_now + service_us, m_sequence++, Event::Type::ServiceDone, index});
+    }
+
+    void service_done(SimThread &thread)
+    {
+        const StageConfig &stage = m_config.stages[thread.stages[thread.stage_pos]];
+        if (!stage.release.empty())
+        {
+            return_buffer(pool_index(stage.release), *thread.frame);
+        }
+        thread.stage_pos++;
+        begin_stage(thread);
+    }
+
+    // One branch is done with the frame (completed or dropped); the last one returns its buffers
+    void finish_copy(const FramePtr &frame, int branch, bool completed)
+    {
+        if (completed && frame->measured)
+        {
+            size_t index = static_cast<size_t>(std::max(branch, 0));
+            m_branch_latency[index].push_back((m_now - frame->capture_us) / 1000.0);
+            m_branch_completed[index]++;
+        }
+        if (--frame->copies == 0)
+        {
+            while (!frame->pools.empty())
+            {
+                return_buffer(frame->pools.back(), *frame);
+            }
+        }
+    }
+
+    // Pushes into the next queue(s); true if anything moved
+    bool push_outputs(SimThread &thread)
+    {
+        bool progress = false;
+        if (thread.outputs.empty())
+        {
+            finish_copy(thread.frame, thread.branch, true);
+        }
+        while (thread.output_pos < thread.outputs.size())
+        {
+            SimQueue &queue = m_queues[thread.outputs[thread.output_pos]];
+            bool full = static_cast<int>(queue.items.size()) >= queue.capacity;
+            if (full && queue.leaky == Leaky::No)
+            {
+                set_state(thread, SimThread::State::Blocked);
+                return progress;
+            }
+            touch(queue);
+            if (full)
+            {
+                queue.leaked += m_now >= m_warmup_us;
+                if (queue.leaky == Leaky::Upstream)
+                {
+                    finish_copy(thread.frame, queue.branch, false);
+                    thread.output_pos++;
+                    progress = true;
+                    continue;
+                }
+                FramePtr oldest = queue.items.front();
+                queue.items.pop_front();
+                finish_copy(oldest, queue.branch, false);
+            }
+            queue.items.push_back(thread.frame);
+            queue.max = std::max(queue.max, m_now >= m_warmup_us ? queue.items.size() : 0);
+            thread.output_pos++;
+            progress = true;
+        }
+        thread.frame.reset();
+        set_state(thread, SimThread::State::Idle);
+        return true;
+    }
+
+    bool step(SimThread &thread)
+    {
+        switch (thread.state)
+        {
+        case SimThread::State::Idle: {
+            SimQueue &input = m_queues[thread.input];
+            if (input.items.empty())
+            {
+                return false;
+            }
+            touch(input);
+            thread.frame = input.items.front();
+            input.items.pop_front();
+            thread.stage_pos = 0;
+            begin_stage(thread);
+            return true;
+        }
+        case SimThread::State::WaitPool: {
+            const StageConfig &stage = m_config.stages[thread.stages[thread.stage_pos]];
+            if (!take_buffer(pool_index(stage.acquire), *thread.frame))
+            {
+                return false;
+            }
+            start_service(thread);
+            return true;
+        }
+        case SimThread::State::Blocked:
+            return push_outputs(thread);
+        case SimThread::State::Busy:
+            return false;
+        }
+        return false;
+    }
+
+    // Lets every thread move until nothing changes at this instant
+    void advance()
+    {
+        bool progress = true;
+        while (progress)
+        {
+            progress = false;
+            for (auto &thread : m_threads)
+            {
+                progress |= step(thread);
+            }
+        }
+    }
+
+    SimResult collect()
+    {
+        SimResult result;
+        result.seconds = std::max(0.0, m_end_us - m_warmup_us) / 1e6;
+        result.captured = m_captured;
+        result.lost_at_source = m_lost_at_source;
+        double measured_us = std::max(1.0, m_end_us - m_warmup_us);
+
+        for (size_t i = 0; i < m_branch_latency.size(); i++)
+        {
+            BranchResult branch;
+            branch.name = m_config.branches.empty() ? m_threads.back().name : m_config.branches[i];
+            branch.completed = m_branch_completed[i];
+            branch.fps = static_cast<double>(branch.completed) / std::max(result.seconds, 1e-9);
+            branch.latency_ms = m_branch_latency[i];
+            std::sort(branch.latency_ms.begin(), branch.latency_ms.end());
+            result.branches.push_back(branch);
+        }
+        for (auto &thread : m_threads)
+        {
+            set_state(thread, thread.state); // account the time up to the end
+            SimQueue &queue = m_queues[thread.input];
+            touch(queue);
+            ThreadResult item;
+            item.name = thread.name;
+            item.queue_capacity = queue.capacity;
+            item.queue_mean = queue.area / measured_us;
+            item.queue_max = queue.max;
+            item.leaked = queue.leaked;
+            item.busy = thread.busy_us / measured_us;
+            item.blocked = thread.blocked_us / measured_us;
+            item.pool_wait = thread.pool_wait_us / measured_us;
+            result.threads.push_back(item);
+        }
+        for (size_t i = 0; i < m_pools.size(); i++)
+        {
+            touch(m_pools[i]);
+            PoolResult pool;
+            pool.name = m_config.pools[i].name;
+            pool.size = m_pools[i].size;
+            pool.mean_in_use = m_pools[i].area / measured_us;
+            pool.max_in_use = m_pools[i].max_in_use;
+            pool.exhausted = m_pools[i].exhausted;
+            result.pools.push_back(pool);
+        }
+        return result;
+    }
+
+    SimConfig m_config;
+    std::mt19937_64 m_rng;
+    std::vector<SimQueue> m_queues;
+    std::vector<SimThread> m_threads;
+    std::vector<SimPool> m_pools;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> m_events;
+    uint64_t m_sequence = 0;
+    double m_now = 0;
+    double m_warmup_us = 0;
+    double m_end_us = 0;
+    uint64_t m_captured = 0;
+    uint64_t m_lost_at_source = 0;
+    std::vector<std::vector<double>> m_branch_latency;
+    std::vector<uint64_t> m_branch_completed;
+};
+
+} // namespace
+
+SimResult Simulator::run(double duration_s, double warmup_s)
+{
+    Engine engine(m_config, m_seed);
+    return engine.run(duration_s, warmup_s);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "sim_config.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Discrete-event model of a GStreamer pipeline described by SimConfig.
+ *
+ * Every queue starts a streaming thread; a thread takes the oldest frame
+ * of its queue, runs it through its stages one after the other (service
+ * time drawn per frame and stage) and pushes it into the next queue(s).
+ * A full leaky=no queue blocks the pushing thread until the consumer
+ * takes a frame, which is how back pressure travels upstream; a leaky
+ * queue drops instead and counts the drop. The trunk ends in a tee: the
+ * frame is pushed into the first queue of every branch in order, like
+ * tee does, and its pool buffers return once every branch is done with
+ * it. The source captures on its own clock into the first thread (the
+ * source thread, which holds the stages before the first queue); with
+ * the source pool empty at capture time the frame is lost.
+ *
+ * Everything before warmup only fills the pipeline; the result covers
+ * frames captured after it, utilizations and occupancies are time
+ * weighted over the measured time.
+ *********************************************************************/
+
+struct BranchResult
+{
+    std::string name;
+    uint64_t completed = 0;
+    double fps = 0;
+    std::vector<double> latency_ms; // capture -> end of the last stage of the branch, sorted
+};
+
+struct ThreadResult
+{
+    std::string name;      // stages of the thread joined by '+'
+    int queue_capacity = 0; // -1 for the source thread
+    double queue_mean = 0;
+    size_t queue_max = 0;
+    uint64_t leaked = 0;   // frames dropped by a leaky queue in front of the thread
+    double busy = 0;       // fraction of the measured time in service
+    double blocked = 0;    // ... waiting for space in the next queue
+    double pool_wait = 0;  // ... waiting for a pool buffer
+};
+
+struct PoolResult
+{
+    std::string name;
+    int size = 0;
+    double mean_in_use = 0;
+    int max_in_use = 0;
+    uint64_t exhausted = 0; // source captures lost, pool empty
+};
+
+struct SimResult
+{
+    double seconds = 0;      // measured time, after warmup
+    uint64_t captured = 0;   // capture attempts after warmup
+    uint64_t lost_at_source = 0;
+    std::vector<BranchResult> branches;
+    std::vector<ThreadResult> threads;
+    std::vector<PoolResult> pools;
+};
+
+double percentile(const std::vector<double> &sorted, double fraction);
+
+class Simulator
+{
+  public:
+    Simulator(const SimConfig &config, uint64_t seed) : m_config(config), m_seed(seed) {}
+
+    SimResult run(double duration_s, double warmup_s);
+
+  private:
+    SimConfig m_config;
+    uint64_t m_seed;
+};
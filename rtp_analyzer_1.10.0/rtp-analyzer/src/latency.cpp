@@ -0,0 +1,197 @@
+#include "latency.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Must match gsttimestampsei.h
+static const char sei_uuid[] = "hailo-capture-ts";
+static constexpr size_t sei_payload_size = 16 + 8 + 4;
+static constexpr size_t sync_request_size = 16;
+static constexpr size_t sync_reply_size = 32;
+static constexpr uint8_t nal_sei = 6;
+static constexpr uint8_t sei_user_data_unregistered = 5;
+
+static constexpr size_t sync_samples = 8;
+static constexpr int64_t sync_period_us = 1000000;
+static constexpr int64_t sync_warmup_period_us = 100000;
+
+static uint64_t read_be(const uint8_t *data, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        value = value << 8 | data[i];
+    }
+    return value;
+}
+
+static void write_be(uint8_t *out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        out[i] = static_cast<uint8_t>(value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+bool parse_timestamp_sei(const uint8_t *nal, size_t size, int64_t &capture_us, uint32_t &frame_index)
+{
+    if (size < 2 || (nal[0] & 0x1f) != nal_sei)
+    {
+        return false;
+    }
+
+    // Only the first message is looked at, timestampsei writes a NAL of its own
+    uint8_t rbsp[64];
+    size_t rbsp_size = 0;
+    int zeros = 0;
+    for (size_t i = 1; i < size && rbsp_size < sizeof(rbsp); i++)
+    {
+        if (zeros >= 2 && nal[i] == 3)
+        {
+            zeros = 0;
+            continue;
+        }
+        rbsp[rbsp_size++] = nal[i];
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+    }
+    if (rbsp_size < 2 + sei_payload_size || rbsp[0] != sei_user_data_unregistered || rbsp[1] != sei_payload_size ||
+        memcmp(rbsp + 2, sei_uuid, 16) != 0)
+    {
+        return false;
+    }
+    capture_us = static_cast<int64_t>(read_be(rbsp + 18, 8));
+    frame_index = static_cast<uint32_t>(read_be(rbsp + 26, 4));
+    return true;
+}
+
+std::vector<uint8_t> build_timestamp_sei(int64_t capture_us, uint32_t frame_index)
+{
+    uint8_t rbsp[2 + sei_payload_size + 1];
+    rbsp[0] = sei_user_data_unregistered;
+    rbsp[1] = sei_payload_size;
+    memcpy(rbsp + 2, sei_uuid, 16);
+    write_be(rbsp + 18, static_cast<uint64_t>(capture_us), 8);
+    write_be(rbsp + 26, frame_index, 4);
+    rbsp[sizeof(rbsp) - 1] = 0x80;
+
+    std::vector<uint8_t> nal = {nal_sei};
+    int zeros = 0;
+    for (uint8_t byte : rbsp)
+    {
+        if (zeros >= 2 && byte <= 3)
+        {
+            nal.push_back(3);
+            zeros = 0;
+        }
+        nal.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    return nal;
+}
+
+std::vector<uint8_t> build_sync_request(uint32_t sequence, int64_t t1_us)
+{
+    std::vector<uint8_t> request(sync_request_size);
+    memcpy(request.data(), "TSYQ", 4);
+    write_be(request.data() + 4, sequence, 4);
+    write_be(request.data() + 8, static_cast<uint64_t>(t1_us), 8);
+    return request;
+}
+
+std::vector<uint8_t> build_sync_reply(const uint8_t *request, size_t size, int64_t t2_us, int64_t t3_us)
+{
+    if (size != sync_request_size || memcmp(request, "TSYQ", 4) != 0)
+    {
+        return {};
+    }
+    std::vector<uint8_t> reply(sync_reply_size);
+    memcpy(reply.data(), "TSYR", 4);
+    memcpy(reply.data() + 4, request + 4, 12);
+    write_be(reply.data() + 16, static_cast<uint64_t>(t2_us), 8);
+    write_be(reply.data() + 24, static_cast<uint64_t>(t3_us), 8);
+    return reply;
+}
+
+bool ClockSync::open(const std::string &target)
+{
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos)
+    {
+        std::cerr << "[SYNC] Expected host:port, got " << target << std::endl;
+        return false;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(target.substr(0, colon).c_str(), target.substr(colon + 1).c_str(), &hints, &result) != 0)
+    {
+        std::cerr << "[SYNC] Cannot resolve " << target << std::endl;
+        return false;
+    }
+    // Connected socket: replies from anywhere else are dropped by the kernel
+    m_fd = socket(result->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 || connect(m_fd, result->ai_addr, result->ai_addrlen) < 0)
+    {
+        std::cerr << "[SYNC] Cannot connect to " << target << std::endl;
+        freeaddrinfo(result);
+        close();
+        return false;
+    }
+    freeaddrinfo(result);
+    return true;
+}
+
+void ClockSync::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void ClockSync::send_request(int64_t now_us)
+{
+    auto request = build_sync_request(++m_sequence, now_us);
+    send(m_fd, request.data(), request.size(), 0);
+    m_next_request_us = now_us + (m_replies < sync_samples ? sync_warmup_period_us : sync_period_us);
+}
+
+void ClockSync::on_readable(int64_t now_us)
+{
+    uint8_t reply[64];
+    ssize_t length;
+    while ((length = recv(m_fd, reply, sizeof(reply), 0)) > 0)
+    {
+        if (static_cast<size_t>(length) != sync_reply_size || memcmp(reply, "TSYR", 4) != 0)
+        {
+            continue;
+        }
+        int64_t t1 = static_cast<int64_t>(read_be(reply + 8, 8));
+        int64_t t2 = static_cast<int64_t>(read_be(reply + 16, 8));
+        int64_t t3 = static_cast<int64_t>(read_be(reply + 24, 8));
+        int64_t t4 = now_us;
+        int64_t rtt = (t4 - t1) - (t3 - t2);
+        if (rtt < 0)
+        {
+            continue;
+        }
+
+        m_samples.push_back({((t2 - t1) + (t3 - t4)) / 2, rtt});
+        if (m_samples.size() > sync_samples)
+        {
+            m_samples.pop_front();
+        }
+        auto best = std::min_element(m_samples.begin(), m_samples.end(),
+                                     [](const Sample &a, const Sample &b) { return a.rtt_us < b.rtt_us; });
+        m_offset_us = best->offset_us;
+        m_rtt_us = best->rtt_us;
+        m_valid = true;
+        m_replies++;
+    }
+}
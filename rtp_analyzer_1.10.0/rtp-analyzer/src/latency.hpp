@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Capture-to-host latency from the timestampsei element
+ * (gstrawcapturebypass/gsttimestampsei.h has the wire formats).
+ *
+ * Every access unit carries a user_data_unregistered SEI with the
+ * capture time on the device clock. The host clock is mapped to the
+ * device clock with an NTP style exchange against the element's sync
+ * port: offset = ((t2 - t1) + (t3 - t4)) / 2, taken from the sample
+ * with the lowest round trip of the last few (its error is at most
+ * rtt / 2 and usually far less on a direct link). Without --sync the
+ * clocks are assumed to be synchronized already (NTP / PTP), offset 0.
+ *********************************************************************/
+
+// SEI NAL (starting at the NAL header, emulation prevention bytes included) -> capture time on the device clock.
+// False for any other SEI.
+bool parse_timestamp_sei(const uint8_t *nal, size_t size, int64_t &capture_us, uint32_t &frame_index);
+
+// Builds the same NAL (without start code), for rtp_test_sender.
+std::vector<uint8_t> build_timestamp_sei(int64_t capture_us, uint32_t frame_index);
+
+// Request / reply of the clock sync exchange; t2 / t3 on the device clock.
+std::vector<uint8_t> build_sync_request(uint32_t sequence, int64_t t1_us);
+std::vector<uint8_t> build_sync_reply(const uint8_t *request, size_t size, int64_t t2_us, int64_t t3_us);
+
+class ClockSync
+{
+  public:
+    // target "host:port" of a timestampsei sync-port
+    bool open(const std::string &target);
+    void close();
+    int fd() const { return m_fd; }
+
+    // Next request is due at next_request_us(); faster until the first samples are in.
+    void send_request(int64_t now_us);
+    int64_t next_request_us() const { return m_next_request_us; }
+    void on_readable(int64_t now_us);
+
+    bool valid() const { return m_valid; }
+    int64_t offset_us() const { return m_offset_us; } // device clock - host clock
+    int64_t rtt_us() const { return m_rtt_us; }
+    uint64_t replies() const { return m_replies; }
+
+  private:
+    struct Sample
+    {
+        int64_t offset_us;
+        int64_t rtt_us;
+    };
+
+    int m_fd = -1;
+    uint32_t m_sequence = 0;
+    int64_t m_next_request_us = 0;
+    std::deque<Sample> m_samples;
+    bool m_valid = false;
+    int64_t m_offset_us = 0;
+    int64_t m_rtt_us = 0;
+    uint64_t m_replies = 0;
+};
@@ -0,0 +1,500 @@
+#include "latency.hpp"
+#include "rtcp_feedback.hpp"
+#include "rtp_stream.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*********************************************************************
+ * rtp_analyzer: host side receiver for the RTP/H.264 streams of the
+ * device (gst_cycle, medialib_gst_runner, detection_rawcapture.sh).
+ *
+ * Binds one UDP socket per port, drains them with recvmmsg from a
+ * single epoll loop and feeds every packet with its kernel receive
+ * timestamp into an RtpStreamAnalyzer (rtp_stream.hpp). Nothing is
+ * decoded. Every --interval ms one [RTP] line per port shows pps, kbps,
+ * fps, loss, reordering, jitter and frame sizes / arrival intervals; on
+ * Ctrl-C or after --duration a [SUMMARY] per port is printed and, with
+ * --json, written to a file.
+ * Streams stamped by timestampsei (--timestamp-sei on the device) also
+ * get capture-to-host latency per frame (latency.hpp); --sync points at
+ * the element's sync port to estimate the device clock offset.
+ * --feedback sends RTCP receiver reports plus the queueing delay to the
+ * sender (rtcp_feedback.hpp) every --feedback-interval ms, for the
+ * adaptive bitrate controller of medialib_gst_runner --abr.
+ * --simulate-loss drops received packets at random (percent) before
+ * they are analyzed, so the feedback loop can be tried over loopback.
+ *
+ * Usage: rtp_analyzer [--port <base>] [--streams <n>] [--ports <p,p,...>]
+ *                     [--bind <addr>] [--interval <ms>] [--duration <s>]
+ *                     [--rcvbuf <bytes>] [--clock-rate <hz>] [--sync <host:port>]
+ *                     [--feedback <host:port>] [--feedback-interval <ms>]
+ *                     [--simulate-loss <pct>] [--json <path>] [--quiet]
+ * e.g. on the aging host (device streams to 10.0.0.2:5000):
+ *   rtp_analyzer --port 5000 --streams 1 | tee rtp_analyzer.log
+ *   rtp_analyzer --port 5000 --sync 10.0.0.1:5990   (latency, device clock offset)
+ *   rtp_analyzer --port 5000 --feedback 10.0.0.1:5100  (medialib_gst_runner --abr)
+ *********************************************************************/
+
+struct AnalyzerOptions
+{
+    std::vector<int> ports;
+    int base_port = 5000;
+    int streams = 1;
+    std::string bind_address = "0.0.0.0";
+    int interval_ms = 1000;
+    int duration_s = 0;
+    int rcvbuf = 8 * 1024 * 1024;
+    uint32_t clock_rate = 90000;
+    std::string sync_target; // timestampsei sync-port, empty = clocks already synchronized
+    std::string feedback_target; // RTCP feedback destination, empty = none
+    int feedback_interval_ms = 250;
+    double simulate_loss_pct = 0;
+    std::string json_path;
+    bool quiet = false;
+};
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void handle_stop(int)
+{
+    g_stop = 1;
+}
+
+// Realtime clock in us, the same clock SO_TIMESTAMPNS stamps packets with
+static int64_t realtime_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+static void print_usage(const char *program_name)
+{
+    std::cerr << "Usage: " << program_name << " [options]" << std::endl;
+    std::cerr << "  --port <port>          First UDP port (default: 5000)" << std::endl;
+    std::cerr << "  --streams <n>          Ports port .. port + n - 1 (default: 1)" << std::endl;
+    std::cerr << "  --ports <p,p,...>      Explicit port list instead of --port / --streams" << std::endl;
+    std::cerr << "  --bind <addr>          Local address (default: 0.0.0.0)" << std::endl;
+    std::cerr << "  --interval <ms>        Live report period, 0 = summary only (default: 1000)" << std::endl;
+    std::cerr << "  --duration <s>         Stop after s seconds (default: until Ctrl-C)" << std::endl;
+    std::cerr << "  --rcvbuf <bytes>       Socket receive buffer (default: 8 MB)" << std::endl;
+    std::cerr << "  --clock-rate <hz>      RTP clock rate (default: 90000)" << std::endl;
+    std::cerr << "  --sync <host:port>     Estimate the device clock offset against timestampsei sync-port" << std::endl;
+    std::cerr << "                         (default: none, device and host clocks assumed synchronized)" << std::endl;
+    std::cerr << "  --feedback <host:port> Send RTCP receiver reports + queueing delay to the sender" << std::endl;
+    std::cerr << "  --feedback-interval <ms> Feedback period (default: 250)" << std::endl;
+    std::cerr << "  --simulate-loss <pct>  Drop received packets at random before analysis" << std::endl;
+    std::cerr << "  --json <path>          Write the summary as JSON" << std::endl;
+    std::cerr << "  --quiet                No live report" << std::endl;
+}
+
+static bool parse_options(int argc, char *argv[], AnalyzerOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc)
+        {
+            options.base_port = std::stoi(argv[++i]);
+        }
+        else if (arg == "--streams" && i + 1 < argc)
+        {
+            options.streams = std::stoi(argv[++i]);
+        }
+        else if (arg == "--ports" && i + 1 < argc)
+        {
+            std::stringstream list(argv[++i]);
+            std::string port;
+            while (std::getline(list, port, ','))
+            {
+                options.ports.push_back(std::stoi(port));
+            }
+        }
+        else if (arg == "--bind" && i + 1 < argc)
+        {
+            options.bind_address = argv[++i];
+        }
+        else if (arg == "--interval" && i + 1 < argc)
+        {
+            options.interval_ms = std::stoi(argv[++i]);
+        }
+        else if (arg == "--duration" && i + 1 < argc)
+        {
+            options.duration_s = std::stoi(argv[++i]);
+        }
+        else if (arg == "--rcvbuf" && i + 1 < argc)
+        {
+            options.rcvbuf = std::stoi(argv[++i]);
+        }
+        else if (arg == "--clock-rate" && i + 1 < argc)
+        {
+            options.clock_rate = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--sync" && i + 1 < argc)
+        {
+            options.sync_target = argv[++i];
+        }
+        else if (arg == "--feedback" && i + 1 < argc)
+        {
+            options.feedback_target = argv[++i];
+        }
+        else if (arg == "--feedback-interval" && i + 1 < argc)
+        {
+            options.feedback_interval_ms = std::max(10, std::stoi(argv[++i]));
+        }
+        else if (arg == "--simulate-loss" && i + 1 < argc)
+        {
+            options.simulate_loss_pct = std::stod(argv[++i]);
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            options.json_path = argv[++i];
+        }
+        else if (arg == "--quiet")
+        {
+            options.quiet = true;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (options.ports.empty())
+    {
+        for (int i = 0; i < options.streams; i++)
+        {
+            options.ports.push_back(options.base_port + i);
+        }
+    }
+    return true;
+}
+
+static int open_socket(const AnalyzerOptions &options, int port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("[RTP] socket");
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, sizeof(options.rcvbuf));
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, options.bind_address.c_str(), &addr.sin_addr) != 1 ||
+        bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        std::cerr << "[RTP] Cannot bind " << options.bind_address << ":" << port << ": " << strerror(errno)
+                  << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct PortReceiver
+{
+    int fd = -1;
+    std::unique_ptr<RtpStreamAnalyzer> analyzer;
+    uint64_t simulated_drops = 0;
+};
+
+// Drains one socket; packets are stamped with the kernel receive time when available.
+static void drain_socket(PortReceiver &receiver, double simulate_loss_pct)
+{
+    static std::mt19937 random(std::random_device{}());
+    static std::uniform_real_distribution<double> percent(0.0, 100.0);
+    constexpr int batch = 64;
+    constexpr size_t control_size = CMSG_SPACE(sizeof(struct timespec));
+    static uint8_t buffers[batch][2048];
+    static char controls[batch][control_size];
+    struct mmsghdr messages[batch];
+    struct iovec iovecs[batch];
+
+    while (true)
+    {
+        for (int i = 0; i < batch; i++)
+        {
+            iovecs[i] = {buffers[i], sizeof(buffers[i])};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = control_size;
+        }
+        int received = recvmmsg(receiver.fd, messages, batch, MSG_DONTWAIT, nullptr);
+        if (received <= 0)
+        {
+            return;
+        }
+        int64_t now_us = realtime_us();
+        for (int i = 0; i < received; i++)
+        {
+            int64_t arrival_us = now_us;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg;
+                 cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    arrival_us = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+                }
+            }
+            if (simulate_loss_pct > 0 && percent(random) < simulate_loss_pct)
+            {
+                receiver.simulated_drops++;
+                continue;
+            }
+            receiver.analyzer->on_packet(buffers[i], messages[i].msg_len, arrival_us);
+        }
+        if (received < batch)
+        {
+            return;
+        }
+    }
+}
+
+static void print_interval(int port, const StreamInterval &interval)
+{
+    double seconds = interval.seconds > 0 ? interval.seconds : 1.0;
+    std::cout << std::fixed << std::setprecision(1) << "[RTP] port=" << port << " pps=" << interval.packets / seconds
+              << " kbps=" << interval.bytes * 8 / 1000.0 / seconds << " fps=" << interval.frames / seconds
+              << " keyframes=" << interval.keyframes << " lost=" << interval.lost
+              << " reordered=" << interval.reordered << " dup=" << interval.duplicates
+              << " incomplete=" << interval.incomplete_frames << std::setprecision(2)
+              << " jitter_ms=" << interval.jitter_ms << std::setprecision(1)
+              << " frame_kb_mean=" << (interval.frames ? interval.frame_bytes / 1024.0 / interval.frames : 0.0)
+              << " frame_kb_max=" << interval.max_frame_bytes / 1024.0
+              << " frame_interval_max_ms=" << interval.max_frame_interval_ms;
+    if (interval.latency_frames)
+    {
+        std::cout << " latency_ms_mean=" << interval.latency_sum_ms / interval.latency_frames
+                  << " latency_ms_max=" << interval.latency_max_ms;
+    }
+    std::cout << std::endl;
+}
+
+static std::string summary_json(int port, const StreamSummary &summary, const ClockSync &sync)
+{
+    std::stringstream out;
+    out << std::fixed << std::setprecision(3) << "{\"port\": " << port << ", \"seconds\": " << summary.seconds
+        << ", \"packets\": " << summary.packets << ", \"bytes\": " << summary.bytes
+        << ", \"expected\": " << summary.expected << ", \"lost\": " << summary.lost
+        << ", \"loss_pct\": " << (summary.expected ? 100.0 * summary.lost / summary.expected : 0.0)
+        << ", \"reordered\": " << summary.reordered << ", \"duplicates\": " << summary.duplicates
+        << ", \"ssrc_changes\": " << summary.ssrc_changes << ", \"frames\": " << summary.frames
+        << ", \"keyframes\": " << summary.keyframes << ", \"incomplete_frames\": " << summary.incomplete_frames
+        << ", \"fps\": " << (summary.seconds > 0 ? summary.frames / summary.seconds : 0.0)
+        << ", \"kbps\": " << (summary.seconds > 0 ? summary.bytes * 8 / 1000.0 / summary.seconds : 0.0)
+        << ", \"jitter_ms\": " << summary.jitter_ms << ", \"max_jitter_ms\": " << summary.max_jitter_ms
+        << ", \"mean_frame_bytes\": " << summary.mean_frame_bytes << ", \"max_frame_bytes\": " << summary.max_frame_bytes
+        << ", \"frame_interval_ms\": {\"p50\": " << summary.frame_interval_p50_ms
+        << ", \"p95\": " << summary.frame_interval_p95_ms << ", \"p99\": " << summary.frame_interval_p99_ms
+        << ", \"max\": " << summary.frame_interval_max_ms << "}";
+    if (summary.latency_frames)
+    {
+        out << ", \"latency_ms\": {\"frames\": " << summary.latency_frames << ", \"mean\": " << summary.latency_mean_ms
+            << ", \"p50\": " << summary.latency_p50_ms << ", \"p95\": " << summary.latency_p95_ms
+            << ", \"p99\": " << summary.latency_p99_ms << ", \"max\": " << summary.latency_max_ms
+            << ", \"clock_sync\": " << (sync.valid() ? "true" : "false")
+            << ", \"clock_offset_ms\": " << sync.offset_us() / 1000.0 << ", \"sync_rtt_ms\": " << sync.rtt_us() / 1000.0
+            << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
+int main(int argc, char *argv[])
+{
+    AnalyzerOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<PortReceiver> receivers(options.ports.size());
+    for (size_t i = 0; i < options.ports.size(); i++)
+    {
+        receivers[i].fd = open_socket(options, options.ports[i]);
+        if (receivers[i].fd < 0)
+        {
+            return 1;
+        }
+        receivers[i].analyzer = std::make_unique<RtpStreamAnalyzer>(options.ports[i], options.clock_rate);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<uint32_t>(i);
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, receivers[i].fd, &event);
+        std::cout << "[RTP] Listening on " << options.bind_address << ":" << options.ports[i] << std::endl;
+    }
+
+    // The sync socket shares the epoll loop, its index is one past the receivers
+    ClockSync sync;
+    const uint32_t sync_index = static_cast<uint32_t>(receivers.size());
+    if (!options.sync_target.empty())
+    {
+        if (!sync.open(options.sync_target))
+        {
+            return 1;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = sync_index;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sync.fd(), &event);
+        for (auto &receiver : receivers)
+        {
+            receiver.analyzer->require_clock_offset();
+        }
+        std::cout << "[SYNC] Clock sync against " << options.sync_target << std::endl;
+    }
+
+    RtcpFeedback feedback;
+    if (!options.feedback_target.empty())
+    {
+        if (!feedback.open(options.feedback_target))
+        {
+            return 1;
+        }
+        std::cout << "[FEEDBACK] RTCP receiver reports to " << options.feedback_target << " every "
+                  << options.feedback_interval_ms << " ms" << std::endl;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    int64_t start_us = realtime_us();
+    int64_t next_report_us = start_us + options.interval_ms * 1000LL;
+    int64_t end_us = options.duration_s > 0 ? start_us + options.duration_s * 1000000LL : 0;
+    int64_t next_feedback_us = start_us + options.feedback_interval_ms * 1000LL;
+    bool live = options.interval_ms > 0 && !options.quiet;
+    struct epoll_event events[16];
+    while (!g_stop)
+    {
+        int64_t now_us = realtime_us();
+        if (end_us && now_us >= end_us)
+        {
+            break;
+        }
+        int64_t wake_us = live ? next_report_us : now_us + 100000;
+        if (end_us)
+        {
+            wake_us = std::min(wake_us, end_us);
+        }
+        if (sync.fd() >= 0)
+        {
+            if (now_us >= sync.next_request_us())
+            {
+                sync.send_request(now_us);
+            }
+            wake_us = std::min(wake_us, sync.next_request_us());
+        }
+        if (feedback.is_open())
+        {
+            wake_us = std::min(wake_us, next_feedback_us);
+        }
+        int timeout_ms = static_cast<int>(std::max<int64_t>(0, (wake_us - now_us + 999) / 1000));
+        int ready = epoll_wait(epoll_fd, events, 16, timeout_ms);
+        for (int i = 0; i < ready; i++)
+        {
+            if (events[i].data.u32 == sync_index)
+            {
+                bool was_valid = sync.valid();
+                int64_t previous_offset_us = sync.offset_us();
+                sync.on_readable(realtime_us());
+                if (sync.valid() && (!was_valid || sync.offset_us() != previous_offset_us))
+                {
+                    for (auto &receiver : receivers)
+                    {
+                        receiver.analyzer->set_clock_offset(sync.offset_us());
+                    }
+                    if (!was_valid)
+                    {
+                        std::cout << std::fixed << std::setprecision(3) << "[SYNC] offset_ms=" << sync.offset_us() / 1000.0
+                                  << " rtt_ms=" << sync.rtt_us() / 1000.0 << std::endl;
+                    }
+                }
+                continue;
+            }
+            drain_socket(receivers[events[i].data.u32], options.simulate_loss_pct);
+        }
+
+        now_us = realtime_us();
+        if (feedback.is_open() && now_us >= next_feedback_us)
+        {
+            std::vector<ReceptionReport> reports;
+            for (auto &receiver : receivers)
+            {
+                reports.push_back(receiver.analyzer->take_report(now_us));
+            }
+            feedback.send(reports);
+            next_feedback_us = std::max<int64_t>(next_feedback_us + options.feedback_interval_ms * 1000LL, now_us);
+        }
+        if (live && now_us >= next_report_us)
+        {
+            for (auto &receiver : receivers)
+            {
+                print_interval(receiver.analyzer->port(), receiver.analyzer->take_interval(now_us));
+            }
+            if (sync.valid())
+            {
+                std::cout << std::fixed << std::setprecision(3) << "[SYNC] offset_ms=" << sync.offset_us() / 1000.0
+                          << " rtt_ms=" << sync.rtt_us() / 1000.0 << " replies=" << sync.replies() << std::endl;
+            }
+            next_report_us += options.interval_ms * 1000LL;
+        }
+    }
+
+    std::vector<std::string> summaries;
+    for (auto &receiver : receivers)
+    {
+        summaries.push_back(summary_json(receiver.analyzer->port(), receiver.analyzer->summary(), sync));
+        std::cout << "[SUMMARY] " << summaries.back() << std::endl;
+        if (receiver.simulated_drops)
+        {
+            std::cout << "[SUMMARY] port=" << receiver.analyzer->port() << " simulated_drops=" << receiver.simulated_drops
+                      << std::endl;
+        }
+        close(receiver.fd);
+    }
+    sync.close();
+    feedback.close();
+    close(epoll_fd);
+
+    if (!options.json_path.empty())
+    {
+        std::ofstream json(options.json_path, std::ios::trunc);
+        json << "{\"streams\": [";
+        for (size_t i = 0; i < summaries.size(); i++)
+        {
+            json << (i ? ", " : "") << summaries[i];
+        }
+        json << "]}" << std::endl;
+        std::cout << "[SUMMARY] Written to " << options.json_path << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "rtcp_feedback.hpp"
+#include <iostream>
+#include <random>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr uint8_t rtcp_rr = 201;
+static constexpr uint8_t rtcp_app = 204;
+static constexpr size_t max_report_blocks = 31;
+
+static void put_be32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+// Header with the length field filled in once the packet is complete
+static size_t begin_packet(std::vector<uint8_t> &out, uint8_t count, uint8_t type)
+{
+    size_t start = out.size();
+    out.push_back(static_cast<uint8_t>(0x80 | count));
+    out.push_back(type);
+    out.push_back(0);
+    out.push_back(0);
+    return start;
+}
+
+static void end_packet(std::vector<uint8_t> &out, size_t start)
+{
+    size_t words = (out.size() - start) / 4 - 1;
+    out[start + 2] = static_cast<uint8_t>(words >> 8);
+    out[start + 3] = static_cast<uint8_t>(words);
+}
+
+std::vector<uint8_t> build_receiver_feedback(uint32_t sender_ssrc, const std::vector<ReceptionReport> &reports)
+{
+    std::vector<const ReceptionReport *> valid;
+    for (const auto &report : reports)
+    {
+        if (report.valid && valid.size() < max_report_blocks)
+        {
+            valid.push_back(&report);
+        }
+    }
+
+    std::vector<uint8_t> out;
+    size_t rr = begin_packet(out, static_cast<uint8_t>(valid.size()), rtcp_rr);
+    put_be32(out, sender_ssrc);
+    for (const auto *report : valid)
+    {
+        put_be32(out, report->ssrc);
+        put_be32(out, static_cast<uint32_t>(report->fraction_lost) << 24 |
+                          (static_cast<uint32_t>(report->cumulative_lost) & 0xffffff));
+        put_be32(out, report->highest_sequence);
+        put_be32(out, report->jitter);
+        put_be32(out, 0); // LSR
+        put_be32(out, 0); // DLSR
+    }
+    end_packet(out, rr);
+
+    if (!valid.empty())
+    {
+        size_t app = begin_packet(out, 0, rtcp_app);
+        put_be32(out, sender_ssrc);
+        out.insert(out.end(), {'Q', 'D', 'L', 'Y'});
+        for (const auto *report : valid)
+        {
+            put_be32(out, report->ssrc);
+            put_be32(out, report->queue_delay_us);
+        }
+        end_packet(out, app);
+    }
+    return out;
+}
+
+bool RtcpFeedback::open(const std::string &target)
+{
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos)
+    {
+        std::cerr << "[FEEDBACK] Expected host:port, got " << target << std::endl;
+        return false;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(target.substr(0, colon).c_str(), target.substr(colon + 1).c_str(), &hints, &result) != 0)
+    {
+        std::cerr << "[FEEDBACK] Cannot resolve " << target << std::endl;
+        return false;
+    }
+    m_fd = socket(result->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 || connect(m_fd, result->ai_addr, result->ai_addrlen) < 0)
+    {
+        std::cerr << "[FEEDBACK] Cannot connect to " << target << std::endl;
+        freeaddrinfo(result);
+        close();
+        return false;
+    }
+    freeaddrinfo(result);
+    m_ssrc = std::random_device()();
+    return true;
+}
+
+void RtcpFeedback::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void RtcpFeedback::send(const std::vector<ReceptionReport> &reports)
+{
+    auto packet = build_receiver_feedback(m_ssrc, reports);
+    // A refused send (nobody listening yet) is not an error, the next report tries again
+    if (::send(m_fd, packet.data(), packet.size(), 0) == static_cast<ssize_t>(packet.size()))
+    {
+        m_packets_sent++;
+    }
+}
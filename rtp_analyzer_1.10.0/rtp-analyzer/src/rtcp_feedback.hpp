@@ -0,0 +1,37 @@
+#pragma once
+
+#include "rtp_stream.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Receiver feedback for the sender's bitrate controller
+ * (medialib_gst_runner --abr, bitrate_controller.hpp).
+ *
+ * One RTCP compound packet per --feedback-interval to host:port:
+ *  - RR (PT 201): one RFC 3550 report block per stream (SSRC, fraction
+ *    lost, cumulative lost, extended highest sequence, jitter; LSR/DLSR
+ *    are 0, there is no SR to refer to)
+ *  - APP (PT 204, name "QDLY"): per stream SSRC + queueing delay in us,
+ *    see RtpStreamAnalyzer::take_report()
+ * Any other RTCP receiver (rtpbin, ffmpeg) can feed the controller with
+ * plain RRs; it then reacts to loss only.
+ *********************************************************************/
+
+std::vector<uint8_t> build_receiver_feedback(uint32_t sender_ssrc, const std::vector<ReceptionReport> &reports);
+
+class RtcpFeedback
+{
+  public:
+    bool open(const std::string &target); // "host:port"
+    void close();
+    bool is_open() const { return m_fd >= 0; }
+    void send(const std::vector<ReceptionReport> &reports);
+    uint64_t packets_sent() const { return m_packets_sent; }
+
+  private:
+    int m_fd = -1;
+    uint32_t m_ssrc = 0;
+    uint64_t m_packets_sent = 0;
+};
@@ -0,0 +1,439 @@
+#include "rtp_stream.hpp"
+#include "latency.hpp"
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t recent_window = 1024;
+static constexpr int64_t transit_window_us = 10000000;
+static constexpr int64_t no_transit = INT64_MAX;
+// No report block for a stream without packets for this long (RFC 3550 6.4: only active sources are reported)
+static constexpr int64_t report_timeout_us = 1000000;
+
+// H.264 NAL unit types (RFC 6184 payload structures)
+static constexpr uint8_t nal_idr_slice = 5;
+static constexpr uint8_t nal_sei = 6;
+static constexpr uint8_t nal_stap_a = 24;
+static constexpr uint8_t nal_fu_a = 28;
+static constexpr uint64_t start_code_bytes = 4;
+
+static uint16_t read_be16(const uint8_t *data)
+{
+    return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+static uint32_t read_be32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+           static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+bool parse_rtp_header(const uint8_t *data, size_t size, RtpHeader &header)
+{
+    if (size < 12 || (data[0] >> 6) != 2)
+    {
+        return false;
+    }
+    size_t offset = 12 + 4 * (data[0] & 0x0f);
+    if (data[0] & 0x10)
+    {
+        if (offset + 4 > size)
+        {
+            return false;
+        }
+        offset += 4 + 4 * read_be16(data + offset + 2);
+    }
+    size_t padding = (data[0] & 0x20) ? data[size - 1] : 0;
+    if (offset + padding > size)
+    {
+        return false;
+    }
+
+    header.marker = data[1] & 0x80;
+    header.payload_type = data[1] & 0x7f;
+    header.sequence = read_be16(data + 2);
+    header.timestamp = read_be32(data + 4);
+    header.ssrc = read_be32(data + 8);
+    header.payload = data + offset;
+    header.payload_size = size - offset - padding;
+    return true;
+}
+
+double percentile(std::vector<float> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(std::lround(fraction * (values.size() - 1)));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+RtpStreamAnalyzer::RtpStreamAnalyzer(int port, uint32_t clock_rate)
+    : m_port(port), m_clock_rate(clock_rate), m_recent(recent_window, -1), m_report_min_transit(no_transit),
+      m_window_min_transit(no_transit), m_previous_window_min_transit(no_transit)
+{
+}
+
+void RtpStreamAnalyzer::reset_sequence(uint16_t sequence)
+{
+    m_base_sequence = m_highest_sequence = sequence;
+    m_interval_expected_base = m_base_sequence - 1;
+    m_interval_received_base = m_total.packets;
+    std::fill(m_recent.begin(), m_recent.end(), -1);
+    m_have_transit = false;
+    m_ssrc_received_base = m_total.packets;
+    m_report_expected_prior = 0;
+    m_report_received_prior = 0;
+    m_frame = Frame();
+}
+
+int64_t RtpStreamAnalyzer::extend_sequence(uint16_t sequence)
+{
+    // Closest extended number to the highest seen, so wraps and late packets both work
+    int16_t delta = static_cast<int16_t>(sequence - static_cast<uint16_t>(m_highest_sequence));
+    return m_highest_sequence + delta;
+}
+
+bool RtpStreamAnalyzer::seen_before(int64_t extended)
+{
+    int64_t &slot = m_recent[static_cast<size_t>(extended) % recent_window];
+    if (slot == extended)
+    {
+        return true;
+    }
+    slot = extended;
+    return false;
+}
+
+void RtpStreamAnalyzer::update_jitter(uint32_t timestamp, int64_t arrival_us)
+{
+    // RFC 3550 6.4.1, in timestamp units: J += (|D| - J) / 16
+    uint32_t arrival = static_cast<uint32_t>(arrival_us * static_cast<int64_t>(m_clock_rate) / 1000000);
+    int64_t transit = static_cast<uint32_t>(arrival - timestamp);
+    if (m_have_transit)
+    {
+        int32_t d = static_cast<int32_t>(static_cast<uint32_t>(transit - m_last_transit));
+        m_jitter += (std::abs(static_cast<double>(d)) - m_jitter) / 16.0;
+        m_max_jitter_ms = std::max(m_max_jitter_ms, m_jitter * 1000.0 / m_clock_rate);
+    }
+    else
+    {
+        m_transit_reference = static_cast<uint32_t>(transit);
+        m_report_min_transit = m_window_min_transit = m_previous_window_min_transit = no_transit;
+        m_window_start_us = arrival_us;
+    }
+    m_last_transit = transit;
+    m_have_transit = true;
+
+    // Queueing delay baseline: lowest transit over two 10 s windows, so clock drift cannot build up
+    int64_t relative = static_cast<int32_t>(static_cast<uint32_t>(transit) - m_transit_reference);
+    if (arrival_us - m_window_start_us >= transit_window_us)
+    {
+        m_previous_window_min_transit = m_window_min_transit;
+        m_window_min_transit = no_transit;
+        m_window_start_us = arrival_us;
+    }
+    m_window_min_transit = std::min(m_window_min_transit, relative);
+    m_report_min_transit = std::min(m_report_min_transit, relative);
+}
+
+void RtpStreamAnalyzer::on_packet(const uint8_t *data, size_t size, int64_t arrival_us)
+{
+    RtpHeader header;
+    if (!parse_rtp_header(data, size, header))
+    {
+        return;
+    }
+
+    if (!m_started)
+    {
+        m_started = true;
+        m_start_us = m_interval_start_us = arrival_us;
+        m_ssrc = header.ssrc;
+        reset_sequence(header.sequence);
+    }
+    else if (header.ssrc != m_ssrc)
+    {
+        // Sender restarted (e.g. pipeline rebuild on a profile switch)
+        finish_frame();
+        m_total.expected += m_highest_sequence - m_base_sequence + 1;
+        m_total.ssrc_changes++;
+        m_ssrc = header.ssrc;
+        reset_sequence(header.sequence);
+    }
+    m_last_arrival_us = arrival_us;
+
+    int64_t extended = extend_sequence(header.sequence);
+    m_interval.bytes += size;
+    m_total.bytes += size;
+    if (seen_before(extended))
+    {
+        m_interval.duplicates++;
+        m_total.duplicates++;
+        return;
+    }
+    m_interval.packets++;
+    m_total.packets++;
+
+    bool late = extended < m_highest_sequence;
+    if (late)
+    {
+        m_interval.reordered++;
+        m_total.reordered++;
+        m_base_sequence = std::min(m_base_sequence, extended);
+    }
+    else
+    {
+        m_highest_sequence = extended;
+    }
+
+    update_jitter(header.timestamp, arrival_us);
+
+    // A late packet of a frame that was already closed is only counted
+    if (!late || (m_frame.active && header.timestamp == m_frame.timestamp))
+    {
+        add_to_frame(header, extended, arrival_us);
+    }
+}
+
+void RtpStreamAnalyzer::add_to_frame(const RtpHeader &header, int64_t extended, int64_t arrival_us)
+{
+    if (m_frame.active && header.timestamp != m_frame.timestamp)
+    {
+        finish_frame(); // marker packet lost
+    }
+    if (!m_frame.active)
+    {
+        m_frame = Frame();
+        m_frame.active = true;
+        m_frame.timestamp = header.timestamp;
+        m_frame.last_sequence = extended - 1;
+    }
+    if (extended > m_frame.last_sequence + 1)
+    {
+        m_frame.complete = false; // packets of this frame missing
+    }
+    m_frame.last_sequence = std::max(m_frame.last_sequence, extended);
+    m_frame.last_arrival_us = arrival_us;
+
+    const uint8_t *payload = header.payload;
+    size_t size = header.payload_size;
+    if (size == 0)
+    {
+        return;
+    }
+    uint8_t nal_type = payload[0] & 0x1f;
+    if (nal_type == nal_fu_a)
+    {
+        if (size < 2)
+        {
+            m_frame.complete = false;
+            return;
+        }
+        bool start = payload[1] & 0x80;
+        bool end = payload[1] & 0x40;
+        if (start)
+        {
+            if (m_frame.in_fragment)
+            {
+                m_frame.complete = false; // previous fragmented NAL lost its end
+            }
+            m_frame.in_fragment = true;
+            m_frame.bytes += start_code_bytes + 1; // reconstructed NAL header
+        }
+        else if (!m_frame.in_fragment)
+        {
+            m_frame.complete = false; // fragment without its start
+        }
+        m_frame.bytes += size - 2;
+        m_frame.keyframe |= (payload[1] & 0x1f) == nal_idr_slice;
+        if (end)
+        {
+            m_frame.in_fragment = false;
+        }
+    }
+    else if (nal_type == nal_stap_a)
+    {
+        for (size_t offset = 1; offset + 2 <= size;)
+        {
+            size_t nal_size = read_be16(payload + offset);
+            offset += 2;
+            if (nal_size == 0 || offset + nal_size > size)
+            {
+                m_frame.complete = false;
+                break;
+            }
+            m_frame.keyframe |= (payload[offset] & 0x1f) == nal_idr_slice;
+            check_sei(payload + offset, nal_size);
+            m_frame.bytes += start_code_bytes + nal_size;
+            offset += nal_size;
+        }
+    }
+    else if (nal_type >= 1 && nal_type <= 23)
+    {
+        if (m_frame.in_fragment)
+        {
+            m_frame.complete = false;
+            m_frame.in_fragment = false;
+        }
+        m_frame.keyframe |= nal_type == nal_idr_slice;
+        check_sei(payload, size);
+        m_frame.bytes += start_code_bytes + size;
+    }
+
+    if (header.marker)
+    {
+        finish_frame();
+    }
+}
+
+void RtpStreamAnalyzer::check_sei(const uint8_t *nal, size_t size)
+{
+    int64_t capture_us;
+    uint32_t frame_index;
+    if ((nal[0] & 0x1f) == nal_sei && parse_timestamp_sei(nal, size, capture_us, frame_index))
+    {
+        m_frame.capture_us = capture_us;
+    }
+}
+
+void RtpStreamAnalyzer::finish_frame()
+{
+    if (!m_frame.active)
+    {
+        return;
+    }
+    if (m_frame.in_fragment)
+    {
+        m_frame.complete = false;
+    }
+
+    m_interval.frames++;
+    m_total.frames++;
+    if (m_frame.keyframe)
+    {
+        m_interval.keyframes++;
+        m_total.keyframes++;
+    }
+    if (!m_frame.complete)
+    {
+        m_interval.incomplete_frames++;
+        m_total.incomplete_frames++;
+    }
+    m_interval.frame_bytes += m_frame.bytes;
+    m_total_frame_bytes += m_frame.bytes;
+    m_interval.max_frame_bytes = std::max(m_interval.max_frame_bytes, m_frame.bytes);
+    m_total.max_frame_bytes = std::max(m_total.max_frame_bytes, m_frame.bytes);
+
+    if (m_last_frame_end_us)
+    {
+        double interval_ms = (m_frame.last_arrival_us - m_last_frame_end_us) / 1000.0;
+        m_frame_intervals_ms.push_back(static_cast<float>(interval_ms));
+        m_interval.max_frame_interval_ms = std::max(m_interval.max_frame_interval_ms, interval_ms);
+    }
+    m_last_frame_end_us = m_frame.last_arrival_us;
+
+    // Measured up to the last packet, so packetization and pacing of the frame are included
+    if (m_frame.capture_us && m_have_clock_offset)
+    {
+        double latency_ms = (m_frame.last_arrival_us - (m_frame.capture_us - m_clock_offset_us)) / 1000.0;
+        m_latencies_ms.push_back(static_cast<float>(latency_ms));
+        m_interval.latency_frames++;
+        m_interval.latency_sum_ms += latency_ms;
+        m_interval.latency_max_ms =
+            m_interval.latency_frames == 1 ? latency_ms : std::max(m_interval.latency_max_ms, latency_ms);
+    }
+    m_frame.active = false;
+}
+
+StreamInterval RtpStreamAnalyzer::take_interval(int64_t now_us)
+{
+    StreamInterval interval = m_interval;
+    interval.seconds = (now_us - m_interval_start_us) / 1e6;
+    interval.jitter_ms = m_jitter * 1000.0 / m_clock_rate;
+    if (m_started)
+    {
+        int64_t expected = m_highest_sequence - m_interval_expected_base;
+        int64_t received = static_cast<int64_t>(m_total.packets - m_interval_received_base);
+        interval.lost = expected > received ? expected - received : 0;
+    }
+
+    m_interval = StreamInterval();
+    m_interval_start_us = now_us;
+    m_interval_expected_base = m_highest_sequence;
+    m_interval_received_base = m_total.packets;
+    return interval;
+}
+
+ReceptionReport RtpStreamAnalyzer::take_report(int64_t now_us)
+{
+    ReceptionReport report;
+    if (!m_started || now_us - m_last_arrival_us > report_timeout_us)
+    {
+        return report;
+    }
+    report.valid = true;
+    report.ssrc = m_ssrc;
+
+    // RFC 3550 A.3
+    int64_t expected = m_highest_sequence - m_base_sequence + 1;
+    uint64_t received = m_total.packets - m_ssrc_received_base;
+    int64_t lost = expected - static_cast<int64_t>(received);
+    report.cumulative_lost = static_cast<int32_t>(std::max<int64_t>(-0x800000, std::min<int64_t>(0x7fffff, lost)));
+    int64_t expected_interval = expected - m_report_expected_prior;
+    int64_t lost_interval = expected_interval - static_cast<int64_t>(received - m_report_received_prior);
+    if (expected_interval > 0 && lost_interval > 0)
+    {
+        report.fraction_lost = static_cast<uint8_t>(std::min<int64_t>(255, (lost_interval << 8) / expected_interval));
+    }
+    m_report_expected_prior = expected;
+    m_report_received_prior = received;
+
+    report.highest_sequence = static_cast<uint32_t>(m_highest_sequence);
+    report.jitter = static_cast<uint32_t>(m_jitter);
+
+    int64_t baseline = std::min(m_window_min_transit, m_previous_window_min_transit);
+    if (m_report_min_transit != no_transit && baseline != no_transit && m_report_min_transit > baseline)
+    {
+        report.queue_delay_us =
+            static_cast<uint32_t>((m_report_min_transit - baseline) * 1000000 / static_cast<int64_t>(m_clock_rate));
+    }
+    m_report_min_transit = no_transit;
+    return report;
+}
+
+StreamSummary RtpStreamAnalyzer::summary() const
+{
+    StreamSummary summary = m_total;
+    if (!m_started)
+    {
+        return summary;
+    }
+    summary.expected += m_highest_sequence - m_base_sequence + 1;
+    summary.lost = summary.expected > summary.packets ? summary.expected - summary.packets : 0;
+    summary.seconds = (m_last_arrival_us - m_start_us) / 1e6;
+    summary.jitter_ms = m_jitter * 1000.0 / m_clock_rate;
+    summary.max_jitter_ms = m_max_jitter_ms;
+    summary.mean_frame_bytes = summary.frames ? static_cast<double>(m_total_frame_bytes) / summary.frames : 0.0;
+    summary.frame_interval_p50_ms = percentile(m_frame_intervals_ms, 0.50);
+    summary.frame_interval_p95_ms = percentile(m_frame_intervals_ms, 0.95);
+    summary.frame_interval_p99_ms = percentile(m_frame_intervals_ms, 0.99);
+    summary.frame_interval_max_ms =
+        m_frame_intervals_ms.empty() ? 0.0 : *std::max_element(m_frame_intervals_ms.begin(), m_frame_intervals_ms.end());
+    if (!m_latencies_ms.empty())
+    {
+        double sum = 0;
+        for (float latency : m_latencies_ms)
+        {
+            sum += latency;
+        }
+        summary.latency_frames = m_latencies_ms.size();
+        summary.latency_mean_ms = sum / m_latencies_ms.size();
+        summary.latency_p50_ms = percentile(m_latencies_ms, 0.50);
+        summary.latency_p95_ms = percentile(m_latencies_ms, 0.95);
+        summary.latency_p99_ms = percentile(m_latencies_ms, 0.99);
+        summary.latency_max_ms = *std::max_element(m_latencies_ms.begin(), m_latencies_ms.end());
+    }
+    return summary;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*********************************************************************
+ * Per port RTP / H.264 stream statistics, no decoding.
+ *
+ * Every packet goes through on_packet() with its arrival time:
+ *  - sequence: extended highest sequence number, loss (expected -
+ *    received, RFC 3550 A.3), reordered packets (older than the highest
+ *    seen) and duplicates (sequence seen in the last 1024 packets)
+ *  - jitter: RFC 3550 6.4.1 interarrival jitter, in ms
+ *  - frames: packets are grouped by RTP timestamp; a frame ends with
+ *    the marker bit (or the next timestamp). The H.264 payload is walked
+ *    (single NAL, STAP-A, FU-A) to get the access unit size, the
+ *    keyframe flag (IDR slice) and whether all fragments arrived.
+ *  - frame arrival interval: time between the last packets of two
+ *    consecutive frames
+ *  - latency: frames with a timestampsei SEI (latency.hpp) get
+ *    last packet arrival - capture time, the capture time mapped to the
+ *    host clock with set_clock_offset()
+ * take_interval() returns the counters since the previous call for the
+ * live report, summary() the totals with interval percentiles; its
+ * rates cover the first to the last received packet, so a sender that
+ * stopped before the analyzer does not dilute them.
+ * take_report() returns an RTCP reception report block of the current
+ * SSRC (RFC 3550 6.4.1 / A.3, loss since the previous call) plus the
+ * queueing delay: lowest transit time since the previous call above the
+ * lowest transit time of the last 10-20 s, i.e. how much the path queue
+ * grew (rtcp_feedback.hpp sends it back to the sender). A stream without
+ * packets for 1 s gets no block, so the sender sees it go stale instead
+ * of loss-free reports.
+ *********************************************************************/
+
+struct RtpHeader
+{
+    bool marker = false;
+    uint8_t payload_type = 0;
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;
+    uint32_t ssrc = 0;
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+};
+
+// Parses the fixed header, CSRCs, header extension and padding; false if not RTP version 2.
+bool parse_rtp_header(const uint8_t *data, size_t size, RtpHeader &header);
+
+struct StreamInterval
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;           // UDP payload bytes
+    uint64_t lost = 0;            // expected - received over the interval (can be 0 after late packets)
+    uint64_t reordered = 0;
+    uint64_t duplicates = 0;
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    uint64_t incomplete_frames = 0;
+    uint64_t frame_bytes = 0;     // H.264 access unit bytes of the completed frames
+    uint64_t max_frame_bytes = 0;
+    double max_frame_interval_ms = 0;
+    double jitter_ms = 0;         // current RFC 3550 estimate
+    uint64_t latency_frames = 0;  // frames with a capture timestamp SEI
+    double latency_sum_ms = 0;
+    double latency_max_ms = 0;
+    double seconds = 0;
+};
+
+struct StreamSummary
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t expected = 0;
+    uint64_t lost = 0;
+    uint64_t reordered = 0;
+    uint64_t duplicates = 0;
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    uint64_t incomplete_frames = 0;
+    uint64_t ssrc_changes = 0;
+    double seconds = 0; // first to last received packet
+    double jitter_ms = 0;
+    double max_jitter_ms = 0;
+    double mean_frame_bytes = 0;
+    uint64_t max_frame_bytes = 0;
+    double frame_interval_p50_ms = 0;
+    double frame_interval_p95_ms = 0;
+    double frame_interval_p99_ms = 0;
+    double frame_interval_max_ms = 0;
+    uint64_t latency_frames = 0;
+    double latency_mean_ms = 0;
+    double latency_p50_ms = 0;
+    double latency_p95_ms = 0;
+    double latency_p99_ms = 0;
+    double latency_max_ms = 0;
+};
+
+struct ReceptionReport
+{
+    bool valid = false;             // false before the first packet and while the stream sends nothing
+    uint32_t ssrc = 0;
+    uint8_t fraction_lost = 0;      // lost / expected since the previous report, 1/256 units
+    int32_t cumulative_lost = 0;
+    uint32_t highest_sequence = 0;  // extended (cycles << 16 | sequence)
+    uint32_t jitter = 0;            // RTP timestamp units
+    uint32_t queue_delay_us = 0;
+};
+
+class RtpStreamAnalyzer
+{
+  public:
+    explicit RtpStreamAnalyzer(int port, uint32_t clock_rate = 90000);
+
+    void on_packet(const uint8_t *data, size_t size, int64_t arrival_us);
+
+    StreamInterval take_interval(int64_t now_us);
+    StreamSummary summary() const;
+    ReceptionReport take_report(int64_t now_us);
+    int port() const { return m_port; }
+    // Device clock - host clock, applied to the capture times of the following frames.
+    // After require_clock_offset() no latency is recorded until the first offset is set.
+    void set_clock_offset(int64_t offset_us)
+    {
+        m_clock_offset_us = offset_us;
+        m_have_clock_offset = true;
+    }
+    void require_clock_offset() { m_have_clock_offset = false; }
+
+  private:
+    struct Frame
+    {
+        bool active = false;
+        uint32_t timestamp = 0;
+        uint64_t bytes = 0;
+        bool keyframe = false;
+        bool complete = true;
+        bool in_fragment = false; // FU-A start seen, end not yet
+        int64_t last_arrival_us = 0;
+        int64_t last_sequence = 0;
+        int64_t capture_us = 0;   // device clock, 0 = no timestamp SEI
+    };
+
+    void reset_sequence(uint16_t sequence);
+    int64_t extend_sequence(uint16_t sequence);
+    bool seen_before(int64_t extended);
+    void update_jitter(uint32_t timestamp, int64_t arrival_us);
+    void add_to_frame(const RtpHeader &header, int64_t extended, int64_t arrival_us);
+    void check_sei(const uint8_t *nal, size_t size);
+    void finish_frame();
+
+    int m_port;
+    uint32_t m_clock_rate;
+
+    bool m_started = false;
+    uint32_t m_ssrc = 0;
+    int64_t m_base_sequence = 0;
+    int64_t m_highest_sequence = 0;
+    std::vector<int64_t> m_recent; // extended sequence numbers by sequence % size, duplicate check
+
+    bool m_have_transit = false;
+    int64_t m_last_transit = 0;
+    uint32_t m_transit_reference = 0; // first transit of the SSRC, the minima below are relative to it
+    int64_t m_report_min_transit;     // since the previous take_report()
+    int64_t m_window_min_transit;     // current 10 s window
+    int64_t m_previous_window_min_transit;
+    int64_t m_window_start_us = 0;
+    double m_jitter = 0;            // RTP timestamp units
+    double m_max_jitter_ms = 0;
+
+    Frame m_frame;
+    int64_t m_last_frame_end_us = 0;
+
+    int64_t m_start_us = 0;
+    int64_t m_last_arrival_us = 0;
+    StreamSummary m_total;
+    uint64_t m_total_frame_bytes = 0;
+    std::vector<float> m_frame_intervals_ms;
+    int64_t m_clock_offset_us = 0;
+    bool m_have_clock_offset = true;
+    std::vector<float> m_latencies_ms;
+
+    StreamInterval m_interval;
+    int64_t m_interval_start_us = 0;
+    int64_t m_interval_expected_base = 0; // highest extended sequence at the interval start
+    uint64_t m_interval_received_base = 0;
+
+    uint64_t m_ssrc_received_base = 0; // m_total.packets when the current SSRC started
+    int64_t m_report_expected_prior = 0;
+    uint64_t m_report_received_prior = 0;
+};
+
+// Value at fraction (0..1) of the sorted values, 0 when empty.
+double percentile(std::vector<float> values, double fraction);
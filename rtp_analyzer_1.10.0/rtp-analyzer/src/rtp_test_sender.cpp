@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "latency.hpp"
+
+/*********************************************************************
+ * rtp_test_sender: synthetic RTP/H.264 sender to try rtp_analyzer over
+ * loopback without a device or GStreamer.
+ *
+ * Per stream it sends one access unit per frame (IDR every --gop frames,
+ * 4x the size of a P-frame) packetized like rtph264pay: single NAL
+ * packets when they fit into --mtu, FU-A fragments otherwise, marker
+ * bit on the last packet of a frame. --loss drops and --reorder swaps
+ * packets at random (percent) so the analyzer numbers can be checked.
+ * --sei stamps every frame like timestampsei: an SEI packet with the
+ * "capture" time now - --latency-ms on a device clock that runs
+ * --clock-offset-ms ahead of CLOCK_REALTIME; --sync-port answers the
+ * analyzer's --sync requests on that clock, so the reported latency
+ * should come out as --latency-ms plus the send time of the frame.
+ *
+ * Usage: rtp_test_sender [--host <addr>] [--port <base>] [--streams <n>]
+ *                        [--bitrate <bps>] [--fps <n>] [--gop <n>] [--mtu <bytes>]
+ *                        [--seconds <n>] [--loss <pct>] [--reorder <pct>]
+ *                        [--sei] [--latency-ms <ms>] [--clock-offset-ms <ms>] [--sync-port <port>]
+ *********************************************************************/
+
+struct SenderOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 5000;
+    int streams = 1;
+    long long bitrate = 8000000;
+    int fps = 30;
+    int gop = 30;
+    size_t mtu = 1400;
+    int seconds = 10;
+    double loss_pct = 0;
+    double reorder_pct = 0;
+    bool sei = false;
+    double latency_ms = 0;
+    double clock_offset_ms = 0;
+    int sync_port = 0;
+};
+
+// Simulated device clock in us
+static int64_t device_us(const SenderOptions &options)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000 + static_cast<int64_t>(options.clock_offset_ms * 1000);
+}
+
+// Sleeps until next, answering clock sync requests meanwhile
+static void wait_until(std::chrono::steady_clock::time_point next, int sync_fd, const SenderOptions &options)
+{
+    if (sync_fd < 0)
+    {
+        std::this_thread::sleep_until(next);
+        return;
+    }
+    for (auto now = std::chrono::steady_clock::now(); now < next; now = std::chrono::steady_clock::now())
+    {
+        struct pollfd pfd = {sync_fd, POLLIN, 0};
+        int timeout_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count());
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+        {
+            continue;
+        }
+        uint8_t request[64];
+        struct sockaddr_in from = {};
+        socklen_t from_len = sizeof(from);
+        ssize_t length = recvfrom(sync_fd, request, sizeof(request), 0, reinterpret_cast<struct sockaddr *>(&from), &from_len);
+        int64_t t2 = device_us(options);
+        if (length <= 0)
+        {
+            continue;
+        }
+        auto reply = build_sync_reply(request, static_cast<size_t>(length), t2, device_us(options));
+        if (!reply.empty())
+        {
+            sendto(sync_fd, reply.data(), reply.size(), 0, reinterpret_cast<struct sockaddr *>(&from), from_len);
+        }
+    }
+}
+
+struct StreamSender
+{
+    struct sockaddr_in addr = {};
+    uint16_t sequence = 0;
+    uint32_t ssrc = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+};
+
+static std::vector<uint8_t> rtp_packet(StreamSender &stream, uint32_t timestamp, bool marker,
+                                       const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> packet(12 + payload.size());
+    packet[0] = 0x80;
+    packet[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | 96);
+    packet[2] = static_cast<uint8_t>(stream.sequence >> 8);
+    packet[3] = static_cast<uint8_t>(stream.sequence);
+    for (int i = 0; i < 4; i++)
+    {
+        packet[4 + i] = static_cast<uint8_t>(timestamp >> (24 - 8 * i));
+        packet[8 + i] = static_cast<uint8_t>(stream.ssrc >> (24 - 8 * i));
+    }
+    std::copy(payload.begin(), payload.end(), packet.begin() + 12);
+    stream.sequence++;
+    return packet;
+}
+
+// RTP packets of one access unit (one slice NAL of nal_size bytes, header included)
+static std::vector<std::vector<uint8_t>> packetize(StreamSender &stream, const SenderOptions &options,
+                                                   uint32_t timestamp, size_t nal_size, bool keyframe)
+{
+    std::vector<std::vector<uint8_t>> packets;
+    uint8_t nal_header = keyframe ? 0x65 : 0x41;
+    size_t max_payload = options.mtu - 12;
+    if (nal_size <= max_payload)
+    {
+        std::vector<uint8_t> payload(nal_size, 0xa5);
+        payload[0] = nal_header;
+        packets.push_back(rtp_packet(stream, timestamp, true, payload));
+        return packets;
+    }
+
+    size_t remaining = nal_size - 1;
+    bool first = true;
+    while (remaining > 0)
+    {
+        size_t chunk = std::min(remaining, max_payload - 2);
+        remaining -= chunk;
+        std::vector<uint8_t> payload(chunk + 2, 0xa5);
+        payload[0] = static_cast<uint8_t>((nal_header & 0xe0) | 28);
+        payload[1] = static_cast<uint8_t>((first ? 0x80 : 0) | (remaining == 0 ? 0x40 : 0) | (nal_header & 0x1f));
+        packets.push_back(rtp_packet(stream, timestamp, remaining == 0, payload));
+        first = false;
+    }
+    return packets;
+}
+
+int main(int argc, char *argv[])
+{
+    SenderOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc)
+        {
+            options.host = argv[++i];
+        }
+        else if (arg == "--port" && i + 1 < argc)
+        {
+            options.port = std::stoi(argv[++i]);
+        }
+        else if (arg == "--streams" && i + 1 < argc)
+        {
+            options.streams = std::stoi(argv[++i]);
+        }
+        else if (arg == "--bitrate" && i + 1 < argc)
+        {
+            options.bitrate = std::stoll(argv[++i]);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            options.fps = std::stoi(argv[++i]);
+        }
+        else if (arg == "--gop" && i + 1 < argc)
+        {
+            options.gop = std::stoi(argv[++i]);
+        }
+        else if (arg == "--mtu" && i + 1 < argc)
+        {
+            options.mtu = std::stoul(argv[++i]);
+        }
+        else if (arg == "--seconds" && i + 1 < argc)
+        {
+            options.seconds = std::stoi(argv[++i]);
+        }
+        else if (arg == "--loss" && i + 1 < argc)
+        {
+            options.loss_pct = std::stod(argv[++i]);
+        }
+        else if (arg == "--reorder" && i + 1 < argc)
+        {
+            options.reorder_pct = std::stod(argv[++i]);
+        }
+        else if (arg == "--sei")
+        {
+            options.sei = true;
+        }
+        else if (arg == "--latency-ms" && i + 1 < argc)
+        {
+            options.latency_ms = std::stod(argv[++i]);
+        }
+        else if (arg == "--clock-offset-ms" && i + 1 < argc)
+        {
+            options.clock_offset_ms = std::stod(argv[++i]);
+        }
+        else if (arg == "--sync-port" && i + 1 < argc)
+        {
+            options.sync_port = std::stoi(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host <addr>] [--port <base>] [--streams <n>] [--bitrate <bps>] [--fps <n>] [--gop <n>]"
+                         " [--mtu <bytes>] [--seconds <n>] [--loss <pct>] [--reorder <pct>]"
+                         " [--sei] [--latency-ms <ms>] [--clock-offset-ms <ms>] [--sync-port <port>]"
+                      << std::endl;
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sync_fd = -1;
+    if (options.sync_port > 0)
+    {
+        sync_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(options.sync_port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(sync_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            std::cerr << "[SENDER] Cannot bind sync port " << options.sync_port << std::endl;
+            return 1;
+        }
+    }
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<double> percent(0.0, 100.0);
+    std::vector<StreamSender> streams(options.streams);
+    for (int i = 0; i < options.streams; i++)
+    {
+        streams[i].addr.sin_family = AF_INET;
+        streams[i].addr.sin_port = htons(options.port + i);
+        inet_pton(AF_INET, options.host.c_str(), &streams[i].addr.sin_addr);
+        streams[i].ssrc = static_cast<uint32_t>(random());
+        streams[i].sequence = static_cast<uint16_t>(random());
+    }
+
+    // P-frame size such that the average over a gop matches the bitrate with 4x I-frames
+    size_t frame_bytes = static_cast<size_t>(options.bitrate / 8 / options.fps);
+    size_t p_bytes = frame_bytes * options.gop / (options.gop + 3);
+    size_t i_bytes = p_bytes * 4;
+
+    auto start = std::chrono::steady_clock::now();
+    auto frame_interval = std::chrono::nanoseconds(1000000000LL / options.fps);
+    uint64_t frames = 0;
+    for (auto next = start; std::chrono::steady_clock::now() - start < std::chrono::seconds(options.seconds);
+         next += frame_interval)
+    {
+        wait_until(next, sync_fd, options);
+        bool keyframe = frames % options.gop == 0;
+        uint32_t timestamp = static_cast<uint32_t>(frames * 90000 / options.fps);
+        for (auto &stream : streams)
+        {
+            std::vector<std::vector<uint8_t>> packets;
+            if (options.sei)
+            {
+                // Own single NAL packet in front of the slice, as rtph264pay sends it
+                int64_t capture_us = device_us(options) - static_cast<int64_t>(options.latency_ms * 1000);
+                packets.push_back(
+                    rtp_packet(stream, timestamp, false, build_timestamp_sei(capture_us, static_cast<uint32_t>(frames))));
+            }
+            auto slice = packetize(stream, options, timestamp, keyframe ? i_bytes : p_bytes, keyframe);
+            packets.insert(packets.end(), slice.begin(), slice.end());
+            for (size_t p = 0; p + 1 < packets.size(); p++)
+            {
+                if (percent(random) < options.reorder_pct)
+                {
+                    std::swap(packets[p], packets[p + 1]);
+                    p++;
+                }
+            }
+            for (const auto &packet : packets)
+            {
+                if (percent(random) < options.loss_pct)
+                {
+                    stream.dropped++;
+                    continue;
+                }
+                sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<const struct sockaddr *>(&stream.addr),
+                       sizeof(stream.addr));
+                stream.sent++;
+            }
+        }
+        frames++;
+    }
+
+    for (int i = 0; i < options.streams; i++)
+    {
+        std::cout << "[SENDER] port=" << options.port + i << " frames=" << frames << " sent=" << streams[i].sent
+                  << " dropped=" << streams[i].dropped << std::endl;
+    }
+    close(fd);
+    if (sync_fd >= 0)
+    {
+        close(sync_fd);
+    }
+    return 0;
+}